@@ -0,0 +1,1334 @@
+// Created by Glif.
+// Host simulation of the 88W8801 driver, see README in this directory.
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "88w8801/wrapper/88w8801_wrapper.h"
+#include "88w8801/sdio/88w8801_sdio_sim.h"
+#include "88w8801/flash/88w8801_slot.h"
+#include "88w8801/flash/88w8801_kv.h"
+#include "lwip/dhcpd.h"
+#include "lwip/inet_chksum.h"
+#include "lwip/prot/dhcp.h"
+#include "lwip/prot/etharp.h"
+#include "lwip/prot/ethernet.h"
+#include "lwip/prot/iana.h"
+#include "lwip/prot/ip4.h"
+#include "lwip/prot/udp.h"
+
+#ifndef WLAN_SIMULATION
+#error "WLAN_SIMULATION must be defined"
+#endif
+
+#define MSG_ERROR_FORMAT "%s %d: Failed to %s\n"
+
+#define WLAN_AP_SSID "SIM"
+// Channel of the AP, 40 MHz is asked for but the virtual card reports a 20 MHz only 802.11n capability like the 88W8801.
+#define SIM_AP_CHANNEL 6
+
+#define SIM_PEER_MAC  {0x02, 0x00, 0x00, 0x00, 0x00, 0x02}
+#define SIM_PEER_IP   "192.168.10.2"
+#define SIM_LOCAL_IP  "192.168.10.1"
+#define SIM_UDP_PORT  5001
+#define SIM_UDP_SIZE  1472
+#define SIM_RX_FRAMES 20000
+#define SIM_TX_FRAMES 20000
+// Datagrams in single pbufs, sent one at a time while the bus is idle (in place) and then in a burst (copied and aggregated).
+#define SIM_TX_REF_FRAMES 20000
+// Bus clock after sdio_init(), see SDIO_TRANSFER_CLK_DIV.
+#define SIM_BUS_CLOCK 24000000.0
+// SPI1 clock of the flash (APB2 84MHz / 2).
+#define SIM_SPI_CLOCK 42000000.0
+// Programmed bytes into the image sector after the first half until the power is cut while loading the firmware.
+#define SIM_SLOT_CUT_STEPS (FLASH_PAGE_SIZE * 3 / 2)
+// Updates written to the KV store before the restart check.
+#define SIM_KV_UPDATES 2000
+// Power cuts during further updates, each at a pseudo-random programmed byte or erase within the next SIM_KV_CUT_RANGE.
+// Every other cut lands on one of the next SIM_KV_ERASE_RANGE erases instead, those are too rare to be hit otherwise.
+#define SIM_KV_POWER_CUTS  2000
+#define SIM_KV_CUT_RANGE   256
+#define SIM_KV_ERASE_RANGE 4
+// Every SIM_KV_DELETE_EVERY-th PMK update deletes the key.
+#define SIM_KV_DELETE_EVERY 5
+// PMKs derived for the timing, each is PBKDF2 with 4096 iterations.
+#define SIM_PMK_ROUNDS 20
+// Time to wait for the init callback after the warm restart (s).
+#define SIM_WARM_TIMEOUT 1.0
+// Network the STA connects to after the UDP runs, served by the APs in g_psaAPs.
+#define SIM_STA_SSID       "SIM-STA"
+#define SIM_STA_PWD        "simulation"
+#define SIM_STA_RECONNECTS 10
+#define SIM_STA_CANDIDATES 4
+// Block ack session of the peer after the UDP runs, it asks for a larger window than the driver keeps and starts
+// right before the 12-bit sequence number wraps. Three sessions are requested, one more than WLAN_RX_REORDER_NUM.
+#define SIM_BA_TID      0
+#define SIM_BA_SESSIONS 3
+#define SIM_BA_WINDOW   32
+#define SIM_BA_SSN      4090
+#define SIM_BA_PAYLOAD  64
+#define SIM_BA_FRAMES   12
+// The peer accepts TX block ack sessions on SIM_TX_BA_TID only, datagrams with IP precedence SIM_TX_BA_REFUSED_TID are refused.
+#define SIM_TX_BA_TID         0
+#define SIM_TX_BA_REFUSED_TID 5
+#define SIM_TX_BA_FRAMES      64
+// A station that associates without HT capabilities and one that never associates, neither gets a TX block ack session.
+#define SIM_LEGACY_MAC  {0x02, 0x00, 0x00, 0x00, 0x00, 0x06}
+#define SIM_UNKNOWN_MAC {0x02, 0x00, 0x00, 0x00, 0x00, 0x07}
+// A-MSDUs of small datagrams go through the TID 1 block ack session, full-size datagrams are sent without a session on SIM_AMSDU_TID.
+#define SIM_AMSDU_SUBFRAMES 8
+#define SIM_AMSDU_TID       3
+#define SIM_AMSDU_FRAMES    (2 * SIM_AMSDU_SUBFRAMES + 3)
+
+typedef enum {
+    SIM_STATE_INIT,
+    SIM_STATE_DHCP,
+    SIM_STATE_RX,
+    SIM_STATE_TX,
+    SIM_STATE_TX_BA,
+    SIM_STATE_REORDER,
+    SIM_STATE_AMSDU,
+    SIM_STATE_TX_REF,
+    SIM_STATE_STA,
+    SIM_STATE_WARM,
+    SIM_STATE_DONE
+} simState;
+
+typedef struct {
+    uint8_t pu8BSSID[ETH_HWADDR_LEN];
+    // 0 when the AP is down.
+    uint8_t u8Channel;
+    uint8_t u8RSSI;
+    // Advertises HT capabilities and answers HT association requests with them.
+    bool bHT;
+} simAP;
+
+static void wlanInitCallback(core_err_e ceStatus);
+static void wlanAPStartCallback(void);
+static void wlanStaConnectCallback(core_err_e ceStatus);
+static void wlanStaDisconnectCallback(void);
+static void rxStart(void);
+#ifdef WLAN_KV_STORE
+static void dhcpStep(void);
+static void peerUploadDHCP(uint8_t u8Type);
+#endif
+static void udpRecvCallback(void *pvArg, struct udp_pcb *pupSession, struct pbuf *pbBuffer, const ip_addr_t *piaAddress, u16_t u16Port);
+static void peerDataHandler(uint8_t *pu8Data, uint16_t u16Len, uint8_t u8BSSType);
+static bool peerCmdHandler(uint8_t *pu8Cmd, uint16_t u16Len);
+static bool peerScan(uint8_t *pu8Cmd, uint16_t u16Len);
+static bool peerCheckAPConfig(uint8_t *pu8Cmd, uint16_t u16Len);
+static void peerAssociate(uint8_t *pu8Cmd, uint16_t u16Len, simAP *psaAP);
+static MrvlIEtypesHeader_t *peerFindTLV(uint8_t *pu8TLV, uint8_t *pu8End, uint16_t u16Type);
+static void txRefStart(void);
+static void txRefStep(void);
+static err_t txRefSend(void);
+static void staStart(void);
+static void staReport(const char *pcName);
+#ifdef WLAN_WARM_BOOT
+static void warmStep(void);
+#endif
+#ifdef WLAN_11N
+static void txBAStep(void);
+static bool txBAFind(uint8_t u8TID, wlan_tx_ba_t *pwtbSession);
+static uint8_t txBANonHT(void);
+#endif
+static void reorderStart(void);
+static void reorderStep(void);
+static void peerAddBA(uint8_t u8TID);
+static void peerUploadBA(uint16_t u16Offset, uint16_t u16PktType);
+#ifdef WLAN_RX_AMSDU
+static void amsduStart(void);
+static void amsduStep(void);
+static uint16_t peerBuildSubframe(uint8_t *pu8Subframe, int32_t i32Index, uint16_t u16PayloadLen);
+static void peerUploadAMSDU(uint8_t u8Priority, uint16_t u16SeqNum, int32_t i32First, uint8_t u8Subframes, uint16_t u16PayloadLen);
+#endif
+static uint16_t peerBuildUDP(uint8_t *pu8Frame, uint16_t u16PayloadLen);
+static void peerStaAssoc(const uint8_t *pu8MAC, bool bReassoc, bool bHT);
+static void timeAdvance(void);
+static double timeNow(void);
+static void simReport(const char *pcName, uint32_t u32Frames, double dSeconds);
+static void simFail(void);
+#ifdef USE_FLASH_FIRMWARE
+static bool flashLoadImage(const char *pcPath);
+#endif
+#ifdef WLAN_KV_STORE
+static bool kvExercise(void);
+static bool kvPowerCuts(void);
+static bool kvHolds(uint8_t u8Key, const uint8_t *pu8Value, uint16_t u16Length);
+#endif
+#ifdef WLAN_HOST_PMK
+static bool pmkBenchmark(void);
+#endif
+
+static core_err_e g_ceStatus = CORE_ERR_UNHANDLED_STATUS;
+static wlan_cb_t g_wlanCallback = {wlanInitCallback, NULL, wlanStaConnectCallback, wlanStaDisconnectCallback, wlanAPStartCallback, NULL, NULL, NULL};
+static struct udp_pcb *g_pupSession = NULL;
+static simState g_ssState = SIM_STATE_INIT;
+// Set by any failed check, main() then returns 1.
+static bool g_bFailed = false;
+static uint8_t g_pu8PeerMAC[ETH_HWADDR_LEN] = SIM_PEER_MAC;
+static uint8_t g_pu8LocalMAC[ETH_HWADDR_LEN];
+static uint32_t g_u32RxFrames = 0, g_u32TxFrames = 0;
+static uint8_t g_pu8Payload[SIM_UDP_SIZE];
+static double g_dStart = 0;
+// The weakest AP answers scans first and is 11g only, the strongest goes down before the last reconnect.
+static simAP g_psaAPs[] = {
+    {{0x02, 0x00, 0x00, 0x00, 0x00, 0x03}, 1, 70, false},
+    {{0x02, 0x00, 0x00, 0x00, 0x00, 0x04}, 6, 40, true},
+    {{0x02, 0x00, 0x00, 0x00, 0x00, 0x05}, 11, 55, true},
+};
+static uint32_t g_u32StaConnects = 0, g_u32ScanChannels = 0, g_u32ScanTime = 0, g_u32HTAssocs = 0;
+// WMM parameter element of the HT APs (best effort, background, video, voice), associations that carried it back (not as advertised).
+static const uint8_t g_pu8WMMParam[] = {0x00, 0x50, 0xF2, 0x02, 0x01, 0x01, 0x00, 0x00, 0x03, 0xA4, 0x00, 0x00, 0x27, 0xA4, 0x00, 0x00, 0x42, 0x43, 0x5E, 0x00, 0x62, 0x32, 0x2F, 0x00};
+static uint32_t g_u32WMMAssocs = 0, g_u32WMMErrors = 0;
+#ifdef WLAN_HOST_PMK
+// PMK of the STA network and SUPPLICANT_PMK commands without it.
+static uint8_t g_pu8StaPMK[PMK_LENGTH];
+static uint32_t g_u32PMKErrors = 0;
+#endif
+// AP start commands seen in order (SYS_CONFIGURE, 11N_CFG, BSS_START), cleared by any unexpected one.
+static uint8_t g_u8APCmds = 0;
+static uint16_t g_u16HTTxCap = 0;
+// Reorder run: step, ADDBA responses (declined, not as expected), datagrams received and out of order.
+static uint8_t g_u8ReorderStep = 0, g_u8ADDBARsps = 0, g_u8ADDBADeclined = 0, g_u8ADDBAErrors = 0;
+static uint32_t g_u32ReorderRx = 0, g_u32ReorderErrors = 0;
+static int32_t g_i32ReorderLast = -1;
+static double g_dHoleTime = 0;
+// In-place TX run: step, datagrams sent, bus-limited goodput of the paced run.
+#ifdef WLAN_WARM_BOOT
+// Start of the warm restart, 0 before wrapper_init is called again.
+static double g_dWarmStart = 0;
+#endif
+static uint8_t g_u8TxRefStep = 0;
+static uint32_t g_u32TxRefSent = 0;
+static double g_dTxRefPaced = 0;
+#ifdef WLAN_KV_STORE
+// DHCP lease run: step, message type of the last reply from the server (0 before it arrives), offered address.
+static uint8_t g_u8DHCPStep = 0, g_u8DHCPReply = 0;
+static ip4_addr_t g_iaDHCPOffer;
+#endif
+#ifdef WLAN_11N
+// TX block ack run: step, ADDBA requests (not as expected).
+static uint8_t g_u8TxBAStep = 0, g_u8TxBAReqs = 0, g_u8TxBAErrors = 0;
+#endif
+
+int main(int argc, char **argv) {
+    setvbuf(stdout, NULL, _IONBF, 0);
+#if defined(USE_FLASH_FIRMWARE) || defined(WLAN_KV_STORE)
+    flashSettings flashsInit = {NULL, NULL, 0};
+    flashInit(&flashsInit);
+#endif
+#ifdef WLAN_KV_STORE
+    if (!kvExercise()) {
+        printf(MSG_ERROR_FORMAT, "FLASH", 0, "check KV store");
+        return 1;
+    }
+#endif
+#ifdef WLAN_HOST_PMK
+    if (!pmkBenchmark()) {
+        printf(MSG_ERROR_FORMAT, "CORE", 0, "derive PMK");
+        return 1;
+    }
+#endif
+#ifdef USE_FLASH_FIRMWARE
+    // The firmware is read from the flash model, the image given on the command line is written to a slot first.
+    if (argc < 2 || !flashLoadImage(argv[1])) {
+        printf(MSG_ERROR_FORMAT, "FLASH", 0, "load firmware image");
+        return 1;
+    }
+    flashSimResetStats();
+#else
+    UNUSED(argc);
+    UNUSED(argv);
+#endif
+    sdio_sim_set_handler(peerCmdHandler, peerDataHandler);
+    uint16_t u16Err = wrapper_init(&g_ceStatus, &g_wlanCallback, NULL, 0);
+    if (u16Err) {
+        printf(MSG_ERROR_FORMAT, (uint8_t)u16Err ? "CORE" : "SDIO", (uint8_t)u16Err | u16Err >> 8, "init WLAN");
+        return 1;
+    }
+    uint8_t pu8Frame[RX_BUF_SIZE], u8Err;
+    uint32_t u32Injected = 0;
+    while (g_ssState != SIM_STATE_DONE) {
+        timeAdvance();
+        if ((u8Err = wrapper_proc())) printf(MSG_ERROR_FORMAT, "CORE", u8Err, "process packet");
+        switch (g_ssState) {
+#ifdef WLAN_KV_STORE
+        case SIM_STATE_DHCP: dhcpStep(); break;
+#endif
+        case SIM_STATE_RX:
+            // Inject frames as long as the virtual card has room for them.
+            while (u32Injected < SIM_RX_FRAMES && sdio_sim_upload_data(pu8Frame, peerBuildUDP(pu8Frame, SIM_UDP_SIZE), BSS_TYPE_UAP)) ++u32Injected;
+            if (g_u32RxFrames < SIM_RX_FRAMES) break;
+            simReport("RX", g_u32RxFrames, timeNow() - g_dStart);
+            g_ssState = SIM_STATE_TX;
+            sdio_sim_reset_stats();
+            sdio_reset_stats();
+            wlan_reset_stats();
+            g_dStart = timeNow();
+            for (uint32_t u32Index = 0; u32Index < SIM_TX_FRAMES; ++u32Index) {
+                err_t errSession = wrapper_udp_send(&g_pupSession, g_pu8Payload, SIM_UDP_SIZE);
+                if (errSession) printf(MSG_ERROR_FORMAT, "LWIP", errSession, "send data");
+            }
+            break;
+        case SIM_STATE_TX:
+            if (g_u32TxFrames < SIM_TX_FRAMES) break;
+            simReport("TX", g_u32TxFrames, timeNow() - g_dStart);
+#ifdef WLAN_11N
+            g_ssState = SIM_STATE_TX_BA;
+#else
+            reorderStart();
+#endif
+            break;
+#ifdef WLAN_11N
+        case SIM_STATE_TX_BA: txBAStep(); break;
+#endif
+        case SIM_STATE_REORDER: reorderStep(); break;
+#ifdef WLAN_RX_AMSDU
+        case SIM_STATE_AMSDU: amsduStep(); break;
+#endif
+        case SIM_STATE_TX_REF: txRefStep(); break;
+#ifdef WLAN_WARM_BOOT
+        case SIM_STATE_WARM: warmStep(); break;
+#endif
+        default: break;
+        }
+    }
+    return g_bFailed ? 1 : 0;
+}
+
+static void wlanInitCallback(core_err_e ceStatus) {
+    if ((g_ceStatus = ceStatus)) {
+        printf(MSG_ERROR_FORMAT, "CORE", ceStatus, "init WLAN");
+        simFail();
+        return;
+    }
+    sdio_sim_stats_t sssStats;
+    sdio_sim_get_stats(&sssStats);
+    printf("Init: %u CMD52, %u CMD53, %llu bytes, %.3f ms bus time\n", sssStats.cmd52_count, sssStats.cmd53_count, (unsigned long long)sssStats.byte_count, sssStats.bus_clocks / SIM_BUS_CLOCK * 1000);
+    wlan_stats_t wsStats;
+    wlan_get_stats(&wsStats);
+#ifdef USE_FLASH_FIRMWARE
+    flashSimStats fssStats;
+    flashSimGetStats(&fssStats);
+    printf("Init: %u flash reads (%u by DMA), %llu bytes clocked, %.3f ms at %.0f MHz SPI\n", fssStats.u32Reads, fssStats.u32DmaReads, (unsigned long long)fssStats.u64Bytes, fssStats.u64Bytes * 8 / SIM_SPI_CLOCK * 1000, SIM_SPI_CLOCK / 1000000);
+#endif
+    printf("Init: firmware ready in %.3f ms host time, %.3f ms loading (%.3f ms not overlapped), %.3f ms waiting for card\n", wsStats.fw_total_time / 1000.0, wsStats.fw_load_time / 1000.0, wsStats.fw_stall_time / 1000.0, wsStats.fw_wait_time / 1000.0);
+#ifdef WLAN_WARM_BOOT
+    if (g_ssState == SIM_STATE_WARM) {
+        printf("Warm boot: init callback in %.3f ms host time, %llu firmware bytes downloaded\n", (timeNow() - g_dWarmStart) * 1000, (unsigned long long)sssStats.fw_byte_count);
+        if (sssStats.fw_byte_count) {
+            printf(MSG_ERROR_FORMAT, "CORE", 0, "skip firmware download");
+            simFail();
+            return;
+        }
+        g_ssState = SIM_STATE_DONE;
+        return;
+    }
+#endif
+    wlan_ap_config_t wacConfig = {(uint8_t *)WLAN_AP_SSID, sizeof(WLAN_AP_SSID) - 1, NULL, 0, SECURITY_TYPE_NONE, true, SIM_AP_CHANNEL, true, true};
+    if (!(ceStatus = wlan_ap_start_ex(&wacConfig))) return;
+    printf(MSG_ERROR_FORMAT, "CORE", ceStatus, "start AP");
+    simFail();
+}
+
+static void wlanAPStartCallback(void) {
+#ifdef WLAN_11N
+    if (g_u8APCmds != 3 || g_u16HTTxCap != HT_CAP_SGI_20) {
+#else
+    if (g_u8APCmds != 2) {
+#endif
+        printf(MSG_ERROR_FORMAT, "CORE", g_u8APCmds, "check AP configuration");
+        simFail();
+        return;
+    }
+    printf("AP: configuration checked, channel %d, 20 MHz, HT TX capability 0x%04X\n", SIM_AP_CHANNEL, g_u16HTTxCap);
+    memcpy(g_pu8LocalMAC, netif_get_by_index(BSS_TYPE_UAP + 1)->hwaddr, ETH_HWADDR_LEN);
+    // The peer reassociates as an 11n station, the legacy station associates without HT capabilities.
+    static const uint8_t pu8Legacy[ETH_HWADDR_LEN] = SIM_LEGACY_MAC;
+    peerStaAssoc(g_pu8PeerMAC, true, true);
+    peerStaAssoc(pu8Legacy, false, false);
+    err_t errSession = wrapper_udp_new(&g_pupSession, BSS_TYPE_UAP);
+    if (!errSession) errSession = wrapper_udp_bind(&g_pupSession, SIM_UDP_PORT, udpRecvCallback);
+    ip_addr_t iaAddress;
+    ipaddr_aton(SIM_PEER_IP, &iaAddress);
+    if (!errSession) errSession = wrapper_udp_connect(&g_pupSession, &iaAddress, SIM_UDP_PORT);
+    if (errSession) {
+        printf(MSG_ERROR_FORMAT, "LWIP", errSession, "create udp_pcb");
+        simFail();
+        return;
+    }
+    // Let lwIP learn the peer from an ARP request before any UDP traffic.
+    uint8_t pu8Frame[SIZEOF_ETH_HDR + SIZEOF_ETHARP_HDR] = {0};
+    struct eth_hdr *pehHeader = (struct eth_hdr *)pu8Frame;
+    struct etharp_hdr *pahHeader = (struct etharp_hdr *)(pu8Frame + SIZEOF_ETH_HDR);
+    memset(pehHeader->dest.addr, 0xFF, ETH_HWADDR_LEN);
+    memcpy(pehHeader->src.addr, g_pu8PeerMAC, ETH_HWADDR_LEN);
+    pehHeader->type = PP_HTONS(ETHTYPE_ARP);
+    pahHeader->hwtype = PP_HTONS(LWIP_IANA_HWTYPE_ETHERNET);
+    pahHeader->proto = PP_HTONS(ETHTYPE_IP);
+    pahHeader->hwlen = ETH_HWADDR_LEN;
+    pahHeader->protolen = sizeof(ip4_addr_t);
+    pahHeader->opcode = PP_HTONS(ARP_REQUEST);
+    memcpy(pahHeader->shwaddr.addr, g_pu8PeerMAC, ETH_HWADDR_LEN);
+    ip4_addr_t iaPeer, iaLocal;
+    ip4addr_aton(SIM_PEER_IP, &iaPeer);
+    ip4addr_aton(SIM_LOCAL_IP, &iaLocal);
+    memcpy(&pahHeader->sipaddr, &iaPeer, sizeof(ip4_addr_t));
+    memcpy(&pahHeader->dipaddr, &iaLocal, sizeof(ip4_addr_t));
+    sdio_sim_upload_data(pu8Frame, sizeof(pu8Frame), BSS_TYPE_UAP);
+#ifdef WLAN_KV_STORE
+    g_ssState = SIM_STATE_DHCP;
+#else
+    rxStart();
+#endif
+}
+
+static void rxStart(void) {
+    printf("AP started, running %d RX and %d TX datagrams of %d bytes\n", SIM_RX_FRAMES, SIM_TX_FRAMES, SIM_UDP_SIZE);
+    sdio_sim_reset_stats();
+    sdio_reset_stats();
+    wlan_reset_stats();
+    g_dStart = timeNow();
+    g_ssState = SIM_STATE_RX;
+}
+
+#ifdef WLAN_KV_STORE
+// The peer leases an address and releases it, a request that follows is refused. The DHCP server is then restarted
+// as after a reboot and must not restore the released lease from the KV store.
+static void dhcpStep(void) {
+    if (g_u8DHCPStep) {
+        if (!g_u8DHCPReply) return;
+        static const uint8_t pu8Expected[] = {DHCP_OFFER, DHCP_ACK, DHCP_NAK, DHCP_NAK};
+        if (g_u8DHCPReply != pu8Expected[g_u8DHCPStep - 1]) {
+            printf(MSG_ERROR_FORMAT, "LWIP", g_u8DHCPReply, "check DHCP reply");
+            simFail();
+            return;
+        }
+        g_u8DHCPReply = 0;
+    }
+    switch (g_u8DHCPStep++) {
+    case 0: peerUploadDHCP(DHCP_DISCOVER); break;
+    case 1: peerUploadDHCP(DHCP_REQUEST); break;
+    case 2:
+        if (kvGet(KV_KEY_DHCPD_LEASES, NULL, 0) == KV_NOT_FOUND) {
+            printf(MSG_ERROR_FORMAT, "LWIP", 0, "save DHCP lease");
+            simFail();
+            return;
+        }
+        peerUploadDHCP(DHCP_RELEASE);
+        peerUploadDHCP(DHCP_REQUEST);
+        break;
+    case 3:
+        if (kvGet(KV_KEY_DHCPD_LEASES, NULL, 0) != KV_NOT_FOUND) {
+            printf(MSG_ERROR_FORMAT, "LWIP", 0, "delete released DHCP lease");
+            simFail();
+            return;
+        }
+        dhcpd_stop();
+        kvInit();
+        dhcpd_start(netif_get_by_index(BSS_TYPE_UAP + 1), NULL);
+        // A restored lease would be acknowledged without a DHCP_DISCOVER.
+        peerUploadDHCP(DHCP_REQUEST);
+        break;
+    default:
+        printf("DHCP: %s leased and released, not restored after restart\n", ip4addr_ntoa(&g_iaDHCPOffer));
+        rxStart();
+        break;
+    }
+}
+
+// Broadcasts a DHCP message from the peer, with the message type as only option.
+static void peerUploadDHCP(uint8_t u8Type) {
+    uint8_t pu8Frame[SIZEOF_ETH_HDR + IP_HLEN + UDP_HLEN + sizeof(struct dhcp_msg)];
+    peerBuildUDP(pu8Frame, sizeof(struct dhcp_msg));
+    struct eth_hdr *pehHeader = (struct eth_hdr *)pu8Frame;
+    struct ip_hdr *pihHeader = (struct ip_hdr *)(pu8Frame + SIZEOF_ETH_HDR);
+    struct udp_hdr *puhHeader = (struct udp_hdr *)(pu8Frame + SIZEOF_ETH_HDR + IP_HLEN);
+    struct dhcp_msg *pdmMsg = (struct dhcp_msg *)(pu8Frame + SIZEOF_ETH_HDR + IP_HLEN + UDP_HLEN);
+    memset(pehHeader->dest.addr, 0xFF, ETH_HWADDR_LEN);
+    ip4_addr_set_any(&pihHeader->src);
+    ip4_addr_set_u32(&pihHeader->dest, IPADDR_BROADCAST);
+    IPH_CHKSUM_SET(pihHeader, 0);
+    IPH_CHKSUM_SET(pihHeader, inet_chksum(pihHeader, IP_HLEN));
+    puhHeader->src = PP_HTONS(LWIP_IANA_PORT_DHCP_CLIENT);
+    puhHeader->dest = PP_HTONS(LWIP_IANA_PORT_DHCP_SERVER);
+    memset(pdmMsg, 0, sizeof(struct dhcp_msg));
+    pdmMsg->op = DHCP_BOOTREQUEST;
+    pdmMsg->htype = LWIP_IANA_HWTYPE_ETHERNET;
+    pdmMsg->hlen = ETH_HWADDR_LEN;
+    pdmMsg->xid = PP_HTONL(0x12345678);
+    memcpy(pdmMsg->chaddr, g_pu8PeerMAC, ETH_HWADDR_LEN);
+    pdmMsg->cookie = PP_HTONL(DHCP_MAGIC_COOKIE);
+    pdmMsg->options[0] = DHCP_OPTION_MESSAGE_TYPE;
+    pdmMsg->options[1] = 1;
+    pdmMsg->options[2] = u8Type;
+    pdmMsg->options[3] = DHCP_OPTION_END;
+    sdio_sim_upload_data(pu8Frame, sizeof(pu8Frame), BSS_TYPE_UAP);
+}
+#endif
+
+#ifdef WLAN_11N
+// The TX run opens a session on SIM_TX_BA_TID, the peer refuses another TID and then tears the session down.
+static void txBAStep(void) {
+    wlan_tx_ba_t wtbSession, wtbRefused;
+    switch (g_u8TxBAStep) {
+    case 0:
+        if (!txBAFind(SIM_TX_BA_TID, &wtbSession) || wtbSession.state != TX_BA_STATE_ACTIVE) return;
+        for (uint32_t u32Index = 0; u32Index < 2 * SIM_TX_BA_FRAMES; ++u32Index) {
+            g_pupSession->tos = u32Index < SIM_TX_BA_FRAMES ? SIM_TX_BA_TID << 5 : SIM_TX_BA_REFUSED_TID << 5;
+            err_t errSession = wrapper_udp_send(&g_pupSession, g_pu8Payload, SIM_UDP_SIZE);
+            if (errSession) printf(MSG_ERROR_FORMAT, "LWIP", errSession, "send data");
+        }
+        g_pupSession->tos = 0;
+        break;
+    case 1: {
+        if (g_u32TxFrames < SIM_TX_FRAMES + 2 * SIM_TX_BA_FRAMES || !txBAFind(SIM_TX_BA_REFUSED_TID, &wtbRefused) || wtbRefused.state != TX_BA_STATE_REFUSED) return;
+        // DELBA from the peer as recipient.
+        HOST_DS_11N_DELBA hdbDelBA = {0};
+        memcpy(hdbDelBA.peer_mac_addr, g_pu8PeerMAC, ETH_HWADDR_LEN);
+        hdbDelBA.del_ba_param_set = SIM_TX_BA_TID << DELBA_TID_POS;
+        sdio_sim_upload_event(EVENT_DELBA, BSS_TYPE_UAP, (uint8_t *)&hdbDelBA, sizeof(hdbDelBA));
+        break;
+    }
+    default:
+        if (!txBAFind(SIM_TX_BA_TID, &wtbSession) || wtbSession.state != TX_BA_STATE_IDLE) return;
+        txBAFind(SIM_TX_BA_REFUSED_TID, &wtbRefused);
+        uint8_t u8NonHT = txBANonHT();
+        printf("TX BA: %u ADDBA requests (%u not as expected), TID %u set up %u and torn down %u times, %u datagrams (%u bytes) in the session, TID %u refused %u times, %u sessions to non-HT stations\n", g_u8TxBAReqs, g_u8TxBAErrors, SIM_TX_BA_TID, wtbSession.setup_count, wtbSession.teardown_count, wtbSession.tx_pkts, wtbSession.tx_bytes, SIM_TX_BA_REFUSED_TID, wtbRefused.refuse_count, u8NonHT);
+        if (g_u8TxBAErrors || u8NonHT || wtbSession.tx_pkts != SIM_TX_BA_FRAMES) {
+            printf(MSG_ERROR_FORMAT, "CORE", g_u8TxBAErrors, "check TX block ack sessions");
+            simFail();
+            return;
+        }
+        reorderStart();
+        return;
+    }
+    ++g_u8TxBAStep;
+}
+
+static bool txBAFind(uint8_t u8TID, wlan_tx_ba_t *pwtbSession) {
+    wlan_tx_ba_t pwtbSessions[WLAN_TX_BA_NUM];
+    uint8_t u8Num = wlan_get_tx_ba(pwtbSessions, WLAN_TX_BA_NUM);
+    for (uint8_t u8Index = 0; u8Index < u8Num; ++u8Index) {
+        if (pwtbSessions[u8Index].tid != u8TID || memcmp(pwtbSessions[u8Index].ra, g_pu8PeerMAC, ETH_HWADDR_LEN)) continue;
+        *pwtbSession = pwtbSessions[u8Index];
+        return true;
+    }
+    return false;
+}
+
+// Sends IPv4 frames straight to the legacy and the unknown station, returns the sessions opened for them.
+static uint8_t txBANonHT(void) {
+    static const uint8_t ppu8Dest[][ETH_HWADDR_LEN] = {SIM_LEGACY_MAC, SIM_UNKNOWN_MAC};
+    struct netif *pnUAP = netif_get_by_index(BSS_TYPE_UAP + 1);
+    wlan_tx_ba_t pwtbSessions[WLAN_TX_BA_NUM];
+    uint8_t u8Num, u8Opened = 0;
+    for (uint8_t u8Dest = 0; u8Dest < 2; ++u8Dest) {
+        struct pbuf *pbBuffer = pbuf_alloc(PBUF_RAW, SIZEOF_ETH_HDR + IP_HLEN, PBUF_RAM);
+        if (!pbBuffer) continue;
+        memset(pbBuffer->payload, 0, pbBuffer->len);
+        struct eth_hdr *pehHeader = (struct eth_hdr *)pbBuffer->payload;
+        memcpy(pehHeader->dest.addr, ppu8Dest[u8Dest], ETH_HWADDR_LEN);
+        memcpy(pehHeader->src.addr, g_pu8LocalMAC, ETH_HWADDR_LEN);
+        pehHeader->type = PP_HTONS(ETHTYPE_IP);
+        pnUAP->linkoutput(pnUAP, pbBuffer);
+        pbuf_free(pbBuffer);
+    }
+    u8Num = wlan_get_tx_ba(pwtbSessions, WLAN_TX_BA_NUM);
+    for (uint8_t u8Index = 0; u8Index < u8Num; ++u8Index) {
+        for (uint8_t u8Dest = 0; u8Dest < 2; ++u8Dest) u8Opened += !memcmp(pwtbSessions[u8Index].ra, ppu8Dest[u8Dest], ETH_HWADDR_LEN);
+    }
+    return u8Opened;
+}
+#endif
+
+// Open the block ack sessions, the first one is used for the datagrams.
+static void reorderStart(void) {
+    g_ssState = SIM_STATE_REORDER;
+    wlan_reset_stats();
+    for (uint8_t u8TID = SIM_BA_TID; u8TID < SIM_BA_TID + SIM_BA_SESSIONS; ++u8TID) peerAddBA(u8TID);
+}
+
+static void reorderStep(void) {
+    switch (g_u8ReorderStep) {
+    case 0:
+        if (g_u8ADDBARsps < SIM_BA_SESSIONS) return;
+        // Swapped pairs and a duplicate are put in order at once, the hole at 6 is given up after the timeout.
+        peerUploadBA(1, 0);
+        peerUploadBA(0, 0);
+        peerUploadBA(3, 0);
+        peerUploadBA(2, 0);
+        peerUploadBA(2, 0);
+        peerUploadBA(5, 0);
+        peerUploadBA(4, 0);
+        peerUploadBA(7, 0);
+        peerUploadBA(8, 0);
+        g_dStart = timeNow();
+        break;
+    case 1: {
+        if (g_u32ReorderRx < 8) return;
+        g_dHoleTime = timeNow() - g_dStart;
+        // 6 comes too late, 40 moves the window past 10, the BAR releases 40 and the DELBA releases 43.
+        peerUploadBA(6, 0);
+        peerUploadBA(10, 0);
+        peerUploadBA(40, 0);
+        peerUploadBA(41, PKT_TYPE_BAR);
+        peerUploadBA(43, 0);
+        HOST_DS_11N_DELBA hdbDelBA = {0};
+        memcpy(hdbDelBA.peer_mac_addr, g_pu8PeerMAC, ETH_HWADDR_LEN);
+        hdbDelBA.del_ba_param_set = DELBA_INITIATOR | SIM_BA_TID << DELBA_TID_POS;
+        sdio_sim_upload_event(EVENT_DELBA, BSS_TYPE_UAP, (uint8_t *)&hdbDelBA, sizeof(hdbDelBA));
+        // The sequence number of 6 is behind the window, without the session the datagram is delivered anyway.
+        peerUploadBA(SEQ_NUM_MASK + 1 + 6, 0);
+        break;
+    }
+    default: {
+        if (g_u32ReorderRx < SIM_BA_FRAMES) return;
+        wlan_stats_t wsStats;
+        wlan_get_stats(&wsStats);
+        printf("Reorder: %u of %u ADDBA declined, %u not as expected, %u datagrams (%u out of order), %u held, %u dropped, hole given up after %.1f ms\n", g_u8ADDBADeclined, g_u8ADDBARsps, g_u8ADDBAErrors, g_u32ReorderRx, g_u32ReorderErrors, wsStats.rx_reorder_count, wsStats.rx_reorder_drop_count, g_dHoleTime * 1000);
+        if (g_u8ADDBAErrors || g_u32ReorderErrors) {
+            printf(MSG_ERROR_FORMAT, "CORE", g_u8ADDBAErrors + g_u32ReorderErrors, "check reordering");
+            simFail();
+            return;
+        }
+#ifdef WLAN_RX_AMSDU
+        amsduStart();
+#else
+        txRefStart();
+#endif
+        return;
+    }
+    }
+    ++g_u8ReorderStep;
+}
+
+#ifdef WLAN_RX_AMSDU
+// The datagram indexes start over for the A-MSDUs.
+static void amsduStart(void) {
+    g_ssState = SIM_STATE_AMSDU;
+    wlan_reset_stats();
+    g_u32ReorderRx = g_u32ReorderErrors = 0;
+    g_i32ReorderLast = -1;
+    // The second A-MSDU of the session arrives first and is held as a whole.
+    peerUploadAMSDU(SIM_BA_TID + 1, (SIM_BA_SSN + 1) & SEQ_NUM_MASK, SIM_AMSDU_SUBFRAMES, SIM_AMSDU_SUBFRAMES, SIM_BA_PAYLOAD);
+    peerUploadAMSDU(SIM_BA_TID + 1, SIM_BA_SSN, 0, SIM_AMSDU_SUBFRAMES, SIM_BA_PAYLOAD);
+    // Two full-size datagrams fill a 4 KB rx buffer.
+    peerUploadAMSDU(SIM_AMSDU_TID, 0, 2 * SIM_AMSDU_SUBFRAMES, 2, SIM_UDP_SIZE);
+    // A valid subframe, one without LLC/SNAP and one whose length runs past the end.
+    uint8_t pu8AMSDU[3 * AMSDU_SUBFRAME_ALIGN(AMSDU_SUBFRAME_HDR_SIZE + LLC_SNAP_SIZE + IP_HLEN + UDP_HLEN + SIM_BA_PAYLOAD)];
+    uint16_t u16Len = AMSDU_SUBFRAME_ALIGN(peerBuildSubframe(pu8AMSDU, 2 * SIM_AMSDU_SUBFRAMES + 2, SIM_BA_PAYLOAD)), u16Next;
+    u16Next = u16Len + AMSDU_SUBFRAME_ALIGN(peerBuildSubframe(pu8AMSDU + u16Len, 2 * SIM_AMSDU_SUBFRAMES + 3, SIM_BA_PAYLOAD));
+    pu8AMSDU[u16Len + AMSDU_SUBFRAME_HDR_SIZE] = 0;
+    u16Len = u16Next;
+    u16Len += peerBuildSubframe(pu8AMSDU + u16Len, 2 * SIM_AMSDU_SUBFRAMES + 4, SIM_BA_PAYLOAD) - 1;
+    sdio_sim_upload_data_ex(pu8AMSDU, u16Len, BSS_TYPE_UAP, PKT_TYPE_AMSDU, SIM_AMSDU_TID, 0);
+}
+
+static void amsduStep(void) {
+    if (g_u32ReorderRx < SIM_AMSDU_FRAMES) return;
+    wlan_stats_t wsStats;
+    wlan_get_stats(&wsStats);
+    printf("A-MSDU: %u A-MSDUs, %u subframes (%u dropped), %u datagrams (%u out of order), %u held, %u passed to lwIP in place, %u copied\n", wsStats.rx_amsdu_count, wsStats.rx_amsdu_subframe_count, wsStats.rx_amsdu_drop_count, g_u32ReorderRx, g_u32ReorderErrors, wsStats.rx_reorder_count, wsStats.rx_ref_count - wsStats.rx_reorder_count, wsStats.rx_copy_count);
+    if (g_u32ReorderErrors || wsStats.rx_amsdu_drop_count != 2) {
+        printf(MSG_ERROR_FORMAT, "CORE", g_u32ReorderErrors, "check A-MSDU de-aggregation");
+        simFail();
+        return;
+    }
+    txRefStart();
+}
+#endif
+
+static void txRefStart(void) {
+    g_ssState = SIM_STATE_TX_REF;
+    g_u32TxFrames = 0;
+    sdio_sim_reset_stats();
+    sdio_reset_stats();
+    wlan_reset_stats();
+    g_dStart = timeNow();
+}
+
+// Every paced datagram has to be sent in place, the burst has to be aggregated like the copied TX run.
+static void txRefStep(void) {
+    wlan_stats_t wsStats;
+    sdio_sim_stats_t sssStats;
+    double dGoodput;
+    if (g_u8TxRefStep == 0 && g_u32TxRefSent < SIM_TX_REF_FRAMES) {
+        // The next datagram once the previous one has reached the peer and no command is on the bus.
+        if (g_u32TxFrames < g_u32TxRefSent || sdio_cmd53_busy()) return;
+        err_t errSession = txRefSend();
+        if (errSession) printf(MSG_ERROR_FORMAT, "LWIP", errSession, "send data");
+        ++g_u32TxRefSent;
+        return;
+    }
+    if (g_u32TxFrames < SIM_TX_REF_FRAMES) return;
+    wlan_get_stats(&wsStats);
+    sdio_sim_get_stats(&sssStats);
+    dGoodput = SIM_TX_REF_FRAMES * SIM_UDP_SIZE * 8 / (sssStats.bus_clocks / SIM_BUS_CLOCK) / 1e6;
+    simReport(g_u8TxRefStep ? "TX burst" : "TX paced", g_u32TxFrames, timeNow() - g_dStart);
+    if (!g_u8TxRefStep) {
+        if (wsStats.tx_ref_count != SIM_TX_REF_FRAMES) {
+            printf(MSG_ERROR_FORMAT, "CORE", wsStats.tx_ref_count, "send paced datagrams in place");
+            simFail();
+            return;
+        }
+        g_dTxRefPaced = dGoodput;
+        txRefStart();
+        g_u8TxRefStep = 1;
+        for (uint32_t u32Index = 0; u32Index < SIM_TX_REF_FRAMES; ++u32Index) {
+            err_t errSession = txRefSend();
+            if (errSession) printf(MSG_ERROR_FORMAT, "LWIP", errSession, "send data");
+        }
+        return;
+    }
+    printf("TX in place: %.2f Mbps bus-limited goodput paced (single-port CMD53), %.2f Mbps in a burst (%u of %u in place, %.2f packets/write)\n", g_dTxRefPaced, dGoodput, wsStats.tx_ref_count, SIM_TX_REF_FRAMES, (double)wsStats.tx_packet_count / wsStats.tx_transfer_count);
+    if ((double)wsStats.tx_packet_count / wsStats.tx_transfer_count < 2) {
+        printf(MSG_ERROR_FORMAT, "CORE", wsStats.tx_transfer_count, "aggregate the burst");
+        simFail();
+        return;
+    }
+    staStart();
+}
+
+// The UDP payload is written into a single pbuf with headroom for all headers and the TxPD.
+static err_t txRefSend(void) {
+    struct pbuf *pbBuffer = pbuf_alloc(PBUF_TRANSPORT, SIM_UDP_SIZE, PBUF_RAM);
+    if (!pbBuffer) return ERR_MEM;
+    memcpy(pbBuffer->payload, g_pu8Payload, SIM_UDP_SIZE);
+    err_t errSession = udp_send(g_pupSession, pbBuffer);
+    pbuf_free(pbBuffer);
+    return errSession;
+}
+
+// Connect, then disconnect and reconnect, the reconnects should not need a scan.
+static void staStart(void) {
+    g_ssState = SIM_STATE_STA;
+#ifdef WLAN_HOST_PMK
+    pbkdf2_sha1((const uint8_t *)SIM_STA_PWD, sizeof(SIM_STA_PWD) - 1, (const uint8_t *)SIM_STA_SSID, sizeof(SIM_STA_SSID) - 1, PMK_ITERATIONS, g_pu8StaPMK, PMK_LENGTH);
+#endif
+    wlan_reset_stats();
+    g_dStart = timeNow();
+    uint8_t u8Err = wlan_sta_connect((uint8_t *)SIM_STA_SSID, sizeof(SIM_STA_SSID) - 1, (uint8_t *)SIM_STA_PWD, sizeof(SIM_STA_PWD) - 1);
+    if (!u8Err) return;
+    printf(MSG_ERROR_FORMAT, "CORE", u8Err, "connect AP");
+    simFail();
+}
+
+static void wlanStaConnectCallback(core_err_e ceStatus) {
+    if (ceStatus) {
+        printf(MSG_ERROR_FORMAT, "CORE", ceStatus, "connect AP");
+        simFail();
+        return;
+    }
+    wlan_stats_t wsStats;
+    wlan_get_stats(&wsStats);
+    if (!g_u32StaConnects++) {
+        printf("STA: connected (%s) in %.3f ms host time, %u channels scanned (up to %u ms on air), PMK derived in %.3f ms (longest slice %.3f ms)\n", wlan_get_phy_mode() == PHY_MODE_11N ? "11n" : "11g", (timeNow() - g_dStart) * 1000, g_u32ScanChannels, g_u32ScanTime, wsStats.pmk_derive_time / 1000.0, wsStats.pmk_slice_time / 1000.0);
+        staReport("STA");
+        g_u32ScanChannels = g_u32ScanTime = 0;
+        wlan_reset_stats();
+        g_dStart = timeNow();
+    } else if (g_u32StaConnects > SIM_STA_RECONNECTS) {
+        printf("STA: %d reconnects in %.3f ms host time, %u from the BSS cache, %u channels scanned (up to %u ms on air), %u PMK derived, %u PMK cache hits\n", SIM_STA_RECONNECTS, (timeNow() - g_dStart) * 1000, wsStats.bss_cache_hit_count, g_u32ScanChannels, g_u32ScanTime, wsStats.pmk_derive_count, wsStats.pmk_cache_hit_count);
+        printf("STA: %u of %u associations requested HT, %u carried the WMM IE (%u not as advertised), last connected with %s\n", g_u32HTAssocs, g_u32StaConnects, g_u32WMMAssocs, g_u32WMMErrors, wlan_get_phy_mode() == PHY_MODE_11N ? "11n" : "11g");
+        staReport("STA");
+        if (g_u32WMMErrors) {
+            printf(MSG_ERROR_FORMAT, "CORE", g_u32WMMErrors, "check WMM IE");
+            simFail();
+            return;
+        }
+#ifdef WLAN_HOST_PMK
+        if (g_u32PMKErrors) {
+            printf(MSG_ERROR_FORMAT, "CORE", g_u32PMKErrors, "send PMK");
+            simFail();
+            return;
+        }
+#endif
+#ifdef WLAN_WARM_BOOT
+        g_ssState = SIM_STATE_WARM;
+#else
+        g_ssState = SIM_STATE_DONE;
+#endif
+        return;
+    }
+    // The cached BSS of the last reconnect then fails to associate, the driver has to scan for another AP.
+    if (g_u32StaConnects == SIM_STA_RECONNECTS) g_psaAPs[1].u8Channel = 0;
+    uint8_t u8Err = wlan_sta_disconnect();
+    if (!u8Err) return;
+    printf(MSG_ERROR_FORMAT, "CORE", u8Err, "disconnect AP");
+    simFail();
+}
+
+// Print the AP in use and the candidates ranked by the driver.
+static void staReport(const char *pcName) {
+    wlan_bss_candidate_t pbcCandidates[SIM_STA_CANDIDATES];
+    uint8_t u8Num = wlan_get_bss((uint8_t *)SIM_STA_SSID, sizeof(SIM_STA_SSID) - 1, pbcCandidates, SIM_STA_CANDIDATES);
+    printf("%s: %u candidates:", pcName, u8Num);
+    for (uint8_t u8Index = 0; u8Index < u8Num; ++u8Index) {
+        wlan_bss_entry_t *pbeBSS = &pbcCandidates[u8Index].bss;
+        printf(" %02X:%02X channel %u RSSI -%u %s score %d%s%s", pbeBSS->bssid[4], pbeBSS->bssid[5], pbeBSS->channel, pbeBSS->rssi, pbeBSS->phy_mode == PHY_MODE_11N ? "11n" : "11g", pbcCandidates[u8Index].score, pbcCandidates[u8Index].blacklisted ? " (blacklisted)" : "", u8Index + 1 < u8Num ? "," : "\n");
+    }
+}
+
+#ifdef WLAN_WARM_BOOT
+// wrapper_init is called again while the firmware runs with the STA connected and the AP up, as after a reset of the MCU
+// only. The firmware must not be downloaded again and the init callback must fire.
+static void warmStep(void) {
+    if (g_dWarmStart) {
+        if (timeNow() - g_dWarmStart < SIM_WARM_TIMEOUT) return;
+        printf(MSG_ERROR_FORMAT, "CORE", 0, "finish warm boot");
+        simFail();
+        return;
+    }
+    sdio_sim_reset_stats();
+    sdio_reset_stats();
+    wlan_reset_stats();
+    g_dWarmStart = timeNow();
+    uint16_t u16Err = wrapper_init(&g_ceStatus, &g_wlanCallback, NULL, 0);
+    if (!u16Err) return;
+    printf(MSG_ERROR_FORMAT, (uint8_t)u16Err ? "CORE" : "SDIO", (uint8_t)u16Err | u16Err >> 8, "init WLAN");
+    simFail();
+}
+#endif
+
+static void wlanStaDisconnectCallback(void) {
+    uint8_t u8Err = wlan_sta_connect((uint8_t *)SIM_STA_SSID, sizeof(SIM_STA_SSID) - 1, (uint8_t *)SIM_STA_PWD, sizeof(SIM_STA_PWD) - 1);
+    if (!u8Err) return;
+    printf(MSG_ERROR_FORMAT, "CORE", u8Err, "connect AP");
+    simFail();
+}
+
+static void udpRecvCallback(void *pvArg, struct udp_pcb *pupSession, struct pbuf *pbBuffer, const ip_addr_t *piaAddress, u16_t u16Port) {
+    UNUSED(pvArg);
+    UNUSED(pupSession);
+    UNUSED(piaAddress);
+    UNUSED(u16Port);
+    if (g_ssState == SIM_STATE_REORDER || g_ssState == SIM_STATE_AMSDU) {
+        // Datagrams of the block ack session carry their offset from the SSN, those of the A-MSDUs their position.
+        int32_t i32Index = 0;
+        pbuf_copy_partial(pbBuffer, &i32Index, sizeof(i32Index), 0);
+        if (i32Index <= g_i32ReorderLast) ++g_u32ReorderErrors;
+        g_i32ReorderLast = i32Index;
+        ++g_u32ReorderRx;
+    } else ++g_u32RxFrames;
+    pbuf_free(pbBuffer);
+}
+
+static void peerDataHandler(uint8_t *pu8Data, uint16_t u16Len, uint8_t u8BSSType) {
+    UNUSED(u8BSSType);
+    if (u16Len < SIZEOF_ETH_HDR) return;
+    struct eth_hdr *pehHeader = (struct eth_hdr *)pu8Data;
+    switch (lwip_htons(pehHeader->type)) {
+    case ETHTYPE_IP:
+#ifdef WLAN_KV_STORE
+        // Replies of the DHCP server are broadcast to the client port, the message type is their first option.
+        if (g_ssState == SIM_STATE_DHCP) {
+            struct udp_hdr *puhHeader = (struct udp_hdr *)(pu8Data + SIZEOF_ETH_HDR + IP_HLEN);
+            struct dhcp_msg *pdmMsg = (struct dhcp_msg *)(pu8Data + SIZEOF_ETH_HDR + IP_HLEN + UDP_HLEN);
+            if (u16Len < SIZEOF_ETH_HDR + IP_HLEN + UDP_HLEN + DHCP_OPTIONS_OFS + 3 || puhHeader->dest != PP_HTONS(LWIP_IANA_PORT_DHCP_CLIENT)) return;
+            if (pdmMsg->options[0] == DHCP_OPTION_MESSAGE_TYPE && (g_u8DHCPReply = pdmMsg->options[2]) == DHCP_OFFER) ip4_addr_copy(g_iaDHCPOffer, pdmMsg->yiaddr);
+            return;
+        }
+#endif
+        if (memcmp(pehHeader->dest.addr, g_pu8PeerMAC, ETH_HWADDR_LEN)) return;
+        ++g_u32TxFrames;
+        break;
+    case ETHTYPE_ARP: {
+        // Answer ARP requests for the peer.
+        struct etharp_hdr *pahHeader = (struct etharp_hdr *)(pu8Data + SIZEOF_ETH_HDR);
+        ip4_addr_t iaPeer;
+        ip4addr_aton(SIM_PEER_IP, &iaPeer);
+        if (pahHeader->opcode != PP_HTONS(ARP_REQUEST) || memcmp(&pahHeader->dipaddr, &iaPeer, sizeof(ip4_addr_t))) return;
+        uint8_t pu8Frame[SIZEOF_ETH_HDR + SIZEOF_ETHARP_HDR];
+        memcpy(pu8Frame, pu8Data, sizeof(pu8Frame));
+        pehHeader = (struct eth_hdr *)pu8Frame;
+        pahHeader = (struct etharp_hdr *)(pu8Frame + SIZEOF_ETH_HDR);
+        memcpy(pehHeader->dest.addr, pehHeader->src.addr, ETH_HWADDR_LEN);
+        memcpy(pehHeader->src.addr, g_pu8PeerMAC, ETH_HWADDR_LEN);
+        pahHeader->opcode = PP_HTONS(ARP_REPLY);
+        memcpy(&pahHeader->dhwaddr, &pahHeader->shwaddr, ETH_HWADDR_LEN);
+        memcpy(&pahHeader->dipaddr, &pahHeader->sipaddr, sizeof(ip4_addr_t));
+        memcpy(&pahHeader->shwaddr, g_pu8PeerMAC, ETH_HWADDR_LEN);
+        memcpy(&pahHeader->sipaddr, &iaPeer, sizeof(ip4_addr_t));
+        sdio_sim_upload_data(pu8Frame, sizeof(pu8Frame), BSS_TYPE_UAP);
+        break;
+    }
+    default: break;
+    }
+}
+
+// Firmware side of the STA: scan results, association with an AP that is up on that channel, deauthentication.
+static bool peerCmdHandler(uint8_t *pu8Cmd, uint16_t u16Len) {
+    HOST_DS_COMMAND *phdcCmd = (HOST_DS_COMMAND *)pu8Cmd;
+    switch (phdcCmd->command) {
+    case HOST_ID_802_11_SCAN: return peerScan(pu8Cmd, u16Len);
+    // AP start, answered by the built-in model.
+    case HOST_ID_APCMD_SYS_CONFIGURE:
+        g_u8APCmds = !g_u8APCmds && peerCheckAPConfig(pu8Cmd, u16Len);
+        return false;
+    case HOST_ID_11N_CFG:
+        g_u16HTTxCap = phdcCmd->params.htcfg.ht_tx_cap;
+        g_u8APCmds = g_u8APCmds == 1 && phdcCmd->params.htcfg.action == HOST_ACT_GEN_SET ? 2 : 0;
+        return false;
+    case HOST_ID_APCMD_BSS_START:
+#ifdef WLAN_11N
+        g_u8APCmds = g_u8APCmds == 2 ? 3 : 0;
+#else
+        g_u8APCmds = g_u8APCmds == 1 ? 2 : 0;
+#endif
+        return false;
+    // Answered by the built-in model, accepted sessions have to keep the SSN and get the window of the driver.
+    case HOST_ID_11N_ADDBA_RSP:
+        ++g_u8ADDBARsps;
+        if (phdcCmd->params.add_ba_rsp.status_code) ++g_u8ADDBADeclined;
+        else if (phdcCmd->bss >> 4 != BSS_TYPE_UAP || phdcCmd->params.add_ba_rsp.ssn != SIM_BA_SSN || phdcCmd->params.add_ba_rsp.block_ack_param_set >> BLOCK_ACK_WIN_SIZE_POS != WLAN_RX_REORDER_WIN) ++g_u8ADDBAErrors;
+        return false;
+#ifdef WLAN_11N
+    case HOST_ID_11N_ADDBA_REQ: {
+        uint16_t u16ParamSet = phdcCmd->params.add_ba_req.block_ack_param_set;
+        ++g_u8TxBAReqs;
+        if (phdcCmd->bss >> 4 != BSS_TYPE_UAP || memcmp(phdcCmd->params.add_ba_req.peer_mac_addr, g_pu8PeerMAC, ETH_HWADDR_LEN) || u16ParamSet >> BLOCK_ACK_WIN_SIZE_POS != WLAN_TX_BA_WIN || !(u16ParamSet & BLOCK_ACK_POLICY_IMMEDIATE)) ++g_u8TxBAErrors;
+        HOST_DS_11N_ADDBA_RSP hdarRsp = {0};
+        memcpy(hdarRsp.peer_mac_addr, g_pu8PeerMAC, ETH_HWADDR_LEN);
+        hdarRsp.dialog_token = g_u8TxBAReqs;
+        hdarRsp.status_code = (u16ParamSet & BLOCK_ACK_TID_MASK) >> BLOCK_ACK_TID_POS == SIM_TX_BA_TID ? 0 : REQUEST_DECLINED;
+        hdarRsp.block_ack_param_set = u16ParamSet;
+        sdio_sim_upload_cmdrsp(pu8Cmd, (uint8_t *)&hdarRsp, sizeof(hdarRsp));
+        return true;
+    }
+#endif
+#ifdef WLAN_HOST_PMK
+    // Associations wait for the PMK derived in slices, the passphrase is never sent. Answered by the built-in model.
+    case HOST_ID_SUPPLICANT_PMK: {
+        MrvlIEtypes_PMK_t *pPMK = (MrvlIEtypes_PMK_t *)peerFindTLV(phdcCmd->params.esupplicant_psk.tlv_buffer, pu8Cmd + u16Len, TLV_TYPE_PMK);
+        if (!pPMK || pPMK->header.len != PMK_LENGTH || memcmp(pPMK->pmk, g_pu8StaPMK, PMK_LENGTH)) ++g_u32PMKErrors;
+        return false;
+    }
+#endif
+    case HOST_ID_802_11_ASSOCIATE: {
+        MrvlIETypes_PhyParamDSSet_t *pPhy = (MrvlIETypes_PhyParamDSSet_t *)peerFindTLV(phdcCmd->params.associate.tlv_buffer, pu8Cmd + u16Len, TLV_TYPE_PHY_DS);
+        for (uint8_t u8Index = 0; u8Index < sizeof(g_psaAPs) / sizeof(simAP); ++u8Index) {
+            if (!memcmp(g_psaAPs[u8Index].pu8BSSID, phdcCmd->params.associate.peer_sta_addr, ETH_HWADDR_LEN) && pPhy && g_psaAPs[u8Index].u8Channel && pPhy->channel == g_psaAPs[u8Index].u8Channel) {
+                peerAssociate(pu8Cmd, u16Len, &g_psaAPs[u8Index]);
+                return true;
+            }
+        }
+        // The AP is not there, the firmware gives up with a timeout.
+        uint8_t pu8Rsp[sizeof(IEEEtypes_AssocRsp_t) - 1] = {0xFC, 0xFF};
+        sdio_sim_upload_cmdrsp(pu8Cmd, pu8Rsp, sizeof(pu8Rsp));
+        return true;
+    }
+    case HOST_ID_802_11_DEAUTHENTICATE:
+        sdio_sim_upload_cmdrsp(pu8Cmd, NULL, 0);
+        sdio_sim_upload_event(EVENT_DEAUTHENTICATED, BSS_TYPE_STA, NULL, 0);
+        return true;
+    default: return false;
+    }
+}
+
+// Answer a scan with the WPA2 APs that are up on the channels asked for, count the channels and their scan time.
+static bool peerScan(uint8_t *pu8Cmd, uint16_t u16Len) {
+    static const uint8_t pu8RSN[] = {0x01, 0x00, 0x00, 0x0F, 0xAC, 0x04, 0x01, 0x00, 0x00, 0x0F, 0xAC, 0x04, 0x01, 0x00, 0x00, 0x0F, 0xAC, 0x02, 0x00, 0x00};
+    static const uint8_t pu8Rates[] = {0x82, 0x84, 0x8B, 0x96, 0x0C, 0x12, 0x18, 0x24};
+    static const uint8_t pu8ExtRates[] = {0x30, 0x48, 0x60, 0x6C};
+    // SM power save disabled, short GI 20 MHz, RX STBC, MCS 0-15.
+    static const uint8_t pu8HTCap[sizeof(IEEEtypes_HTCap_t)] = {0x2C, 0x01, 0x17, 0xFF, 0xFF};
+    HOST_DS_COMMAND *phdcCmd = (HOST_DS_COMMAND *)pu8Cmd;
+    MrvlIEtypes_SSIDParamSet_t *pSSID = (MrvlIEtypes_SSIDParamSet_t *)peerFindTLV(phdcCmd->params.scan.tlv_buffer, pu8Cmd + u16Len, TLV_TYPE_SSID);
+    MrvlIEtypes_ChanListParamSet_t *pList = (MrvlIEtypes_ChanListParamSet_t *)peerFindTLV(phdcCmd->params.scan.tlv_buffer, pu8Cmd + u16Len, TLV_TYPE_CHANLIST);
+    uint8_t pu8Rsp[0x200] = {0}, *pu8IE;
+    uint16_t u16Channels = 0;
+    if (!pList) return false;
+    for (ChanScanParamSet_t *pParams = (ChanScanParamSet_t *)(&pList->header + 1); (uint8_t *)pParams < (uint8_t *)(&pList->header + 1) + pList->header.len; ++pParams) {
+        ++g_u32ScanChannels;
+        g_u32ScanTime += pParams->max_scan_time;
+        if (pParams->chan_number && pParams->chan_number <= 16) u16Channels |= 1 << (pParams->chan_number - 1);
+    }
+    HOST_DS_802_11_SCAN_RSP *pRsp = (HOST_DS_802_11_SCAN_RSP *)pu8Rsp;
+    bss_desc_set_t *pBSS = (bss_desc_set_t *)pRsp->bss_desc_and_tlv_buffer;
+    bool bMatch = pSSID && pSSID->header.len == sizeof(SIM_STA_SSID) - 1 && !memcmp(pSSID->ssid, SIM_STA_SSID, pSSID->header.len);
+    for (uint8_t u8Index = 0; bMatch && u8Index < sizeof(g_psaAPs) / sizeof(simAP); ++u8Index) {
+        simAP *psaAP = &g_psaAPs[u8Index];
+        if (!psaAP->u8Channel || !(u16Channels & 1 << (psaAP->u8Channel - 1))) continue;
+        memset(pBSS, 0, sizeof(bss_desc_set_t));
+        memcpy(pBSS->bssid, psaAP->pu8BSSID, ETH_HWADDR_LEN);
+        pBSS->rssi = psaAP->u8RSSI;
+        pBSS->bcn_interval = 100;
+        pBSS->cap_info = 0x1 | WLAN_CAPABILITY_PRIVACY;
+        pu8IE = (uint8_t *)&pBSS->ie_parameters;
+        *pu8IE++ = TLV_TYPE_SSID;
+        *pu8IE++ = sizeof(SIM_STA_SSID) - 1;
+        pu8IE = (uint8_t *)memcpy(pu8IE, SIM_STA_SSID, sizeof(SIM_STA_SSID) - 1) + sizeof(SIM_STA_SSID) - 1;
+        *pu8IE++ = TLV_TYPE_RATES;
+        *pu8IE++ = sizeof(pu8Rates);
+        pu8IE = (uint8_t *)memcpy(pu8IE, pu8Rates, sizeof(pu8Rates)) + sizeof(pu8Rates);
+        *pu8IE++ = TLV_TYPE_PHY_DS;
+        *pu8IE++ = 1;
+        *pu8IE++ = psaAP->u8Channel;
+        *pu8IE++ = TLV_TYPE_RSN_PARAMSET;
+        *pu8IE++ = sizeof(pu8RSN);
+        pu8IE = (uint8_t *)memcpy(pu8IE, pu8RSN, sizeof(pu8RSN)) + sizeof(pu8RSN);
+        *pu8IE++ = TLV_TYPE_EXT_RATES;
+        *pu8IE++ = sizeof(pu8ExtRates);
+        pu8IE = (uint8_t *)memcpy(pu8IE, pu8ExtRates, sizeof(pu8ExtRates)) + sizeof(pu8ExtRates);
+        if (psaAP->bHT) {
+            *pu8IE++ = TLV_TYPE_HT_CAPABILITY;
+            *pu8IE++ = sizeof(pu8HTCap);
+            pu8IE = (uint8_t *)memcpy(pu8IE, pu8HTCap, sizeof(pu8HTCap)) + sizeof(pu8HTCap);
+            *pu8IE++ = TLV_TYPE_VENDOR_SPECIFIC_IE;
+            *pu8IE++ = sizeof(g_pu8WMMParam);
+            pu8IE = (uint8_t *)memcpy(pu8IE, g_pu8WMMParam, sizeof(g_pu8WMMParam)) + sizeof(g_pu8WMMParam);
+        }
+        pBSS->ie_length = pu8IE - (uint8_t *)pBSS - sizeof(pBSS->ie_length);
+        pRsp->bss_descript_size += pu8IE - (uint8_t *)pBSS;
+        ++pRsp->number_of_sets;
+        pBSS = (bss_desc_set_t *)pu8IE;
+    }
+    sdio_sim_upload_cmdrsp(pu8Cmd, pu8Rsp, (uint8_t *)pBSS - pu8Rsp);
+    return true;
+}
+
+// Accept the association, an HT AP answers a valid HT capability TLV (20 MHz, MCS 0-7) that comes with its WMM IE with its own HT capabilities.
+static void peerAssociate(uint8_t *pu8Cmd, uint16_t u16Len, simAP *psaAP) {
+    HOST_DS_COMMAND *phdcCmd = (HOST_DS_COMMAND *)pu8Cmd;
+    MrvlIETypes_HTCap_t *pHTCap = (MrvlIETypes_HTCap_t *)peerFindTLV(phdcCmd->params.associate.tlv_buffer, pu8Cmd + u16Len, TLV_TYPE_HT_CAPABILITY);
+    uint8_t pu8Rsp[sizeof(IEEEtypes_AssocRsp_t) - 1 + sizeof(IEEEHeader) + sizeof(IEEEtypes_HTCap_t)] = {0x11, 0x04, 0x00, 0x00, 0x01, 0xC0};
+    uint16_t u16RspLen = sizeof(IEEEtypes_AssocRsp_t) - 1;
+    if (pHTCap) ++g_u32HTAssocs;
+    // The WMM IE of the scan result has to come back unchanged, and only from the APs that advertise it.
+    MrvlIEtypesHeader_t *pWMM = peerFindTLV(phdcCmd->params.associate.tlv_buffer, pu8Cmd + u16Len, TLV_TYPE_VENDOR_SPECIFIC_IE);
+    for (; pWMM && (pWMM->len < 4 || memcmp(pWMM + 1, g_pu8WMMParam, 4)); pWMM = peerFindTLV((uint8_t *)(pWMM + 1) + pWMM->len, pu8Cmd + u16Len, TLV_TYPE_VENDOR_SPECIFIC_IE));
+    if (pWMM) ++g_u32WMMAssocs;
+    if (pWMM ? !psaAP->bHT || pWMM->len != sizeof(g_pu8WMMParam) || memcmp(pWMM + 1, g_pu8WMMParam, sizeof(g_pu8WMMParam)) : psaAP->bHT || pHTCap) ++g_u32WMMErrors;
+    // HT needs QoS, an HT request without the WMM IE is answered as 11g.
+    if (psaAP->bHT && pHTCap && pWMM && pHTCap->header.len == sizeof(IEEEtypes_HTCap_t) && !(pHTCap->ht_cap.ht_cap_info & 0x2) && pHTCap->ht_cap.ht_cap_info & HT_CAP_SGI_20 && pHTCap->ht_cap.rx_mcs_mask[0] == HT_MCS_SET_1SS && !pHTCap->ht_cap.rx_mcs_mask[1]) {
+        IEEEType *pIE = (IEEEType *)(pu8Rsp + u16RspLen);
+        pIE->header.type = TLV_TYPE_HT_CAPABILITY;
+        pIE->header.length = sizeof(IEEEtypes_HTCap_t);
+        memcpy(pIE->data, &pHTCap->ht_cap, sizeof(IEEEtypes_HTCap_t));
+        u16RspLen += sizeof(IEEEHeader) + sizeof(IEEEtypes_HTCap_t);
+    }
+    sdio_sim_upload_cmdrsp(pu8Cmd, pu8Rsp, u16RspLen);
+    sdio_sim_upload_event(EVENT_PORT_RELEASE, BSS_TYPE_STA, NULL, 0);
+}
+
+// Check the TLV stream of the AP configuration: SSID, broadcast control, 20 MHz HT capabilities and the channel, in that order.
+static bool peerCheckAPConfig(uint8_t *pu8Cmd, uint16_t u16Len) {
+#ifdef WLAN_11N
+    static const uint16_t pu16Types[] = {TLV_TYPE_SSID, TLV_TYPE_UAP_BCAST_SSID_CTL, TLV_TYPE_HT_CAPABILITY, TLV_TYPE_UAP_CHAN_BAND_CONFIG};
+    static const IEEEtypes_HTCap_t ihcExpected = {.ht_cap_info = HT_CAP_SM_PS_DISABLED | HT_CAP_SGI_20, .ampdu_params = HT_AMPDU_PARAMS, .rx_mcs_mask = {HT_MCS_SET_1SS}};
+#else
+    static const uint16_t pu16Types[] = {TLV_TYPE_SSID, TLV_TYPE_UAP_BCAST_SSID_CTL, TLV_TYPE_UAP_CHAN_BAND_CONFIG};
+#endif
+    uint8_t *pu8TLV = ((HOST_DS_COMMAND *)pu8Cmd)->params.sys_config.tlv_buffer, *pu8End = pu8Cmd + u16Len, u8Index = 0;
+    for (MrvlIEtypesHeader_t *pHeader; pu8TLV + sizeof(MrvlIEtypesHeader_t) <= pu8End; pu8TLV += sizeof(MrvlIEtypesHeader_t) + pHeader->len, ++u8Index) {
+        pHeader = (MrvlIEtypesHeader_t *)pu8TLV;
+        if (u8Index == sizeof(pu16Types) / sizeof(uint16_t) || pHeader->type != pu16Types[u8Index] || pu8TLV + sizeof(MrvlIEtypesHeader_t) + pHeader->len > pu8End) return false;
+        switch (pHeader->type) {
+        case TLV_TYPE_SSID:
+            if (pHeader->len != sizeof(WLAN_AP_SSID) - 1 || memcmp(pHeader + 1, WLAN_AP_SSID, pHeader->len)) return false;
+            break;
+#ifdef WLAN_11N
+        case TLV_TYPE_HT_CAPABILITY:
+            if (pHeader->len != sizeof(IEEEtypes_HTCap_t) || memcmp(pHeader + 1, &ihcExpected, sizeof(IEEEtypes_HTCap_t))) return false;
+            break;
+#endif
+        case TLV_TYPE_UAP_CHAN_BAND_CONFIG:
+            if (((MrvlIEtypes_channel_band_t *)pHeader)->band_config != CHAN_BW_20MHZ << 2 || ((MrvlIEtypes_channel_band_t *)pHeader)->channel != SIM_AP_CHANNEL) return false;
+            break;
+        default: break;
+        }
+    }
+    return u8Index == sizeof(pu16Types) / sizeof(uint16_t) && pu8TLV == pu8End;
+}
+
+static MrvlIEtypesHeader_t *peerFindTLV(uint8_t *pu8TLV, uint8_t *pu8End, uint16_t u16Type) {
+    for (MrvlIEtypesHeader_t *pHeader; pu8TLV + sizeof(MrvlIEtypesHeader_t) <= pu8End; pu8TLV += sizeof(MrvlIEtypesHeader_t) + pHeader->len)
+        if ((pHeader = (MrvlIEtypesHeader_t *)pu8TLV)->type == u16Type) return pHeader;
+    return NULL;
+}
+
+static uint16_t peerBuildUDP(uint8_t *pu8Frame, uint16_t u16PayloadLen) {
+    struct eth_hdr *pehHeader = (struct eth_hdr *)pu8Frame;
+    struct ip_hdr *pihHeader = (struct ip_hdr *)(pu8Frame + SIZEOF_ETH_HDR);
+    struct udp_hdr *puhHeader = (struct udp_hdr *)(pu8Frame + SIZEOF_ETH_HDR + IP_HLEN);
+    memcpy(pehHeader->dest.addr, g_pu8LocalMAC, ETH_HWADDR_LEN);
+    memcpy(pehHeader->src.addr, g_pu8PeerMAC, ETH_HWADDR_LEN);
+    pehHeader->type = PP_HTONS(ETHTYPE_IP);
+    memset(pihHeader, 0, IP_HLEN);
+    IPH_VHL_SET(pihHeader, 4, IP_HLEN / 4);
+    IPH_LEN_SET(pihHeader, lwip_htons(IP_HLEN + UDP_HLEN + u16PayloadLen));
+    IPH_TTL_SET(pihHeader, 64);
+    IPH_PROTO_SET(pihHeader, IP_PROTO_UDP);
+    ip4_addr_t iaPeer, iaLocal;
+    ip4addr_aton(SIM_PEER_IP, &iaPeer);
+    ip4addr_aton(SIM_LOCAL_IP, &iaLocal);
+    memcpy(&pihHeader->src, &iaPeer, sizeof(ip4_addr_t));
+    memcpy(&pihHeader->dest, &iaLocal, sizeof(ip4_addr_t));
+    IPH_CHKSUM_SET(pihHeader, inet_chksum(pihHeader, IP_HLEN));
+    puhHeader->src = puhHeader->dest = PP_HTONS(SIM_UDP_PORT);
+    puhHeader->len = lwip_htons(UDP_HLEN + u16PayloadLen);
+    // Checksum 0 means no UDP checksum.
+    puhHeader->chksum = 0;
+    memcpy(pu8Frame + SIZEOF_ETH_HDR + IP_HLEN + UDP_HLEN, g_pu8Payload, u16PayloadLen);
+    return SIZEOF_ETH_HDR + IP_HLEN + UDP_HLEN + u16PayloadLen;
+}
+
+// EVENT_MICRO_AP_STA_ASSOC with the (re)association request of a station, 2 reserved bytes come before it.
+static void peerStaAssoc(const uint8_t *pu8MAC, bool bReassoc, bool bHT) {
+    uint8_t pu8Event[64] = {0};
+    HOST_DS_MICRO_AP_STA_ASSOC *phdsaAssoc = (HOST_DS_MICRO_AP_STA_ASSOC *)(pu8Event + 2);
+    uint8_t *pu8IE = phdsaAssoc->IEBuffer;
+    memcpy(phdsaAssoc->sta_mac_addr, pu8MAC, ETH_HWADDR_LEN);
+    phdsaAssoc->type = TLV_TYPE_UAP_MGMT_FRAME;
+    if (bReassoc) {
+        phdsaAssoc->frame_control = 0x0020;
+        memcpy(pu8IE, g_pu8LocalMAC, ETH_HWADDR_LEN);
+        pu8IE += ETH_HWADDR_LEN;
+    }
+    // Supported rates, then the HT capabilities of an 11n station.
+    *pu8IE++ = TLV_TYPE_RATES;
+    *pu8IE++ = 1;
+    *pu8IE++ = 0x82;
+    if (bHT) {
+        *pu8IE++ = TLV_TYPE_HT_CAPABILITY;
+        *pu8IE++ = sizeof(IEEEtypes_HTCap_t);
+        pu8IE += sizeof(IEEEtypes_HTCap_t);
+    }
+    phdsaAssoc->len = pu8IE - (uint8_t *)&phdsaAssoc->frame_control;
+    sdio_sim_upload_event(EVENT_MICRO_AP_STA_ASSOC, BSS_TYPE_UAP, pu8Event, pu8IE - pu8Event);
+}
+
+static void peerAddBA(uint8_t u8TID) {
+    HOST_DS_11N_ADDBA_REQ hdarReq = {0};
+    memcpy(hdarReq.peer_mac_addr, g_pu8PeerMAC, ETH_HWADDR_LEN);
+    hdarReq.dialog_token = u8TID + 1;
+    hdarReq.block_ack_param_set = SIM_BA_WINDOW << BLOCK_ACK_WIN_SIZE_POS | u8TID << BLOCK_ACK_TID_POS | BLOCK_ACK_POLICY_IMMEDIATE;
+    hdarReq.ssn = SIM_BA_SSN;
+    sdio_sim_upload_event(EVENT_ADDBA, BSS_TYPE_UAP, (uint8_t *)&hdarReq, sizeof(hdarReq));
+}
+
+// Upload the datagram at an offset from the SSN, a BAR only carries the new window start.
+static void peerUploadBA(uint16_t u16Offset, uint16_t u16PktType) {
+    uint8_t pu8Frame[SIZEOF_ETH_HDR + IP_HLEN + UDP_HLEN + SIM_BA_PAYLOAD];
+    uint16_t u16Len = peerBuildUDP(pu8Frame, SIM_BA_PAYLOAD);
+    int32_t i32Index = u16Offset;
+    memcpy(pu8Frame + SIZEOF_ETH_HDR + IP_HLEN + UDP_HLEN, &i32Index, sizeof(i32Index));
+    sdio_sim_upload_data_ex(pu8Frame, u16PktType == PKT_TYPE_BAR ? SIZEOF_ETH_HDR : u16Len, BSS_TYPE_UAP, u16PktType, SIM_BA_TID, (SIM_BA_SSN + u16Offset) & SEQ_NUM_MASK);
+}
+
+#ifdef WLAN_RX_AMSDU
+// The subframe header replaces the Ethernet header, the EtherType follows the LLC/SNAP header.
+static uint16_t peerBuildSubframe(uint8_t *pu8Subframe, int32_t i32Index, uint16_t u16PayloadLen) {
+    uint8_t pu8Frame[SIZEOF_ETH_HDR + IP_HLEN + UDP_HLEN + SIM_UDP_SIZE];
+    uint16_t u16Len = peerBuildUDP(pu8Frame, u16PayloadLen), u16MSDULen = u16Len - SIZEOF_ETH_HDR + LLC_SNAP_SIZE;
+    memcpy(pu8Frame + SIZEOF_ETH_HDR + IP_HLEN + UDP_HLEN, &i32Index, sizeof(i32Index));
+    memcpy(pu8Subframe, pu8Frame, 2 * ETH_HWADDR_LEN);
+    pu8Subframe[2 * ETH_HWADDR_LEN] = u16MSDULen >> 8;
+    pu8Subframe[2 * ETH_HWADDR_LEN + 1] = u16MSDULen;
+    memcpy(pu8Subframe + AMSDU_SUBFRAME_HDR_SIZE, LLC_SNAP_HDR, LLC_SNAP_SIZE - 2);
+    memcpy(pu8Subframe + AMSDU_SUBFRAME_HDR_SIZE + LLC_SNAP_SIZE - 2, pu8Frame + 2 * ETH_HWADDR_LEN, u16Len - 2 * ETH_HWADDR_LEN);
+    return AMSDU_SUBFRAME_HDR_SIZE + u16MSDULen;
+}
+
+static void peerUploadAMSDU(uint8_t u8Priority, uint16_t u16SeqNum, int32_t i32First, uint8_t u8Subframes, uint16_t u16PayloadLen) {
+    uint8_t pu8AMSDU[RX_BUF_SIZE];
+    uint16_t u16Len = 0;
+    for (uint8_t u8Index = 0; u8Index < u8Subframes; ++u8Index) {
+        // Every subframe but the last is padded to 4 bytes.
+        u16Len = AMSDU_SUBFRAME_ALIGN(u16Len);
+        u16Len += peerBuildSubframe(pu8AMSDU + u16Len, i32First + u8Index, u16PayloadLen);
+    }
+    sdio_sim_upload_data_ex(pu8AMSDU, u16Len, BSS_TYPE_UAP, PKT_TYPE_AMSDU, u8Priority, u16SeqNum);
+}
+#endif
+
+static void timeAdvance(void) {
+    // Replace the SysTick interrupt with the host monotonic clock.
+    extern void SysTick_Handler(void);
+    static double dLast = 0;
+    double dNow = timeNow();
+    if (!dLast) dLast = dNow;
+    for (; dNow - dLast >= 0.001; dLast += 0.001) SysTick_Handler();
+}
+
+static void simFail(void) {
+    g_bFailed = true;
+    g_ssState = SIM_STATE_DONE;
+}
+
+static double timeNow(void) {
+    struct timespec tsNow;
+    clock_gettime(CLOCK_MONOTONIC, &tsNow);
+    return tsNow.tv_sec + tsNow.tv_nsec / 1e9;
+}
+
+static void simReport(const char *pcName, uint32_t u32Frames, double dSeconds) {
+    sdio_sim_stats_t sssStats;
+    sdio_sim_get_stats(&sssStats);
+    double dBusSeconds = sssStats.bus_clocks / SIM_BUS_CLOCK;
+    printf("%s: %u datagrams in %.3f s host time (%.1f us/datagram)\n", pcName, u32Frames, dSeconds, dSeconds * 1e6 / u32Frames);
+    printf("%s: %u CMD52, %u CMD53, %u blocks, %llu bytes, %u interrupts, %u transfer interrupts\n", pcName, sssStats.cmd52_count, sssStats.cmd53_count, sssStats.block_count, (unsigned long long)sssStats.byte_count, sssStats.int_count, sssStats.transfer_int_count);
+    printf("%s: %.3f s estimated bus time, %.2f Mbps bus-limited goodput\n", pcName, dBusSeconds, dBusSeconds ? u32Frames * SIM_UDP_SIZE * 8 / dBusSeconds / 1e6 : 0);
+    sdio_stats_t ssStats;
+    sdio_get_stats(&ssStats);
+    printf("%s: %u of %u CMD53 in byte mode, %u padding bytes saved\n", pcName, ssStats.byte_mode_count, ssStats.cmd53_count, ssStats.saved_bytes);
+    wlan_stats_t wsStats;
+    wlan_get_stats(&wsStats);
+    if (wsStats.rx_transfer_count) {
+        printf("%s: %u port reads, %u packets, %.2f packets/read, histogram", pcName, wsStats.rx_transfer_count, wsStats.rx_packet_count, (double)wsStats.rx_packet_count / wsStats.rx_transfer_count);
+        for (uint8_t u8Index = 0; u8Index < MP_RX_AGGR_PKT_LIMIT; ++u8Index) printf(" %u", wsStats.rx_aggr_hist[u8Index]);
+        printf("\n");
+    }
+    if (wsStats.tx_transfer_count) {
+        printf("%s: %u port writes, %u packets, %.2f packets/write, histogram", pcName, wsStats.tx_transfer_count, wsStats.tx_packet_count, (double)wsStats.tx_packet_count / wsStats.tx_transfer_count);
+        for (uint8_t u8Index = 0; u8Index < MP_TX_AGGR_PKT_LIMIT; ++u8Index) printf(" %u", wsStats.tx_aggr_hist[u8Index]);
+        printf("\n");
+        printf("%s: %u write bitmap polls, %u packets sent in place\n", pcName, wsStats.tx_bitmap_poll_count, wsStats.tx_ref_count);
+    }
+    if (wsStats.rx_ref_count || wsStats.rx_copy_count) printf("%s: %u frames passed to lwIP in place, %u copied, up to %u of %u rx buffers lent\n", pcName, wsStats.rx_ref_count, wsStats.rx_copy_count, wsStats.rx_lent_max, RX_BUF_NUM);
+}
+
+#ifdef USE_FLASH_FIRMWARE
+static bool flashLoadImage(const char *pcPath) {
+    static uint8_t pu8Image[0x80000];
+    FILE *pfImage = fopen(pcPath, "rb");
+    if (!pfImage) return false;
+    size_t stLength = fread(pu8Image, 1, sizeof(pu8Image), pfImage);
+    fclose(pfImage);
+    flashSlotInfo fsiSlot = {0};
+    fsiSlot.u32Length = stLength;
+    fsiSlot.u32Version = 1;
+    fsiSlot.u32CRC = flashCRC32(0, pu8Image, stLength);
+    fsiSlot.bCompressed = !memcmp(pu8Image, FW_Z_MAGIC, sizeof(FW_Z_MAGIC) - 1);
+    // The first half in whole sectors, then the power is lost partway through the sector after it.
+    const flashSlotInfo fsiImage = fsiSlot;
+    const uint32_t u32Cut = stLength / 2 / FLASH_SECTOR_SIZE * FLASH_SECTOR_SIZE;
+    uint32_t u32Offset = flashSlotBegin(&fsiSlot);
+    if (u32Offset || !u32Cut || !flashSlotWrite(&fsiSlot, 0, pu8Image, u32Cut)) return false;
+    flashSimCutPower(SIM_SLOT_CUT_STEPS, false);
+    flashSlotWrite(&fsiSlot, u32Cut, pu8Image + u32Cut, stLength - u32Cut);
+    const bool bCut = flashSimPowerLost();
+    flashSimCutPower(0, false);
+    // Resumed from the first sector not recorded as written.
+    fsiSlot = fsiImage;
+    if (!bCut || (u32Offset = flashSlotBegin(&fsiSlot)) != u32Cut) {
+        printf(MSG_ERROR_FORMAT, "FLASH", u32Offset, "resume the image write");
+        return false;
+    }
+    if (!flashSlotWrite(&fsiSlot, u32Offset, pu8Image + u32Offset, stLength - u32Offset) || !flashSlotFinish(&fsiSlot) || !flashSlotSelect(&fsiSlot) || fsiSlot.u32CRC != fsiImage.u32CRC) return false;
+    flashSimStats fssStats;
+    flashSimGetStats(&fssStats);
+    printf("Flash: %zu bytes from %s written to slot %c, resumed at %u after a power cut, %u sectors erased, %u pages programmed\n", stLength, pcPath, 'A' + fsiSlot.u8Slot, u32Offset, fssStats.u32SectorErases, fssStats.u32PagePrograms);
+    // Reprovision into the other slot, then into this one again, where every image sector already matches.
+    for (uint32_t u32Version = 2; u32Version <= 3; ++u32Version) {
+        flashSimResetStats();
+        fsiSlot = fsiImage;
+        fsiSlot.u32Version = u32Version;
+        if (flashSlotBegin(&fsiSlot) || !flashSlotWrite(&fsiSlot, 0, pu8Image, stLength) || !flashSlotFinish(&fsiSlot)) return false;
+    }
+    flashSimGetStats(&fssStats);
+    printf("Flash: rewritten to slot %c, %u sectors erased, %u pages programmed\n", 'A' + fsiSlot.u8Slot, fssStats.u32SectorErases, fssStats.u32PagePrograms);
+    // Header sector, header, progress and state only.
+    return fssStats.u32SectorErases == 1 && fssStats.u32PagePrograms <= 3;
+}
+#endif
+
+#ifdef WLAN_KV_STORE
+// Update the BSS and PMK as reconnects would, then check that a restart (kvInit) finds the last values.
+static bool kvExercise(void) {
+    uint8_t pu8BSS[sizeof(wlan_bss_record_t)] = {0}, pu8PMK[32], pu8Check[sizeof(pu8BSS)];
+    flashSimResetStats();
+    if (!kvInit()) return false;
+    for (uint32_t u32Index = 0; u32Index < SIM_KV_UPDATES; ++u32Index) {
+        memcpy(pu8BSS, &u32Index, sizeof(u32Index));
+        memset(pu8PMK, (uint8_t)u32Index, sizeof(pu8PMK));
+        if (!kvSet(KV_KEY_STA_BSS, pu8BSS, sizeof(pu8BSS)) || !kvSet(KV_KEY_STA_PMK, pu8PMK, sizeof(pu8PMK))) return false;
+    }
+    if (!kvInit() || kvGet(KV_KEY_STA_BSS, pu8Check, sizeof(pu8Check)) != sizeof(pu8BSS) || memcmp(pu8Check, pu8BSS, sizeof(pu8BSS)) || kvGet(KV_KEY_STA_PMK, pu8Check, sizeof(pu8Check)) != sizeof(pu8PMK) || memcmp(pu8Check, pu8PMK, sizeof(pu8PMK))) return false;
+    flashSimStats fssStats;
+    flashSimGetStats(&fssStats);
+    printf("KV: %d updates, %u sectors erased over %d sectors, %u pages programmed, %.1f ms busy\n", SIM_KV_UPDATES * 2, fssStats.u32SectorErases, KV_SECTOR_NUM, fssStats.u32PagePrograms, fssStats.u64BusyTime / 1000.0);
+    return kvPowerCuts();
+}
+
+// Cut the power during the updates at a different point each time, after kvInit every key has to hold its old or its new value.
+static bool kvPowerCuts(void) {
+    static const uint8_t pu8Keys[] = {KV_KEY_STA_BSS, KV_KEY_STA_PMK};
+    uint8_t pu8Old[sizeof(pu8Keys)][KV_VALUE_MAX], pu8New[KV_VALUE_MAX], u8Index = 0;
+    uint16_t pu16Old[sizeof(pu8Keys)], u16New = 0;
+    uint32_t u32Update = SIM_KV_UPDATES, u32Seed = 1;
+    bool bDone;
+    // Never updated here, it is only ever copied by garbage collection.
+    if (!kvSet(KV_KEY_STA_SSID, SIM_STA_SSID, sizeof(SIM_STA_SSID) - 1)) return false;
+    for (uint8_t u8Key = 0; u8Key < sizeof(pu8Keys); ++u8Key) pu16Old[u8Key] = kvGet(pu8Keys[u8Key], pu8Old[u8Key], KV_VALUE_MAX);
+    flashSimResetStats();
+    for (uint32_t u32Cut = 0; u32Cut < SIM_KV_POWER_CUTS; ++u32Cut) {
+        // The same cut points on every run.
+        u32Seed = u32Seed * 1103515245 + 12345;
+        if (u32Cut & 1) flashSimCutPower(1 + (u32Seed >> 16) % SIM_KV_ERASE_RANGE, true);
+        else flashSimCutPower(1 + (u32Seed >> 16) % SIM_KV_CUT_RANGE, false);
+        for (;; ++u32Update) {
+            u8Index = u32Update & 1;
+            if (pu8Keys[u8Index] == KV_KEY_STA_BSS) {
+                memset(pu8New, 0, sizeof(wlan_bss_record_t));
+                memcpy(pu8New, &u32Update, sizeof(u32Update));
+                u16New = sizeof(wlan_bss_record_t);
+            } else if (u32Update / 2 % SIM_KV_DELETE_EVERY) {
+                memset(pu8New, (uint8_t)u32Update, PMK_LENGTH);
+                u16New = PMK_LENGTH;
+            } else u16New = KV_NOT_FOUND;
+            bDone = u16New == KV_NOT_FOUND ? kvDelete(pu8Keys[u8Index]) : kvSet(pu8Keys[u8Index], pu8New, u16New);
+            if (flashSimPowerLost()) break;
+            if (!bDone) return false;
+            memcpy(pu8Old[u8Index], pu8New, u16New == KV_NOT_FOUND ? 0 : u16New);
+            pu16Old[u8Index] = u16New;
+        }
+        ++u32Update;
+        flashSimCutPower(0, false);
+        if (!kvInit()) return false;
+        bDone = kvHolds(KV_KEY_STA_SSID, (const uint8_t *)SIM_STA_SSID, sizeof(SIM_STA_SSID) - 1);
+        for (uint8_t u8Key = 0; bDone && u8Key < sizeof(pu8Keys); ++u8Key) {
+            if (kvHolds(pu8Keys[u8Key], pu8Old[u8Key], pu16Old[u8Key])) continue;
+            // Only the update that lost the power may have been committed.
+            if (u8Key != u8Index || !kvHolds(pu8Keys[u8Key], pu8New, u16New)) bDone = false;
+            else {
+                memcpy(pu8Old[u8Key], pu8New, u16New == KV_NOT_FOUND ? 0 : u16New);
+                pu16Old[u8Key] = u16New;
+            }
+        }
+        if (!bDone) {
+            printf(MSG_ERROR_FORMAT, "FLASH", u32Cut, "keep the old or the new value after a power cut");
+            return false;
+        }
+    }
+    flashSimStats fssStats;
+    flashSimGetStats(&fssStats);
+    printf("KV: %u power cuts (%u during an erase) over %u updates, %u sectors erased, every key kept its old or its new value\n", fssStats.u32PowerCuts, fssStats.u32ErasesCut, u32Update - SIM_KV_UPDATES, fssStats.u32SectorErases);
+    return fssStats.u32PowerCuts == SIM_KV_POWER_CUTS && fssStats.u32ErasesCut;
+}
+
+// Whether the key holds the value, KV_NOT_FOUND for a deleted key.
+static bool kvHolds(uint8_t u8Key, const uint8_t *pu8Value, uint16_t u16Length) {
+    uint8_t pu8Check[KV_VALUE_MAX];
+    uint16_t u16Check = kvGet(u8Key, pu8Check, sizeof(pu8Check));
+    return u16Check == u16Length && (u16Length == KV_NOT_FOUND || !memcmp(pu8Check, pu8Value, u16Length));
+}
+#endif
+
+#ifdef WLAN_HOST_PMK
+// Check the PBKDF2 test vector of IEEE 802.11 (SSID "IEEE", passphrase "password") and time the derivation.
+static bool pmkBenchmark(void) {
+    static const uint8_t pu8Expect[PMK_LENGTH] = {0xF4, 0x2C, 0x6F, 0xC5, 0x2D, 0xF0, 0xEB, 0xEF, 0x9E, 0xBB, 0x4B, 0x90, 0xB3, 0x8A, 0x5F, 0x90,
+                                                  0x2E, 0x83, 0xFE, 0x1B, 0x13, 0x5A, 0x70, 0xE2, 0x3A, 0xED, 0x76, 0x2E, 0x97, 0x10, 0xA1, 0x2E};
+    uint8_t pu8PMK[PMK_LENGTH];
+    double dStart = timeNow();
+    for (uint32_t u32Index = 0; u32Index < SIM_PMK_ROUNDS; ++u32Index) {
+        pbkdf2_sha1((const uint8_t *)"password", 8, (const uint8_t *)"IEEE", 4, PMK_ITERATIONS, pu8PMK, PMK_LENGTH);
+        if (memcmp(pu8PMK, pu8Expect, PMK_LENGTH)) return false;
+    }
+    printf("PMK: %d derivations, %.3f ms/PMK host time (%d HMAC-SHA1 each)\n", SIM_PMK_ROUNDS, (timeNow() - dStart) * 1000 / SIM_PMK_ROUNDS, PMK_ITERATIONS * 2);
+    return true;
+}
+#endif
@@ -9,6 +9,9 @@
 #if defined(WRITE_FIRMWARE_TO_FLASH) || defined(USE_FLASH_FIRMWARE)
 #include "88w8801/flash/88w8801_program.h"
 #endif
+#ifdef WLAN_KV_STORE
+#include "88w8801/flash/88w8801_kv.h"
+#endif
 #include "ov2640/ov2640.h"
 #include "st7735s/st7735s.h"
 
@@ -38,6 +41,7 @@
 #define CAM_BUF_SIZE (CAM_IMAGE_W * CAM_IMAGE_H * 2)
 
 static void SystemClock_Config(void);
+static uint8_t wlanConnect(void);
 static void wlanInitCallback(core_err_e ceStatus);
 static void wlanSTAConnectCallback(core_err_e ceStatus);
 static void wlanSTADisconnectCallback(void);
@@ -48,6 +52,10 @@ static core_err_e g_ceStatus = CORE_ERR_UNHANDLED_STATUS;
 static wlan_cb_t g_wlanCallback = {wlanInitCallback, NULL, wlanSTAConnectCallback, wlanSTADisconnectCallback, NULL, NULL, NULL, NULL};
 static struct udp_pcb *g_pupSession = NULL;
 static uint8_t g_pu8FrameBuffer[CAM_BUF_SIZE];
+#ifdef WLAN_KV_STORE
+// Toggled by each failed connection, so that retries alternate between the saved AP and WLAN_AP_SSID.
+static bool g_bSavedAP = true;
+#endif
 
 int main(void) {
     HAL_Init();
@@ -103,21 +111,37 @@ static void SystemClock_Config(void) {
     if (HAL_InitTick(TICK_INT_PRIORITY) != HAL_OK) Error_Handler();
 }
 
+// The AP saved by the last connection is used if there is one, otherwise (or after it failed) WLAN_AP_SSID.
+static uint8_t wlanConnect(void) {
+    uint8_t pu8SSID[MAX_SSID_LENGTH] = WLAN_AP_SSID, pu8Password[MAX_PHRASE_LENGTH] = WLAN_AP_PWD, u8SSIDLength = sizeof(WLAN_AP_SSID) - 1, u8PasswordLength = sizeof(WLAN_AP_PWD) - 1;
+#ifdef WLAN_KV_STORE
+    uint16_t u16Length = g_bSavedAP ? kvGet(KV_KEY_STA_SSID, pu8SSID, sizeof(pu8SSID)) : KV_NOT_FOUND;
+    if (u16Length && u16Length <= sizeof(pu8SSID)) {
+        u8SSIDLength = u16Length;
+        u8PasswordLength = (u16Length = kvGet(KV_KEY_STA_PASSPHRASE, pu8Password, sizeof(pu8Password))) <= sizeof(pu8Password) ? u16Length : 0;
+    }
+#endif
+    MAIN_DEBUG("Connecting to '%.*s'...\n", u8SSIDLength, pu8SSID);
+    return wlan_sta_connect(pu8SSID, u8SSIDLength, pu8Password, u8PasswordLength);
+}
+
 static void wlanInitCallback(core_err_e ceStatus) {
     // Used for wlan_shutdown().
     if ((g_ceStatus = ceStatus)) return;
 #ifdef CAM_DEBUG
     dcmiCaptureFrame(&hdcmi);
 #else
-    MAIN_DEBUG("Connecting to '%s'...\n", WLAN_AP_SSID);
-    if ((ceStatus = wlan_sta_connect((uint8_t *)WLAN_AP_SSID, sizeof(WLAN_AP_SSID) - 1, (uint8_t *)WLAN_AP_PWD, sizeof(WLAN_AP_PWD) - 1))) MAIN_DEBUG(MSG_ERROR_FORMAT, "CORE", ceStatus, "connect");
+    if ((ceStatus = wlanConnect())) MAIN_DEBUG(MSG_ERROR_FORMAT, "CORE", ceStatus, "connect");
 #endif
 }
 
 static void wlanSTAConnectCallback(core_err_e ceStatus) {
     if (ceStatus) {
         MAIN_DEBUG(MSG_ERROR_FORMAT, "CORE", ceStatus, "connect, retrying...");
-        if ((ceStatus = wlan_sta_connect((uint8_t *)WLAN_AP_SSID, sizeof(WLAN_AP_SSID) - 1, (uint8_t *)WLAN_AP_PWD, sizeof(WLAN_AP_PWD) - 1))) MAIN_DEBUG(MSG_ERROR_FORMAT, "CORE", ceStatus, "connect");
+#ifdef WLAN_KV_STORE
+        g_bSavedAP = !g_bSavedAP;
+#endif
+        if ((ceStatus = wlanConnect())) MAIN_DEBUG(MSG_ERROR_FORMAT, "CORE", ceStatus, "connect");
         return;
     }
     MAIN_DEBUG("Creating udp_pcb...\n");
@@ -141,8 +165,7 @@ static void wlanSTAConnectCallback(core_err_e ceStatus) {
 }
 
 static void wlanSTADisconnectCallback(void) {
-    MAIN_DEBUG("Reconnecting to '%s'...\n", WLAN_AP_SSID);
-    const uint8_t u8Err = wlan_sta_connect((uint8_t *)WLAN_AP_SSID, sizeof(WLAN_AP_SSID) - 1, (uint8_t *)WLAN_AP_PWD, sizeof(WLAN_AP_PWD) - 1);
+    const uint8_t u8Err = wlanConnect();
     if (u8Err) MAIN_DEBUG(MSG_ERROR_FORMAT, "CORE", u8Err, "reconnect");
 }
 
@@ -160,12 +183,19 @@ static void moduleInit(void) {
     lcdInit(&lcdsInit);
     MAIN_DEBUG("Initializing...\n");
 #endif
-#if defined(WRITE_FIRMWARE_TO_FLASH) || defined(USE_FLASH_FIRMWARE)
+#if defined(WRITE_FIRMWARE_TO_FLASH) || defined(USE_FLASH_FIRMWARE) || defined(WLAN_KV_STORE)
     flashSettings flashsInit;
     flashsInit.SPIx = SPI1;
     flashsInit.CS_GPIO_Port = FLASH_CS_GPIO_Port;
     flashsInit.CS_Pin = FLASH_CS_Pin;
+#if defined(WRITE_FIRMWARE_TO_FLASH) || defined(USE_FLASH_FIRMWARE)
     flashInitFirmware(&flashsInit);
+#else
+    flashInit(&flashsInit);
+#endif
+#ifdef WLAN_KV_STORE
+    if (!kvInit()) MAIN_DEBUG(MSG_ERROR_FORMAT, "FLASH", 0, "init KV store");
+#endif
 #endif
     camSettings camsInit;
     camsInit.SCL_GPIO_Port = SCCB_SCL_GPIO_Port;
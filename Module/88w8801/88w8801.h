@@ -36,8 +36,127 @@ typedef unsigned char uint8_t;
 #undef USE_FLASH_FIRMWARE
 #endif
 
-// Flash 固件地址
-#define FLASH_FIRMWARE_ADDRESS 0x000000
+// 热启动：初始化时先不使用 PDN 重置芯片，MCU 单独复位后芯片固件仍在运行时跳过固件下载，只重新初始化固件
+// 固件未运行、端口同步或初始化命令失败（超时）时使用 PDN 重置芯片并下载固件
+// 需在 CubeMX 中将 PDN 引脚的初始电平设为高，否则 MCU 复位时芯片仍会被重置（此时照常下载固件）
+// #define WLAN_WARM_BOOT
+
+// 使用压缩固件（由 Utility/fw_pack.py 生成 core/88w8801_firmware_z.c 或写入 Flash 的二进制文件），下载时逐块解压缩
+// 固件约减少 26%，解压缩窗口使用下载期间空闲的接收缓冲区
+#define WLAN_FW_COMPRESSED
+
+// Flash 固件槽（A/B）：槽 A 位于 FLASH_FIRMWARE_ADDRESS，槽 B 紧随其后，每个槽首扇区为头部（长度、版本、CRC32、压缩标志），
+// 其后为固件，槽大小需为扇区（4KB）的整数倍且不小于固件 + 4KB；启动时使用版本最高的有效槽，写入固件时写入另一个槽，中断后可继续写入
+#define FLASH_FIRMWARE_ADDRESS   0x000000
+#define FLASH_FIRMWARE_SLOT_SIZE 0x40000
+
+// Flash 键值存储（88w8801_kv.c）：从 KV_STORE_ADDRESS 起 KV_SECTOR_NUM 个扇区循环写入日志，每次更新追加一条记录，各扇区轮流擦除，
+// 内存索引保存各键最新记录的地址，掉电时未提交的记录在启动时丢弃；保存 STA 的 AP 名称、密码、上次连接的 BSS 及 DHCP 服务器租约，
+// 启动时先搜索上次连接的信道；KV_KEY_NUM 为键个数（含应用使用的键），KV_VALUE_MAX 为值的最大长度
+// #define WLAN_KV_STORE
+#define KV_STORE_ADDRESS 0x080000
+#define KV_SECTOR_NUM    4
+#define KV_KEY_NUM       8
+#define KV_VALUE_MAX     0x80
+
+// 主机计算 WPA/WPA2 的 PMK（PBKDF2-SHA1，4096 次迭代，在芯片搜索期间由 wrapper_proc 分段计算）并按（SSID，密码）缓存，
+// 连接时向芯片发送 PMK 而非密码，PMK 未算完时推迟关联；重新连接时无需再次计算；启用 WLAN_KV_STORE 时连接成功后同时保存到 Flash，重启后仍可使用
+#define WLAN_HOST_PMK
+// PMK 缓存个数
+#define WLAN_PMK_CACHE_NUM 2
+// 每次 wrapper_proc 至多计算的 PBKDF2 迭代次数（每次迭代压缩两次），决定计算 PMK 时主循环的最长停顿
+#define WLAN_PMK_SLICE 64
+
+// BSS 缓存：每次搜索结果按 BSSID 记录（信道、RSSI、能力、RSN/WPA IE、更新时间），已满时替换最早更新的项；
+// 连接时缓存中有同名且不超过 WLAN_BSS_CACHE_AGE（ms）的 AP 则直接关联（失败时删除该项并搜索其信道），
+// 不超过 WLAN_BSS_CACHE_EXPIRE（ms）则只在其信道上搜索 WLAN_BSS_PROBE_TIME（ms），未搜索到时再搜索全部信道
+#define WLAN_BSS_CACHE_NUM    8
+#define WLAN_BSS_CACHE_AGE    60000
+#define WLAN_BSS_CACHE_EXPIRE 600000
+#define WLAN_BSS_PROBE_TIME   50
+// 每个 AP 缓存的 RSN/WPA/WMM IE 总长度
+#define WLAN_BSS_IE_SIZE 0x80
+// BSS 评分（wlan_set_bss_score 可替换）：信号强度每 dB 得 WLAN_BSS_SCORE_RSSI 分，认证类型每级（OPEN、WEP、WPA、WPA2）
+// 得 WLAN_BSS_SCORE_SECURITY 分，同一信道上每个其他 AP 扣 WLAN_BSS_SCORE_LOAD 分；连接时选择得分最高的同名 AP
+#define WLAN_BSS_SCORE_RSSI     1
+#define WLAN_BSS_SCORE_SECURITY 2
+#define WLAN_BSS_SCORE_LOAD     3
+// 关联或握手失败的 BSSID 在 WLAN_BSS_BLACKLIST_TIME（ms）内扣 WLAN_BSS_SCORE_BLACKLIST 分（仍可在没有其他 AP 时使用）
+#define WLAN_BSS_BLACKLIST_NUM   4
+#define WLAN_BSS_BLACKLIST_TIME  60000
+#define WLAN_BSS_SCORE_BLACKLIST 100
+// STA 802.11n：AP 支持 HT 及 WMM（加密时成对密钥需含 CCMP，WEP/TKIP 不能使用 HT）时在关联请求中声明 HT 能力（20MHz、短 GI、
+// 1 个空间流 MCS 0~7）并转发 WMM IE，关联响应中有 HT 能力 IE 则以 11n 连接，wlan_get_phy_mode 获取协商的模式；
+// uAP 默认以 802.11n 启动（wlan_ap_start_ex 可关闭或请求 40MHz，芯片支持 40MHz 且指定了信道时才使用）
+#define WLAN_11N
+// A-MPDU 接收重排序：接受 ADDBA 时为每个（发送方，TID）建立重排序表（至多 WLAN_RX_REORDER_NUM 个，已满时拒绝），窗口限制为
+// WLAN_RX_REORDER_WIN（2 的幂），乱序到达的帧引用所在的接收缓冲区等待（缓冲区不足时不再等待），缺失的帧超过
+// WLAN_RX_REORDER_TIMEOUT（ms）仍未到达时交付已缓存的帧，对方发送 DELBA 时交付已缓存的帧并删除重排序表
+#define WLAN_RX_REORDER_NUM     2
+#define WLAN_RX_REORDER_WIN     16
+#define WLAN_RX_REORDER_TIMEOUT 50
+// TX BA 会话（A-MPDU 发送，需启用 WLAN_11N）：TID 取 IPv4 TOS 的高 3 位，按（接收方，TID）统计发往 11n AP 或（11n uAP 下）某一 STA 的
+// 单播帧（至多 WLAN_TX_BA_NUM 组），WLAN_TX_BA_PERIOD（ms）内不少于 WLAN_TX_BA_THRESHOLD 帧时发送 ADDBA 请求（窗口 WLAN_TX_BA_WIN），
+// 空闲超过 WLAN_TX_BA_IDLE（ms）时发送 DELBA，对方拒绝或未响应时 WLAN_TX_BA_RETRY（ms）内不再请求，
+// ADDBA 命令发送失败、超时或固件返回错误时会话回到统计状态；wlan_get_tx_ba 获取各会话的计数
+#define WLAN_TX_BA_NUM       4
+#define WLAN_TX_BA_THRESHOLD 32
+#define WLAN_TX_BA_PERIOD    100
+#define WLAN_TX_BA_WIN       32
+#define WLAN_TX_BA_IDLE      5000
+#define WLAN_TX_BA_RETRY     30000
+// 接收 A-MSDU（需启用 WLAN_11N）：子帧在接收缓冲区中原地转换为以太网帧后逐个交付，单个封包最大 4 KB（RX_BUF_SIZE），
+// 对方在 ADDBA 中请求时允许 A-MPDU 中的 A-MSDU；禁用时封包最大 2 KB，A-MSDU 被丢弃且不允许 A-MPDU 中的 A-MSDU
+#define WLAN_RX_AMSDU
+
+// Flash 快速读取（0x0B）使用的 SPI DMA 流（需与 SPI 对应，SPI1 为 DMA2 Stream0/2 RX、Stream3/5 TX，通道 3；SDIO 已占用 DMA2 Stream3）
+#define FLASH_DMA            DMA2
+#define FLASH_DMA_RX_STREAM  LL_DMA_STREAM_0
+#define FLASH_DMA_TX_STREAM  LL_DMA_STREAM_5
+#define FLASH_DMA_CHANNEL    LL_DMA_CHANNEL_3
+#define FLASH_DMA_IRQn       DMA2_Stream0_IRQn
+#define FLASH_DMA_IRQHandler DMA2_Stream0_IRQHandler
+// Flash DMA 中断抢占优先级
+#define FLASH_IRQ_PRIORITY 3
+// 读取长度不小于该值时使用 DMA，否则逐字节读取
+#define FLASH_DMA_THRESHOLD 16
+
+// SDIO 中断抢占优先级（数据传输完成及卡中断，需与 CubeMX 中的优先级分组一致）
+#define SDIO_IRQ_PRIORITY 2
+
+// CMD53 异步传输队列深度
+#define SDIO_QUEUE_SIZE 4
+
+// SDIO 多端口接收聚合：单次 CMD53 最多读取的端口数（1-8，1 为关闭）及聚合缓冲区大小
+#define MP_RX_AGGR_PKT_LIMIT 8
+#define MP_RX_AGGR_BUF_SIZE  0x2000
+
+// 接收缓冲区个数（每个 MP_RX_AGGR_BUF_SIZE 字节，至少 2 个），2 个轮流用于读取/解析，其余可借给 lwIP 以零拷贝方式引用封包
+#define RX_BUF_NUM 4
+
+// 每次调用 wlan_process_packet/wlan_process_rx 最多解析的封包数，其余留到下次调用，避免连续接收时阻塞发送及定时器
+#define WLAN_RX_BUDGET 8
+
+// 命令队列深度及命令超时时间（ms，需大于全信道搜索时间）
+#define WLAN_CMD_QUEUE_SIZE 4
+#define WLAN_CMD_TIMEOUT    5000
+
+// SDIO 多端口发送聚合：单次 CMD53 最多写入的封包数（1-8，1 为关闭）、聚合缓冲区大小及最长等待时间（ms）
+#define MP_TX_AGGR_PKT_LIMIT 8
+#define MP_TX_AGGR_BUF_SIZE  0x2000
+#define MP_TX_AGGR_TIMEOUT   1
+
+// 零拷贝发送：发送队列为空且总线空闲时，单个 pbuf 的帧在 lwIP 预留的头部空间中填写 TxPD 后直接由 DMA 发送（每帧一次 CMD53），
+// 连续发送时及链式 pbuf（如 wrapper_udp_send 的 PBUF_ROM 数据）仍复制到发送队列以多端口聚合，0 为全部复制
+#define WLAN_TX_ZERO_COPY 1
+
+// 固件启动后 Func1 的 CMD53 字节模式策略（sdio_byte_mode_e）：
+// SDIO_BYTE_MODE_SHORT 不足一个分块的传输使用字节模式
+// SDIO_BYTE_MODE_TAIL 另外将端口数据的尾部拆分为一次字节模式 CMD53（需固件支持同一端口分两次传输）
+#define WLAN_SDIO_BYTE_MODE SDIO_BYTE_MODE_SHORT
+
+// 主机仿真（使用 sdio/88w8801_sdio_sim.c 中的虚拟 SDIO 卡代替 STM32 SDIO，可在 Linux 下编译运行）
+// #define WLAN_SIMULATION
 
 // 调试标志
 // #define WLAN_DEBUG
@@ -2,8 +2,19 @@
 #include "88w8801_core.h"
 #include "88w8801/sdio/88w8801_sdio.h"
 #include "netif/ethernetif.h"
+#include "lwip/sys.h"
+#include "systime/systime.h"
+#ifdef WLAN_FW_COMPRESSED
+#include "88w8801_inflate.h"
+#endif
 #ifdef USE_FLASH_FIRMWARE
-#include "88w8801/flash/88w8801_flash.h"
+#include "88w8801/flash/88w8801_slot.h"
+#endif
+#ifdef WLAN_KV_STORE
+#include "88w8801/flash/88w8801_kv.h"
+#if defined(WLAN_HOST_PMK) && KV_VALUE_MAX < 85
+#error "KV_VALUE_MAX is too small for wlan_pmk_entry_t"
+#endif
 #endif
 
 #ifdef WLAN_CORE_DEBUG
@@ -15,23 +26,104 @@
     } while (0)
 #endif
 
-uint8_t wlan_tx_buf[TX_BUF_SIZE];
-static uint8_t wlan_rx_buf[RX_BUF_SIZE];
+static wlan_cmd_t wlan_cmd_queue[WLAN_CMD_QUEUE_SIZE];
+static uint8_t wlan_tx_buf[TX_BUF_NUM][MP_TX_AGGR_BUF_SIZE];
+static uint8_t wlan_rx_buf[RX_BUF_NUM][MP_RX_AGGR_BUF_SIZE];
+static mp_rx_aggr_t wlan_rx_aggr[RX_BUF_NUM];
 static uint8_t mp_regs_buf[SDIO_BLOCK_SIZE];
 static wlan_cb_t *wlan_callback = NULL;
 static wlan_core_t wlan_core;
+#ifdef WLAN_FW_COMPRESSED
+/* 固件解压缩状态 */
+static inflate_t wlan_inflate;
+#ifndef USE_FLASH_FIRMWARE
+/* 在88w8801_firmware_z.c中定义 */
+extern const uint8_t fw_mrvl88w8801_z[];
+extern const uint32_t fw_mrvl88w8801_z_size;
+#endif
+#else
 /* 在88w8801_firmware.c中定义 */
 extern const uint8_t fw_mrvl88w8801[0x3E630];
+#endif
+#ifdef USE_FLASH_FIRMWARE
+/* 固件在Flash中的地址（所选槽） */
+static uint32_t wlan_fw_addr;
+#endif
 
+static uint8_t wlan_scan_ssid_channel(uint8_t *ssid, uint8_t ssid_len, uint8_t channel, uint16_t max_time);
 static uint8_t wlan_ass_supplicant_pmk_pkg(uint8_t *bssid);
+static uint8_t wlan_associate(wlan_bss_entry_t *bss);
+static wlan_bss_entry_t *wlan_update_bss(bss_desc_set_t *bss_desc_set, uint8_t *ssid);
+#ifdef WLAN_11N
+static uint8_t wlan_ht_cap_tlv(uint8_t *buf, uint16_t ht_cap_info);
+static void wlan_count_tx_ba(TxPD *tx_packet);
+static wlan_tx_ba_t *wlan_find_tx_ba(uint8_t bss_type, uint8_t *ra, uint8_t tid);
+static void wlan_set_tx_ba(wlan_tx_ba_t *session, wlan_tx_ba_state state);
+static void wlan_tx_ba_complete(uint8_t err, uint8_t *resp, void *arg);
+#endif
+static bool wlan_pairwise_ccmp(const uint8_t *suite, uint8_t len, const uint8_t *oui);
+static wlan_phy_mode wlan_ret_phy_mode(IEEEtypes_AssocRsp_t *assoc_rsp, uint16_t rsp_size);
+static wlan_bss_entry_t *wlan_find_bss(uint8_t *ssid, uint8_t ssid_len);
+static void wlan_drop_bss(uint8_t *bssid);
+static int32_t wlan_score_bss(const wlan_bss_entry_t *bss, bool *blacklisted);
+static bool wlan_bss_blacklisted(const uint8_t *bssid);
+static void wlan_blacklist_bss(uint8_t *bssid, bool failed);
+#ifdef WLAN_HOST_PMK
+static void wlan_get_pmk(void);
+static bool wlan_parse_pmk(void);
+static wlan_pmk_entry_t *wlan_find_pmk(uint8_t *pwd_hash);
+#endif
+#ifdef WLAN_KV_STORE
+static void wlan_save_sta(void);
+#endif
 static uint8_t wlan_ret_scan(uint8_t *rx_buf);
 static uint8_t wlan_process_data(uint8_t *rx_buf);
+static uint8_t wlan_deliver_data(uint8_t *rx_buf);
+#ifdef WLAN_RX_AMSDU
+static uint8_t wlan_deliver_amsdu(uint8_t *rx_buf);
+#endif
+static wlan_rx_reorder_t *wlan_find_rx_reorder(uint8_t bss_type, uint8_t *ta, uint8_t tid);
+static uint8_t wlan_add_rx_reorder(uint8_t *rx_buf);
+static void wlan_del_rx_reorder(wlan_rx_reorder_t *table);
+static void wlan_clear_ba(uint8_t bss_type, uint8_t *ra);
+static uint8_t wlan_rx_reorder(wlan_rx_reorder_t *table, uint8_t *rx_buf);
+static uint8_t wlan_flush_rx_reorder(wlan_rx_reorder_t *table, uint16_t start_win);
+static uint8_t wlan_drain_rx_reorder(wlan_rx_reorder_t *table);
 static uint8_t wlan_process_cmdrsp(uint8_t *rx_buf);
 static uint8_t wlan_process_event(uint8_t *rx_buf);
 static uint8_t wlan_get_read_port(uint8_t *port);
 static uint8_t wlan_get_write_port(uint8_t *port);
+static uint8_t wlan_wait_write_port(uint8_t *port);
+static uint16_t wlan_get_read_len(uint8_t port);
+static uint8_t wlan_get_rx_index(void);
+static uint8_t wlan_fill_rx(void);
+static uint8_t wlan_read_port_async(uint8_t rx_index);
+static void wlan_rx_complete(uint8_t err, void *arg);
+static void wlan_tx_complete(uint8_t err, void *arg);
+static void wlan_tx_ref_complete(uint8_t err, void *arg);
+static void wlan_release_tx_ref(void);
+static uint8_t wlan_ret_cmd(uint8_t *rx_buf);
+static wlan_cmd_t *wlan_build_cmd(uint16_t cmd_id, uint16_t cmd_action, uint8_t *data_buf, uint16_t data_len);
 static uint8_t wlan_prepare_cmd(uint16_t cmd_id, uint16_t cmd_action, uint8_t *data_buf, uint16_t data_len);
+static uint8_t wlan_dispatch_cmd(void);
+static void wlan_cmd_complete(uint8_t err, void *arg);
+static void wlan_finish_cmd(uint8_t err, uint8_t *resp);
+static uint8_t wlan_sync_port(void);
+static uint8_t wlan_first_port(uint16_t bitmap);
+static bool wlan_fw_ready(void);
+#ifdef WLAN_FW_COMPRESSED
+static uint8_t wlan_fw_read(void *arg);
+#endif
+#ifdef FW_STAGED
+static uint8_t wlan_fw_load(uint8_t *data_buf, uint16_t data_len, uint32_t *offset);
+#endif
+static void wlan_fw_complete(uint8_t err, void *arg);
 static uint8_t wlan_download_fw(void);
+static uint8_t wlan_start(bool warm);
+#ifdef WLAN_WARM_BOOT
+static uint8_t wlan_cold_boot(void);
+static void wlan_warm_boot_complete(uint8_t err, uint8_t *resp, void *arg);
+#endif
 
 /**
  * @param callback 回调函数表
@@ -40,6 +132,22 @@ static uint8_t wlan_download_fw(void);
  */
 uint8_t wlan_init(wlan_cb_t *callback) {
     wlan_callback = callback;
+#ifdef WLAN_WARM_BOOT
+    /* 芯片未重置且固件仍在运行时跳过下载（热启动），同步失败时重置芯片后下载固件 */
+    if (!wlan_start(true)) return CORE_ERR_OK;
+    CORE_DEBUG("Warm boot failed, reset chip\n");
+    return wlan_cold_boot();
+#else
+    return wlan_start(false);
+#endif
+}
+
+/**
+ * @param warm 热启动，固件未在运行时返回CORE_ERR_FIRMWARE_FAILED
+ * @return core_err_e中某一状态码
+ * @brief 读取控制端口，下载固件（热启动时同步端口）并发送初始化命令
+ */
+static uint8_t wlan_start(bool warm) {
     /* Init core */
     memset(&wlan_core, 0, sizeof(wlan_core_t));
     /* Port 0 is reserved for command */
@@ -50,12 +158,44 @@ uint8_t wlan_init(wlan_cb_t *callback) {
     /* Little endian */
     CORE_DEBUG("Control port: 0x%lX\n", *(uint32_t *)ctrl_port);
     wlan_core.ctrl_port = *(uint32_t *)ctrl_port;
+    if ((wlan_core.warm_boot = warm)) {
+        if (!wlan_fw_ready()) return CORE_ERR_FIRMWARE_FAILED;
+        CORE_DEBUG("Firmware is already active, skip download\n");
+    }
     /* Download firmware */
-    if ((*ctrl_port = wlan_download_fw())) return *ctrl_port;
+    else if ((*ctrl_port = wlan_download_fw())) return *ctrl_port;
+    /* 固件启动后短传输使用字节模式 */
+    sdio_set_byte_mode(SDIO_FUNC_1, WLAN_SDIO_BYTE_MODE);
+    if (warm && (*ctrl_port = wlan_sync_port())) return *ctrl_port;
     /* Enable host interrupt for SDIO and init firmware */
-    return sdio_cmd52(true, SDIO_FUNC_1, HOST_INT_MASK_REG, UP_LD_HOST_INT_MASK, NULL) ? CORE_ERR_INT_MASK_FAILED : wlan_prepare_cmd(HOST_ID_FUNC_INIT, HOST_ACT_GEN_GET, NULL, 0);
+    /* 下载中断用于在端口释放时刷新写入位图，热启动时先关闭芯片上次的运行状态再初始化 */
+    if (sdio_cmd52(true, SDIO_FUNC_1, HOST_INT_MASK_REG, HIM_ENABLE, NULL)) return CORE_ERR_INT_MASK_FAILED;
+#ifdef WLAN_WARM_BOOT
+    if (warm) return wlan_queue_cmd(HOST_ID_FUNC_SHUTDOWN, HOST_ACT_GEN_GET, NULL, 0, wlan_warm_boot_complete, NULL);
+#endif
+    return wlan_prepare_cmd(HOST_ID_FUNC_INIT, HOST_ACT_GEN_GET, NULL, 0);
 }
 
+#ifdef WLAN_WARM_BOOT
+/**
+ * @return core_err_e中某一状态码
+ * @brief 使用PDN重置芯片，重新初始化SDIO后下载固件
+ */
+static uint8_t wlan_cold_boot(void) { return sdio_power_cycle() ? CORE_ERR_FIRMWARE_FAILED : wlan_start(false); }
+
+/**
+ * @param err core_err_e中某一状态码
+ * @param resp 无意义
+ * @param arg 无意义
+ * @brief 热启动初始化命令（FUNC_SHUTDOWN、FUNC_INIT）结束回调，失败或超时时由wlan_poll_cmd重置芯片并下载固件
+ */
+static void wlan_warm_boot_complete(uint8_t err, uint8_t *resp, void *arg) {
+    UNUSED(resp);
+    UNUSED(arg);
+    if (err) wlan_core.warm_boot_failed = true;
+}
+#endif
+
 /**
  * @return core_err_e中某一状态码
  * @brief 停止芯片运行
@@ -64,33 +204,67 @@ uint8_t wlan_shutdown(void) { return wlan_prepare_cmd(HOST_ID_FUNC_SHUTDOWN, HOS
 
 /**
  * @return core_err_e中某一状态码
- * @brief 发生SDIO中断时读取封包并解析
+ * @brief 发生SDIO中断时读取控制寄存器，读取就绪端口并解析至多WLAN_RX_BUDGET个封包
  */
 uint8_t wlan_process_packet(void) {
-    /* 读取控制寄存器并清除芯片中断 */
-    if (sdio_cmd53(false, SDIO_FUNC_1, REG_PORT, false, mp_regs_buf, MAX_MP_REGS) || sdio_cmd52(true, SDIO_FUNC_1, HOST_INT_STATUS_REG, *(mp_regs_buf + HOST_INT_STATUS_REG) & ~UP_LD_HOST_INT_STATUS, NULL)) return CORE_ERR_INT_STATUS_FAILED;
+    /* 读取控制寄存器并清除芯片中断（写0清除） */
+    if (sdio_cmd53(false, SDIO_FUNC_1, REG_PORT, false, mp_regs_buf, MAX_MP_REGS) || sdio_cmd52(true, SDIO_FUNC_1, HOST_INT_STATUS_REG, *(mp_regs_buf + HOST_INT_STATUS_REG) & ~HOST_INT_STATUS_BIT, NULL)) return CORE_ERR_INT_STATUS_FAILED;
+    /* 已发起读取的端口在卡端已清除，其余为待读取端口 */
     wlan_core.read_bitmap = *(mp_regs_buf + RD_BITMAP_U) << 8 | *(mp_regs_buf + RD_BITMAP_L);
+    /* 写入端口在此前的CMD53结束后才读取控制寄存器，位图与卡端一致 */
     wlan_core.write_bitmap = *(mp_regs_buf + WR_BITMAP_U) << 8 | *(mp_regs_buf + WR_BITMAP_L);
-    uint8_t read_port;
-    while (!wlan_get_read_port(&read_port)) {
-        CORE_DEBUG("Rx: Port %d, Size %d\n", read_port, *(mp_regs_buf + RD_LEN_P0_U + (read_port << 1)) << 8 | *(mp_regs_buf + RD_LEN_P0_L + (read_port << 1)));
-        /* 使用CMD53读取数据 */
-        if (sdio_cmd53(false, SDIO_FUNC_1, wlan_core.ctrl_port + read_port, false, wlan_rx_buf, *(mp_regs_buf + RD_LEN_P0_U + (read_port << 1)) << 8 | *(mp_regs_buf + RD_LEN_P0_L + (read_port << 1)))) return CORE_ERR_INVALID_RX_BUFFER;
-        /* 解析从芯片发来的数据 */
-        switch (*(wlan_rx_buf + 2)) {
-        case TYPE_DATA: read_port = wlan_process_data(wlan_rx_buf); break;
-        case TYPE_CMD_CMDRSP: read_port = wlan_process_cmdrsp(wlan_rx_buf); break;
-        case TYPE_EVENT: read_port = wlan_process_event(wlan_rx_buf); break;
-        default:
-            CORE_DEBUG("Warning: Invalid rx 0x%X\n", *(wlan_rx_buf + 2));
-            read_port = CORE_ERR_OK;
-            break;
+    return wlan_process_rx();
+}
+
+/**
+ * @return core_err_e中某一状态码
+ * @brief 将就绪端口读取到空闲接收缓冲区，按读取顺序解析至多WLAN_RX_BUDGET个封包
+ *        读取未结束或超出预算时立即返回，剩余封包由之后的调用处理（wlan_rx_pending）
+ */
+uint8_t wlan_process_rx(void) {
+    uint8_t budget = WLAN_RX_BUDGET, rx_index, *rx_buf, err;
+    mp_rx_aggr_t *rx_aggr;
+    if ((err = wlan_fill_rx())) return err;
+    while (wlan_core.rx_queue_num) {
+        rx_index = *(wlan_core.rx_queue + wlan_core.rx_queue_head);
+        if (*(wlan_core.rx_result + rx_index) == RX_RESULT_PENDING) return CORE_ERR_OK;
+        rx_aggr = wlan_rx_aggr + rx_index;
+        /* 读取失败，丢弃该缓冲区 */
+        if (*(wlan_core.rx_result + rx_index)) rx_aggr->pkt_num = 0, err = CORE_ERR_INVALID_RX_BUFFER;
+        /* 解聚合，逐个解析从芯片发来的数据，解析失败的封包同样计入 */
+        for (; !err && wlan_core.rx_pkt_index < rx_aggr->pkt_num; wlan_core.rx_pkt_offset += *(rx_aggr->pkt_len + wlan_core.rx_pkt_index++)) {
+            if (!budget--) return CORE_ERR_OK;
+            rx_buf = *(wlan_rx_buf + rx_index) + wlan_core.rx_pkt_offset;
+            if ((*(rx_buf + 1) << 8 | *rx_buf) > *(rx_aggr->pkt_len + wlan_core.rx_pkt_index)) {
+                CORE_DEBUG("Warning: Invalid rx size %d\n", *(rx_buf + 1) << 8 | *rx_buf);
+                continue;
+            }
+            switch (*(rx_buf + 2)) {
+            case TYPE_DATA: err = wlan_process_data(rx_buf); break;
+            case TYPE_CMD_CMDRSP: err = wlan_process_cmdrsp(rx_buf); break;
+            case TYPE_EVENT: err = wlan_process_event(rx_buf); break;
+            default:
+                CORE_DEBUG("Warning: Invalid rx 0x%X\n", *(rx_buf + 2));
+                break;
+            }
+        }
+        /* 缓冲区解析完毕，出队并继续读取端口 */
+        if (!err || wlan_core.rx_pkt_index == rx_aggr->pkt_num) {
+            wlan_core.rx_queue_head = (wlan_core.rx_queue_head + 1) % RX_BUF_NUM;
+            --wlan_core.rx_queue_num;
+            wlan_core.rx_pkt_index = wlan_core.rx_pkt_offset = 0;
         }
-        if (read_port) return read_port;
+        if (err || (err = wlan_fill_rx())) return err;
     }
     return CORE_ERR_OK;
 }
 
+/**
+ * @return 是否有待读取的端口或待解析的封包
+ * @brief 为true时无需等待SDIO中断，继续调用wlan_process_rx
+ */
+bool wlan_rx_pending(void) { return wlan_core.rx_queue_num || wlan_core.read_bitmap; }
+
 /**
  * @param channel 需搜索的通道
  * @param channel_num 搜索通道个数
@@ -112,6 +286,7 @@ uint8_t wlan_scan(uint8_t *channel, uint8_t channel_num, uint16_t max_time) {
         (*(channel_list_params + index))->max_scan_time = max_time;
         (*(channel_list_params + index))->radio_type = (*(channel_list_params + index))->chan_scan_mode = (*(channel_list_params + index))->min_scan_time = 0;
     }
+    wlan_core.stats.scan_channel_count += channel_num;
     return wlan_prepare_cmd(HOST_ID_802_11_SCAN, HOST_ACT_GEN_GET, scan_params, scan_params_len);
 }
 
@@ -122,27 +297,7 @@ uint8_t wlan_scan(uint8_t *channel, uint8_t channel_num, uint16_t max_time) {
  * @return core_err_e中某一状态码
  * @brief 执行特定搜索
  */
-uint8_t wlan_scan_ssid(uint8_t *ssid, uint8_t ssid_len, uint16_t max_time) {
-    uint16_t scan_params_len = 2 * sizeof(MrvlIEtypesHeader_t) + ssid_len + MAX_CHANNEL_NUM * sizeof(ChanScanParamSet_t);
-    uint8_t scan_params[scan_params_len];
-    /* 组合SSID */
-    MrvlIEtypes_SSIDParamSet_t *ssid_tlv = (MrvlIEtypes_SSIDParamSet_t *)scan_params;
-    ssid_tlv->header.type = TLV_TYPE_SSID;
-    ssid_tlv->header.len = ssid_len;
-    memcpy(ssid_tlv->ssid, ssid, ssid_len);
-    /* 组合通道列表 */
-    MrvlIEtypes_ChanListParamSet_t *channel_list = (MrvlIEtypes_ChanListParamSet_t *)(scan_params + sizeof(MrvlIEtypesHeader_t) + ssid_len);
-    channel_list->header.type = TLV_TYPE_CHANLIST;
-    channel_list->header.len = MAX_CHANNEL_NUM * sizeof(ChanScanParamSet_t);
-    ChanScanParamSet_t *channel_list_params[MAX_CHANNEL_NUM];
-    for (uint8_t index = 0; index < MAX_CHANNEL_NUM; ++index) {
-        *(channel_list_params + index) = (ChanScanParamSet_t *)(scan_params + 2 * sizeof(MrvlIEtypesHeader_t) + ssid_len + index * sizeof(ChanScanParamSet_t));
-        (*(channel_list_params + index))->chan_number = index + 1;
-        (*(channel_list_params + index))->max_scan_time = max_time;
-        (*(channel_list_params + index))->radio_type = (*(channel_list_params + index))->chan_scan_mode = (*(channel_list_params + index))->min_scan_time = 0;
-    }
-    return wlan_prepare_cmd(HOST_ID_802_11_SCAN, HOST_ACT_GEN_GET, scan_params, scan_params_len);
-}
+uint8_t wlan_scan_ssid(uint8_t *ssid, uint8_t ssid_len, uint16_t max_time) { return wlan_scan_ssid_channel(ssid, ssid_len, 0, max_time); }
 
 /**
  * @param ssid AP名称
@@ -157,8 +312,78 @@ uint8_t wlan_sta_connect(uint8_t *ssid, uint8_t ssid_len, uint8_t *pwd, uint8_t
     wlan_core.ap_info.ssid_len = ssid_len;
     memcpy(wlan_core.ap_info.pwd, pwd, pwd_len);
     wlan_core.ap_info.pwd_len = pwd_len;
+    wlan_core.ap_info.hint_channel = 0;
+    wlan_core.ap_info.bss_cached = false;
+    wlan_bss_entry_t *bss = wlan_find_bss(ssid, ssid_len);
+    if (bss && sys_now() - bss->time <= WLAN_BSS_CACHE_AGE) {
+        /* 缓存的AP未过期，不搜索直接关联 */
+        wlan_core.ap_info.con_status = CON_STATUS_CONNECTING;
+        wlan_core.ap_info.bss_cached = true;
+        ++wlan_core.stats.bss_cache_hit_count;
+#ifdef WLAN_HOST_PMK
+        wlan_get_pmk();
+#endif
+        return wlan_associate(bss);
+    }
+    /* 缓存的AP已过期但仍保留，或与上次连接的AP名称相同时先只搜索其信道 */
+    if (bss) wlan_core.ap_info.hint_channel = bss->channel;
+#ifdef WLAN_KV_STORE
+    wlan_bss_record_t bss_record;
+    if (!bss && kvGet(KV_KEY_STA_BSS, &bss_record, sizeof(bss_record)) == sizeof(bss_record) && bss_record.ssid_len == ssid_len && !memcmp(bss_record.ssid, ssid, ssid_len) && bss_record.channel && bss_record.channel <= MAX_CHANNEL_NUM) wlan_core.ap_info.hint_channel = bss_record.channel;
+#endif
     /* 执行特定搜索，状态变为连接中 */
-    return (ssid_len = wlan_scan_ssid(ssid, ssid_len, MAX_SCAN_TIME)) ? ssid_len : (wlan_core.ap_info.con_status = CON_STATUS_CONNECTING, CORE_ERR_OK);
+    if ((ssid_len = wlan_scan_ssid_channel(ssid, ssid_len, wlan_core.ap_info.hint_channel, wlan_core.ap_info.hint_channel ? WLAN_BSS_PROBE_TIME : MAX_SCAN_TIME))) return ssid_len;
+    wlan_core.ap_info.con_status = CON_STATUS_CONNECTING;
+#ifdef WLAN_HOST_PMK
+    /* 芯片搜索期间由wlan_poll_pmk分段计算PMK */
+    wlan_get_pmk();
+#endif
+    return CORE_ERR_OK;
+}
+
+/**
+ * @param score 评分函数，为NULL时使用wlan_bss_default_score
+ * @brief 设置连接时选择AP的评分函数（黑名单另行扣分），需在wlan_init之后调用
+ */
+void wlan_set_bss_score(wlan_bss_score_fn score) { wlan_core.bss_score = score; }
+
+/**
+ * @param bss 缓存的AP
+ * @return 按信号强度、认证类型及同一信道上其他AP个数计算的得分
+ */
+int32_t wlan_bss_default_score(const wlan_bss_entry_t *bss) {
+    int32_t score = -(int32_t)bss->rssi * WLAN_BSS_SCORE_RSSI + (int32_t)bss->sec_type * WLAN_BSS_SCORE_SECURITY;
+    for (wlan_bss_entry_t *entry = wlan_core.bss_cache; entry < wlan_core.bss_cache + WLAN_BSS_CACHE_NUM; ++entry)
+        if (entry->used && entry->channel == bss->channel && memcmp(entry->bssid, bss->bssid, MAC_ADDR_LENGTH)) score -= WLAN_BSS_SCORE_LOAD;
+    return score;
+}
+
+/**
+ * @param ssid AP名称，为NULL时包括所有AP
+ * @param ssid_len AP名称长度
+ * @param candidate 候选AP，按得分从高到低排列
+ * @param num 候选AP个数上限
+ * @return 候选AP个数
+ * @brief 从BSS缓存中选出得分最高的num个AP，不包括超过WLAN_BSS_CACHE_EXPIRE的缓存项
+ */
+uint8_t wlan_get_bss(uint8_t *ssid, uint8_t ssid_len, wlan_bss_candidate_t *candidate, uint8_t num) {
+    uint8_t count = 0, index;
+    uint32_t now = sys_now();
+    int32_t score;
+    bool blacklisted;
+    for (wlan_bss_entry_t *entry = wlan_core.bss_cache; entry < wlan_core.bss_cache + WLAN_BSS_CACHE_NUM; ++entry) {
+        if (entry->used && now - entry->time > WLAN_BSS_CACHE_EXPIRE) entry->used = false;
+        if (!entry->used || (ssid && (entry->ssid_len != ssid_len || memcmp(entry->ssid, ssid, ssid_len)))) continue;
+        score = wlan_score_bss(entry, &blacklisted);
+        /* 插入排序，已满时得分最低的被移出 */
+        for (index = count < num ? count++ : num; index && (candidate + index - 1)->score < score; --index)
+            if (index < num) *(candidate + index) = *(candidate + index - 1);
+        if (index >= num) continue;
+        (candidate + index)->bss = *entry;
+        (candidate + index)->score = score;
+        (candidate + index)->blacklisted = blacklisted;
+    }
+    return count;
 }
 
 /**
@@ -167,6 +392,11 @@ uint8_t wlan_sta_connect(uint8_t *ssid, uint8_t ssid_len, uint8_t *pwd, uint8_t
  */
 uint8_t wlan_sta_disconnect(void) { return wlan_core.ap_info.con_status != CON_STATUS_CONNECTED ? CORE_ERR_OK : wlan_prepare_cmd(HOST_ID_802_11_DEAUTHENTICATE, HOST_ACT_GEN_GET, NULL, 0); }
 
+/**
+ * @return STA模式下与AP协商的PHY模式，连接成功后有效
+ */
+wlan_phy_mode wlan_get_phy_mode(void) { return wlan_core.ap_info.phy_mode; }
+
 /**
  * @param ssid AP名称
  * @param ssid_len AP名称长度
@@ -178,33 +408,43 @@ uint8_t wlan_sta_disconnect(void) { return wlan_core.ap_info.con_status != CON_S
  * @brief 创建AP，不带参数则创建一个名称为Marvell Micro AP且无认证类型的AP
  */
 uint8_t wlan_ap_start(uint8_t *ssid, uint8_t ssid_len, uint8_t *pwd, uint8_t pwd_len, wlan_security_type sec_type, bool broadcast_ssid) {
+    wlan_ap_config_t config = {ssid, ssid_len, pwd, pwd_len, sec_type, broadcast_ssid, 0, true, false};
+    return wlan_ap_start_ex(&config);
+}
+
+/**
+ * @param config AP参数
+ * @return core_err_e中某一状态码
+ * @brief 创建AP，可指定信道，启用WLAN_11N时可启用802.11n（SYS_CONFIGURE中的HT能力及信道带宽，之后发送11N_CFG）
+ */
+uint8_t wlan_ap_start_ex(const wlan_ap_config_t *config) {
     uint8_t sys_config[0x100], sys_config_len = 0;
     /* 组合SSID */
-    if (ssid && ssid_len && ssid_len < MAX_SSID_LENGTH) {
+    if (config->ssid && config->ssid_len && config->ssid_len < MAX_SSID_LENGTH) {
         MrvlIEtypes_SSIDParamSet_t *ssid_tlv = (MrvlIEtypes_SSIDParamSet_t *)sys_config;
         ssid_tlv->header.type = TLV_TYPE_SSID;
-        ssid_tlv->header.len = ssid_len;
-        memcpy(ssid_tlv->ssid, ssid, ssid_len);
-        sys_config_len += sizeof(MrvlIEtypesHeader_t) + ssid_len;
+        ssid_tlv->header.len = config->ssid_len;
+        memcpy(ssid_tlv->ssid, config->ssid, config->ssid_len);
+        sys_config_len += sizeof(MrvlIEtypesHeader_t) + config->ssid_len;
         MrvlIETypes_ApBCast_SSID_Ctrl_t *ssid_broadcast_tlv = (MrvlIETypes_ApBCast_SSID_Ctrl_t *)(sys_config + sys_config_len);
         ssid_broadcast_tlv->header.type = TLV_TYPE_UAP_BCAST_SSID_CTL;
         ssid_broadcast_tlv->header.len = 1;
-        ssid_broadcast_tlv->broadcast_ssid = broadcast_ssid;
+        ssid_broadcast_tlv->broadcast_ssid = config->broadcast_ssid;
         sys_config_len += sizeof(MrvlIETypes_ApBCast_SSID_Ctrl_t);
     }
     /* 创建WPA/WPA2认证类型的AP（WEP替换为WPA） */
-    if (sec_type != SECURITY_TYPE_NONE) {
-        if (pwd && pwd_len && pwd_len < MAX_PHRASE_LENGTH) {
+    if (config->sec_type != SECURITY_TYPE_NONE) {
+        if (config->pwd && config->pwd_len && config->pwd_len < MAX_PHRASE_LENGTH) {
             MrvlIEtypes_PassPhrase_t *phrase_tlv = (MrvlIEtypes_PassPhrase_t *)(sys_config + sys_config_len);
             phrase_tlv->header.type = TLV_TYPE_UAP_WPA_PASSPHRASE;
-            phrase_tlv->header.len = pwd_len;
-            memcpy(phrase_tlv->phrase, pwd, pwd_len);
-            sys_config_len += sizeof(MrvlIEtypesHeader_t) + pwd_len;
+            phrase_tlv->header.len = config->pwd_len;
+            memcpy(phrase_tlv->phrase, config->pwd, config->pwd_len);
+            sys_config_len += sizeof(MrvlIEtypesHeader_t) + config->pwd_len;
         }
         MrvlIEtypes_Enc_Protocol_t *enc_protocol_tlv = (MrvlIEtypes_Enc_Protocol_t *)(sys_config + sys_config_len);
         enc_protocol_tlv->header.type = TLV_TYPE_UAP_ENCRYPT_PROTOCOL;
         enc_protocol_tlv->header.len = 2;
-        enc_protocol_tlv->enc_protocol = 1 << (sec_type != SECURITY_TYPE_WPA2 ? 3 : 5);
+        enc_protocol_tlv->enc_protocol = 1 << (config->sec_type != SECURITY_TYPE_WPA2 ? 3 : 5);
         sys_config_len += sizeof(MrvlIEtypes_Enc_Protocol_t);
         MrvlIEtypes_AKMP_t *akmp_tlv = (MrvlIEtypes_AKMP_t *)(sys_config + sys_config_len);
         akmp_tlv->header.type = TLV_TYPE_UAP_AKMP;
@@ -215,7 +455,7 @@ uint8_t wlan_ap_start(uint8_t *ssid, uint8_t ssid_len, uint8_t *pwd, uint8_t pwd
         MrvlIEtypes_PTK_cipher_t *ptk_cipher_tlv = (MrvlIEtypes_PTK_cipher_t *)(sys_config + sys_config_len);
         ptk_cipher_tlv->header.type = TLV_TYPE_PWK_CIPHER;
         ptk_cipher_tlv->header.len = sizeof(MrvlIEtypes_PTK_cipher_t) - sizeof(MrvlIEtypesHeader_t);
-        ptk_cipher_tlv->protocol = 1 << (sec_type != SECURITY_TYPE_WPA2 ? 3 : 5);
+        ptk_cipher_tlv->protocol = 1 << (config->sec_type != SECURITY_TYPE_WPA2 ? 3 : 5);
         ptk_cipher_tlv->cipher = WPA_CIPHER_CCMP;
         sys_config_len += sizeof(MrvlIEtypes_PTK_cipher_t);
         MrvlIEtypes_GTK_cipher_t *gtk_cipher_tlv = (MrvlIEtypes_GTK_cipher_t *)(sys_config + sys_config_len);
@@ -224,7 +464,34 @@ uint8_t wlan_ap_start(uint8_t *ssid, uint8_t ssid_len, uint8_t *pwd, uint8_t pwd
         gtk_cipher_tlv->cipher = WPA_CIPHER_CCMP;
         sys_config_len += sizeof(MrvlIEtypes_GTK_cipher_t);
     }
-    return sys_config_len ? wlan_prepare_cmd(HOST_ID_APCMD_SYS_CONFIGURE, HOST_ACT_GEN_SET, sys_config, sys_config_len) : wlan_prepare_cmd(HOST_ID_APCMD_BSS_START, HOST_ACT_GEN_GET, NULL, 0);
+    /* 信道及带宽 */
+    uint8_t band_config = CHAN_BW_20MHZ << 2 | SEC_CHAN_NONE << 4, err;
+#ifdef WLAN_11N
+    uint16_t ht_cap_info = HT_CAP_SM_PS_DISABLED | HT_CAP_SGI_20;
+    if ((wlan_core.uap_ht = config->ht)) {
+        /* 信道1~9的副信道在其上方，10~13在其下方 */
+        if (config->ht_40mhz && config->channel && config->channel <= 13 && wlan_core.dev_11n_cap & HT_DEV_CAP_CHANWIDTH40) {
+            band_config = CHAN_BW_40MHZ << 2 | (config->channel <= 9 ? SEC_CHAN_ABOVE : SEC_CHAN_BELOW) << 4;
+            ht_cap_info |= HT_CAP_SUP_WIDTH_20_40 | HT_CAP_SGI_40;
+        }
+        sys_config_len += wlan_ht_cap_tlv(sys_config + sys_config_len, ht_cap_info);
+    }
+#endif
+    if (config->channel) {
+        MrvlIEtypes_channel_band_t *channel_band_tlv = (MrvlIEtypes_channel_band_t *)(sys_config + sys_config_len);
+        channel_band_tlv->header.type = TLV_TYPE_UAP_CHAN_BAND_CONFIG;
+        channel_band_tlv->header.len = sizeof(MrvlIEtypes_channel_band_t) - sizeof(MrvlIEtypesHeader_t);
+        channel_band_tlv->band_config = band_config;
+        channel_band_tlv->channel = config->channel;
+        sys_config_len += sizeof(MrvlIEtypes_channel_band_t);
+    }
+    if (!sys_config_len) return wlan_prepare_cmd(HOST_ID_APCMD_BSS_START, HOST_ACT_GEN_GET, NULL, 0);
+    if ((err = wlan_prepare_cmd(HOST_ID_APCMD_SYS_CONFIGURE, HOST_ACT_GEN_SET, sys_config, sys_config_len))) return err;
+#ifdef WLAN_11N
+    /* 发送使用的HT能力（40MHz、短GI），SYS_CONFIGURE响应后加入的BSS_START在其后 */
+    if (config->ht) return wlan_prepare_cmd(HOST_ID_11N_CFG, HOST_ACT_GEN_SET, NULL, ht_cap_info & (HT_CAP_SUP_WIDTH_20_40 | HT_CAP_SGI_20 | HT_CAP_SGI_40));
+#endif
+    return CORE_ERR_OK;
 }
 
 /**
@@ -246,14 +513,24 @@ void wlan_ap_show(void) { for (uint8_t index = 0; index < MAX_CLIENT_NUM; ++inde
 uint8_t wlan_ap_deauth(uint8_t *mac_addr) { return wlan_prepare_cmd(HOST_ID_APCMD_STA_DEAUTH, HOST_ACT_GEN_GET, mac_addr, MAC_ADDR_LENGTH); }
 
 /**
- * @param data_buf 数据缓冲区
+ * @return 发送缓冲区
+ * @brief 获取发送队列中下一封包的位置，剩余空间不足时先发送队列，在缓冲区的上一次传输结束前等待
+ */
+uint8_t *wlan_get_tx_buf(void) {
+    if (wlan_core.tx_buf_len + TX_BUF_SIZE > MP_TX_AGGR_BUF_SIZE) wlan_flush_data(true);
+    while (*(wlan_core.tx_busy + wlan_core.curr_tx_buf)) sdio_cmd53_wait();
+    return *(wlan_tx_buf + wlan_core.curr_tx_buf) + wlan_core.tx_buf_len;
+}
+
+/**
+ * @param data_buf 数据缓冲区，为NULL时数据已写入wlan_get_tx_buf()的TxPD负载中
  * @param data_len 缓冲区长度
  * @param bss_type BSS网络类型
  * @return core_err_e中某一状态码
- * @brief 发送数据
+ * @brief 将数据加入发送队列，队列满或超过MP_TX_AGGR_TIMEOUT时发送
  */
 uint8_t wlan_send_data(uint8_t *data_buf, uint16_t data_len, wlan_bss_type bss_type) {
-    TxPD *tx_packet = (TxPD *)wlan_tx_buf;
+    TxPD *tx_packet = (TxPD *)wlan_get_tx_buf();
     tx_packet->pack_len = sizeof(TxPD) + data_len;
     tx_packet->pack_type = TYPE_DATA;
     tx_packet->bss_type = bss_type;
@@ -261,13 +538,225 @@ uint8_t wlan_send_data(uint8_t *data_buf, uint16_t data_len, wlan_bss_type bss_t
     tx_packet->tx_pkt_offset = sizeof(TxPD) - SDIO_HDR_SIZE;
     tx_packet->bss_num = tx_packet->tx_pkt_type = tx_packet->tx_control = tx_packet->priority = tx_packet->flags = tx_packet->pkt_delay_2ms = tx_packet->reserved1 = 0;
     if (data_buf) memcpy(tx_packet->payload, data_buf, data_len);
-    uint8_t wr_bitmap[2];
-    do {
-        if (sdio_cmd52(false, SDIO_FUNC_1, WR_BITMAP_L, 0, wr_bitmap) || sdio_cmd52(false, SDIO_FUNC_1, WR_BITMAP_U, 0, wr_bitmap + 1)) return CORE_ERR_SEND_DATA_FAILED;
-        wlan_core.write_bitmap = *(uint16_t *)wr_bitmap;
-    } while (wlan_get_write_port(wr_bitmap));
-    CORE_DEBUG("Tx: Port %d, Size %d\n", *wr_bitmap, tx_packet->pack_len);
-    return sdio_cmd53(true, SDIO_FUNC_1, wlan_core.ctrl_port + *wr_bitmap, false, (uint8_t *)tx_packet, tx_packet->pack_len) ? CORE_ERR_SEND_DATA_FAILED : CORE_ERR_OK;
+#ifdef WLAN_11N
+    wlan_count_tx_ba(tx_packet);
+#endif
+    if (!wlan_core.tx_pkt_num++) wlan_core.tx_time = sys_now();
+    /* 封包按分块对齐存放 */
+    wlan_core.tx_buf_len += BLOCK_ALIGN(tx_packet->pack_len);
+    return wlan_flush_data(wlan_core.tx_pkt_num == MP_TX_AGGR_PKT_LIMIT);
+}
+
+/**
+ * @return 是否应以零拷贝方式发送下一封包
+ * @brief 发送队列为空且总线空闲时直接写入端口只省去复制，不影响聚合；否则复制到发送队列，与之后的封包一起写入多个端口
+ */
+bool wlan_send_ref_ready(void) {
+    wlan_release_tx_ref();
+    return !wlan_core.tx_pkt_num && !sdio_cmd53_busy() && wlan_core.tx_ref_num < TX_REF_NUM;
+}
+
+/**
+ * @param tx_packet 封包，TxPD之前无需预留空间，地址需4字节对齐
+ * @param data_len 数据链路层上的帧长度
+ * @param data_offset 帧相对于tx_packet的偏移，不小于sizeof(TxPD)
+ * @param bss_type BSS网络类型
+ * @param free 传输结束后释放封包的函数（主循环中调用）
+ * @param arg free的参数
+ * @return core_err_e中某一状态码，失败时封包仍由调用者释放
+ * @brief 不复制封包，先发送队列中的封包以保持顺序，再以一次CMD53直接写入一个空闲端口
+ *        每个封包单独占用一次CMD53，仅在wlan_send_ref_ready为true时使用不会减少聚合
+ *        分块模式下DMA读取长度按分块对齐，封包之后的内存需可读
+ */
+uint8_t wlan_send_data_ref(TxPD *tx_packet, uint16_t data_len, uint16_t data_offset, wlan_bss_type bss_type, wlan_tx_free_fn free, void *arg) {
+    uint8_t port, err;
+    if ((err = wlan_flush_data(true))) return err;
+    /* 等待已发送的封包释放 */
+    while (wlan_core.tx_ref_num == TX_REF_NUM) sdio_cmd53_wait(), wlan_release_tx_ref();
+    tx_packet->pack_len = data_offset + data_len;
+    tx_packet->pack_type = TYPE_DATA;
+    tx_packet->bss_type = bss_type;
+    tx_packet->tx_pkt_length = data_len;
+    tx_packet->tx_pkt_offset = data_offset - SDIO_HDR_SIZE;
+    tx_packet->bss_num = tx_packet->tx_pkt_type = tx_packet->tx_control = tx_packet->priority = tx_packet->flags = tx_packet->pkt_delay_2ms = tx_packet->reserved1 = 0;
+#ifdef WLAN_11N
+    wlan_count_tx_ba(tx_packet);
+#endif
+    if (wlan_wait_write_port(&port)) return CORE_ERR_SEND_DATA_FAILED;
+    CORE_DEBUG("Tx: Port %d, Size %d (in place)\n", port, tx_packet->pack_len);
+    wlan_tx_ref_t *tx_ref = wlan_core.tx_ref + (wlan_core.tx_ref_head + wlan_core.tx_ref_num) % TX_REF_NUM;
+    tx_ref->free = free;
+    tx_ref->arg = arg;
+    if (sdio_cmd53_async(true, SDIO_FUNC_1, wlan_core.ctrl_port + port, false, (uint8_t *)tx_packet, tx_packet->pack_len, wlan_tx_ref_complete, NULL)) return CORE_ERR_SEND_DATA_FAILED;
+    ++wlan_core.tx_ref_num;
+    ++wlan_core.stats.tx_transfer_count;
+    ++wlan_core.stats.tx_packet_count;
+    ++*wlan_core.stats.tx_aggr_hist;
+    ++wlan_core.stats.tx_ref_count;
+    return CORE_ERR_OK;
+}
+
+/**
+ * @param force 是否立即发送，否则仅在超过MP_TX_AGGR_TIMEOUT时发送
+ * @return core_err_e中某一状态码
+ * @brief 释放已发送的零拷贝封包，将发送队列写入一组连续的空闲端口，CMD53启动后立即返回，不等待传输结束
+ */
+uint8_t wlan_flush_data(bool force) {
+    wlan_release_tx_ref();
+    if (!wlan_core.tx_pkt_num || (!force && sys_now() - wlan_core.tx_time < MP_TX_AGGR_TIMEOUT)) return CORE_ERR_OK;
+    uint8_t tx_index = wlan_core.curr_tx_buf, *tx_buf = *(wlan_tx_buf + tx_index), remain_num = wlan_core.tx_pkt_num, start_port, port, pkt_num;
+    uint16_t buf_len, last_len;
+    /* 上一次异步发送的结果 */
+    if (wlan_core.tx_err) {
+        CORE_DEBUG("Error: Previous tx failed (0x%X)\n", wlan_core.tx_err);
+        wlan_core.tx_err = SDIO_ERR_OK;
+    }
+    /* 缓冲区在最后一次CMD53的结束回调中释放，之后的封包使用下一缓冲区 */
+    *(wlan_core.tx_busy + tx_index) = true;
+    wlan_core.curr_tx_buf = (tx_index + 1) % TX_BUF_NUM;
+    wlan_core.tx_pkt_num = wlan_core.tx_buf_len = 0;
+    for (; remain_num; remain_num -= pkt_num, tx_buf += buf_len) {
+        if (wlan_wait_write_port(&start_port)) break;
+        /* 从起始端口开始选取连续且不回绕的空闲端口 */
+        buf_len = BLOCK_ALIGN(last_len = *(uint16_t *)tx_buf);
+        for (pkt_num = 1, port = start_port; pkt_num < remain_num && wlan_core.curr_wr_port == port + 1 && wlan_core.write_bitmap & 1 << wlan_core.curr_wr_port; ++pkt_num) {
+            wlan_get_write_port(&port);
+            buf_len += BLOCK_ALIGN(last_len = *(uint16_t *)(tx_buf + buf_len));
+        }
+        CORE_DEBUG("Tx: Port %d-%d, Size %d\n", start_port, port, buf_len - BLOCK_ALIGN(last_len) + last_len);
+        ++wlan_core.stats.tx_transfer_count;
+        wlan_core.stats.tx_packet_count += pkt_num;
+        ++*(wlan_core.stats.tx_aggr_hist + pkt_num - 1);
+        /* 多端口写入地址格式与读取相同 */
+        uint32_t reg_addr = pkt_num == 1 ? wlan_core.ctrl_port + start_port : (wlan_core.ctrl_port | MPA_ADDR_BASE | ((1 << pkt_num) - 1) << 4) + start_port;
+        /* 最后一个封包不补齐，尾部由sdio_cmd53按字节模式策略处理 */
+        if (sdio_cmd53_async(true, SDIO_FUNC_1, reg_addr, false, tx_buf, buf_len - BLOCK_ALIGN(last_len) + last_len, wlan_tx_complete, (void *)(uintptr_t)(tx_index | (remain_num == pkt_num) << 7))) break;
+    }
+    if (!remain_num) return CORE_ERR_OK;
+    /* 发送失败，丢弃剩余封包 */
+    sdio_cmd53_wait();
+    *(wlan_core.tx_busy + tx_index) = false;
+    return CORE_ERR_SEND_DATA_FAILED;
+}
+
+/**
+ * @param stats 统计信息
+ * @brief 获取收发统计信息
+ */
+void wlan_get_stats(wlan_stats_t *stats) { memcpy(stats, &wlan_core.stats, sizeof(wlan_stats_t)); }
+
+/**
+ * @brief 清除收发统计信息
+ */
+void wlan_reset_stats(void) { memset(&wlan_core.stats, 0, sizeof(wlan_stats_t)); }
+
+/**
+ * @param rx_buf 接收缓冲区中的封包
+ * @return 是否引用成功，失败时需复制封包
+ * @brief 引用封包所在的接收缓冲区，引用期间缓冲区不再用于读取端口
+ *        至少保留两个未被引用的缓冲区用于轮流读取/解析
+ */
+bool wlan_rx_buf_ref(uint8_t *rx_buf) {
+    if (rx_buf < *wlan_rx_buf || rx_buf >= *wlan_rx_buf + sizeof(wlan_rx_buf)) return ++wlan_core.stats.rx_copy_count, false;
+    uint8_t *rx_ref = wlan_core.rx_ref + (rx_buf - *wlan_rx_buf) / MP_RX_AGGR_BUF_SIZE;
+    if ((!*rx_ref && wlan_core.rx_lent_num >= RX_BUF_NUM - 2) || *rx_ref == UINT8_MAX) return ++wlan_core.stats.rx_copy_count, false;
+    if (!(*rx_ref)++ && ++wlan_core.rx_lent_num > wlan_core.stats.rx_lent_max) wlan_core.stats.rx_lent_max = wlan_core.rx_lent_num;
+    ++wlan_core.stats.rx_ref_count;
+    return true;
+}
+
+/**
+ * @param rx_buf 接收缓冲区中的封包
+ * @brief 释放wlan_rx_buf_ref的引用，引用数为0时缓冲区重新用于读取端口
+ */
+void wlan_rx_buf_unref(uint8_t *rx_buf) {
+    if (!--*(wlan_core.rx_ref + (rx_buf - *wlan_rx_buf) / MP_RX_AGGR_BUF_SIZE)) --wlan_core.rx_lent_num;
+}
+
+/**
+ * @return core_err_e中某一状态码
+ * @brief 检查重排序表，缺失的帧超过WLAN_RX_REORDER_TIMEOUT仍未到达时交付已缓存的帧
+ */
+uint8_t wlan_poll_rx_reorder(void) {
+    uint8_t err = CORE_ERR_OK, drain_err;
+    for (wlan_rx_reorder_t *table = wlan_core.rx_reorder; table < wlan_core.rx_reorder + WLAN_RX_REORDER_NUM; ++table) {
+        if (!table->used || !table->pkt_num || sys_now() - table->time < WLAN_RX_REORDER_TIMEOUT) continue;
+        ++wlan_core.stats.rx_reorder_timeout_count;
+        if ((drain_err = wlan_drain_rx_reorder(table)) && !err) err = drain_err;
+    }
+    return err;
+}
+
+#ifdef WLAN_11N
+/**
+ * @brief 按流量建立或拆除TX BA会话：统计周期内达到WLAN_TX_BA_THRESHOLD帧时发送ADDBA请求，空闲超过WLAN_TX_BA_IDLE时发送DELBA，
+ *        命令队列已满时下次调用再发送
+ */
+void wlan_poll_tx_ba(void) {
+    uint32_t now = sys_now();
+    for (wlan_tx_ba_t *session = wlan_core.tx_ba; session < wlan_core.tx_ba + WLAN_TX_BA_NUM; ++session) {
+        if (!session->used) continue;
+        switch (session->state) {
+        case TX_BA_STATE_IDLE:
+            if (session->period_pkts >= WLAN_TX_BA_THRESHOLD && now - session->last_time < WLAN_TX_BA_PERIOD && !wlan_queue_cmd(HOST_ID_11N_ADDBA_REQ, HOST_ACT_GEN_GET, (uint8_t *)session, 0, wlan_tx_ba_complete, session)) wlan_set_tx_ba(session, TX_BA_STATE_SETUP);
+            break;
+        /* 由ADDBA响应或wlan_tx_ba_complete改变状态 */
+        case TX_BA_STATE_SETUP: break;
+        case TX_BA_STATE_ACTIVE:
+            if (now - session->last_time >= WLAN_TX_BA_IDLE && !wlan_prepare_cmd(HOST_ID_11N_DELBA, HOST_ACT_GEN_GET, (uint8_t *)session, 0)) wlan_set_tx_ba(session, TX_BA_STATE_IDLE);
+            break;
+        case TX_BA_STATE_REFUSED:
+            if (now - session->state_time >= WLAN_TX_BA_RETRY) wlan_set_tx_ba(session, TX_BA_STATE_IDLE);
+            break;
+        }
+    }
+}
+
+/**
+ * @param session 输出的TX BA会话
+ * @param num 最多输出的个数
+ * @return 输出的个数
+ * @brief 获取TX BA会话及其计数，含未建立会话、只统计流量的项
+ */
+uint8_t wlan_get_tx_ba(wlan_tx_ba_t *session, uint8_t num) {
+    uint8_t count = 0;
+    for (uint8_t index = 0; index < WLAN_TX_BA_NUM && count < num; ++index) {
+        if ((wlan_core.tx_ba + index)->used) *(session + count++) = *(wlan_core.tx_ba + index);
+    }
+    return count;
+}
+#endif
+
+/**
+ * @param ssid AP名称
+ * @param ssid_len AP名称长度
+ * @param channel 搜索的信道，0为全部信道
+ * @param max_time 最大搜索时间
+ * @return core_err_e中某一状态码
+ * @brief 执行特定搜索
+ */
+static uint8_t wlan_scan_ssid_channel(uint8_t *ssid, uint8_t ssid_len, uint8_t channel, uint16_t max_time) {
+    uint8_t channel_num = channel ? 1 : MAX_CHANNEL_NUM;
+    uint16_t scan_params_len = 2 * sizeof(MrvlIEtypesHeader_t) + ssid_len + channel_num * sizeof(ChanScanParamSet_t);
+    uint8_t scan_params[scan_params_len];
+    /* 组合SSID */
+    MrvlIEtypes_SSIDParamSet_t *ssid_tlv = (MrvlIEtypes_SSIDParamSet_t *)scan_params;
+    ssid_tlv->header.type = TLV_TYPE_SSID;
+    ssid_tlv->header.len = ssid_len;
+    memcpy(ssid_tlv->ssid, ssid, ssid_len);
+    /* 组合通道列表 */
+    MrvlIEtypes_ChanListParamSet_t *channel_list = (MrvlIEtypes_ChanListParamSet_t *)(scan_params + sizeof(MrvlIEtypesHeader_t) + ssid_len);
+    channel_list->header.type = TLV_TYPE_CHANLIST;
+    channel_list->header.len = channel_num * sizeof(ChanScanParamSet_t);
+    ChanScanParamSet_t *channel_list_params[MAX_CHANNEL_NUM];
+    for (uint8_t index = 0; index < channel_num; ++index) {
+        *(channel_list_params + index) = (ChanScanParamSet_t *)(scan_params + 2 * sizeof(MrvlIEtypesHeader_t) + ssid_len + index * sizeof(ChanScanParamSet_t));
+        (*(channel_list_params + index))->chan_number = channel ? channel : index + 1;
+        (*(channel_list_params + index))->max_scan_time = max_time;
+        (*(channel_list_params + index))->radio_type = (*(channel_list_params + index))->chan_scan_mode = (*(channel_list_params + index))->min_scan_time = 0;
+    }
+    wlan_core.stats.scan_channel_count += channel_num;
+    return wlan_prepare_cmd(HOST_ID_802_11_SCAN, HOST_ACT_GEN_GET, scan_params, scan_params_len);
 }
 
 /**
@@ -287,6 +776,17 @@ static uint8_t wlan_ass_supplicant_pmk_pkg(uint8_t *bssid) {
     pmk_bssid_tlv->header.len = MAC_ADDR_LENGTH;
     memcpy(pmk_bssid_tlv->mac_addr, bssid, MAC_ADDR_LENGTH);
     pmk_len += sizeof(MrvlIETypes_BSSIDList_t);
+#ifdef WLAN_HOST_PMK
+    /* 芯片直接使用主机计算的PMK */
+    if (wlan_core.ap_info.pmk_valid) {
+        MrvlIEtypes_PMK_t *pmk_key_tlv = (MrvlIEtypes_PMK_t *)(pmk_tlv + pmk_len);
+        pmk_key_tlv->header.type = TLV_TYPE_PMK;
+        pmk_key_tlv->header.len = PMK_LENGTH;
+        memcpy(pmk_key_tlv->pmk, wlan_core.ap_info.pmk, PMK_LENGTH);
+        pmk_len += sizeof(MrvlIEtypes_PMK_t);
+        return wlan_prepare_cmd(HOST_ID_SUPPLICANT_PMK, HOST_ACT_GEN_SET, pmk_tlv, pmk_len);
+    }
+#endif
     MrvlIEtypes_PassPhrase_t *pmk_phrase_tlv = (MrvlIEtypes_PassPhrase_t *)(pmk_tlv + pmk_len);
     pmk_phrase_tlv->header.type = TLV_TYPE_PASSPHRASE;
     pmk_phrase_tlv->header.len = wlan_core.ap_info.pwd_len;
@@ -295,189 +795,839 @@ static uint8_t wlan_ass_supplicant_pmk_pkg(uint8_t *bssid) {
     return wlan_prepare_cmd(HOST_ID_SUPPLICANT_PMK, HOST_ACT_GEN_SET, pmk_tlv, pmk_len);
 }
 
+#ifdef WLAN_HOST_PMK
+/**
+ * @brief 按AP名称及密码从缓存、Flash中查找PMK，均未找到时开始分段计算，放弃上次连接未算完的PMK
+ */
+static void wlan_get_pmk(void) {
+    sha1_t sha1;
+    wlan_pmk_entry_t *entry;
+    wlan_core.pmk_entry = NULL;
+    wlan_core.pmk_bss.used = false;
+    if ((wlan_core.ap_info.pmk_valid = wlan_parse_pmk()) || wlan_core.ap_info.pwd_len < MIN_PHRASE_LENGTH || wlan_core.ap_info.pwd_len >= MAX_PHRASE_LENGTH) return;
+    sha1_init(&sha1);
+    sha1_update(&sha1, wlan_core.ap_info.pwd, wlan_core.ap_info.pwd_len);
+    sha1_final(&sha1, wlan_core.pmk_pwd_hash);
+    if (!(entry = wlan_find_pmk(wlan_core.pmk_pwd_hash))) {
+        entry = wlan_core.pmk_cache + wlan_core.pmk_cache_next;
+        wlan_core.pmk_cache_next = (wlan_core.pmk_cache_next + 1) % WLAN_PMK_CACHE_NUM;
+        /* 算完前该缓存项作废，AP名称用作盐 */
+        entry->ssid_len = 0;
+        memset(entry->pwd_hash, 0, SHA1_DIGEST_SIZE);
+        memset(entry->ssid, 0, MAX_SSID_LENGTH);
+        memcpy(entry->ssid, wlan_core.ap_info.ssid, wlan_core.ap_info.ssid_len);
+        pbkdf2_sha1_init(&wlan_core.pmk_ctx, wlan_core.ap_info.pwd, wlan_core.ap_info.pwd_len, entry->ssid, wlan_core.ap_info.ssid_len, PMK_ITERATIONS, entry->pmk, PMK_LENGTH);
+        wlan_core.pmk_entry = entry;
+        wlan_core.stats.pmk_derive_time = 0;
+        return;
+    }
+    ++wlan_core.stats.pmk_cache_hit_count;
+    memcpy(wlan_core.ap_info.pmk, entry->pmk, PMK_LENGTH);
+    wlan_core.ap_info.pmk_valid = true;
+}
+
+/**
+ * @brief 继续计算PMK，每次至多WLAN_PMK_SLICE次迭代，算完后加入缓存并关联等待PMK的AP
+ */
+void wlan_poll_pmk(void) {
+    wlan_pmk_entry_t *entry = wlan_core.pmk_entry;
+    if (!entry) return;
+    uint32_t slice_time = sys_now_us();
+    bool done = pbkdf2_sha1_step(&wlan_core.pmk_ctx, WLAN_PMK_SLICE);
+    slice_time = sys_now_us() - slice_time;
+    wlan_core.stats.pmk_derive_time += slice_time;
+    if (slice_time > wlan_core.stats.pmk_slice_time) wlan_core.stats.pmk_slice_time = slice_time;
+    if (!done) return;
+    ++wlan_core.stats.pmk_derive_count;
+    CORE_DEBUG("PMK derived in %ld us\n", wlan_core.stats.pmk_derive_time);
+    entry->ssid_len = wlan_core.pmk_ctx.salt_len;
+    memcpy(entry->pwd_hash, wlan_core.pmk_pwd_hash, SHA1_DIGEST_SIZE);
+    memcpy(wlan_core.ap_info.pmk, entry->pmk, PMK_LENGTH);
+    wlan_core.ap_info.pmk_valid = true;
+    wlan_core.pmk_entry = NULL;
+    if (!wlan_core.pmk_bss.used) return;
+    wlan_core.pmk_bss.used = false;
+    if (wlan_core.ap_info.con_status == CON_STATUS_CONNECTING && wlan_associate(&wlan_core.pmk_bss) && wlan_callback && wlan_callback->wlan_cb_sta_connect) wlan_callback->wlan_cb_sta_connect(CORE_ERR_UNHANDLED_STATUS);
+}
+
+/**
+ * @return 密码是否为64个十六进制字符的PMK
+ */
+static bool wlan_parse_pmk(void) {
+    uint8_t index, digit, *pwd = wlan_core.ap_info.pwd;
+    if (wlan_core.ap_info.pwd_len != MAX_PHRASE_LENGTH) return false;
+    for (index = 0; index < MAX_PHRASE_LENGTH; ++index) {
+        if (*(pwd + index) >= '0' && *(pwd + index) <= '9') digit = *(pwd + index) - '0';
+        else if ((*(pwd + index) | 0x20) >= 'a' && (*(pwd + index) | 0x20) <= 'f') digit = (*(pwd + index) | 0x20) - 'a' + 10;
+        else return false;
+        *(wlan_core.ap_info.pmk + (index >> 1)) = index & 1 ? *(wlan_core.ap_info.pmk + (index >> 1)) | digit : digit << 4;
+    }
+    return true;
+}
+
+/**
+ * @param pwd_hash 密码的SHA-1
+ * @return 当前AP名称及密码的缓存项，未找到时为NULL
+ * @brief 缓存中未找到时读取Flash中保存的PMK并加入缓存
+ */
+static wlan_pmk_entry_t *wlan_find_pmk(uint8_t *pwd_hash) {
+    wlan_pmk_entry_t *entry = wlan_core.pmk_cache;
+    for (; entry < wlan_core.pmk_cache + WLAN_PMK_CACHE_NUM; ++entry)
+        if (entry->ssid_len == wlan_core.ap_info.ssid_len && !memcmp(entry->ssid, wlan_core.ap_info.ssid, entry->ssid_len) && !memcmp(entry->pwd_hash, pwd_hash, SHA1_DIGEST_SIZE)) return entry;
+#ifdef WLAN_KV_STORE
+    entry = wlan_core.pmk_cache + wlan_core.pmk_cache_next;
+    if (kvGet(KV_KEY_STA_PMK, entry, sizeof(wlan_pmk_entry_t)) == sizeof(wlan_pmk_entry_t) && entry->ssid_len == wlan_core.ap_info.ssid_len && !memcmp(entry->ssid, wlan_core.ap_info.ssid, entry->ssid_len) && !memcmp(entry->pwd_hash, pwd_hash, SHA1_DIGEST_SIZE)) {
+        wlan_core.pmk_cache_next = (wlan_core.pmk_cache_next + 1) % WLAN_PMK_CACHE_NUM;
+        return entry;
+    }
+    /* 读出的记录不匹配，该缓存项作废 */
+    entry->ssid_len = 0;
+    memset(entry->pwd_hash, 0, SHA1_DIGEST_SIZE);
+#endif
+    return NULL;
+}
+#endif
+
+#ifdef WLAN_KV_STORE
+/**
+ * @brief 连接成功后将AP名称、密码及BSS保存到Flash，未改变的值不写入
+ */
+static void wlan_save_sta(void) {
+    wlan_bss_record_t bss_record;
+    memcpy(bss_record.bssid, wlan_core.ap_info.ap_mac_addr, MAC_ADDR_LENGTH);
+    bss_record.channel = wlan_core.ap_info.channel;
+    bss_record.ssid_len = wlan_core.ap_info.ssid_len;
+    memset(bss_record.ssid, 0, MAX_SSID_LENGTH);
+    memcpy(bss_record.ssid, wlan_core.ap_info.ssid, wlan_core.ap_info.ssid_len);
+    if (!kvSet(KV_KEY_STA_SSID, wlan_core.ap_info.ssid, wlan_core.ap_info.ssid_len) || !(wlan_core.ap_info.pwd_len ? kvSet(KV_KEY_STA_PASSPHRASE, wlan_core.ap_info.pwd, wlan_core.ap_info.pwd_len) : kvDelete(KV_KEY_STA_PASSPHRASE)) || !kvSet(KV_KEY_STA_BSS, &bss_record, sizeof(bss_record))) CORE_DEBUG("Warning: Failed to save AP\n");
+#ifdef WLAN_HOST_PMK
+    /* 只保存验证过的PMK，即当前密码计算的缓存项 */
+    wlan_pmk_entry_t *entry = wlan_core.pmk_cache;
+    if (!wlan_core.ap_info.pmk_valid || wlan_core.ap_info.sec_type < SECURITY_TYPE_WPA) return;
+    for (; entry < wlan_core.pmk_cache + WLAN_PMK_CACHE_NUM; ++entry)
+        if (entry->ssid_len == wlan_core.ap_info.ssid_len && !memcmp(entry->ssid, wlan_core.ap_info.ssid, entry->ssid_len) && !memcmp(entry->pmk, wlan_core.ap_info.pmk, PMK_LENGTH)) {
+            if (!kvSet(KV_KEY_STA_PMK, entry, sizeof(wlan_pmk_entry_t))) CORE_DEBUG("Warning: Failed to save PMK\n");
+            break;
+        }
+#endif
+}
+#endif
+
+/**
+ * @param rx_buf rx缓冲区
+ * @return core_err_e中某一状态码
+ * @brief 解析搜索命令响应，搜索的是IEEE的TLV而非Marvell的TLV
+ */
+static uint8_t wlan_ret_scan(uint8_t *rx_buf) {
+    HOST_DS_802_11_SCAN_RSP *scan_rsp = (HOST_DS_802_11_SCAN_RSP *)rx_buf;
+    CORE_DEBUG("bss_descript_size: %d\nnumber_of_sets: %d\n", scan_rsp->bss_descript_size, scan_rsp->number_of_sets);
+    bss_desc_set_t *bss_desc_set = (bss_desc_set_t *)scan_rsp->bss_desc_and_tlv_buffer;
+    wlan_bss_entry_t *bss, best;
+    uint8_t ssid[MAX_SSID_LENGTH + 1], err;
+    int32_t score, best_score = 0;
+    best.used = false;
+    for (uint8_t index = 0; index < scan_rsp->number_of_sets; ++index) {
+        bss = wlan_update_bss(bss_desc_set, ssid);
+        /* 连接时选择得分最高的同名AP（需要密码而未提供密码的除外），缓存项可能被之后的AP替换，因此复制 */
+        if (wlan_core.ap_info.con_status == CON_STATUS_CONNECTING) {
+            if (bss->ssid_len == wlan_core.ap_info.ssid_len && !memcmp(bss->ssid, wlan_core.ap_info.ssid, bss->ssid_len) && (bss->sec_type == SECURITY_TYPE_NONE || wlan_core.ap_info.pwd_len)) {
+                score = wlan_score_bss(bss, NULL);
+                CORE_DEBUG("Score %ld\n", score);
+                if (!best.used || score > best_score) best = *bss, best_score = score;
+            }
+        } else if (wlan_callback && wlan_callback->wlan_cb_scan) wlan_callback->wlan_cb_scan(CORE_ERR_UNHANDLED_STATUS, ssid, bss->rssi, bss->channel, bss->sec_type);
+        /* 解析下一个AP */
+        bss_desc_set = (bss_desc_set_t *)((uint8_t *)bss_desc_set + sizeof(bss_desc_set->ie_length) + bss_desc_set->ie_length);
+    }
+    if (wlan_core.ap_info.con_status != CON_STATUS_CONNECTING) {
+        if (wlan_callback && wlan_callback->wlan_cb_scan) wlan_callback->wlan_cb_scan(CORE_ERR_OK, NULL, 0, 0, SECURITY_TYPE_NONE);
+        return CORE_ERR_OK;
+    }
+    if (best.used) {
+        if ((err = wlan_associate(&best)) && wlan_callback && wlan_callback->wlan_cb_sta_connect) wlan_callback->wlan_cb_sta_connect(CORE_ERR_UNHANDLED_STATUS);
+        return err;
+    }
+    /* 上次连接的信道上未搜索到AP，搜索全部信道 */
+    if (wlan_core.ap_info.hint_channel) {
+        CORE_DEBUG("AP is not on channel %d, scan all channels\n", wlan_core.ap_info.hint_channel);
+        wlan_core.ap_info.hint_channel = 0;
+        if (!wlan_scan_ssid(wlan_core.ap_info.ssid, wlan_core.ap_info.ssid_len, MAX_SCAN_TIME)) return CORE_ERR_OK;
+    }
+    CORE_DEBUG("Warning: Cannot connect to AP at this time\n");
+    wlan_core.ap_info.con_status = CON_STATUS_NOT_CONNECTED;
+    if (wlan_callback && wlan_callback->wlan_cb_sta_connect) wlan_callback->wlan_cb_sta_connect(CORE_ERR_UNHANDLED_STATUS);
+    return CORE_ERR_OK;
+}
+
+/**
+ * @param bss 搜索到或缓存的AP
+ * @return core_err_e中某一状态码
+ * @brief 组合关联参数并发送，WPA/WPA2先发送SUPPLICANT_PMK，失败时状态变为未连接
+ */
+static uint8_t wlan_associate(wlan_bss_entry_t *bss) {
+#ifdef WLAN_HOST_PMK
+    /* PMK未算完，由wlan_poll_pmk算完后关联 */
+    if (bss->sec_type >= SECURITY_TYPE_WPA && wlan_core.pmk_entry) {
+        wlan_core.pmk_bss = *bss;
+        wlan_core.pmk_bss.used = true;
+        return CORE_ERR_OK;
+    }
+#endif
+    uint8_t associate_params[0x200], err;
+    MrvlIEtypes_SSIDParamSet_t *ssid_tlv = (MrvlIEtypes_SSIDParamSet_t *)associate_params;
+    ssid_tlv->header.type = TLV_TYPE_SSID;
+    ssid_tlv->header.len = bss->ssid_len;
+    memcpy(ssid_tlv->ssid, bss->ssid, bss->ssid_len);
+    uint16_t associate_params_len = sizeof(MrvlIEtypesHeader_t) + bss->ssid_len;
+    MrvlIETypes_PhyParamDSSet_t *phy_tlv = (MrvlIETypes_PhyParamDSSet_t *)(associate_params + associate_params_len);
+    phy_tlv->header.type = TLV_TYPE_PHY_DS;
+    phy_tlv->header.len = 1;
+    phy_tlv->channel = bss->channel;
+    associate_params_len += sizeof(MrvlIETypes_PhyParamDSSet_t);
+    MrvlIETypes_CfParamSet_t *cf_tlv = (MrvlIETypes_CfParamSet_t *)(associate_params + associate_params_len);
+    memset(cf_tlv, 0, sizeof(MrvlIETypes_CfParamSet_t));
+    cf_tlv->header.type = TLV_TYPE_CF;
+    cf_tlv->header.len = sizeof(MrvlIETypes_CfParamSet_t) - sizeof(MrvlIEtypesHeader_t);
+    associate_params_len += sizeof(MrvlIETypes_CfParamSet_t);
+    if (bss->sec_type == SECURITY_TYPE_NONE) {
+        MrvlIETypes_AuthType_t *auth_tlv = (MrvlIETypes_AuthType_t *)(associate_params + associate_params_len);
+        auth_tlv->header.type = TLV_TYPE_AUTH_TYPE;
+        auth_tlv->header.len = sizeof(MrvlIETypes_AuthType_t) - sizeof(MrvlIEtypesHeader_t);
+        auth_tlv->auth_type = AUTH_TYPE_OPEN;
+        associate_params_len += sizeof(MrvlIETypes_AuthType_t);
+    }
+    MrvlIEtypes_ChanListParamSet_t *channel_list = (MrvlIEtypes_ChanListParamSet_t *)(associate_params + associate_params_len);
+    ChanScanParamSet_t *channel_list_params = (ChanScanParamSet_t *)(associate_params + associate_params_len + sizeof(MrvlIEtypesHeader_t));
+    channel_list->header.type = TLV_TYPE_CHANLIST;
+    channel_list->header.len = sizeof(ChanScanParamSet_t);
+    channel_list_params->chan_number = bss->channel;
+    channel_list_params->max_scan_time = MAX_SCAN_TIME;
+    channel_list_params->radio_type = channel_list_params->chan_scan_mode = channel_list_params->min_scan_time = 0;
+    associate_params_len += sizeof(MrvlIEtypes_ChanListParamSet_t);
+    uint8_t rate_tlv[] = {0x01, 0x00, 0x0C, 0x00, 0x82, 0x84, 0x8B, 0x8C, 0x12, 0x96, 0x98, 0x24, 0xB0, 0x48, 0x60, 0x6C};
+    memcpy(associate_params + associate_params_len, rate_tlv, sizeof(rate_tlv));
+    associate_params_len += sizeof(rate_tlv);
+#ifdef WLAN_11N
+    wlan_core.ap_info.phy_mode = bss->phy_mode;
+    /* 20MHz、短GI，AP的WMM IE随后与RSN/WPA IE一同转发 */
+    if (bss->phy_mode == PHY_MODE_11N) associate_params_len += wlan_ht_cap_tlv(associate_params + associate_params_len, HT_CAP_SM_PS_DISABLED | HT_CAP_SGI_20);
+#else
+    wlan_core.ap_info.phy_mode = bss->phy_mode == PHY_MODE_11N ? PHY_MODE_11G : bss->phy_mode;
+#endif
+    if (bss->sec_type >= SECURITY_TYPE_WPA && (err = wlan_ass_supplicant_pmk_pkg(bss->bssid))) return wlan_core.ap_info.con_status = CON_STATUS_NOT_CONNECTED, err;
+    /* RSN、WPA及WMM IE转为TLV（类型与IEEE元素ID相同） */
+    MrvlIEtypesHeader_t *ie_tlv;
+    for (uint8_t *ie = bss->ie; ie < bss->ie + bss->ie_len; ie += sizeof(IEEEHeader) + ie_tlv->len) {
+        ie_tlv = (MrvlIEtypesHeader_t *)(associate_params + associate_params_len);
+        ie_tlv->type = ((IEEEType *)ie)->header.type;
+        ie_tlv->len = ((IEEEType *)ie)->header.length;
+        memcpy(ie_tlv + 1, ((IEEEType *)ie)->data, ie_tlv->len);
+        associate_params_len += sizeof(MrvlIEtypesHeader_t) + ie_tlv->len;
+    }
+    memcpy(wlan_core.ap_info.ap_mac_addr, bss->bssid, MAC_ADDR_LENGTH);
+    wlan_core.ap_info.cap_info = bss->cap_info;
+    wlan_core.ap_info.channel = bss->channel;
+    wlan_core.ap_info.sec_type = bss->sec_type;
+    /* WPA/WPA2在SUPPLICANT_PMK成功后关联 */
+    wlan_cmd_t *associate_cmd = wlan_build_cmd(HOST_ID_802_11_ASSOCIATE, HOST_ACT_GEN_GET, associate_params, associate_params_len);
+    if (associate_cmd) associate_cmd->chained = bss->sec_type >= SECURITY_TYPE_WPA;
+    if ((err = associate_cmd ? wlan_dispatch_cmd() : CORE_ERR_CMD_QUEUE_FULL)) wlan_core.ap_info.con_status = CON_STATUS_NOT_CONNECTED;
+    return err;
+}
+
+/**
+ * @param bss_desc_set 搜索结果中的AP
+ * @param ssid 输出AP名称（以'\0'结尾）
+ * @return 更新的缓存项
+ * @brief 解析AP并按BSSID更新BSS缓存，缓存已满时替换最早更新的项
+ */
+static wlan_bss_entry_t *wlan_update_bss(bss_desc_set_t *bss_desc_set, uint8_t *ssid) {
+    wlan_bss_entry_t *bss = NULL, *entry = wlan_core.bss_cache;
+    IEEEType *rates = NULL, *ie, *wmm = NULL, *ie_params = &bss_desc_set->ie_parameters;
+    wlan_vendor *vendor;
+    const uint8_t rsn_oui[] = {0x00, 0x0F, 0xAC}, wpa_oui[] = {0x00, 0x50, 0xF2};
+    bool ht = false, ccmp = false;
+    uint8_t rate;
+    uint16_t ie_size = bss_desc_set->ie_length > sizeof(bss_desc_set_t) + sizeof(bss_desc_set->ie_length) + sizeof(bss_desc_set->ie_parameters) ? bss_desc_set->ie_length - (sizeof(bss_desc_set_t) - sizeof(bss_desc_set->ie_length) - sizeof(bss_desc_set->ie_parameters)) : 0;
+    for (; entry < wlan_core.bss_cache + WLAN_BSS_CACHE_NUM; ++entry) {
+        if (entry->used && !memcmp(entry->bssid, bss_desc_set->bssid, MAC_ADDR_LENGTH)) {
+            bss = entry;
+            break;
+        }
+        if (!bss || (bss->used && (!entry->used || (int32_t)(entry->time - bss->time) < 0))) bss = entry;
+    }
+    bss->used = true;
+    memcpy(bss->bssid, bss_desc_set->bssid, MAC_ADDR_LENGTH);
+    bss->rssi = bss_desc_set->rssi;
+    bss->cap_info = bss_desc_set->cap_info;
+    bss->sec_type = SECURITY_TYPE_WEP;
+    bss->time = sys_now();
+    bss->ssid_len = bss->channel = bss->ie_len = 0;
+    bss->phy_mode = PHY_MODE_11B;
+    while (ie_size) {
+        ie = NULL;
+        /* 判断TLV */
+        switch (ie_params->header.type) {
+        case TLV_TYPE_SSID:
+            bss->ssid_len = ie_params->header.length > MAX_SSID_LENGTH ? MAX_SSID_LENGTH : ie_params->header.length;
+            memcpy(bss->ssid, ie_params->data, bss->ssid_len);
+            break;
+        case TLV_TYPE_RATES: rates = ie_params; /* fall through */
+        case TLV_TYPE_EXT_RATES:
+            /* 有1、2、5.5、11Mbps以外的速率即支持OFDM */
+            for (uint8_t index = 0; index < ie_params->header.length; ++index) {
+                if ((rate = *(ie_params->data + index) & 0x7F) != 2 && rate != 4 && rate != 11 && rate != 22) bss->phy_mode = PHY_MODE_11G;
+            }
+            break;
+        case TLV_TYPE_PHY_DS: bss->channel = *ie_params->data; break;
+        case TLV_TYPE_HT_CAPABILITY: ht = true; break;
+        case TLV_TYPE_RSN_PARAMSET:
+            /* 收到RSN即为WPA2 */
+            bss->sec_type = SECURITY_TYPE_WPA2;
+            /* 版本号后为组密钥套件 */
+            if (ie_params->header.length > 2 && wlan_pairwise_ccmp(ie_params->data + 2, ie_params->header.length - 2, rsn_oui)) ccmp = true;
+            ie = ie_params;
+            break;
+        case TLV_TYPE_VENDOR_SPECIFIC_IE:
+            vendor = (wlan_vendor *)ie_params->data;
+            if (!memcmp(vendor->oui, wpa_oui, sizeof(wpa_oui)) && vendor->oui_type == 0x1) {
+                if (bss->sec_type != SECURITY_TYPE_WPA2) bss->sec_type = SECURITY_TYPE_WPA;
+                if (ie_params->header.length > 6 && wlan_pairwise_ccmp(vendor->multicast_oui, ie_params->header.length - 6, wpa_oui)) ccmp = true;
+                ie = ie_params;
+            }
+            /* WMM参数/信息元素，关联时转发 */
+            else if (!memcmp(vendor->oui, wpa_oui, sizeof(wpa_oui)) && vendor->oui_type == 0x2) ie = wmm = ie_params;
+            break;
+        }
+        if (ie && bss->ie_len + TLV_STRUCTLEN(ie) <= WLAN_BSS_IE_SIZE) {
+            memcpy(bss->ie + bss->ie_len, ie, TLV_STRUCTLEN(ie));
+            bss->ie_len += TLV_STRUCTLEN(ie);
+        }
+        /* 未能缓存的WMM IE不会在关联时转发 */
+        else if (ie && ie == wmm) wmm = NULL;
+        ie_size -= TLV_STRUCTLEN(ie_params);
+        ie_params = (IEEEType *)TLV_NEXT(ie_params);
+    }
+    if (!(bss->cap_info & WLAN_CAPABILITY_PRIVACY)) bss->sec_type = SECURITY_TYPE_NONE;
+    /* HT需要WMM（QoS），且不能使用WEP及TKIP */
+    if (ht && wmm && (bss->sec_type == SECURITY_TYPE_NONE || ccmp)) bss->phy_mode = PHY_MODE_11N;
+    memcpy(ssid, bss->ssid, bss->ssid_len);
+    *(ssid + bss->ssid_len) = '\0';
+    /* SSID名称 */
+    CORE_DEBUG("SSID '%s', ", ssid);
+    /* MAC地址 */
+    CORE_DEBUG("MAC %02X:%02X:%02X:%02X:%02X:%02X, ", *bss->bssid, *(bss->bssid + 1), *(bss->bssid + 2), *(bss->bssid + 3), *(bss->bssid + 4), *(bss->bssid + 5));
+    /* 信号强度及通道 */
+    CORE_DEBUG("RSSI %d, Channel %d\nCapability: 0x%04X (Security: ", bss->rssi, bss->channel, bss->cap_info);
+    switch (bss->sec_type) {
+    case SECURITY_TYPE_NONE: CORE_DEBUG("%s", "OPEN"); break;
+    case SECURITY_TYPE_WEP: CORE_DEBUG("%s", "WEP"); break;
+    case SECURITY_TYPE_WPA: CORE_DEBUG("%s", "WPA"); break;
+    case SECURITY_TYPE_WPA2: CORE_DEBUG("%s", "WPA2"); break;
+    }
+    CORE_DEBUG(", Mode: %s, PHY: %s)\n", bss->cap_info & WLAN_CAPABILITY_IBSS ? "Ad-Hoc" : "Infrastructure", bss->phy_mode == PHY_MODE_11N ? "11n" : bss->phy_mode == PHY_MODE_11G ? "11g" : "11b");
+    if (rates) {
+        CORE_DEBUG("Rates:");
+        for (uint8_t index = 0; index < rates->header.length; ++index) CORE_DEBUG(" %d Mbps", (*(rates->data + index) & 0x7F) >> 1);
+        CORE_DEBUG("\n");
+    }
+    return bss;
+}
+
+#ifdef WLAN_11N
+/**
+ * @param buf TLV缓冲区
+ * @param ht_cap_info HT能力信息
+ * @return TLV长度
+ * @brief 组合HT能力TLV（类型与IEEE元素ID相同），A-MPDU最大64KB，1个空间流MCS 0~7
+ */
+static uint8_t wlan_ht_cap_tlv(uint8_t *buf, uint16_t ht_cap_info) {
+    MrvlIETypes_HTCap_t *ht_cap_tlv = (MrvlIETypes_HTCap_t *)buf;
+    memset(ht_cap_tlv, 0, sizeof(MrvlIETypes_HTCap_t));
+    ht_cap_tlv->header.type = TLV_TYPE_HT_CAPABILITY;
+    ht_cap_tlv->header.len = sizeof(IEEEtypes_HTCap_t);
+    ht_cap_tlv->ht_cap.ht_cap_info = ht_cap_info;
+    ht_cap_tlv->ht_cap.ampdu_params = HT_AMPDU_PARAMS;
+    *ht_cap_tlv->ht_cap.rx_mcs_mask = HT_MCS_SET_1SS;
+    return sizeof(MrvlIETypes_HTCap_t);
+}
+#endif
+
+/**
+ * @param suite RSN或WPA IE中的组密钥套件，其后为成对密钥套件个数及列表
+ * @param len suite起的IE长度
+ * @param oui 套件的OUI
+ * @return 成对密钥套件中是否有CCMP
+ */
+static bool wlan_pairwise_ccmp(const uint8_t *suite, uint8_t len, const uint8_t *oui) {
+    if (len < 6) return false;
+    uint16_t count = *(suite + 4) | *(suite + 5) << 8;
+    for (suite += 6, len -= 6; count && len >= 4; --count, suite += 4, len -= 4) {
+        if (!memcmp(suite, oui, 3) && *(suite + 3) == 0x4) return true;
+    }
+    return false;
+}
+
+/**
+ * @param assoc_rsp 关联响应
+ * @param rsp_size 关联响应长度
+ * @return 协商的PHY模式，请求11n而关联响应中没有HT能力IE时为11g
+ */
+static wlan_phy_mode wlan_ret_phy_mode(IEEEtypes_AssocRsp_t *assoc_rsp, uint16_t rsp_size) {
+    if (wlan_core.ap_info.phy_mode != PHY_MODE_11N) return wlan_core.ap_info.phy_mode;
+    IEEEType *ie = (IEEEType *)assoc_rsp->IEBuffer;
+    uint16_t ie_size = rsp_size > sizeof(IEEEtypes_AssocRsp_t) - sizeof(assoc_rsp->IEBuffer) ? rsp_size - (sizeof(IEEEtypes_AssocRsp_t) - sizeof(assoc_rsp->IEBuffer)) : 0;
+    for (; ie_size >= sizeof(IEEEHeader) && ie_size >= TLV_STRUCTLEN(ie); ie_size -= TLV_STRUCTLEN(ie), ie = (IEEEType *)TLV_NEXT(ie)) {
+        if (ie->header.type == TLV_TYPE_HT_CAPABILITY) return PHY_MODE_11N;
+    }
+    return PHY_MODE_11G;
+}
+
+/**
+ * @param ssid AP名称
+ * @param ssid_len AP名称长度
+ * @return 同名AP中优先未过期（WLAN_BSS_CACHE_AGE）、其次得分最高的缓存项，未找到时为NULL
+ * @brief 查找前先删除超过WLAN_BSS_CACHE_EXPIRE的缓存项，需要密码而未提供密码的AP除外
+ */
+static wlan_bss_entry_t *wlan_find_bss(uint8_t *ssid, uint8_t ssid_len) {
+    wlan_bss_entry_t *bss = NULL, *entry = wlan_core.bss_cache;
+    uint32_t now = sys_now();
+    int32_t score, bss_score = 0;
+    bool fresh, bss_fresh = false;
+    for (; entry < wlan_core.bss_cache + WLAN_BSS_CACHE_NUM; ++entry) {
+        if (entry->used && now - entry->time > WLAN_BSS_CACHE_EXPIRE) entry->used = false;
+        if (!entry->used || entry->ssid_len != ssid_len || memcmp(entry->ssid, ssid, ssid_len) || !entry->channel || entry->channel > MAX_CHANNEL_NUM || (entry->sec_type != SECURITY_TYPE_NONE && !wlan_core.ap_info.pwd_len)) continue;
+        fresh = now - entry->time <= WLAN_BSS_CACHE_AGE;
+        score = wlan_score_bss(entry, NULL);
+        if (!bss || fresh > bss_fresh || (fresh == bss_fresh && score > bss_score)) bss = entry, bss_fresh = fresh, bss_score = score;
+    }
+    return bss;
+}
+
+/**
+ * @param bssid MAC地址
+ * @brief 删除BSS缓存项
+ */
+static void wlan_drop_bss(uint8_t *bssid) {
+    for (wlan_bss_entry_t *entry = wlan_core.bss_cache; entry < wlan_core.bss_cache + WLAN_BSS_CACHE_NUM; ++entry)
+        if (entry->used && !memcmp(entry->bssid, bssid, MAC_ADDR_LENGTH)) entry->used = false;
+}
+
+/**
+ * @param bss 缓存的AP
+ * @param blacklisted 输出是否在黑名单中，可为NULL
+ * @return 评分函数的得分，在黑名单中时扣除WLAN_BSS_SCORE_BLACKLIST
+ */
+static int32_t wlan_score_bss(const wlan_bss_entry_t *bss, bool *blacklisted) {
+    int32_t score = wlan_core.bss_score ? wlan_core.bss_score(bss) : wlan_bss_default_score(bss);
+    bool failed = wlan_bss_blacklisted(bss->bssid);
+    if (blacklisted) *blacklisted = failed;
+    return failed ? score - WLAN_BSS_SCORE_BLACKLIST : score;
+}
+
+/**
+ * @param bssid MAC地址
+ * @return 是否在黑名单中
+ * @brief 同时删除超过WLAN_BSS_BLACKLIST_TIME的黑名单项
+ */
+static bool wlan_bss_blacklisted(const uint8_t *bssid) {
+    bool found = false;
+    uint32_t now = sys_now();
+    for (wlan_bss_blacklist_t *entry = wlan_core.bss_blacklist; entry < wlan_core.bss_blacklist + WLAN_BSS_BLACKLIST_NUM; ++entry) {
+        if (entry->used && now - entry->time > WLAN_BSS_BLACKLIST_TIME) entry->used = false;
+        if (entry->used && !memcmp(entry->bssid, bssid, MAC_ADDR_LENGTH)) found = true;
+    }
+    return found;
+}
+
+/**
+ * @param bssid MAC地址
+ * @param failed 关联或握手失败时加入黑名单（已满时替换最早加入的项），连接成功时移出黑名单
+ */
+static void wlan_blacklist_bss(uint8_t *bssid, bool failed) {
+    wlan_bss_blacklist_t *blacklist = NULL, *entry = wlan_core.bss_blacklist;
+    for (; entry < wlan_core.bss_blacklist + WLAN_BSS_BLACKLIST_NUM; ++entry) {
+        if (entry->used && !memcmp(entry->bssid, bssid, MAC_ADDR_LENGTH)) {
+            blacklist = entry;
+            break;
+        }
+        if (!blacklist || (blacklist->used && (!entry->used || (int32_t)(entry->time - blacklist->time) < 0))) blacklist = entry;
+    }
+    if (!(blacklist->used = failed)) return;
+    CORE_DEBUG("Blacklist %02X:%02X:%02X:%02X:%02X:%02X\n", *bssid, *(bssid + 1), *(bssid + 2), *(bssid + 3), *(bssid + 4), *(bssid + 5));
+    memcpy(blacklist->bssid, bssid, MAC_ADDR_LENGTH);
+    blacklist->time = sys_now();
+}
+
+/**
+ * @param rx_buf rx缓冲区
+ * @return core_err_e中某一状态码
+ * @brief 处理数据，已建立重排序表的单播帧按序列号交付
+ */
+static uint8_t wlan_process_data(uint8_t *rx_buf) {
+    RxPD *rx_packet = (RxPD *)rx_buf;
+    uint8_t *payload = rx_buf + rx_packet->rx_pkt_offset + SDIO_HDR_SIZE;
+    /* STA模式下发送方为AP，AP模式下为以太网源地址 */
+    wlan_rx_reorder_t *table = *payload & 1 ? NULL : wlan_find_rx_reorder(rx_packet->bss_type, rx_packet->bss_type == BSS_TYPE_STA ? wlan_core.ap_info.ap_mac_addr : payload + MAC_ADDR_LENGTH, rx_packet->priority);
+    if (table) return wlan_rx_reorder(table, rx_buf);
+    /* BAR只用于移动重排序窗口 */
+    return rx_packet->rx_pkt_type == PKT_TYPE_BAR ? CORE_ERR_OK : wlan_deliver_data(rx_buf);
+}
+
+/**
+ * @param rx_buf rx缓冲区
+ * @return core_err_e中某一状态码
+ * @brief 交付数据：STA模式下由lwIP处理，AP模式下按目的地址转发或由lwIP处理，A-MSDU按子帧交付
+ */
+static uint8_t wlan_deliver_data(uint8_t *rx_buf) {
+#ifdef WLAN_RX_AMSDU
+    if (((RxPD *)rx_buf)->rx_pkt_type == PKT_TYPE_AMSDU) return wlan_deliver_amsdu(rx_buf);
+#else
+    if (((RxPD *)rx_buf)->rx_pkt_type == PKT_TYPE_AMSDU) return ++wlan_core.stats.rx_amsdu_count, CORE_ERR_OK;
+#endif
+    switch (*(rx_buf + SDIO_HDR_SIZE)) {
+    case BSS_TYPE_STA: ethernetif_data_input(rx_buf, BSS_TYPE_STA); break;
+    case BSS_TYPE_UAP: {
+        uint8_t *payload = rx_buf + ((RxPD *)rx_buf)->rx_pkt_offset + SDIO_HDR_SIZE;
+        /* 多播封包，转发并由lwIP处理 */
+        if (*payload & 1) {
+            if ((*payload = wlan_send_data(payload, ((RxPD *)rx_buf)->rx_pkt_length, BSS_TYPE_UAP))) return *payload;
+            ethernetif_data_input(rx_buf, BSS_TYPE_UAP);
+        }
+        /* 单播封包地址不同，转发 */
+        else if (memcmp(payload, wlan_core.mac_addr, MAC_ADDR_LENGTH)) return wlan_send_data(payload, ((RxPD *)rx_buf)->rx_pkt_length, BSS_TYPE_UAP);
+        /* 单播封包地址相同，由lwIP处理 */
+        else ethernetif_data_input(rx_buf, BSS_TYPE_UAP);
+        break;
+    }
+    }
+    return CORE_ERR_OK;
+}
+
+#ifdef WLAN_RX_AMSDU
+/**
+ * @param rx_buf rx缓冲区（A-MSDU）
+ * @return core_err_e中某一状态码
+ * @brief 拆分A-MSDU：子帧的目的及源地址后移覆盖长度及LLC/SNAP头，原地成为以太网帧，
+ *        改写RxPD中的偏移及长度后逐个交付，lwIP可零拷贝引用各子帧
+ */
+static uint8_t wlan_deliver_amsdu(uint8_t *rx_buf) {
+    RxPD *rx_packet = (RxPD *)rx_buf;
+    uint16_t offset = rx_packet->rx_pkt_offset, end = offset + rx_packet->rx_pkt_length, msdu_len;
+    uint8_t *subframe, err = CORE_ERR_OK, deliver_err;
+    ++wlan_core.stats.rx_amsdu_count;
+    if (SDIO_HDR_SIZE + end > rx_packet->pack_len) end = rx_packet->pack_len - SDIO_HDR_SIZE;
+    rx_packet->rx_pkt_type = 0;
+    for (; offset + AMSDU_SUBFRAME_HDR_SIZE <= end; offset += AMSDU_SUBFRAME_ALIGN(AMSDU_SUBFRAME_HDR_SIZE + msdu_len)) {
+        subframe = rx_buf + SDIO_HDR_SIZE + offset;
+        msdu_len = *(subframe + 12) << 8 | *(subframe + 13);
+        /* 长度超出封包时丢弃其余子帧 */
+        if (offset + AMSDU_SUBFRAME_HDR_SIZE + msdu_len > end) {
+            ++wlan_core.stats.rx_amsdu_drop_count;
+            break;
+        }
+        if (msdu_len < LLC_SNAP_SIZE || memcmp(subframe + AMSDU_SUBFRAME_HDR_SIZE, LLC_SNAP_HDR, LLC_SNAP_SIZE - 2)) {
+            ++wlan_core.stats.rx_amsdu_drop_count;
+            continue;
+        }
+        memmove(subframe + LLC_SNAP_SIZE, subframe, MAC_ADDR_LENGTH << 1);
+        rx_packet->rx_pkt_offset = offset + LLC_SNAP_SIZE;
+        rx_packet->rx_pkt_length = AMSDU_SUBFRAME_HDR_SIZE + msdu_len - LLC_SNAP_SIZE;
+        ++wlan_core.stats.rx_amsdu_subframe_count;
+        if ((deliver_err = wlan_deliver_data(rx_buf)) && !err) err = deliver_err;
+    }
+    return err;
+}
+#endif
+
+/**
+ * @param bss_type BSS网络类型
+ * @param ta 发送方地址
+ * @param tid TID
+ * @return 重排序表，不存在时返回NULL
+ * @brief 查找重排序表
+ */
+static wlan_rx_reorder_t *wlan_find_rx_reorder(uint8_t bss_type, uint8_t *ta, uint8_t tid) {
+    for (wlan_rx_reorder_t *table = wlan_core.rx_reorder; table < wlan_core.rx_reorder + WLAN_RX_REORDER_NUM; ++table) {
+        if (table->used && table->bss_type == bss_type && table->tid == tid && !memcmp(table->ta, ta, MAC_ADDR_LENGTH)) return table;
+    }
+    return NULL;
+}
+
+/**
+ * @param rx_buf rx缓冲区（ADDBA事件）
+ * @return core_err_e中某一状态码
+ * @brief 为ADDBA请求建立重排序表并响应，窗口限制为WLAN_RX_REORDER_WIN，无空闲重排序表时拒绝，禁用WLAN_RX_AMSDU时不允许A-MPDU中的A-MSDU
+ */
+static uint8_t wlan_add_rx_reorder(uint8_t *rx_buf) {
+    HOST_DS_11N_ADDBA_REQ *add_ba_req = (HOST_DS_11N_ADDBA_REQ *)(rx_buf + EVENT_HDR_SIZE);
+    uint8_t bss_type = *(rx_buf + SDIO_HDR_SIZE + 3), tid = (add_ba_req->block_ack_param_set & BLOCK_ACK_TID_MASK) >> BLOCK_ACK_TID_POS, err;
+    uint16_t win_size = add_ba_req->block_ack_param_set >> BLOCK_ACK_WIN_SIZE_POS;
+    wlan_rx_reorder_t *table = wlan_find_rx_reorder(bss_type, add_ba_req->peer_mac_addr, tid);
+    /* 同一TID重新建立，交付已缓存的帧 */
+    if (table) wlan_drain_rx_reorder(table);
+    else {
+        for (table = wlan_core.rx_reorder; table < wlan_core.rx_reorder + WLAN_RX_REORDER_NUM && table->used; ++table);
+        if (table == wlan_core.rx_reorder + WLAN_RX_REORDER_NUM) {
+            CORE_DEBUG("Warning: ADDBA declined (TID %d)\n", tid);
+            return wlan_prepare_cmd(HOST_ID_11N_ADDBA_RSP, HOST_ACT_GEN_GET, (uint8_t *)add_ba_req, REQUEST_DECLINED << 8 | bss_type);
+        }
+    }
+    if (!win_size || win_size > WLAN_RX_REORDER_WIN) win_size = WLAN_RX_REORDER_WIN;
+    add_ba_req->block_ack_param_set = (add_ba_req->block_ack_param_set & ~BLOCK_ACK_WIN_SIZE_MASK) | win_size << BLOCK_ACK_WIN_SIZE_POS;
+#ifndef WLAN_RX_AMSDU
+    add_ba_req->block_ack_param_set &= ~BLOCK_ACK_AMSDU_SUPPORTED;
+#endif
+    memset(table, 0, sizeof(wlan_rx_reorder_t));
+    table->used = true;
+    table->bss_type = bss_type;
+    memcpy(table->ta, add_ba_req->peer_mac_addr, MAC_ADDR_LENGTH);
+    table->tid = tid;
+    table->win_size = win_size;
+    table->start_win = add_ba_req->ssn & SEQ_NUM_MASK;
+    CORE_DEBUG("ADDBA TID %d, window %d, SSN %d\n", tid, win_size, table->start_win);
+    if ((err = wlan_prepare_cmd(HOST_ID_11N_ADDBA_RSP, HOST_ACT_GEN_GET, (uint8_t *)add_ba_req, bss_type))) table->used = false;
+    return err;
+}
+
+/**
+ * @param table 重排序表
+ * @brief 删除重排序表，丢弃已缓存的帧
+ */
+static void wlan_del_rx_reorder(wlan_rx_reorder_t *table) {
+    for (uint8_t index = 0; table->pkt_num && index < WLAN_RX_REORDER_WIN; ++index) {
+        if (!*(table->pkt + index)) continue;
+        wlan_rx_buf_unref(*(table->pkt + index));
+        --table->pkt_num;
+    }
+    table->used = false;
+}
+
+/**
+ * @param bss_type BSS网络类型
+ * @param ra 对方地址，NULL为全部
+ * @brief 连接断开时删除对应的重排序表及TX BA会话
+ */
+static void wlan_clear_ba(uint8_t bss_type, uint8_t *ra) {
+    for (wlan_rx_reorder_t *table = wlan_core.rx_reorder; table < wlan_core.rx_reorder + WLAN_RX_REORDER_NUM; ++table) {
+        if (table->used && table->bss_type == bss_type && (!ra || !memcmp(table->ta, ra, MAC_ADDR_LENGTH))) wlan_del_rx_reorder(table);
+    }
+#ifdef WLAN_11N
+    for (wlan_tx_ba_t *session = wlan_core.tx_ba; session < wlan_core.tx_ba + WLAN_TX_BA_NUM; ++session) {
+        if (session->used && session->bss_type == bss_type && (!ra || !memcmp(session->ra, ra, MAC_ADDR_LENGTH))) session->used = false;
+    }
+#endif
+}
+
 /**
+ * @param table 重排序表
  * @param rx_buf rx缓冲区
  * @return core_err_e中某一状态码
- * @brief 解析搜索命令响应，搜索的是IEEE的TLV而非Marvell的TLV
+ * @brief 按序列号重排序：丢弃窗口之前的帧及重复的帧，超出窗口时移动窗口，窗口起始的帧及之后连续的帧立即交付，
+ *        其余帧引用所在的接收缓冲区等待，缓冲区不足时交付该帧之前缓存的帧后不再等待
  */
-static uint8_t wlan_ret_scan(uint8_t *rx_buf) {
-    HOST_DS_802_11_SCAN_RSP *scan_rsp = (HOST_DS_802_11_SCAN_RSP *)rx_buf;
-    CORE_DEBUG("bss_descript_size: %d\nnumber_of_sets: %d\n", scan_rsp->bss_descript_size, scan_rsp->number_of_sets);
-    /* 判断搜索到的AP个数 */
-    if (!scan_rsp->number_of_sets) {
-        if (wlan_core.ap_info.con_status == CON_STATUS_CONNECTING) {
-            CORE_DEBUG("Warning: Cannot connect to AP at this time\n");
-            wlan_core.ap_info.con_status = CON_STATUS_NOT_CONNECTED;
-            if (wlan_callback && wlan_callback->wlan_cb_sta_connect) wlan_callback->wlan_cb_sta_connect(CORE_ERR_UNHANDLED_STATUS);
-        } else if (wlan_callback && wlan_callback->wlan_cb_scan) wlan_callback->wlan_cb_scan(CORE_ERR_OK, NULL, 0, 0, SECURITY_TYPE_NONE);
-        return CORE_ERR_OK;
-    }
-    bss_desc_set_t *bss_desc_set = (bss_desc_set_t *)scan_rsp->bss_desc_and_tlv_buffer;
-    IEEEType *rates, *ie_params, *vendor_data_ptr[8], *rsn_data_ptr = NULL;
-    wlan_security_type sec_type;
-    wlan_vendor *vendor;
-    uint16_t ie_size;
-    uint8_t ssid[MAX_SSID_LENGTH + 1], channel = 0, vendor_tlv_count = 0;
-    for (uint8_t index = 0; index < scan_rsp->number_of_sets; ++index) {
-        rates = NULL;
-        sec_type = SECURITY_TYPE_WEP;
-        ie_params = &bss_desc_set->ie_parameters;
-        ie_size = bss_desc_set->ie_length > sizeof(bss_desc_set_t) + sizeof(bss_desc_set->ie_length) + sizeof(bss_desc_set->ie_parameters) ? bss_desc_set->ie_length - (sizeof(bss_desc_set_t) - sizeof(bss_desc_set->ie_length) - sizeof(bss_desc_set->ie_parameters)) : 0;
-        while (ie_size) {
-            /* 判断TLV */
-            switch (ie_params->header.type) {
-            case TLV_TYPE_SSID:
-                memcpy(ssid, ie_params->data, ie_params->header.length > MAX_SSID_LENGTH ? MAX_SSID_LENGTH : ie_params->header.length);
-                *(ssid + (ie_params->header.length > MAX_SSID_LENGTH ? MAX_SSID_LENGTH : ie_params->header.length)) = '\0';
-                break;
-            case TLV_TYPE_RATES: rates = ie_params; break;
-            case TLV_TYPE_PHY_DS: channel = *ie_params->data; break;
-            case TLV_TYPE_RSN_PARAMSET:
-                /* 收到RSN即为WPA2 */
-                sec_type = SECURITY_TYPE_WPA2;
-                rsn_data_ptr = ie_params;
-                break;
-            case TLV_TYPE_VENDOR_SPECIFIC_IE:
-                if (sec_type != SECURITY_TYPE_WPA2) {
-                    vendor = (wlan_vendor *)ie_params->data;
-                    if (!*vendor->oui && *(vendor->oui + 1) == 0x50 && *(vendor->oui + 2) == 0xF2 && vendor->oui_type == 0x1) sec_type = SECURITY_TYPE_WPA;
-                }
-                if (vendor_tlv_count < 8) {
-                    *(vendor_data_ptr + vendor_tlv_count) = ie_params;
-                    ++vendor_tlv_count;
-                }
-                break;
-            }
-            ie_size -= TLV_STRUCTLEN(ie_params);
-            ie_params = (IEEEType *)TLV_NEXT(ie_params);
-        }
-        if (!(bss_desc_set->cap_info & WLAN_CAPABILITY_PRIVACY)) sec_type = SECURITY_TYPE_NONE;
-        /* SSID名称 */
-        CORE_DEBUG("SSID '%s', ", ssid);
-        /* MAC地址 */
-        CORE_DEBUG("MAC %02X:%02X:%02X:%02X:%02X:%02X, ", *bss_desc_set->bssid, *(bss_desc_set->bssid + 1), *(bss_desc_set->bssid + 2), *(bss_desc_set->bssid + 3), *(bss_desc_set->bssid + 4), *(bss_desc_set->bssid + 5));
-        /* 信号强度及通道 */
-        CORE_DEBUG("RSSI %d, Channel %d\nCapability: 0x%04X (Security: ", bss_desc_set->rssi, channel, bss_desc_set->cap_info);
-        switch (wlan_core.ap_info.sec_type = sec_type) {
-        case SECURITY_TYPE_NONE: CORE_DEBUG("%s", "OPEN"); break;
-        case SECURITY_TYPE_WEP: CORE_DEBUG("%s", "WEP"); break;
-        case SECURITY_TYPE_WPA: CORE_DEBUG("%s", "WPA"); break;
-        case SECURITY_TYPE_WPA2: CORE_DEBUG("%s", "WPA2"); break;
-        }
-        CORE_DEBUG(", Mode: %s)\n", bss_desc_set->cap_info & WLAN_CAPABILITY_IBSS ? "Ad-Hoc" : "Infrastructure");
-        if (rates) {
-            CORE_DEBUG("Rates:");
-            for (uint8_t index = 0; index < rates->header.length; ++index) CORE_DEBUG(" %d Mbps", (*(rates->data + index) & 0x7F) >> 1);
-            CORE_DEBUG("\n");
+static uint8_t wlan_rx_reorder(wlan_rx_reorder_t *table, uint8_t *rx_buf) {
+    RxPD *rx_packet = (RxPD *)rx_buf;
+    uint16_t seq_num = rx_packet->seq_num & SEQ_NUM_MASK, offset = (seq_num - table->start_win) & SEQ_NUM_MASK;
+    uint8_t **pkt = table->pkt + (seq_num & (WLAN_RX_REORDER_WIN - 1)), err, flush_err;
+    if (offset >= SEQ_NUM_HALF) return ++wlan_core.stats.rx_reorder_drop_count, CORE_ERR_OK;
+    /* BAR中的序列号为新的窗口起始 */
+    if (rx_packet->rx_pkt_type == PKT_TYPE_BAR) return wlan_flush_rx_reorder(table, seq_num);
+    /* 超出窗口，窗口末尾移至该帧 */
+    if (offset >= table->win_size && (err = wlan_flush_rx_reorder(table, (seq_num - table->win_size + 1) & SEQ_NUM_MASK))) return err;
+    if (seq_num != table->start_win) {
+        if (*pkt) return ++wlan_core.stats.rx_reorder_drop_count, CORE_ERR_OK;
+        if (wlan_rx_buf_ref(rx_buf)) {
+            *pkt = rx_buf;
+            if (!table->pkt_num++) table->time = sys_now();
+            ++wlan_core.stats.rx_reorder_count;
+            return CORE_ERR_OK;
         }
-        if (wlan_core.ap_info.con_status == CON_STATUS_CONNECTING) {
-            /* 连接准备 */
-            uint8_t associate_params[0x200];
-            MrvlIEtypes_SSIDParamSet_t *ssid_tlv = (MrvlIEtypes_SSIDParamSet_t *)associate_params;
-            ssid_tlv->header.type = TLV_TYPE_SSID;
-            ssid_tlv->header.len = wlan_core.ap_info.ssid_len;
-            memcpy(ssid_tlv->ssid, ssid, wlan_core.ap_info.ssid_len);
-            uint16_t associate_params_len = sizeof(MrvlIEtypesHeader_t) + wlan_core.ap_info.ssid_len;
-            MrvlIETypes_PhyParamDSSet_t *phy_tlv = (MrvlIETypes_PhyParamDSSet_t *)(associate_params + associate_params_len);
-            phy_tlv->header.type = TLV_TYPE_PHY_DS;
-            phy_tlv->header.len = 1;
-            phy_tlv->channel = channel;
-            associate_params_len += sizeof(MrvlIETypes_PhyParamDSSet_t);
-            MrvlIETypes_CfParamSet_t *cf_tlv = (MrvlIETypes_CfParamSet_t *)(associate_params + associate_params_len);
-            memset(cf_tlv, 0, sizeof(MrvlIETypes_CfParamSet_t));
-            cf_tlv->header.type = TLV_TYPE_CF;
-            cf_tlv->header.len = sizeof(MrvlIETypes_CfParamSet_t) - sizeof(MrvlIEtypesHeader_t);
-            associate_params_len += sizeof(MrvlIETypes_CfParamSet_t);
-            if (sec_type == SECURITY_TYPE_NONE) {
-                MrvlIETypes_AuthType_t *auth_tlv = (MrvlIETypes_AuthType_t *)(associate_params + associate_params_len);
-                auth_tlv->header.type = TLV_TYPE_AUTH_TYPE;
-                auth_tlv->header.len = sizeof(MrvlIETypes_AuthType_t) - sizeof(MrvlIEtypesHeader_t);
-                auth_tlv->auth_type = AUTH_TYPE_OPEN;
-                associate_params_len += sizeof(MrvlIETypes_AuthType_t);
-            }
-            MrvlIEtypes_ChanListParamSet_t *channel_list = (MrvlIEtypes_ChanListParamSet_t *)(associate_params + associate_params_len);
-            ChanScanParamSet_t *channel_list_params = (ChanScanParamSet_t *)(associate_params + associate_params_len + sizeof(MrvlIEtypesHeader_t));
-            channel_list->header.type = TLV_TYPE_CHANLIST;
-            channel_list->header.len = sizeof(ChanScanParamSet_t);
-            channel_list_params->chan_number = channel;
-            channel_list_params->max_scan_time = MAX_SCAN_TIME;
-            channel_list_params->radio_type = channel_list_params->chan_scan_mode = channel_list_params->min_scan_time = 0;
-            associate_params_len += sizeof(MrvlIEtypes_ChanListParamSet_t);
-            uint8_t rate_tlv[] = {0x01, 0x00, 0x0C, 0x00, 0x82, 0x84, 0x8B, 0x8C, 0x12, 0x96, 0x98, 0x24, 0xB0, 0x48, 0x60, 0x6C};
-            memcpy(associate_params + associate_params_len, rate_tlv, sizeof(rate_tlv));
-            associate_params_len += sizeof(rate_tlv);
-            if (sec_type >= SECURITY_TYPE_WPA) {
-                if ((*rate_tlv = wlan_ass_supplicant_pmk_pkg(bss_desc_set->bssid))) {
-                    wlan_core.ap_info.con_status = CON_STATUS_NOT_CONNECTED;
-                    if (wlan_callback && wlan_callback->wlan_cb_sta_connect) wlan_callback->wlan_cb_sta_connect(CORE_ERR_UNHANDLED_STATUS);
-                    return *rate_tlv;
-                }
-                MrvlIETypes_Vendor_t *vendor_tlv;
-                for (uint8_t index = 0; index < vendor_tlv_count; ++index) {
-                    vendor_tlv = (MrvlIETypes_Vendor_t *)(associate_params + associate_params_len);
-                    vendor_tlv->header.type = TLV_TYPE_VENDOR_SPECIFIC_IE;
-                    vendor_tlv->header.len = (*(vendor_data_ptr + index))->header.length;
-                    memcpy(vendor_tlv->vendor, (*(vendor_data_ptr + index))->data, vendor_tlv->header.len);
-                    associate_params_len += sizeof(MrvlIEtypesHeader_t) + vendor_tlv->header.len;
-                }
-                if (sec_type == SECURITY_TYPE_WPA2) {
-                    MrvlIETypes_RSN_t *rsn_tlv = (MrvlIETypes_RSN_t *)(associate_params + associate_params_len);
-                    rsn_tlv->header.type = TLV_TYPE_RSN_PARAMSET;
-                    rsn_tlv->header.len = rsn_data_ptr->header.length;
-                    memcpy(rsn_tlv->rsn, rsn_data_ptr->data, rsn_tlv->header.len);
-                    associate_params_len += sizeof(MrvlIEtypesHeader_t) + rsn_tlv->header.len;
-                }
-            }
-            memcpy(wlan_core.ap_info.ap_mac_addr, bss_desc_set->bssid, MAC_ADDR_LENGTH);
-            wlan_core.ap_info.cap_info = bss_desc_set->cap_info;
-            if ((*rate_tlv = wlan_prepare_cmd(HOST_ID_802_11_ASSOCIATE, HOST_ACT_GEN_GET, associate_params, associate_params_len))) {
-                wlan_core.ap_info.con_status = CON_STATUS_NOT_CONNECTED;
-                if (wlan_callback && wlan_callback->wlan_cb_sta_connect) wlan_callback->wlan_cb_sta_connect(CORE_ERR_UNHANDLED_STATUS);
-                return *rate_tlv;
-            }
-        } else if (wlan_callback && wlan_callback->wlan_cb_scan) wlan_callback->wlan_cb_scan(CORE_ERR_UNHANDLED_STATUS, ssid, bss_desc_set->rssi, channel, sec_type);
-        /* 解析下一个AP */
-        bss_desc_set = (bss_desc_set_t *)((uint8_t *)bss_desc_set + sizeof(bss_desc_set->ie_length) + bss_desc_set->ie_length);
+        ++wlan_core.stats.rx_reorder_flush_count;
+        if ((err = wlan_flush_rx_reorder(table, seq_num))) return err;
     }
-    if (wlan_core.ap_info.con_status != CON_STATUS_CONNECTING && wlan_callback && wlan_callback->wlan_cb_scan) wlan_callback->wlan_cb_scan(CORE_ERR_OK, NULL, 0, 0, SECURITY_TYPE_NONE);
-    return CORE_ERR_OK;
+    err = wlan_deliver_data(rx_buf);
+    flush_err = wlan_flush_rx_reorder(table, (seq_num + 1) & SEQ_NUM_MASK);
+    return err ? err : flush_err;
 }
 
 /**
- * @param rx_buf rx缓冲区
+ * @param table 重排序表
+ * @param start_win 新的窗口起始（不早于当前窗口起始）
  * @return core_err_e中某一状态码
- * @brief 处理数据
+ * @brief 交付新窗口起始之前缓存的帧，再交付窗口起始之后连续的帧
  */
-static uint8_t wlan_process_data(uint8_t *rx_buf) {
-    switch (*(rx_buf + SDIO_HDR_SIZE)) {
-    case BSS_TYPE_STA: ethernetif_data_input(rx_buf, BSS_TYPE_STA); break;
-    case BSS_TYPE_UAP: {
-        uint8_t *payload = rx_buf + ((RxPD *)rx_buf)->rx_pkt_offset + SDIO_HDR_SIZE;
-        /* 多播封包，转发并由lwIP处理 */
-        if (*payload & 1) {
-            if ((*payload = wlan_send_data(payload, ((RxPD *)rx_buf)->rx_pkt_length, BSS_TYPE_UAP))) return *payload;
-            ethernetif_data_input(rx_buf, BSS_TYPE_UAP);
+static uint8_t wlan_flush_rx_reorder(wlan_rx_reorder_t *table, uint16_t start_win) {
+    uint16_t prev_win = table->start_win;
+    uint8_t err = CORE_ERR_OK, deliver_err, **pkt;
+    /* 缓存的帧均在窗口内，全部交付后直接移至新窗口起始 */
+    for (; table->pkt_num; table->start_win = (table->start_win + 1) & SEQ_NUM_MASK) {
+        pkt = table->pkt + (table->start_win & (WLAN_RX_REORDER_WIN - 1));
+        if (*pkt) {
+            if ((deliver_err = wlan_deliver_data(*pkt)) && !err) err = deliver_err;
+            wlan_rx_buf_unref(*pkt);
+            *pkt = NULL;
+            --table->pkt_num;
+        } else if (((table->start_win - start_win) & SEQ_NUM_MASK) < SEQ_NUM_HALF) break;
+    }
+    if (((start_win - table->start_win) & SEQ_NUM_MASK) < SEQ_NUM_HALF) table->start_win = start_win;
+    if (table->start_win != prev_win) table->time = sys_now();
+    return err;
+}
+
+/**
+ * @param table 重排序表
+ * @return core_err_e中某一状态码
+ * @brief 交付全部缓存的帧，窗口起始移至最后一个缓存的帧之后
+ */
+static uint8_t wlan_drain_rx_reorder(wlan_rx_reorder_t *table) {
+    uint8_t offset = table->win_size;
+    if (!table->pkt_num) return CORE_ERR_OK;
+    while (!*(table->pkt + ((table->start_win + offset - 1) & (WLAN_RX_REORDER_WIN - 1)))) --offset;
+    return wlan_flush_rx_reorder(table, (table->start_win + offset) & SEQ_NUM_MASK);
+}
+
+#ifdef WLAN_11N
+/**
+ * @param mac STA的MAC地址
+ * @return 已接入的STA信息，未接入时为NULL
+ */
+static sta_info_t *wlan_find_sta(uint8_t *mac) {
+    for (uint8_t index = 0; index < MAX_CLIENT_NUM; ++index) {
+        if ((wlan_core.sta_info + index)->used && !memcmp((wlan_core.sta_info + index)->sta_mac_addr, mac, MAC_ADDR_LENGTH)) return wlan_core.sta_info + index;
+    }
+    return NULL;
+}
+
+/**
+ * @param assoc STA接入事件内容
+ * @param size 事件内容长度
+ * @return STA的关联请求中是否带有HT能力IE
+ */
+static bool wlan_sta_ht(HOST_DS_MICRO_AP_STA_ASSOC *assoc, uint16_t size) {
+    uint16_t offset = sizeof(HOST_DS_MICRO_AP_STA_ASSOC) - sizeof(assoc->IEBuffer), end;
+    IEEEType *ie;
+    if (size < offset || assoc->type != TLV_TYPE_UAP_MGMT_FRAME) return false;
+    /* 重新关联请求（子类型2）跳过当前AP地址 */
+    if ((assoc->frame_control & 0x00FC) == 0x0020) offset += MAC_ADDR_LENGTH;
+    /* IE结束位置不超出事件长度 */
+    end = MAC_ADDR_LENGTH + 2 * sizeof(uint16_t) + assoc->len;
+    if (end > size) end = size;
+    if (end <= offset) return false;
+    ie = (IEEEType *)((uint8_t *)assoc + offset);
+    for (uint16_t ie_size = end - offset; ie_size >= sizeof(IEEEHeader) && ie_size >= TLV_STRUCTLEN(ie); ie_size -= TLV_STRUCTLEN(ie), ie = (IEEEType *)TLV_NEXT(ie)) {
+        if (ie->header.type == TLV_TYPE_HT_CAPABILITY) return true;
+    }
+    return false;
+}
+
+/**
+ * @param tx_packet 封包
+ * @brief 以IPv4 TOS的高3位作为TID，按（接收方，TID）统计单播帧，无对应项时替换最久未发送的空闲项
+ */
+static void wlan_count_tx_ba(TxPD *tx_packet) {
+    uint8_t *payload = (uint8_t *)tx_packet + tx_packet->tx_pkt_offset + SDIO_HDR_SIZE, *ra, tid = 0;
+    uint32_t now = sys_now();
+    wlan_tx_ba_t *session, *oldest = NULL;
+    sta_info_t *sta;
+    /* 以太网类型0x0800，TOS为IP头部的第2字节 */
+    if (tx_packet->tx_pkt_length >= 16 && *(payload + 12) == 0x08 && !*(payload + 13)) tid = *(payload + 15) >> 5;
+    tx_packet->priority = tid;
+    if (*payload & 1) return;
+    /* STA模式下接收方为以11n连接的AP，AP模式下为关联请求中带有HT能力的已接入STA */
+    if (tx_packet->bss_type == BSS_TYPE_STA) {
+        if (wlan_core.ap_info.con_status != CON_STATUS_CONNECTED || wlan_core.ap_info.phy_mode != PHY_MODE_11N) return;
+        ra = wlan_core.ap_info.ap_mac_addr;
+    } else if (wlan_core.uap_ht && (sta = wlan_find_sta(payload)) && sta->ht) ra = payload;
+    else return;
+    if (!(session = wlan_find_tx_ba(tx_packet->bss_type, ra, tid))) {
+        for (session = wlan_core.tx_ba; session < wlan_core.tx_ba + WLAN_TX_BA_NUM && session->used; ++session) {
+            if (session->state == TX_BA_STATE_IDLE && (!oldest || now - session->last_time > now - oldest->last_time)) oldest = session;
         }
-        /* 单播封包地址不同，转发 */
-        else if (memcmp(payload, wlan_core.mac_addr, MAC_ADDR_LENGTH)) return wlan_send_data(payload, ((RxPD *)rx_buf)->rx_pkt_length, BSS_TYPE_UAP);
-        /* 单播封包地址相同，由lwIP处理 */
-        else ethernetif_data_input(rx_buf, BSS_TYPE_UAP);
-        break;
+        if (session == wlan_core.tx_ba + WLAN_TX_BA_NUM && !(session = oldest)) return;
+        memset(session, 0, sizeof(wlan_tx_ba_t));
+        session->used = true;
+        session->bss_type = tx_packet->bss_type;
+        memcpy(session->ra, ra, MAC_ADDR_LENGTH);
+        session->tid = tid;
+        session->state_time = session->period_time = now;
     }
+    if (now - session->period_time >= WLAN_TX_BA_PERIOD) session->period_time = now, session->period_pkts = 0;
+    if (session->period_pkts < UINT16_MAX) ++session->period_pkts;
+    session->last_time = now;
+    if (session->state == TX_BA_STATE_ACTIVE) ++session->tx_pkts, session->tx_bytes += tx_packet->tx_pkt_length;
+}
+
+/**
+ * @param bss_type BSS网络类型
+ * @param ra 接收方地址
+ * @param tid TID
+ * @return TX BA会话，不存在时返回NULL
+ * @brief 查找TX BA会话
+ */
+static wlan_tx_ba_t *wlan_find_tx_ba(uint8_t bss_type, uint8_t *ra, uint8_t tid) {
+    for (wlan_tx_ba_t *session = wlan_core.tx_ba; session < wlan_core.tx_ba + WLAN_TX_BA_NUM; ++session) {
+        if (session->used && session->bss_type == bss_type && session->tid == tid && !memcmp(session->ra, ra, MAC_ADDR_LENGTH)) return session;
     }
-    return CORE_ERR_OK;
+    return NULL;
+}
+
+/**
+ * @param err core_err_e中某一状态码
+ * @param resp 无意义
+ * @param arg TX BA会话
+ * @brief ADDBA请求结束回调，发送失败、超时或固件返回错误时响应不会到达，会话回到空闲状态
+ */
+static void wlan_tx_ba_complete(uint8_t err, uint8_t *resp, void *arg) {
+    UNUSED(resp);
+    wlan_tx_ba_t *session = (wlan_tx_ba_t *)arg;
+    if (err && session->used && session->state == TX_BA_STATE_SETUP) wlan_set_tx_ba(session, TX_BA_STATE_IDLE);
 }
 
+/**
+ * @param session TX BA会话
+ * @param state 新的状态
+ * @brief 改变TX BA会话的状态并累计次数，之后重新统计流量
+ */
+static void wlan_set_tx_ba(wlan_tx_ba_t *session, wlan_tx_ba_state state) {
+    CORE_DEBUG("TX BA TID %d: %d -> %d\n", session->tid, session->state, state);
+    if (state == TX_BA_STATE_ACTIVE) ++session->setup_count, ++wlan_core.stats.tx_ba_setup_count;
+    else if (state == TX_BA_STATE_REFUSED) ++session->refuse_count, ++wlan_core.stats.tx_ba_refuse_count;
+    else if (session->state == TX_BA_STATE_ACTIVE) ++session->teardown_count, ++wlan_core.stats.tx_ba_teardown_count;
+    session->state = state;
+    session->state_time = session->period_time = sys_now();
+    session->period_pkts = 0;
+}
+#endif
+
 /**
  * @param rx_buf rx缓冲区
  * @return core_err_e中某一状态码
- * @brief 处理命令响应
+ * @brief 处理命令响应，按序号匹配已发送的命令，结束后发送队列中的下一条命令
  */
 static uint8_t wlan_process_cmdrsp(uint8_t *rx_buf) {
-    if (((HOST_DS_COMMAND *)rx_buf)->result != HOST_RESULT_OK) return CORE_ERR_INVALID_CMD_RESPONSE;
+    HOST_DS_COMMAND *cmd = (HOST_DS_COMMAND *)(wlan_cmd_queue + wlan_core.cmd_head)->buf, *rsp = (HOST_DS_COMMAND *)rx_buf;
+    /* 超时后到达的响应丢弃 */
+    if (!wlan_core.cmd_sent || rsp->seq_num != cmd->seq_num || (rsp->command & ~HOST_RET_BIT) != cmd->command) {
+        CORE_DEBUG("Warning: Unexpected cmd response 0x%X (seq %d)\n", rsp->command & ~HOST_RET_BIT, rsp->seq_num);
+        return CORE_ERR_OK;
+    }
+    uint8_t err = rsp->result != HOST_RESULT_OK ? CORE_ERR_INVALID_CMD_RESPONSE : wlan_ret_cmd(rx_buf), dispatch_err;
+    wlan_finish_cmd(err, rx_buf);
+    dispatch_err = wlan_dispatch_cmd();
+    return err ? err : dispatch_err;
+}
+
+/**
+ * @param rx_buf rx缓冲区
+ * @return core_err_e中某一状态码
+ * @brief 解析命令响应，部分命令在响应后加入下一条命令
+ */
+static uint8_t wlan_ret_cmd(uint8_t *rx_buf) {
     switch (((HOST_DS_COMMAND *)rx_buf)->command & ~HOST_RET_BIT) {
     case HOST_ID_GET_HW_SPEC:
         wlan_core.mp_end_port = ((HOST_DS_GET_HW_SPEC *)(rx_buf + CMD_HDR_SIZE))->mp_end_port;
+        wlan_core.dev_11n_cap = ((HOST_DS_GET_HW_SPEC *)(rx_buf + CMD_HDR_SIZE))->dot_11n_dev_cap;
         return wlan_prepare_cmd(HOST_ID_802_11_MAC_ADDR, HOST_ACT_GEN_GET, NULL, 0);
     case HOST_ID_802_11_SCAN: return wlan_ret_scan(rx_buf + CMD_HDR_SIZE);
     case HOST_ID_802_11_ASSOCIATE:
@@ -493,10 +1643,21 @@ static uint8_t wlan_process_cmdrsp(uint8_t *rx_buf) {
         case 0xFFFE:
         case 0xFFFF:
             CORE_DEBUG("Error: Association 0x%X\n", ((HOST_DS_802_11_ASSOCIATE_RSP *)(rx_buf + CMD_HDR_SIZE))->assoc_rsp.Capability);
+            wlan_blacklist_bss(wlan_core.ap_info.ap_mac_addr, true);
+            /* 缓存的AP无法关联，删除该项并搜索其信道 */
+            if (wlan_core.ap_info.bss_cached) {
+                wlan_core.ap_info.bss_cached = false;
+                wlan_drop_bss(wlan_core.ap_info.ap_mac_addr);
+                wlan_core.ap_info.hint_channel = wlan_core.ap_info.channel;
+                if (!wlan_scan_ssid_channel(wlan_core.ap_info.ssid, wlan_core.ap_info.ssid_len, wlan_core.ap_info.hint_channel, WLAN_BSS_PROBE_TIME)) break;
+            }
             wlan_core.ap_info.con_status = CON_STATUS_NOT_CONNECTED;
             if (wlan_callback && wlan_callback->wlan_cb_sta_connect) wlan_callback->wlan_cb_sta_connect(CORE_ERR_UNHANDLED_STATUS);
             break;
-        default: CORE_DEBUG("Capability 0x%X\n", ((HOST_DS_802_11_ASSOCIATE_RSP *)(rx_buf + CMD_HDR_SIZE))->assoc_rsp.Capability); break;
+        default:
+            wlan_core.ap_info.phy_mode = wlan_ret_phy_mode(&((HOST_DS_802_11_ASSOCIATE_RSP *)(rx_buf + CMD_HDR_SIZE))->assoc_rsp, ((HOST_DS_COMMAND *)rx_buf)->size - (CMD_HDR_SIZE - SDIO_HDR_SIZE));
+            CORE_DEBUG("Capability 0x%X, PHY: %s\n", ((HOST_DS_802_11_ASSOCIATE_RSP *)(rx_buf + CMD_HDR_SIZE))->assoc_rsp.Capability, wlan_core.ap_info.phy_mode == PHY_MODE_11N ? "11n" : wlan_core.ap_info.phy_mode == PHY_MODE_11G ? "11g" : "11b");
+            break;
         }
         break;
     case HOST_ID_MAC_CONTROL: return wlan_prepare_cmd(HOST_ID_GET_HW_SPEC, HOST_ACT_GEN_GET, NULL, 0);
@@ -507,17 +1668,38 @@ static uint8_t wlan_process_cmdrsp(uint8_t *rx_buf) {
         break;
     case HOST_ID_FUNC_INIT: return wlan_prepare_cmd(HOST_ID_MAC_CONTROL, HOST_ACT_GEN_GET, NULL, HOST_ACT_MAC_RX_ON | HOST_ACT_MAC_TX_ON | HOST_ACT_MAC_ETHERNETII_ENABLE);
     case HOST_ID_FUNC_SHUTDOWN:
+#ifdef WLAN_WARM_BOOT
+        if (wlan_core.warm_boot) return wlan_core.warm_boot = false, wlan_queue_cmd(HOST_ID_FUNC_INIT, HOST_ACT_GEN_GET, NULL, 0, wlan_warm_boot_complete, NULL);
+#endif
         if (wlan_callback && wlan_callback->wlan_cb_init) wlan_callback->wlan_cb_init(CORE_ERR_UNHANDLED_STATUS);
         break;
     case HOST_ID_APCMD_SYS_CONFIGURE: return wlan_prepare_cmd(HOST_ID_APCMD_BSS_START, HOST_ACT_GEN_GET, NULL, 0);
     case HOST_ID_APCMD_BSS_STOP:
+        wlan_clear_ba(BSS_TYPE_UAP, NULL);
         ethernetif_link_down(BSS_TYPE_UAP);
         if (wlan_callback && wlan_callback->wlan_cb_ap_stop) wlan_callback->wlan_cb_ap_stop();
         break;
-    case HOST_ID_SUPPLICANT_PMK: return sdio_cmd53(true, SDIO_FUNC_1, wlan_core.ctrl_port + CTRL_PORT, false, wlan_tx_buf, *(wlan_tx_buf + 1) << 8 | *wlan_tx_buf) ? CORE_ERR_INVALID_CMD_RESPONSE : CORE_ERR_OK;
+    case HOST_ID_SUPPLICANT_PMK:
     case HOST_ID_802_11_DEAUTHENTICATE:
     case HOST_ID_APCMD_BSS_START:
-    case HOST_ID_11N_ADDBA_RSP: break;
+    case HOST_ID_11N_CFG: break;
+    case HOST_ID_11N_ADDBA_RSP: {
+        /* 固件未能建立BA，删除重排序表 */
+        HOST_DS_11N_ADDBA_RSP *add_ba_rsp = (HOST_DS_11N_ADDBA_RSP *)(rx_buf + CMD_HDR_SIZE);
+        wlan_rx_reorder_t *table = add_ba_rsp->add_rsp_result ? wlan_find_rx_reorder(((HOST_DS_COMMAND *)rx_buf)->bss >> 4, add_ba_rsp->peer_mac_addr, (add_ba_rsp->block_ack_param_set & BLOCK_ACK_TID_MASK) >> BLOCK_ACK_TID_POS) : NULL;
+        if (table) wlan_del_rx_reorder(table);
+        break;
+    }
+#ifdef WLAN_11N
+    case HOST_ID_11N_ADDBA_REQ: {
+        /* 响应中为对方的ADDBA响应，对方拒绝或未响应时状态码或结果非0 */
+        HOST_DS_11N_ADDBA_RSP *add_ba_rsp = (HOST_DS_11N_ADDBA_RSP *)(rx_buf + CMD_HDR_SIZE);
+        wlan_tx_ba_t *session = wlan_find_tx_ba(((HOST_DS_COMMAND *)rx_buf)->bss >> 4, add_ba_rsp->peer_mac_addr, (add_ba_rsp->block_ack_param_set & BLOCK_ACK_TID_MASK) >> BLOCK_ACK_TID_POS);
+        if (session && session->state == TX_BA_STATE_SETUP) wlan_set_tx_ba(session, add_ba_rsp->add_rsp_result || add_ba_rsp->status_code ? TX_BA_STATE_REFUSED : TX_BA_STATE_ACTIVE);
+        break;
+    }
+    case HOST_ID_11N_DELBA: break;
+#endif
     default: CORE_DEBUG("Warning: Invalid cmd response 0x%X\n", ((HOST_DS_COMMAND *)rx_buf)->command & ~HOST_RET_BIT); break;
     }
     return CORE_ERR_OK;
@@ -533,7 +1715,10 @@ static uint8_t wlan_process_event(uint8_t *rx_buf) {
     case EVENT_DEAUTHENTICATED:
         /* STA模式下，被AP断开或AP关闭 */
         CORE_DEBUG("EVENT_DEAUTHENTICATED\n");
+        /* 关联后握手失败 */
+        if (wlan_core.ap_info.con_status == CON_STATUS_CONNECTING) wlan_blacklist_bss(wlan_core.ap_info.ap_mac_addr, true);
         wlan_core.ap_info.con_status = CON_STATUS_NOT_CONNECTED;
+        wlan_clear_ba(BSS_TYPE_STA, NULL);
         ethernetif_link_down(BSS_TYPE_STA);
         if (wlan_callback && wlan_callback->wlan_cb_sta_disconnect) wlan_callback->wlan_cb_sta_disconnect();
         break;
@@ -543,6 +1728,10 @@ static uint8_t wlan_process_event(uint8_t *rx_buf) {
         /* STA模式下，成功与AP建立连接 */
         CORE_DEBUG("EVENT_PORT_RELEASE\n");
         wlan_core.ap_info.con_status = CON_STATUS_CONNECTED;
+        wlan_blacklist_bss(wlan_core.ap_info.ap_mac_addr, false);
+#ifdef WLAN_KV_STORE
+        wlan_save_sta();
+#endif
         ethernetif_link_up(BSS_TYPE_STA, NULL);
         if (wlan_callback && wlan_callback->wlan_cb_sta_connect) wlan_callback->wlan_cb_sta_connect(CORE_ERR_OK);
         break;
@@ -553,6 +1742,7 @@ static uint8_t wlan_process_event(uint8_t *rx_buf) {
             if (memcmp((wlan_core.sta_info + index)->sta_mac_addr, rx_buf + EVENT_HDR_SIZE + 2, MAC_ADDR_LENGTH)) continue;
             memset((wlan_core.sta_info + index)->sta_mac_addr, 0, MAC_ADDR_LENGTH);
             (wlan_core.sta_info + index)->used = 0;
+            wlan_clear_ba(BSS_TYPE_UAP, rx_buf + EVENT_HDR_SIZE + 2);
             ethernetif_dhcpd_erase(rx_buf + EVENT_HDR_SIZE + 2, wlan_callback ? wlan_callback->wlan_cb_ap_disconnect : NULL);
             return CORE_ERR_OK;
         }
@@ -565,6 +1755,9 @@ static uint8_t wlan_process_event(uint8_t *rx_buf) {
             if ((wlan_core.sta_info + index)->used) continue;
             memcpy((wlan_core.sta_info + index)->sta_mac_addr, rx_buf + EVENT_HDR_SIZE + 2, MAC_ADDR_LENGTH);
             (wlan_core.sta_info + index)->used = 1;
+#ifdef WLAN_11N
+            (wlan_core.sta_info + index)->ht = wlan_sta_ht((HOST_DS_MICRO_AP_STA_ASSOC *)(rx_buf + EVENT_HDR_SIZE + 2), *(uint16_t *)rx_buf - EVENT_HDR_SIZE - 2);
+#endif
             return CORE_ERR_OK;
         }
         /* 无空闲STA信息节点 */
@@ -578,9 +1771,27 @@ static uint8_t wlan_process_event(uint8_t *rx_buf) {
         } else ethernetif_link_up(BSS_TYPE_UAP, NULL);
         break;
     /* 收到ADDBA请求 */
-    case EVENT_ADDBA: return wlan_prepare_cmd(HOST_ID_11N_ADDBA_RSP, HOST_ACT_GEN_GET, rx_buf + EVENT_HDR_SIZE, 0);
+    case EVENT_ADDBA: return wlan_add_rx_reorder(rx_buf);
     /* 收到DELBA请求 */
-    case EVENT_DELBA: CORE_DEBUG("EVENT_DELBA\n"); break;
+    case EVENT_DELBA: {
+        CORE_DEBUG("EVENT_DELBA\n");
+        HOST_DS_11N_DELBA *del_ba = (HOST_DS_11N_DELBA *)(rx_buf + EVENT_HDR_SIZE);
+        uint8_t bss_type = *(rx_buf + SDIO_HDR_SIZE + 3), tid = del_ba->del_ba_param_set >> DELBA_TID_POS;
+        /* 对方为接收方时拆除TX BA会话 */
+        if (!(del_ba->del_ba_param_set & DELBA_INITIATOR)) {
+#ifdef WLAN_11N
+            wlan_tx_ba_t *session = wlan_find_tx_ba(bss_type, del_ba->peer_mac_addr, tid);
+            if (session && session->state == TX_BA_STATE_ACTIVE) wlan_set_tx_ba(session, TX_BA_STATE_IDLE);
+#endif
+            break;
+        }
+        /* 对方为发起方时删除接收方向的重排序表 */
+        wlan_rx_reorder_t *table = wlan_find_rx_reorder(bss_type, del_ba->peer_mac_addr, tid);
+        if (!table) break;
+        uint8_t err = wlan_drain_rx_reorder(table);
+        table->used = false;
+        return err;
+    }
     /* AP模式空闲中 */
     case EVENT_MICRO_AP_BSS_IDLE: CORE_DEBUG("EVENT_MICRO_AP_BSS_IDLE\n"); break;
     /* AP模式连接中 */
@@ -598,6 +1809,8 @@ static uint8_t wlan_process_event(uint8_t *rx_buf) {
  * @brief 获取读取端口
  */
 static uint8_t wlan_get_read_port(uint8_t *port) {
+    /* 热启动后第一次读取数据端口时与芯片同步 */
+    if (wlan_core.rd_port_sync && wlan_core.read_bitmap & ~CTRL_PORT_MASK) wlan_core.curr_rd_port = wlan_first_port(wlan_core.read_bitmap), wlan_core.rd_port_sync = false;
     if (wlan_core.read_bitmap & CTRL_PORT_MASK) {
         wlan_core.read_bitmap &= ~CTRL_PORT_MASK;
         *port = CTRL_PORT;
@@ -623,18 +1836,195 @@ static uint8_t wlan_get_write_port(uint8_t *port) {
     return CORE_ERR_OK;
 }
 
+/**
+ * @param port 写入端口
+ * @return core_err_e中某一状态码
+ * @brief 优先使用缓存的写入位图，无空闲端口时读取写入位图直到有空闲端口
+ */
+static uint8_t wlan_wait_write_port(uint8_t *port) {
+    uint8_t wr_bitmap[2];
+    if (!wlan_get_write_port(port)) return CORE_ERR_OK;
+    ++wlan_core.stats.tx_bitmap_poll_count;
+    do {
+        if (sdio_cmd52(false, SDIO_FUNC_1, WR_BITMAP_L, 0, wr_bitmap) || sdio_cmd52(false, SDIO_FUNC_1, WR_BITMAP_U, 0, wr_bitmap + 1)) return CORE_ERR_SEND_DATA_FAILED;
+        wlan_core.write_bitmap = *(uint16_t *)wr_bitmap;
+    } while (wlan_get_write_port(port));
+    return CORE_ERR_OK;
+}
+
+/**
+ * @param port 读取端口
+ * @return 读取长度
+ * @brief 从控制寄存器获取端口数据长度
+ */
+static uint16_t wlan_get_read_len(uint8_t port) { return *(mp_regs_buf + RD_LEN_P0_U + (port << 1)) << 8 | *(mp_regs_buf + RD_LEN_P0_L + (port << 1)); }
+
+/**
+ * @return 接收缓冲区序号，RX_BUF_NUM表示无空闲缓冲区
+ * @brief 选取不在接收队列中且未被lwIP引用的接收缓冲区
+ */
+static uint8_t wlan_get_rx_index(void) {
+    uint8_t rx_index, index;
+    for (rx_index = 0; rx_index < RX_BUF_NUM; ++rx_index) {
+        if (*(wlan_core.rx_ref + rx_index)) continue;
+        for (index = 0; index < wlan_core.rx_queue_num && *(wlan_core.rx_queue + (wlan_core.rx_queue_head + index) % RX_BUF_NUM) != rx_index; ++index);
+        if (index == wlan_core.rx_queue_num) break;
+    }
+    return rx_index;
+}
+
+/**
+ * @return core_err_e中某一状态码
+ * @brief 为每组就绪端口选取空闲接收缓冲区，发起读取并加入接收队列，不等待传输结束
+ */
+static uint8_t wlan_fill_rx(void) {
+    uint8_t rx_index, err;
+    while ((rx_index = wlan_get_rx_index()) != RX_BUF_NUM) {
+        if ((err = wlan_read_port_async(rx_index))) return err == CORE_ERR_END_OF_READ_PORT ? CORE_ERR_OK : err;
+        *(wlan_core.rx_queue + (wlan_core.rx_queue_head + wlan_core.rx_queue_num++) % RX_BUF_NUM) = rx_index;
+    }
+    return CORE_ERR_OK;
+}
+
+/**
+ * @param rx_index 接收缓冲区序号
+ * @return core_err_e中某一状态码
+ * @brief 选取一组连续的就绪端口，以一次CMD53读取到聚合缓冲区，不等待传输结束
+ */
+static uint8_t wlan_read_port_async(uint8_t rx_index) {
+    mp_rx_aggr_t *rx_aggr = wlan_rx_aggr + rx_index;
+    uint8_t start_port, port;
+    uint16_t rx_len, buf_len, last_len;
+    if (wlan_get_read_port(&start_port)) return CORE_ERR_END_OF_READ_PORT;
+    if (!(last_len = wlan_get_read_len(port = start_port)) || last_len > RX_BUF_SIZE) return CORE_ERR_INVALID_RX_BUFFER;
+    buf_len = *rx_aggr->pkt_len = BLOCK_ALIGN(last_len);
+    /**
+     * 命令端口单独读取，数据端口需连续、不回绕且小于GET_HW_SPEC返回的mp_end_port
+     * mp_end_port未知（初始化完成前）时不聚合
+     */
+    for (rx_aggr->pkt_num = 1; start_port != CTRL_PORT && rx_aggr->pkt_num < MP_RX_AGGR_PKT_LIMIT; ++rx_aggr->pkt_num) {
+        if (wlan_core.curr_rd_port != port + 1 || port + 1 >= wlan_core.mp_end_port || wlan_core.read_bitmap & CTRL_PORT_MASK || !(wlan_core.read_bitmap & 1 << (port + 1))) break;
+        if (!(rx_len = wlan_get_read_len(port + 1)) || rx_len > RX_BUF_SIZE || buf_len + BLOCK_ALIGN(rx_len) > MP_RX_AGGR_BUF_SIZE) break;
+        wlan_get_read_port(&port);
+        buf_len += *(rx_aggr->pkt_len + rx_aggr->pkt_num) = BLOCK_ALIGN(last_len = rx_len);
+    }
+    /* 最后一个封包不补齐，尾部由sdio_cmd53按字节模式策略处理 */
+    buf_len -= BLOCK_ALIGN(last_len) - last_len;
+    CORE_DEBUG("Rx: Port %d-%d, Size %d\n", start_port, port, buf_len);
+    ++wlan_core.stats.rx_transfer_count;
+    wlan_core.stats.rx_packet_count += rx_aggr->pkt_num;
+    ++*(wlan_core.stats.rx_aggr_hist + rx_aggr->pkt_num - 1);
+    /* 多端口读取地址：bit[11:4]为相对起始端口的位图，bit[3:0]为起始端口 */
+    uint32_t reg_addr = rx_aggr->pkt_num == 1 ? wlan_core.ctrl_port + start_port : (wlan_core.ctrl_port | MPA_ADDR_BASE | ((1 << rx_aggr->pkt_num) - 1) << 4) + start_port;
+    *(wlan_core.rx_result + rx_index) = RX_RESULT_PENDING;
+    return sdio_cmd53_async(false, SDIO_FUNC_1, reg_addr, false, *(wlan_rx_buf + rx_index), buf_len, wlan_rx_complete, (void *)(uintptr_t)rx_index) ? CORE_ERR_INVALID_RX_BUFFER : CORE_ERR_OK;
+}
+
+/**
+ * @param err sdio_err_e中某一状态码
+ * @param arg 接收缓冲区序号
+ * @brief 读取端口结束回调（中断上下文）
+ */
+static void wlan_rx_complete(uint8_t err, void *arg) { *(wlan_core.rx_result + (uintptr_t)arg) = err; }
+
+/**
+ * @param err sdio_err_e中某一状态码
+ * @param arg 发送缓冲区序号，bit7表示该缓冲区的最后一次CMD53
+ * @brief 发送结束回调（中断上下文），最后一次CMD53结束后释放发送缓冲区
+ */
+static void wlan_tx_complete(uint8_t err, void *arg) {
+    if (err) wlan_core.tx_err = err;
+    if ((uintptr_t)arg & 0x80) *(wlan_core.tx_busy + ((uintptr_t)arg & 0x7F)) = false;
+}
+
+/**
+ * @param err sdio_err_e中某一状态码
+ * @param arg 无意义
+ * @brief 零拷贝发送结束回调（中断上下文），CMD53按顺序结束，仅累加结束数
+ */
+static void wlan_tx_ref_complete(uint8_t err, void *arg) {
+    UNUSED(arg);
+    if (err) wlan_core.tx_err = err;
+    ++wlan_core.tx_ref_done;
+}
+
+/**
+ * @brief 按发送顺序释放传输已结束的零拷贝封包
+ */
+static void wlan_release_tx_ref(void) {
+    wlan_tx_ref_t *tx_ref;
+    for (; wlan_core.tx_ref_released != wlan_core.tx_ref_done; ++wlan_core.tx_ref_released, --wlan_core.tx_ref_num) {
+        tx_ref = wlan_core.tx_ref + wlan_core.tx_ref_head;
+        wlan_core.tx_ref_head = (wlan_core.tx_ref_head + 1) % TX_REF_NUM;
+        tx_ref->free(tx_ref->arg);
+    }
+}
+
+/**
+ * @param cmd_id 命令ID
+ * @param cmd_action 命令动作
+ * @param data_buf 命令缓冲区
+ * @param data_len 缓冲区长度
+ * @param callback 命令结束回调，可为NULL
+ * @param arg callback的参数
+ * @return core_err_e中某一状态码
+ * @brief 组封包并加入命令队列，无正在执行的命令时立即发送，不等待响应
+ */
+uint8_t wlan_queue_cmd(uint16_t cmd_id, uint16_t cmd_action, uint8_t *data_buf, uint16_t data_len, wlan_cmd_cb callback, void *arg) {
+    wlan_cmd_t *cmd = wlan_build_cmd(cmd_id, cmd_action, data_buf, data_len);
+    if (!cmd) return CORE_ERR_CMD_QUEUE_FULL;
+    cmd->callback = callback;
+    cmd->arg = arg;
+    return wlan_dispatch_cmd();
+}
+
+/**
+ * @return core_err_e中某一状态码
+ * @brief 检查正在执行的命令是否发送失败或超时，是则结束该命令并发送下一条命令，热启动初始化失败时重置芯片
+ */
+uint8_t wlan_poll_cmd(void) {
+#ifdef WLAN_WARM_BOOT
+    if (wlan_core.warm_boot_failed) {
+        CORE_DEBUG("Warm boot failed, reset chip\n");
+        uint8_t err = wlan_cold_boot();
+        if (err && wlan_callback && wlan_callback->wlan_cb_init) wlan_callback->wlan_cb_init(err);
+        return err;
+    }
+#endif
+    if (!wlan_core.cmd_sent) return CORE_ERR_OK;
+    uint8_t err = wlan_core.cmd_err ? CORE_ERR_SEND_CMD_FAILED : sys_now() - wlan_core.cmd_time >= WLAN_CMD_TIMEOUT ? CORE_ERR_CMD_TIMEOUT : CORE_ERR_OK, dispatch_err;
+    if (!err) return CORE_ERR_OK;
+    CORE_DEBUG("Error: Cmd 0x%X (seq %d) failed (0x%X)\n", ((HOST_DS_COMMAND *)(wlan_cmd_queue + wlan_core.cmd_head)->buf)->command, ((HOST_DS_COMMAND *)(wlan_cmd_queue + wlan_core.cmd_head)->buf)->seq_num, err);
+    wlan_core.cmd_err = SDIO_ERR_OK;
+    wlan_finish_cmd(err, NULL);
+    return (dispatch_err = wlan_dispatch_cmd()) ? dispatch_err : err;
+}
+
 /**
  * @param cmd_id 命令ID
  * @param cmd_action 命令动作
  * @param data_buf 命令缓冲区
  * @param data_len 缓冲区长度
  * @return core_err_e中某一状态码
- * @brief 组封包
+ * @brief 组封包并加入命令队列
+ */
+static uint8_t wlan_prepare_cmd(uint16_t cmd_id, uint16_t cmd_action, uint8_t *data_buf, uint16_t data_len) { return wlan_queue_cmd(cmd_id, cmd_action, data_buf, data_len, NULL, NULL); }
+
+/**
+ * @param cmd_id 命令ID
+ * @param cmd_action 命令动作
+ * @param data_buf 命令缓冲区
+ * @param data_len 缓冲区长度
+ * @return 命令队列中的位置，队列满时为NULL
+ * @brief 在命令队列尾部组封包，分配序号，不发送
  */
-static uint8_t wlan_prepare_cmd(uint16_t cmd_id, uint16_t cmd_action, uint8_t *data_buf, uint16_t data_len) {
-    HOST_DS_COMMAND *cmd = (HOST_DS_COMMAND *)wlan_tx_buf;
+static wlan_cmd_t *wlan_build_cmd(uint16_t cmd_id, uint16_t cmd_action, uint8_t *data_buf, uint16_t data_len) {
+    if (wlan_core.cmd_num == WLAN_CMD_QUEUE_SIZE) return NULL;
+    wlan_cmd_t *entry = wlan_cmd_queue + (wlan_core.cmd_head + wlan_core.cmd_num) % WLAN_CMD_QUEUE_SIZE;
+    HOST_DS_COMMAND *cmd = (HOST_DS_COMMAND *)entry->buf;
     cmd->pack_type = TYPE_CMD_CMDRSP;
-    cmd->seq_num = cmd->result = 0;
+    cmd->seq_num = ++wlan_core.cmd_seq;
+    cmd->result = 0;
     switch (cmd->command = cmd_id) {
     case HOST_ID_GET_HW_SPEC:
         cmd->size = (cmd->pack_len = CMD_HDR_SIZE + sizeof(HOST_DS_GET_HW_SPEC)) - SDIO_HDR_SIZE;
@@ -692,6 +2082,13 @@ static uint8_t wlan_prepare_cmd(uint16_t cmd_id, uint16_t cmd_action, uint8_t *d
         cmd->size = (cmd->pack_len = CMD_HDR_SIZE) - SDIO_HDR_SIZE;
         cmd->bss = BSS_TYPE_UAP << 4;
         break;
+    case HOST_ID_11N_CFG:
+        cmd->size = (cmd->pack_len = CMD_HDR_SIZE + sizeof(HOST_DS_11N_CFG)) - SDIO_HDR_SIZE;
+        cmd->bss = BSS_TYPE_UAP << 4;
+        cmd->params.htcfg.action = cmd_action;
+        cmd->params.htcfg.ht_tx_cap = data_len;
+        cmd->params.htcfg.ht_tx_info = cmd->params.htcfg.misc_config = 0;
+        break;
     case HOST_ID_APCMD_BSS_STOP:
         cmd->size = (cmd->pack_len = CMD_HDR_SIZE) - SDIO_HDR_SIZE;
         cmd->bss = BSS_TYPE_UAP << 4;
@@ -710,9 +2107,11 @@ static uint8_t wlan_prepare_cmd(uint16_t cmd_id, uint16_t cmd_action, uint8_t *d
         memcpy(cmd->params.esupplicant_psk.tlv_buffer, data_buf, data_len);
         break;
     case HOST_ID_11N_ADDBA_RSP: {
+        /* data_len的低8位为BSS类型，高8位为状态码 */
         cmd->size = (cmd->pack_len = CMD_HDR_SIZE + sizeof(HOST_DS_11N_ADDBA_RSP)) - SDIO_HDR_SIZE;
-        cmd->bss = BSS_TYPE_STA << 4;
-        cmd->params.add_ba_rsp.add_rsp_result = cmd->params.add_ba_rsp.status_code = 0;
+        cmd->bss = (data_len & 0xFF) << 4;
+        cmd->params.add_ba_rsp.add_rsp_result = 0;
+        cmd->params.add_ba_rsp.status_code = data_len >> 8;
         HOST_DS_11N_ADDBA_REQ *add_ba_req = (HOST_DS_11N_ADDBA_REQ *)data_buf;
         memcpy(cmd->params.add_ba_rsp.peer_mac_addr, add_ba_req->peer_mac_addr, MAC_ADDR_LENGTH);
         cmd->params.add_ba_rsp.dialog_token = add_ba_req->dialog_token;
@@ -721,29 +2120,240 @@ static uint8_t wlan_prepare_cmd(uint16_t cmd_id, uint16_t cmd_action, uint8_t *d
         cmd->params.add_ba_rsp.ssn = add_ba_req->ssn;
         break;
     }
+#ifdef WLAN_11N
+    case HOST_ID_11N_ADDBA_REQ: {
+        /* data_buf为TX BA会话，对话令牌及起始序列号由固件填写 */
+        wlan_tx_ba_t *session = (wlan_tx_ba_t *)data_buf;
+        cmd->size = (cmd->pack_len = CMD_HDR_SIZE + sizeof(HOST_DS_11N_ADDBA_REQ)) - SDIO_HDR_SIZE;
+        cmd->bss = session->bss_type << 4;
+        memset(&cmd->params.add_ba_req, 0, sizeof(HOST_DS_11N_ADDBA_REQ));
+        memcpy(cmd->params.add_ba_req.peer_mac_addr, session->ra, MAC_ADDR_LENGTH);
+        cmd->params.add_ba_req.block_ack_param_set = WLAN_TX_BA_WIN << BLOCK_ACK_WIN_SIZE_POS | session->tid << BLOCK_ACK_TID_POS | BLOCK_ACK_POLICY_IMMEDIATE;
+        break;
+    }
+    case HOST_ID_11N_DELBA: {
+        /* data_buf为TX BA会话，本方为发起方 */
+        wlan_tx_ba_t *session = (wlan_tx_ba_t *)data_buf;
+        cmd->size = (cmd->pack_len = CMD_HDR_SIZE + sizeof(HOST_DS_11N_DELBA)) - SDIO_HDR_SIZE;
+        cmd->bss = session->bss_type << 4;
+        memset(&cmd->params.del_ba, 0, sizeof(HOST_DS_11N_DELBA));
+        memcpy(cmd->params.del_ba.peer_mac_addr, session->ra, MAC_ADDR_LENGTH);
+        cmd->params.del_ba.del_ba_param_set = DELBA_INITIATOR | session->tid << DELBA_TID_POS;
+        cmd->params.del_ba.reason_code = QSTA_TIMEOUT;
+        break;
+    }
+#endif
+    }
+    entry->callback = NULL;
+    entry->arg = NULL;
+    entry->chained = false;
+    ++wlan_core.cmd_num;
+    return entry;
+}
+
+/**
+ * @return core_err_e中某一状态码
+ * @brief 无正在执行的命令时发送队首命令，CMD53启动后立即返回
+ */
+static uint8_t wlan_dispatch_cmd(void) {
+    if (!wlan_core.cmd_num || wlan_core.cmd_sent) return CORE_ERR_OK;
+    uint8_t *cmd_buf = (wlan_cmd_queue + wlan_core.cmd_head)->buf;
+    wlan_core.cmd_sent = true;
+    wlan_core.cmd_time = sys_now();
+    if (!sdio_cmd53_async(true, SDIO_FUNC_1, wlan_core.ctrl_port + CTRL_PORT, false, cmd_buf, *(cmd_buf + 1) << 8 | *cmd_buf, wlan_cmd_complete, NULL)) return CORE_ERR_OK;
+    wlan_finish_cmd(CORE_ERR_SEND_CMD_FAILED, NULL);
+    return CORE_ERR_SEND_CMD_FAILED;
+}
+
+/**
+ * @param err sdio_err_e中某一状态码
+ * @param arg 无意义
+ * @brief 命令发送结束回调（中断上下文），发送失败由wlan_poll_cmd处理
+ */
+static void wlan_cmd_complete(uint8_t err, void *arg) {
+    UNUSED(arg);
+    if (err) wlan_core.cmd_err = err;
+}
+
+/**
+ * @param err core_err_e中某一状态码
+ * @param resp 命令响应，可为NULL
+ * @brief 队首命令出队并执行回调，失败时一并取消之后的关联命令
+ */
+static void wlan_finish_cmd(uint8_t err, uint8_t *resp) {
+    wlan_cmd_t *cmd;
+    wlan_core.cmd_sent = false;
+    do {
+        cmd = wlan_cmd_queue + wlan_core.cmd_head;
+        wlan_core.cmd_head = (wlan_core.cmd_head + 1) % WLAN_CMD_QUEUE_SIZE;
+        --wlan_core.cmd_num;
+        /* 连接失败 */
+        if (err && (((HOST_DS_COMMAND *)cmd->buf)->command == HOST_ID_SUPPLICANT_PMK || ((HOST_DS_COMMAND *)cmd->buf)->command == HOST_ID_802_11_ASSOCIATE) && wlan_core.ap_info.con_status == CON_STATUS_CONNECTING) {
+            wlan_core.ap_info.con_status = CON_STATUS_NOT_CONNECTED;
+            if (wlan_callback && wlan_callback->wlan_cb_sta_connect) wlan_callback->wlan_cb_sta_connect(CORE_ERR_UNHANDLED_STATUS);
+        }
+        if (cmd->callback) cmd->callback(err, resp, cmd->arg);
+        resp = NULL;
+    } while (err && wlan_core.cmd_num && (wlan_cmd_queue + wlan_core.cmd_head)->chained);
+}
+
+/**
+ * @return core_err_e中某一状态码
+ * @brief 热启动时清除芯片中断，读取并丢弃MCU复位前芯片已准备好的封包，从芯片的写入位图同步写入端口
+ */
+static uint8_t wlan_sync_port(void) {
+    uint8_t port;
+    uint16_t read_len;
+    if (sdio_cmd52(true, SDIO_FUNC_1, HOST_INT_STATUS_REG, 0, NULL) || sdio_cmd53(false, SDIO_FUNC_1, REG_PORT, false, mp_regs_buf, MAX_MP_REGS)) return CORE_ERR_INT_STATUS_FAILED;
+    wlan_core.read_bitmap = *(mp_regs_buf + RD_BITMAP_U) << 8 | *(mp_regs_buf + RD_BITMAP_L);
+    /* MCU复位前写入、芯片尚未释放的端口之后的空闲端口为下一个写入端口 */
+    wlan_core.write_bitmap = *(mp_regs_buf + WR_BITMAP_U) << 8 | *(mp_regs_buf + WR_BITMAP_L);
+    wlan_core.curr_wr_port = wlan_first_port(wlan_core.write_bitmap);
+    /* 没有待读取的数据端口时，读取端口在第一次读取时同步 */
+    wlan_core.rd_port_sync = true;
+    while (!wlan_get_read_port(&port)) {
+        if (!(read_len = wlan_get_read_len(port))) continue;
+        CORE_DEBUG("Discard %d bytes from port %d\n", read_len, port);
+        if (read_len > MP_RX_AGGR_BUF_SIZE || sdio_cmd53(false, SDIO_FUNC_1, wlan_core.ctrl_port + port, false, *wlan_rx_buf, read_len)) return CORE_ERR_INVALID_RX_BUFFER;
+    }
+    return CORE_ERR_OK;
+}
+
+/**
+ * @param bitmap 读取位图或写入位图
+ * @return 芯片最早准备好的数据端口（读取）或芯片下一个接收的数据端口（写入）
+ * @brief 置位的数据端口首尾相连，取前一端口未置位的端口，全部置位或全部未置位时取端口1
+ */
+static uint8_t wlan_first_port(uint16_t bitmap) {
+    for (uint8_t port = 1, prev = MAX_PORT - 1; port < MAX_PORT; prev = port++)
+        if (bitmap & 1 << port && !(bitmap & 1 << prev)) return port;
+    return 1;
+}
+
+/**
+ * @return 固件是否正在运行
+ */
+static bool wlan_fw_ready(void) {
+    uint8_t fw_status[2];
+    return !sdio_cmd52(false, SDIO_FUNC_1, CARD_FW_STATUS0_REG, 0, fw_status) && !sdio_cmd52(false, SDIO_FUNC_1, CARD_FW_STATUS1_REG, 0, fw_status + 1) && (*(fw_status + 1) << 8 | *fw_status) == FIRMWARE_READY;
+}
+
+#ifdef WLAN_FW_COMPRESSED
+/**
+ * @param arg 已读取的压缩固件长度
+ * @return 压缩固件的下一个字节
+ */
+static uint8_t wlan_fw_read(void *arg) {
+    uint32_t *offset = (uint32_t *)arg;
+#ifdef USE_FLASH_FIRMWARE
+    /* 每次从Flash读取FW_READ_SIZE字节，两段轮流使用，位于分段缓冲区之后，解压缩当前段期间以DMA读取下一段 */
+    uint8_t *read_buf = *(wlan_rx_buf + 1) + FW_STAGE_SIZE;
+    if (!(*offset % FW_READ_SIZE)) {
+        if (*offset) flashWaitForRead();
+        else flashReadMemory(wlan_fw_addr, read_buf, FW_READ_SIZE);
+        flashReadMemoryAsync(wlan_fw_addr + *offset + FW_READ_SIZE, read_buf + ((*offset / FW_READ_SIZE + 1) & 1) * FW_READ_SIZE, FW_READ_SIZE, NULL, NULL);
+    }
+    return *(read_buf + (*offset)++ % (FW_READ_SIZE << 1));
+#else
+    return *offset < fw_mrvl88w8801_z_size ? *(fw_mrvl88w8801_z + (*offset)++) : 0;
+#endif
+}
+#endif
+
+#ifdef FW_STAGED
+/**
+ * @param data_buf 分段缓冲区
+ * @param data_len 长度
+ * @param offset 已准备的固件长度
+ * @return core_err_e中某一状态码
+ * @brief 解压缩之后的固件数据，或启动从Flash读取（DMA，使用前需调用flashWaitForRead）
+ */
+static uint8_t wlan_fw_load(uint8_t *data_buf, uint16_t data_len, uint32_t *offset) {
+    uint32_t time = sys_now_us();
+#ifdef WLAN_FW_COMPRESSED
+    if (inflate_read(&wlan_inflate, data_buf, data_len)) {
+        CORE_DEBUG("Error: Failed to decompress %d bytes\n", data_len);
+        return CORE_ERR_FIRMWARE_FAILED;
     }
-    return wlan_core.ap_info.sec_type < SECURITY_TYPE_WPA || cmd_id != HOST_ID_802_11_ASSOCIATE ? sdio_cmd53(true, SDIO_FUNC_1, wlan_core.ctrl_port + CTRL_PORT, false, wlan_tx_buf, *(wlan_tx_buf + 1) << 8 | *wlan_tx_buf) : CORE_ERR_OK;
+#else
+    if (!flashReadMemoryAsync(wlan_fw_addr + *offset, data_buf, data_len, NULL, NULL)) return CORE_ERR_FIRMWARE_FAILED;
+#endif
+    *offset += data_len;
+    wlan_core.stats.fw_load_time += sys_now_us() - time;
+    return CORE_ERR_OK;
+}
+#endif
+
+/**
+ * @param err sdio_err_e中某一状态码
+ * @param arg 传输结果
+ * @brief 固件块发送结束回调（中断上下文）
+ */
+static void wlan_fw_complete(uint8_t err, void *arg) {
+    if (err) *(volatile uint8_t *)arg = err;
 }
 
 /**
  * @return core_err_e中某一状态码
- * @brief 将固件下载到芯片
+ * @brief 将固件下载到芯片，芯片读取当前块（CMD53）期间从Flash读取或解压缩之后的数据
  */
 static uint8_t wlan_download_fw(void) {
-#ifndef USE_FLASH_FIRMWARE
-    const uint8_t *fw_data = fw_mrvl88w8801;
+    /* 回调可能在返回后执行，不使用栈上的变量 */
+    static volatile uint8_t fw_err;
+    uint32_t fw_time = sys_now_us(), fw_len, time;
+    fw_err = SDIO_ERR_OK;
+#ifdef USE_FLASH_FIRMWARE
+    /* 使用版本最高且CRC正确的槽，压缩标志需与WLAN_FW_COMPRESSED一致 */
+    flashSlotInfo fw_slot;
+#ifdef WLAN_FW_COMPRESSED
+    const bool fw_compressed = true;
+#else
+    const bool fw_compressed = false;
+#endif
+    if (!flashSlotSelect(&fw_slot) || fw_slot.bCompressed != fw_compressed) {
+        CORE_DEBUG("Error: No valid firmware slot\n");
+        return CORE_ERR_FIRMWARE_FAILED;
+    }
+    wlan_fw_addr = fw_slot.u32Address;
+#endif
+#ifdef FW_STAGED
+    /**
+     * 分段缓冲区使用下载期间空闲的接收缓冲区，[fw_head, fw_tail)为已准备好的数据
+     * 每块16-1024 bytes，发送前一块时继续准备至缓冲区末尾，块的起始地址保持4字节对齐
+     */
+    uint8_t *fw_stage = *(wlan_rx_buf + 1), *fw_data, err;
+    uint16_t fw_head = 0, fw_tail = 0;
+    uint32_t fw_offset = 0;
+#ifdef WLAN_FW_COMPRESSED
+    /* 已读取的压缩固件长度 */
+    uint32_t fw_input = 0;
+    /* 头部：'F' 'W' 'Z'、窗口位数、原始长度 */
+    for (fw_len = 0; fw_len < FW_Z_HDR_SIZE; ++fw_len) *(fw_stage + fw_len) = wlan_fw_read(&fw_input);
+    if (memcmp(fw_stage, FW_Z_MAGIC, sizeof(FW_Z_MAGIC) - 1) || *(fw_stage + 3) > FW_Z_WINDOW_BITS) {
+        CORE_DEBUG("Error: Invalid compressed firmware\n");
+        return CORE_ERR_FIRMWARE_FAILED;
+    }
+    fw_len = *(uint32_t *)(fw_stage + 4);
+    /* 窗口使用下载期间空闲的接收缓冲区 */
+    inflate_init(&wlan_inflate, wlan_fw_read, &fw_input, *wlan_rx_buf, FW_Z_WINDOW_BITS);
+#else
+    fw_len = fw_slot.u32Length;
+#endif
 #else
-    /* 16-1024 bytes */
-    uint8_t *fw_data = wlan_tx_buf;
+    const uint8_t *fw_data = fw_mrvl88w8801;
+    fw_len = sizeof(fw_mrvl88w8801);
 #endif
+    const uint32_t fw_size = fw_len;
     uint8_t fw_next[2];
     uint16_t fw_next_16;
-    uint32_t fw_len = sizeof(fw_mrvl88w8801);
     while (fw_len) {
+        /* CMD52在前一块发送结束后才执行 */
+        time = sys_now_us();
         *fw_next = *(fw_next + 1) = 0;
-        if (fw_len != sizeof(fw_mrvl88w8801)) while (!(*fw_next & CARD_IO_READY && *fw_next & DN_LD_CARD_RDY)) if (sdio_cmd52(false, SDIO_FUNC_1, CARD_TO_HOST_EVENT_REG, 0, fw_next)) return CORE_ERR_FIRMWARE_FAILED;
+        if (fw_len != fw_size) while (!(*fw_next & CARD_IO_READY && *fw_next & DN_LD_CARD_RDY)) if (sdio_cmd52(false, SDIO_FUNC_1, CARD_TO_HOST_EVENT_REG, 0, fw_next)) return CORE_ERR_FIRMWARE_FAILED;
         /* Get next block length */
-        if (sdio_cmd52(false, SDIO_FUNC_1, READ_BASE_0_REG, 0, fw_next) || sdio_cmd52(false, SDIO_FUNC_1, READ_BASE_1_REG, 0, fw_next + 1)) return CORE_ERR_FIRMWARE_FAILED;
+        if (fw_err || sdio_cmd52(false, SDIO_FUNC_1, READ_BASE_0_REG, 0, fw_next) || sdio_cmd52(false, SDIO_FUNC_1, READ_BASE_1_REG, 0, fw_next + 1)) return CORE_ERR_FIRMWARE_FAILED;
+        wlan_core.stats.fw_wait_time += sys_now_us() - time;
         /* Little endian */
         if (!(fw_next_16 = *(uint16_t *)fw_next)) continue;
         CORE_DEBUG("Required: %d bytes, remaining: %ld bytes\n", fw_next_16, fw_len);
@@ -753,23 +2363,50 @@ static uint8_t wlan_download_fw(void) {
             return CORE_ERR_FIRMWARE_FAILED;
         }
         if (fw_next_16 > fw_len) fw_next_16 = fw_len;
-#ifdef USE_FLASH_FIRMWARE
-        flashReadMemory(FLASH_FIRMWARE_ADDRESS + sizeof(fw_mrvl88w8801) - fw_len, fw_data, fw_next_16);
+#ifdef FW_STAGED
+        if (fw_next_16 > CMD_BUF_SIZE) return CORE_ERR_FIRMWARE_FAILED;
+#ifndef WLAN_FW_COMPRESSED
+        /* 发送期间启动的Flash读取尚未结束时等待，这部分未与CMD53重叠 */
+        time = sys_now_us();
+        flashWaitForRead();
+        wlan_core.stats.fw_stall_time += sys_now_us() - time;
+#endif
+        /* 前一块已发送结束，剩余数据移到缓冲区开头 */
+        if (fw_head + fw_next_16 > FW_STAGE_SIZE || fw_head & 3) memmove(fw_stage, fw_stage + fw_head, fw_tail - fw_head), fw_tail -= fw_head, fw_head = 0;
+        /* 数据不足时立即准备，这部分未与CMD53重叠 */
+        if (fw_tail - fw_head < fw_next_16) {
+            time = sys_now_us();
+            if ((err = wlan_fw_load(fw_stage + fw_tail, fw_head + fw_next_16 - fw_tail, &fw_offset))) return err;
+#ifndef WLAN_FW_COMPRESSED
+            flashWaitForRead();
+#endif
+            fw_tail = fw_head + fw_next_16;
+            wlan_core.stats.fw_stall_time += sys_now_us() - time;
+        }
+        fw_data = fw_stage + fw_head;
+        fw_head += fw_next_16;
 #endif
         /* Write block */
-        if (sdio_cmd53(true, SDIO_FUNC_1, wlan_core.ctrl_port, false, (uint8_t *)fw_data, fw_next_16)) return CORE_ERR_FIRMWARE_FAILED;
+        if (sdio_cmd53_async(true, SDIO_FUNC_1, wlan_core.ctrl_port, false, (uint8_t *)fw_data, fw_next_16, wlan_fw_complete, (void *)&fw_err)) return CORE_ERR_FIRMWARE_FAILED;
         fw_len -= fw_next_16;
-#ifndef USE_FLASH_FIRMWARE
+#ifdef FW_STAGED
+        /* 发送期间准备之后的数据 */
+        fw_next_16 = fw_size - fw_offset < FW_STAGE_SIZE - fw_tail ? fw_size - fw_offset : FW_STAGE_SIZE - fw_tail;
+        if (fw_next_16 && (err = wlan_fw_load(fw_stage + fw_tail, fw_next_16, &fw_offset))) return err;
+        fw_tail += fw_next_16;
+#else
         fw_data += fw_next_16;
 #endif
     }
     /* Check firmware status */
     for (fw_next_16 = 0; fw_next_16 < MAX_POLL_TRIES; ++fw_next_16) {
-        if (sdio_cmd52(false, SDIO_FUNC_1, CARD_FW_STATUS0_REG, 0, fw_next) || sdio_cmd52(false, SDIO_FUNC_1, CARD_FW_STATUS1_REG, 0, fw_next + 1)) break;
-        if (*(uint16_t *)fw_next == FIRMWARE_READY) {
+        if (wlan_fw_ready()) {
             CORE_DEBUG("Firmware is active (Index %d)\n", fw_next_16);
+            wlan_core.stats.fw_total_time = sys_now_us() - fw_time;
             return CORE_ERR_OK;
         }
+        /* 最后一块发送失败 */
+        if (fw_err) break;
     }
     return CORE_ERR_FIRMWARE_FAILED;
 }
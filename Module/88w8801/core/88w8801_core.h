@@ -3,6 +3,9 @@
 #include <stdint.h>
 #include <stdbool.h>
 #include "88w8801/88w8801.h"
+#ifdef WLAN_HOST_PMK
+#include "88w8801_sha1.h"
+#endif
 
 typedef enum {
     CORE_ERR_OK,
@@ -15,7 +18,10 @@ typedef enum {
     CORE_ERR_OCCUPIED_WRITE_PORT,
     CORE_ERR_SEND_DATA_FAILED,
     CORE_ERR_INVALID_CMD_RESPONSE,
-    CORE_ERR_INVALID_RX_BUFFER
+    CORE_ERR_INVALID_RX_BUFFER,
+    CORE_ERR_CMD_QUEUE_FULL,
+    CORE_ERR_SEND_CMD_FAILED,
+    CORE_ERR_CMD_TIMEOUT
 } core_err_e;
 
 #define MAC_ADDR_LENGTH 6
@@ -24,17 +30,58 @@ typedef enum {
 #define MAX_PORT 16
 #define MAX_SSID_LENGTH 32
 #define MAX_PHRASE_LENGTH 64
+/* WPA/WPA2：PMK = PBKDF2-SHA1(passphrase, SSID, 4096, 32)，64个十六进制字符的密码即为PMK */
+#define PMK_LENGTH 32
+#define PMK_ITERATIONS 4096
+#define MIN_PHRASE_LENGTH 8
 #define MAX_CHANNEL_NUM 14
 #define MAX_SCAN_TIME 200
 
 #define TX_BUF_SIZE 0x800
+#define CMD_BUF_SIZE 0x400
+/* 接收A-MSDU时需容纳3839字节（HT能力中最大A-MSDU长度位为0）及RxPD */
+#ifdef WLAN_RX_AMSDU
+#define RX_BUF_SIZE 0x1000
+#else
 #define RX_BUF_SIZE 0x800
+#endif
+#if MP_RX_AGGR_PKT_LIMIT < 1 || MP_RX_AGGR_PKT_LIMIT > 8 || MP_RX_AGGR_BUF_SIZE < RX_BUF_SIZE
+#error "Invalid MP_RX_AGGR_PKT_LIMIT or MP_RX_AGGR_BUF_SIZE"
+#endif
+#if RX_BUF_NUM < 2 || RX_BUF_NUM > 8
+#error "Invalid RX_BUF_NUM"
+#endif
+#if MP_TX_AGGR_PKT_LIMIT < 1 || MP_TX_AGGR_PKT_LIMIT > 8 || MP_TX_AGGR_BUF_SIZE < TX_BUF_SIZE
+#error "Invalid MP_TX_AGGR_PKT_LIMIT or MP_TX_AGGR_BUF_SIZE"
+#endif
+/* 压缩固件头部：'F' 'W' 'Z'、窗口位数、原始长度（见Utility/fw_pack.py） */
+#define FW_Z_MAGIC "FWZ"
+#define FW_Z_HDR_SIZE 8
+#define FW_Z_WINDOW_BITS 12
+/* 从Flash读取压缩固件的分段大小 */
+#define FW_READ_SIZE 0x200
+#if defined(WLAN_FW_COMPRESSED) && MP_RX_AGGR_BUF_SIZE < (1 << FW_Z_WINDOW_BITS)
+#error "MP_RX_AGGR_BUF_SIZE is too small for the firmware window"
+#endif
+/* 固件需读取或解压缩时，在芯片读取当前块期间准备之后的数据，分段缓冲区为两块大小 */
+#if defined(WLAN_FW_COMPRESSED) || defined(USE_FLASH_FIRMWARE)
+#define FW_STAGED
+#endif
+#define FW_STAGE_SIZE (CMD_BUF_SIZE * 2u)
+/* 接收缓冲区读取未结束 */
+#define RX_RESULT_PENDING 0xFF
+/* 数据发送缓冲区个数，一个用于DMA传输时另一个用于组包 */
+#define TX_BUF_NUM 2
+/* 零拷贝发送中（含已结束未释放）的最大封包数 */
+#define TX_REF_NUM SDIO_QUEUE_SIZE
 
 #define TYPE_DATA 0x0
 #define TYPE_CMD_CMDRSP 0x1
 #define TYPE_EVENT 0x3
 
 #define SDIO_HDR_SIZE 4
+/* 按分块大小对齐 */
+#define BLOCK_ALIGN(x) (((x) + SDIO_BLOCK_SIZE - 1) / SDIO_BLOCK_SIZE * SDIO_BLOCK_SIZE)
 #define CMD_HDR_SIZE (SDIO_HDR_SIZE + 8)
 #define EVENT_HDR_SIZE (SDIO_HDR_SIZE + 4)
 
@@ -43,6 +90,24 @@ typedef enum {
 #define LEAVING_NETWORK_DEAUTH 3
 /* Requesting STA is leaving/resetting BSS */
 #define STA_LEAVING 36
+/* Disassociated/DELBA because of timeout */
+#define QSTA_TIMEOUT 39
+/* Status code: request declined */
+#define REQUEST_DECLINED 37
+
+/* Block ACK parameter set: [Bit 0] A-MSDU supported, [Bit 1] Block ACK policy, [Bit 2-5] TID, [Bit 6-15] Buffer size */
+#define BLOCK_ACK_AMSDU_SUPPORTED 0x1
+#define BLOCK_ACK_POLICY_IMMEDIATE 0x2
+#define BLOCK_ACK_TID_POS 2
+#define BLOCK_ACK_TID_MASK 0x3C
+#define BLOCK_ACK_WIN_SIZE_POS 6
+#define BLOCK_ACK_WIN_SIZE_MASK 0xFFC0
+/* DELBA parameter set: [Bit 11] Initiator, [Bit 12-15] TID */
+#define DELBA_INITIATOR 0x800
+#define DELBA_TID_POS 12
+/* 序列号为12位，与窗口起始相差半个序列号空间以上的视为窗口之前的帧 */
+#define SEQ_NUM_MASK 0xFFF
+#define SEQ_NUM_HALF 0x800
 
 /* Host control registers */
 /* Host control registers: Host interrupt mask */
@@ -50,9 +115,9 @@ typedef enum {
 /* Host control registers: Upload host interrupt mask */
 #define UP_LD_HOST_INT_MASK 0x1
 /* Host control registers: Download host interrupt mask */
-// #define DN_LD_HOST_INT_MASK 0x2
+#define DN_LD_HOST_INT_MASK 0x2
 /* Enable host interrupt mask */
-// #define HIM_ENABLE (UP_LD_HOST_INT_MASK | DN_LD_HOST_INT_MASK)
+#define HIM_ENABLE (UP_LD_HOST_INT_MASK | DN_LD_HOST_INT_MASK)
 /* Disable host interrupt mask */
 // #define HIM_DISABLE 0xFF
 
@@ -61,9 +126,9 @@ typedef enum {
 /* Host control registers: Upload host interrupt status */
 #define UP_LD_HOST_INT_STATUS 0x1
 /* Host control registers: Download host interrupt status */
-// #define DN_LD_HOST_INT_STATUS 0x2
+#define DN_LD_HOST_INT_STATUS 0x2
 /* Host control registers: Host interrupt status bit */
-// #define HOST_INT_STATUS_BIT (UP_LD_HOST_INT_STATUS | DN_LD_HOST_INT_STATUS)
+#define HOST_INT_STATUS_BIT (UP_LD_HOST_INT_STATUS | DN_LD_HOST_INT_STATUS)
 
 /* Port for registers */
 #define REG_PORT 0x0
@@ -85,6 +150,8 @@ typedef enum {
 #define CTRL_PORT_MASK 0x1
 /* Data port mask */
 // #define DATA_PORT_MASK 0xFFFE
+/* Multi-port aggregation address base */
+#define MPA_ADDR_BASE 0x1000
 
 /* Card control registers */
 /* Card control registers: Card to host event */
@@ -142,8 +209,14 @@ typedef enum {
 // #define TLV_TYPE_POWER_CONSTRAINT 0x20
 /* TLV type: Power capability */
 // #define TLV_TYPE_POWER_CAPABILITY 0x21
+/* TLV type: HT Capabilities (IEEE element) */
+#define TLV_TYPE_HT_CAPABILITY 0x2D
 /* TLV type: TLV_TYPE_RSN_PARAMSET */
 #define TLV_TYPE_RSN_PARAMSET 0x30
+/* TLV type: Extended Supported Rates */
+#define TLV_TYPE_EXT_RATES 0x32
+/* TLV type: HT Operation (IEEE element) */
+// #define TLV_TYPE_HT_OPERATION 0x3D
 /* TLV type: Vendor Specific IE */
 #define TLV_TYPE_VENDOR_SPECIFIC_IE 0xDD
 
@@ -200,7 +273,7 @@ typedef enum {
 /* TLV type: Channel band list */
 // #define TLV_TYPE_CHANNELBANDLIST (PROPRIETARY_TLV_BASE_ID + 0x2A) // 0x12A
 /* TLV type: AP Channel band config */
-// #define TLV_TYPE_UAP_CHAN_BAND_CONFIG (PROPRIETARY_TLV_BASE_ID + 0x2A) // 0x12A
+#define TLV_TYPE_UAP_CHAN_BAND_CONFIG (PROPRIETARY_TLV_BASE_ID + 0x2A) // 0x12A
 /* TLV type: AP Mac address */
 // #define TLV_TYPE_UAP_MAC_ADDR (PROPRIETARY_TLV_BASE_ID + 0x2B) // 0x12B
 /* TLV type: AP Beacon period */
@@ -242,7 +315,7 @@ typedef enum {
 /* TLV type: Cipher TLV */
 // #define TLV_TYPE_CIPHER (PROPRIETARY_TLV_BASE_ID + 0x42) // 0x142
 /* TLV type: PMK */
-// #define TLV_TYPE_PMK (PROPRIETARY_TLV_BASE_ID + 0x44) // 0x144
+#define TLV_TYPE_PMK (PROPRIETARY_TLV_BASE_ID + 0x44) // 0x144
 /* TLV type: AP Fragment threshold */
 // #define TLV_TYPE_UAP_FRAG_THRESHOLD (PROPRIETARY_TLV_BASE_ID + 0x46) // 0x146
 /* TLV type: AP Group rekey timer */
@@ -288,7 +361,7 @@ typedef enum {
 /* TLV type: AP RSN replay protection */
 // #define TLV_TYPE_UAP_RSN_REPLAY_PROTECT (PROPRIETARY_TLV_BASE_ID + 0x64) // 0x164
 /* TLV type: Management frame */
-// #define TLV_TYPE_UAP_MGMT_FRAME (PROPRIETARY_TLV_BASE_ID + 0x68) // 0x168
+#define TLV_TYPE_UAP_MGMT_FRAME (PROPRIETARY_TLV_BASE_ID + 0x68) // 0x168
 /* TLV type: Mgmt IE */
 // #define TLV_TYPE_MGMT_IE (PROPRIETARY_TLV_BASE_ID + 0x69) // 0x169
 /* TLV type: AP mgmt IE passthru mask */
@@ -333,6 +406,25 @@ typedef enum {
 // #define WLAN_CAPABILITY_SHORT_SLOT 0x400
 // #define WLAN_CAPABILITY_DSSS_OFDM 0x2000
 
+/* HT capability info: LDPC coding */
+// #define HT_CAP_LDPC 0x1
+/* HT capability info: 20/40 MHz */
+#define HT_CAP_SUP_WIDTH_20_40 0x2
+/* HT capability info: SM power save disabled */
+#define HT_CAP_SM_PS_DISABLED 0xC
+/* HT capability info: Greenfield */
+// #define HT_CAP_GRN_FLD 0x10
+/* HT capability info: Short GI for 20 MHz */
+#define HT_CAP_SGI_20 0x20
+/* HT capability info: Short GI for 40 MHz */
+#define HT_CAP_SGI_40 0x40
+/* A-MPDU parameters: Maximum A-MPDU length 64 KB, no MPDU density restriction */
+#define HT_AMPDU_PARAMS 0x3
+/* Supported MCS set: MCS 0-7 (1 spatial stream) */
+#define HT_MCS_SET_1SS 0xFF
+/* 802.11n device capability: 40 MHz channel width */
+#define HT_DEV_CAP_CHANWIDTH40 0x20000
+
 /* Firmware host command ID constants */
 /* Host command ID: Get hardware specifications */
 #define HOST_ID_GET_HW_SPEC 0x3
@@ -453,13 +545,13 @@ typedef enum {
 /* Host command ID: SUPPLICANT_PROFILE */
 // #define HOST_ID_SUPPLICANT_PROFILE 0xC5
 /* Host command ID: Delete a Block Ack Request */
-// #define HOST_ID_11N_CFG 0xCD
+#define HOST_ID_11N_CFG 0xCD
 /* Host command ID: Add Block Ack Request */
-// #define HOST_ID_11N_ADDBA_REQ 0xCE
+#define HOST_ID_11N_ADDBA_REQ 0xCE
 /* Host command ID: Add Block Ack Response */
 #define HOST_ID_11N_ADDBA_RSP 0xCF
 /* Host command ID: Delete a Block Ack Request */
-// #define HOST_ID_11N_DELBA 0xD0
+#define HOST_ID_11N_DELBA 0xD0
 /* Host command ID: 802.11 Tx power configuration */
 // #define HOST_ID_TXPWR_CFG 0xD1
 /* Host command ID: Soft reset */
@@ -690,6 +782,22 @@ typedef enum {
     SECURITY_TYPE_WPA2
 } wlan_security_type;
 
+typedef enum {
+    PHY_MODE_11B,
+    PHY_MODE_11G,
+    PHY_MODE_11N
+} wlan_phy_mode;
+
+typedef enum {
+    /* 统计流量，未建立会话 */
+    TX_BA_STATE_IDLE,
+    /* 已发送ADDBA请求，等待响应 */
+    TX_BA_STATE_SETUP,
+    TX_BA_STATE_ACTIVE,
+    /* 对方拒绝或未响应，WLAN_TX_BA_RETRY内不再请求 */
+    TX_BA_STATE_REFUSED
+} wlan_tx_ba_state;
+
 typedef enum {
     BSS_TYPE_STA = 0x00,
     BSS_TYPE_UAP = 0x01,
@@ -829,6 +937,45 @@ typedef struct {
     uint8_t IEBuffer[1];
 } WLAN_PACK_STRUCT IEEEtypes_AssocRsp_t;
 
+/* EVENT_MICRO_AP_STA_ASSOC的事件内容（2字节保留之后），type为TLV_TYPE_UAP_MGMT_FRAME时带有STA的（重新）关联请求 */
+typedef struct {
+    uint8_t sta_mac_addr[MAC_ADDR_LENGTH];
+    uint16_t type;
+    /* frame_control至IE结束的长度 */
+    uint16_t len;
+    uint16_t frame_control;
+    uint16_t cap_info;
+    uint16_t listen_interval;
+    /* 重新关联请求在IE之前还有当前AP地址 */
+    uint8_t IEBuffer[1];
+} WLAN_PACK_STRUCT HOST_DS_MICRO_AP_STA_ASSOC;
+
+typedef struct {
+    /* HT capability information */
+    uint16_t ht_cap_info;
+    /* A-MPDU parameters */
+    uint8_t ampdu_params;
+    /* Supported MCS set: Rx MCS bitmask */
+    uint8_t rx_mcs_mask[10];
+    /* Supported MCS set: Rx highest supported data rate */
+    uint16_t rx_highest;
+    /* Supported MCS set: Tx parameters */
+    uint8_t tx_params;
+    /* Supported MCS set: Reserved */
+    uint8_t reserved[3];
+    /* Extended HT capabilities */
+    uint16_t ext_ht_cap_info;
+    /* Transmit beamforming capabilities */
+    uint32_t tx_bf_cap_info;
+    /* Antenna selection capability */
+    uint8_t asel_cap;
+} WLAN_PACK_STRUCT IEEEtypes_HTCap_t;
+
+typedef struct {
+    MrvlIEtypesHeader_t header;
+    IEEEtypes_HTCap_t ht_cap;
+} WLAN_PACK_STRUCT MrvlIETypes_HTCap_t;
+
 typedef struct {
     /* CF parameter: Element ID */
     uint8_t element_id;
@@ -1384,6 +1531,11 @@ typedef struct {
     uint8_t phrase[MAX_PHRASE_LENGTH];
 } WLAN_PACK_STRUCT MrvlIEtypes_PassPhrase_t;
 
+typedef struct {
+    MrvlIEtypesHeader_t header;
+    uint8_t pmk[PMK_LENGTH];
+} WLAN_PACK_STRUCT MrvlIEtypes_PMK_t;
+
 typedef struct {
     MrvlIEtypesHeader_t header;
     uint16_t enc_protocol;
@@ -1416,6 +1568,18 @@ typedef struct {
     uint8_t broadcast_ssid;
 } WLAN_PACK_STRUCT MrvlIETypes_ApBCast_SSID_Ctrl_t;
 
+typedef struct {
+    MrvlIEtypesHeader_t header;
+    /* Band configuration
+     * [Bit 0-1] Band: 2.4 GHz = 0
+     * [Bit 2-3] Channel width: wlan_channel_bandwidth
+     * [Bit 4-5] Secondary channel offset: wlan_second_channel
+     * [Bit 6-7] Channel mode: Manual = 0, ACS = 1 */
+    uint8_t band_config;
+    /* Channel number */
+    uint8_t channel;
+} WLAN_PACK_STRUCT MrvlIEtypes_channel_band_t;
+
 typedef struct {
     /* BSS mode */
     uint8_t bss_mode;
@@ -2526,6 +2690,13 @@ typedef struct {
 /* Packet type debugging */
 #define PKT_TYPE_DEBUG 0xEF
 
+/* A-MSDU子帧头：目的地址、源地址及长度（大端序），子帧（最后一个除外）按4字节对齐 */
+#define AMSDU_SUBFRAME_HDR_SIZE 14
+#define AMSDU_SUBFRAME_ALIGN(len) (((len) + 3) & ~3)
+/* RFC 1042 LLC/SNAP头，其后为以太网类型 */
+#define LLC_SNAP_HDR "\xAA\xAA\x03\x00\x00\x00"
+#define LLC_SNAP_SIZE 8
+
 typedef struct {
     /* SDIO packet length */
     uint16_t pack_len;
@@ -2606,11 +2777,138 @@ typedef struct {
     wlan_security_type sec_type;
     con_status_e con_status;
     uint16_t cap_info;
+    uint8_t channel;
+    /* 只搜索了上次连接的信道，未搜索到AP时再搜索全部信道 */
+    uint8_t hint_channel;
+    /* 未搜索，直接使用缓存的AP关联 */
+    bool bss_cached;
+    /* 关联时为请求的PHY模式，关联响应后为协商的模式 */
+    wlan_phy_mode phy_mode;
+#ifdef WLAN_HOST_PMK
+    /* 主机计算或缓存的PMK，有效时代替密码发送给芯片 */
+    bool pmk_valid;
+    uint8_t pmk[PMK_LENGTH];
+#endif
 } ap_info_t;
 
+/* BSS缓存项，ie为AP的RSN及WPA IE（IEEE格式） */
+typedef struct {
+    bool used;
+    uint8_t bssid[MAC_ADDR_LENGTH];
+    uint8_t ssid_len;
+    uint8_t ssid[MAX_SSID_LENGTH];
+    uint8_t channel;
+    uint8_t rssi;
+    uint16_t cap_info;
+    wlan_security_type sec_type;
+    /* AP可用的最高PHY模式，AP支持HT但没有WMM或只有WEP/TKIP时为11g */
+    wlan_phy_mode phy_mode;
+    uint8_t ie_len;
+    uint8_t ie[WLAN_BSS_IE_SIZE];
+    /* 最近一次搜索到的时间（ms） */
+    uint32_t time;
+} wlan_bss_entry_t;
+
+/* BSS评分函数，得分越高越优先 */
+typedef int32_t (*wlan_bss_score_fn)(const wlan_bss_entry_t *bss);
+
+/* 候选AP，blacklisted表示得分已扣除黑名单分数 */
+typedef struct {
+    wlan_bss_entry_t bss;
+    int32_t score;
+    bool blacklisted;
+} wlan_bss_candidate_t;
+
+/* 关联或握手失败的BSSID */
+typedef struct {
+    bool used;
+    uint8_t bssid[MAC_ADDR_LENGTH];
+    uint32_t time;
+} wlan_bss_blacklist_t;
+
+/* wlan_ap_start_ex的参数，HT需启用WLAN_11N */
+typedef struct {
+    uint8_t *ssid;
+    uint8_t ssid_len;
+    uint8_t *pwd;
+    uint8_t pwd_len;
+    wlan_security_type sec_type;
+    bool broadcast_ssid;
+    /* 信道，0为固件默认 */
+    uint8_t channel;
+    /* 802.11n（短GI、MCS 0~7） */
+    bool ht;
+    /* 请求40MHz，芯片支持且指定的信道有副信道时才使用 */
+    bool ht_40mhz;
+} wlan_ap_config_t;
+
+/* A-MPDU接收重排序表，以（BSS类型，发送方，TID）区分 */
+typedef struct {
+    bool used;
+    uint8_t bss_type;
+    uint8_t ta[MAC_ADDR_LENGTH];
+    uint8_t tid;
+    uint8_t win_size;
+    /* 窗口起始序列号，之前的帧均已交付 */
+    uint16_t start_win;
+    /* 缓存的帧数及窗口起始最近一次移动（或开始缓存）的时间 */
+    uint8_t pkt_num;
+    uint32_t time;
+    /* 缓存的帧（rx缓冲区），以序列号的低位为下标 */
+    uint8_t *pkt[WLAN_RX_REORDER_WIN];
+} wlan_rx_reorder_t;
+
+#ifdef WLAN_HOST_PMK
+/* PMK缓存项，同时为保存在Flash中的记录（KV_KEY_STA_PMK），以密码的SHA-1匹配 */
+typedef struct {
+    uint8_t ssid_len;
+    uint8_t ssid[MAX_SSID_LENGTH];
+    uint8_t pwd_hash[SHA1_DIGEST_SIZE];
+    uint8_t pmk[PMK_LENGTH];
+} wlan_pmk_entry_t;
+#endif
+
+#ifdef WLAN_11N
+/* TX BA会话，以（BSS类型，接收方，TID）区分 */
+typedef struct {
+    bool used;
+    uint8_t bss_type;
+    uint8_t ra[MAC_ADDR_LENGTH];
+    uint8_t tid;
+    wlan_tx_ba_state state;
+    /* 状态改变的时间 */
+    uint32_t state_time;
+    /* 当前统计周期的开始时间及周期内的帧数，最近一次发送的时间 */
+    uint32_t period_time;
+    uint16_t period_pkts;
+    uint32_t last_time;
+    /* 会话建立期间发送的帧数及字节数 */
+    uint32_t tx_pkts;
+    uint32_t tx_bytes;
+    /* 会话建立、被拒绝（含未响应）及拆除的次数 */
+    uint16_t setup_count;
+    uint16_t refuse_count;
+    uint16_t teardown_count;
+} wlan_tx_ba_t;
+#endif
+
+#ifdef WLAN_KV_STORE
+/* 保存在Flash中的上次连接的BSS（KV_KEY_STA_BSS） */
+typedef struct {
+    uint8_t bssid[MAC_ADDR_LENGTH];
+    uint8_t channel;
+    uint8_t ssid_len;
+    uint8_t ssid[MAX_SSID_LENGTH];
+} wlan_bss_record_t;
+#endif
+
 typedef struct {
     uint8_t used;
     uint8_t sta_mac_addr[MAC_ADDR_LENGTH];
+#ifdef WLAN_11N
+    /* 关联请求中带有HT能力IE */
+    bool ht;
+#endif
 } sta_info_t;
 
 typedef struct {
@@ -2624,28 +2922,189 @@ typedef struct {
     void (*wlan_cb_ap_disconnect)(uint8_t *name, uint8_t *mac, uint8_t *ip);
 } wlan_cb_t;
 
+/* 命令结束回调，resp为命令响应（超时、发送失败或被取消时为NULL） */
+typedef void (*wlan_cmd_cb)(uint8_t err, uint8_t *resp, void *arg);
+
+typedef struct {
+    uint8_t buf[CMD_BUF_SIZE];
+    wlan_cmd_cb callback;
+    void *arg;
+    /* 前一命令失败时取消（如SUPPLICANT_PMK之后的ASSOCIATE） */
+    bool chained;
+} wlan_cmd_t;
+
+/* 零拷贝发送结束后在主循环中释放封包 */
+typedef void (*wlan_tx_free_fn)(void *arg);
+
+typedef struct {
+    wlan_tx_free_fn free;
+    void *arg;
+} wlan_tx_ref_t;
+
+typedef struct {
+    /* 聚合读取的端口数 */
+    uint8_t pkt_num;
+    /* 各封包在聚合缓冲区中占用的长度（按分块对齐） */
+    uint16_t pkt_len[MP_RX_AGGR_PKT_LIMIT];
+} mp_rx_aggr_t;
+
+typedef struct {
+    /* 读取端口的CMD53次数及封包数 */
+    uint32_t rx_transfer_count;
+    uint32_t rx_packet_count;
+    /* 每次CMD53读取封包数的分布，下标为封包数-1 */
+    uint32_t rx_aggr_hist[MP_RX_AGGR_PKT_LIMIT];
+    /* 写入端口的CMD53次数及封包数 */
+    uint32_t tx_transfer_count;
+    uint32_t tx_packet_count;
+    /* 每次CMD53写入封包数的分布，下标为封包数-1 */
+    uint32_t tx_aggr_hist[MP_TX_AGGR_PKT_LIMIT];
+    /* 缓存的写入位图无空闲端口，需读取写入位图的次数 */
+    uint32_t tx_bitmap_poll_count;
+    /* 零拷贝发送的封包数 */
+    uint32_t tx_ref_count;
+    /* 以零拷贝方式交给lwIP的封包数及缓冲区不足时复制的封包数 */
+    uint32_t rx_ref_count;
+    uint32_t rx_copy_count;
+    /* 借给lwIP的接收缓冲区个数的最大值 */
+    uint8_t rx_lent_max;
+    /**
+     * 固件下载耗时（us）：总耗时（至固件就绪）、读取Flash及解压缩耗时
+     * 其中未与CMD53重叠的部分、等待芯片（CMD53结束及下一块请求）耗时
+     */
+    uint32_t fw_total_time;
+    uint32_t fw_load_time;
+    uint32_t fw_stall_time;
+    uint32_t fw_wait_time;
+    /* 主机计算PMK的次数、命中缓存（含Flash）的次数、最近一次计算的耗时（各段之和）及最长一段的耗时（us） */
+    uint32_t pmk_derive_count;
+    uint32_t pmk_cache_hit_count;
+    uint32_t pmk_derive_time;
+    uint32_t pmk_slice_time;
+    /* 搜索的信道数（含特定搜索），未搜索而直接使用缓存的AP关联的次数 */
+    uint32_t scan_channel_count;
+    uint32_t bss_cache_hit_count;
+    /* 重排序：缓存等待的帧数、丢弃的重复或过期帧数、超时交付的次数、缓冲区不足时不再等待的次数 */
+    uint32_t rx_reorder_count;
+    uint32_t rx_reorder_drop_count;
+    uint32_t rx_reorder_timeout_count;
+    uint32_t rx_reorder_flush_count;
+    /* 接收的A-MSDU个数、交付的子帧数及丢弃的子帧数（长度错误或不是LLC/SNAP） */
+    uint32_t rx_amsdu_count;
+    uint32_t rx_amsdu_subframe_count;
+    uint32_t rx_amsdu_drop_count;
+    /* TX BA会话建立、被拒绝（含未响应）及拆除（空闲或对方DELBA）的次数 */
+    uint32_t tx_ba_setup_count;
+    uint32_t tx_ba_refuse_count;
+    uint32_t tx_ba_teardown_count;
+} wlan_stats_t;
+
 typedef struct {
     uint8_t mac_addr[MAC_ADDR_LENGTH];
     sta_info_t sta_info[MAX_CLIENT_NUM];
     ap_info_t ap_info;
     uint32_t ctrl_port;
     uint16_t mp_end_port;
+    /* GET_HW_SPEC返回的802.11n能力 */
+    uint32_t dev_11n_cap;
     uint16_t read_bitmap;
+    /* 空闲写入端口，由控制寄存器读取（上传/下载中断）更新，发送时清除已占用端口 */
     uint16_t write_bitmap;
     uint16_t curr_rd_port;
     uint16_t curr_wr_port;
+    /* 热启动：芯片固件未重新下载，warm_boot_failed表示初始化命令失败需重置芯片，rd_port_sync表示读取端口尚未与芯片同步 */
+    bool warm_boot;
+    bool warm_boot_failed;
+    bool rd_port_sync;
+    uint8_t curr_tx_buf;
+    /* 发送队列：当前缓冲区中的封包数、已用长度及首个封包入队时间 */
+    uint8_t tx_pkt_num;
+    uint16_t tx_buf_len;
+    uint32_t tx_time;
+    /* 零拷贝发送的封包环形队列，tx_ref_done由CMD53结束回调累加，tx_ref_released由主循环累加 */
+    wlan_tx_ref_t tx_ref[TX_REF_NUM];
+    uint8_t tx_ref_head;
+    uint8_t tx_ref_num;
+    uint8_t tx_ref_released;
+    volatile uint8_t tx_ref_done;
+    /* 命令队列：芯片同时只处理一条命令，队首命令发送后等待序号相同的响应 */
+    uint8_t cmd_head;
+    uint8_t cmd_num;
+    uint8_t cmd_seq;
+    bool cmd_sent;
+    uint32_t cmd_time;
+    /* 以下由CMD53结束回调（中断上下文）修改 */
+    volatile uint8_t cmd_err;
+    volatile bool tx_busy[TX_BUF_NUM];
+    volatile uint8_t tx_err;
+    /* 各接收缓冲区的读取结果（sdio_err_e或RX_RESULT_PENDING） */
+    volatile uint8_t rx_result[RX_BUF_NUM];
+    /* 接收队列：按读取顺序排列的缓冲区序号，队首缓冲区已解析的封包数及偏移 */
+    uint8_t rx_queue[RX_BUF_NUM];
+    uint8_t rx_queue_head;
+    uint8_t rx_queue_num;
+    uint8_t rx_pkt_index;
+    uint16_t rx_pkt_offset;
+    /* 各接收缓冲区被lwIP引用的封包数及被引用的缓冲区个数 */
+    uint8_t rx_ref[RX_BUF_NUM];
+    uint8_t rx_lent_num;
+    wlan_bss_entry_t bss_cache[WLAN_BSS_CACHE_NUM];
+    wlan_bss_blacklist_t bss_blacklist[WLAN_BSS_BLACKLIST_NUM];
+    wlan_bss_score_fn bss_score;
+    wlan_rx_reorder_t rx_reorder[WLAN_RX_REORDER_NUM];
+#ifdef WLAN_11N
+    /* uAP以802.11n启动 */
+    bool uap_ht;
+    wlan_tx_ba_t tx_ba[WLAN_TX_BA_NUM];
+#endif
+#ifdef WLAN_HOST_PMK
+    /* PMK缓存，pmk_cache_next为下一个替换的缓存项 */
+    wlan_pmk_entry_t pmk_cache[WLAN_PMK_CACHE_NUM];
+    uint8_t pmk_cache_next;
+    /* 正在分段计算的缓存项（无则为NULL）及密码的SHA-1，算完前等待关联的AP（used为false时无） */
+    wlan_pmk_entry_t *pmk_entry;
+    pbkdf2_sha1_t pmk_ctx;
+    uint8_t pmk_pwd_hash[SHA1_DIGEST_SIZE];
+    wlan_bss_entry_t pmk_bss;
+#endif
+    wlan_stats_t stats;
 } wlan_core_t;
 
 uint8_t wlan_init(wlan_cb_t *callback);
 uint8_t wlan_shutdown(void);
 uint8_t wlan_process_packet(void);
+uint8_t wlan_process_rx(void);
+uint8_t wlan_queue_cmd(uint16_t cmd_id, uint16_t cmd_action, uint8_t *data_buf, uint16_t data_len, wlan_cmd_cb callback, void *arg);
+uint8_t wlan_poll_cmd(void);
+uint8_t wlan_poll_rx_reorder(void);
+#ifdef WLAN_HOST_PMK
+void wlan_poll_pmk(void);
+#endif
+#ifdef WLAN_11N
+void wlan_poll_tx_ba(void);
+uint8_t wlan_get_tx_ba(wlan_tx_ba_t *session, uint8_t num);
+#endif
+bool wlan_rx_pending(void);
 uint8_t wlan_scan(uint8_t *channel, uint8_t channel_num, uint16_t max_time);
 uint8_t wlan_scan_ssid(uint8_t *ssid, uint8_t ssid_len, uint16_t max_time);
 uint8_t wlan_sta_connect(uint8_t *ssid, uint8_t ssid_len, uint8_t *pwd, uint8_t pwd_len);
+void wlan_set_bss_score(wlan_bss_score_fn score);
+int32_t wlan_bss_default_score(const wlan_bss_entry_t *bss);
+uint8_t wlan_get_bss(uint8_t *ssid, uint8_t ssid_len, wlan_bss_candidate_t *candidate, uint8_t num);
 uint8_t wlan_sta_disconnect(void);
+wlan_phy_mode wlan_get_phy_mode(void);
 uint8_t wlan_ap_start(uint8_t *ssid, uint8_t ssid_len, uint8_t *pwd, uint8_t pwd_len, wlan_security_type sec_type, bool broadcast_ssid);
+uint8_t wlan_ap_start_ex(const wlan_ap_config_t *config);
 uint8_t wlan_ap_stop(void);
 void wlan_ap_show(void);
 uint8_t wlan_ap_deauth(uint8_t *mac_addr);
+uint8_t *wlan_get_tx_buf(void);
+void wlan_get_stats(wlan_stats_t *stats);
+void wlan_reset_stats(void);
+bool wlan_rx_buf_ref(uint8_t *rx_buf);
+void wlan_rx_buf_unref(uint8_t *rx_buf);
 uint8_t wlan_send_data(uint8_t *data_buf, uint16_t data_len, wlan_bss_type bss_type);
+bool wlan_send_ref_ready(void);
+uint8_t wlan_send_data_ref(TxPD *tx_packet, uint16_t data_len, uint16_t data_offset, wlan_bss_type bss_type, wlan_tx_free_fn free, void *arg);
+uint8_t wlan_flush_data(bool force);
 #endif
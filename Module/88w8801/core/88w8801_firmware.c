@@ -1,6 +1,6 @@
 #include "88w8801/88w8801.h"
 
-#ifndef USE_FLASH_FIRMWARE
+#if !defined(USE_FLASH_FIRMWARE) && !defined(WLAN_FW_COMPRESSED)
 const uint8_t fw_mrvl88w8801[] = {
     0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x04, 0x00, 0x00, 0x00, 0x94, 0x51, 0x1A,
     0x1C, 0xF0, 0x9F, 0xE5, 0x1C, 0xF0, 0x9F, 0xE5, 0x1C, 0xF0, 0x9F, 0xE5, 0x1C, 0xF0, 0x9F, 0xE5,
@@ -0,0 +1,197 @@
+#include <string.h>
+#include "88w8801_inflate.h"
+
+/* 块类型 */
+#define INFLATE_BLOCK_STORED  0
+#define INFLATE_BLOCK_FIXED   1
+#define INFLATE_BLOCK_DYNAMIC 2
+
+/* 字面/长度码及距离码个数 */
+#define INFLATE_LIT_NUM  288
+#define INFLATE_DIST_NUM 30
+/* 块结束符号 */
+#define INFLATE_END_OF_BLOCK 256
+
+/* 长度码257-285的基数及附加位数 */
+static const uint16_t inflate_len_base[29] = {3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+static const uint8_t inflate_len_bits[29] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+/* 距离码0-29的基数及附加位数 */
+static const uint16_t inflate_dist_base[INFLATE_DIST_NUM] = {1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577};
+static const uint8_t inflate_dist_bits[INFLATE_DIST_NUM] = {0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+/* 动态块中码长码的码长顺序 */
+static const uint8_t inflate_clen_order[19] = {16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15};
+
+static uint32_t inflate_get_bits(inflate_t *inf, uint8_t bit_num);
+static int16_t inflate_decode(inflate_t *inf, inflate_tree_t *tree);
+static void inflate_build(inflate_tree_t *tree, const uint8_t *lengths, uint16_t num);
+static uint8_t inflate_block(inflate_t *inf);
+
+/**
+ * @param inf 解压缩状态
+ * @param read 输入回调函数
+ * @param arg read的参数
+ * @param window 窗口缓冲区，大小为1 << window_bits字节
+ * @param window_bits 窗口位数（不超过15）
+ * @brief 初始化解压缩状态
+ */
+void inflate_init(inflate_t *inf, inflate_read_fn read, void *arg, uint8_t *window, uint8_t window_bits) {
+    memset(inf, 0, sizeof(inflate_t));
+    inf->read = read;
+    inf->arg = arg;
+    inf->window = window;
+    inf->window_mask = (1 << window_bits) - 1;
+    inf->state = INFLATE_STATE_HEADER;
+}
+
+/**
+ * @param inf 解压缩状态
+ * @param data_buf 输出缓冲区
+ * @param data_len 输出长度
+ * @return inflate_err_e中某一状态码
+ * @brief 解压缩data_len字节，数据流提前结束时返回INFLATE_ERR_END_OF_STREAM
+ */
+uint8_t inflate_read(inflate_t *inf, uint8_t *data_buf, uint16_t data_len) {
+    int16_t symbol;
+    uint8_t byte, err;
+    while (data_len) {
+        if (inf->copy_len) {
+            /* 复制未完成的匹配或未压缩块 */
+            byte = inf->copy_dist ? *(inf->window + ((inf->window_pos - inf->copy_dist) & inf->window_mask)) : (uint8_t)inflate_get_bits(inf, 8);
+            --inf->copy_len;
+        } else if (inf->state == INFLATE_STATE_HUFFMAN) {
+            if ((symbol = inflate_decode(inf, &inf->lit_tree)) < 0) return INFLATE_ERR_INVALID_CODE;
+            if (symbol < INFLATE_END_OF_BLOCK) byte = (uint8_t)symbol;
+            else {
+                if (symbol == INFLATE_END_OF_BLOCK) {
+                    inf->state = inf->final ? INFLATE_STATE_DONE : INFLATE_STATE_HEADER;
+                    continue;
+                }
+                /* 长度-距离对，复制在之后的循环中完成 */
+                if ((symbol -= INFLATE_END_OF_BLOCK + 1) >= (int16_t)sizeof(inflate_len_base) / 2) return INFLATE_ERR_INVALID_CODE;
+                inf->copy_len = *(inflate_len_base + symbol) + inflate_get_bits(inf, *(inflate_len_bits + symbol));
+                if ((symbol = inflate_decode(inf, &inf->dist_tree)) < 0 || symbol >= INFLATE_DIST_NUM) return INFLATE_ERR_INVALID_CODE;
+                if ((inf->copy_dist = *(inflate_dist_base + symbol) + inflate_get_bits(inf, *(inflate_dist_bits + symbol))) > inf->window_mask + 1) return INFLATE_ERR_INVALID_DISTANCE;
+                continue;
+            }
+        } else if (inf->state == INFLATE_STATE_STORED) {
+            /* 未压缩块结束 */
+            inf->state = inf->final ? INFLATE_STATE_DONE : INFLATE_STATE_HEADER;
+            continue;
+        } else if (inf->state == INFLATE_STATE_HEADER) {
+            if ((err = inflate_block(inf))) return err;
+            continue;
+        } else return INFLATE_ERR_END_OF_STREAM;
+        *(inf->window + inf->window_pos) = *data_buf++ = byte;
+        inf->window_pos = (inf->window_pos + 1) & inf->window_mask;
+        --data_len;
+    }
+    return INFLATE_ERR_OK;
+}
+
+/**
+ * @param inf 解压缩状态
+ * @param bit_num 位数（不超过16）
+ * @return 按LSB优先读取的位
+ */
+static uint32_t inflate_get_bits(inflate_t *inf, uint8_t bit_num) {
+    while (inf->bit_num < bit_num) inf->bit_buf |= (uint32_t)inf->read(inf->arg) << inf->bit_num, inf->bit_num += 8;
+    uint32_t bits = inf->bit_buf & ((1UL << bit_num) - 1);
+    inf->bit_buf >>= bit_num;
+    inf->bit_num -= bit_num;
+    return bits;
+}
+
+/**
+ * @param inf 解压缩状态
+ * @param tree Huffman树
+ * @return 符号，码字无效时返回-1
+ * @brief Huffman码字按MSB优先逐位读取
+ */
+static int16_t inflate_decode(inflate_t *inf, inflate_tree_t *tree) {
+    int16_t code = 0, first = 0, index = 0, count;
+    for (uint8_t len = 1; len < 16; ++len) {
+        code |= inflate_get_bits(inf, 1);
+        if (code - first < (count = *(tree->count + len))) return *(tree->symbol + index + code - first);
+        index += count;
+        first = (first + count) << 1;
+        code <<= 1;
+    }
+    return -1;
+}
+
+/**
+ * @param tree Huffman树
+ * @param lengths 各符号的码长
+ * @param num 符号个数
+ * @brief 由码长构造范式Huffman树
+ */
+static void inflate_build(inflate_tree_t *tree, const uint8_t *lengths, uint16_t num) {
+    uint16_t offs[16], index;
+    memset(tree->count, 0, sizeof(tree->count));
+    for (index = 0; index < num; ++index) ++*(tree->count + *(lengths + index));
+    *tree->count = 0;
+    for (*offs = *(offs + 1) = 0, index = 1; index < 15; ++index) *(offs + index + 1) = *(offs + index) + *(tree->count + index);
+    for (index = 0; index < num; ++index)
+        if (*(lengths + index)) *(tree->symbol + (*(offs + *(lengths + index)))++) = index;
+}
+
+/**
+ * @param inf 解压缩状态
+ * @return inflate_err_e中某一状态码
+ * @brief 读取块头部，构造Huffman树
+ */
+static uint8_t inflate_block(inflate_t *inf) {
+    uint8_t lengths[INFLATE_LIT_NUM + INFLATE_DIST_NUM + 2], len;
+    uint16_t lit_num, dist_num, index, repeat;
+    int16_t symbol;
+    inf->final = inflate_get_bits(inf, 1);
+    switch (inflate_get_bits(inf, 2)) {
+    case INFLATE_BLOCK_STORED:
+        /* 跳过当前字节的剩余位，LEN与NLEN互为反码 */
+        inf->bit_buf = inf->bit_num = 0;
+        inf->copy_len = inflate_get_bits(inf, 16);
+        if ((inflate_get_bits(inf, 16) ^ 0xFFFF) != inf->copy_len) return INFLATE_ERR_INVALID_BLOCK;
+        inf->copy_dist = 0;
+        inf->state = INFLATE_STATE_STORED;
+        return INFLATE_ERR_OK;
+    case INFLATE_BLOCK_FIXED:
+        memset(lengths, 8, 144);
+        memset(lengths + 144, 9, 112);
+        memset(lengths + 256, 7, 24);
+        memset(lengths + 280, 8, 8);
+        inflate_build(&inf->lit_tree, lengths, INFLATE_LIT_NUM);
+        memset(lengths, 5, INFLATE_DIST_NUM);
+        inflate_build(&inf->dist_tree, lengths, INFLATE_DIST_NUM);
+        break;
+    case INFLATE_BLOCK_DYNAMIC:
+        lit_num = inflate_get_bits(inf, 5) + 257;
+        dist_num = inflate_get_bits(inf, 5) + 1;
+        len = inflate_get_bits(inf, 4) + 4;
+        if (lit_num > 286 || dist_num > INFLATE_DIST_NUM) return INFLATE_ERR_INVALID_BLOCK;
+        /* 码长码的树暂存在距离树中 */
+        memset(lengths, 0, sizeof(inflate_clen_order));
+        for (index = 0; index < len; ++index) *(lengths + *(inflate_clen_order + index)) = inflate_get_bits(inf, 3);
+        inflate_build(&inf->dist_tree, lengths, sizeof(inflate_clen_order));
+        for (index = 0; index < lit_num + dist_num; index += repeat) {
+            if ((symbol = inflate_decode(inf, &inf->dist_tree)) < 0) return INFLATE_ERR_INVALID_CODE;
+            if (symbol < 16) {
+                *(lengths + index) = symbol, repeat = 1;
+                continue;
+            }
+            /* 16：重复前一码长3-6次，17：3-10个0，18：11-138个0 */
+            if (symbol == 16) {
+                if (!index) return INFLATE_ERR_INVALID_BLOCK;
+                len = *(lengths + index - 1), repeat = 3 + inflate_get_bits(inf, 2);
+            } else len = 0, repeat = symbol == 17 ? 3 + inflate_get_bits(inf, 3) : 11 + inflate_get_bits(inf, 7);
+            if (index + repeat > lit_num + dist_num) return INFLATE_ERR_INVALID_BLOCK;
+            memset(lengths + index, len, repeat);
+        }
+        if (!*(lengths + INFLATE_END_OF_BLOCK)) return INFLATE_ERR_INVALID_BLOCK;
+        inflate_build(&inf->lit_tree, lengths, lit_num);
+        inflate_build(&inf->dist_tree, lengths + lit_num, dist_num);
+        break;
+    default: return INFLATE_ERR_INVALID_BLOCK;
+    }
+    inf->state = INFLATE_STATE_HUFFMAN;
+    return INFLATE_ERR_OK;
+}
@@ -0,0 +1,57 @@
+/**
+ * 流式DEFLATE（RFC 1951，无zlib/gzip头部）解压缩
+ * 输入按字节由回调函数读取，输出按调用方要求的长度逐段生成，匹配可跨越两次调用
+ * 窗口由调用方提供，大小需不小于压缩时的窗口
+ */
+#ifndef _88W8801_INFLATE_
+#define _88W8801_INFLATE_
+#include <stdint.h>
+#include <stdbool.h>
+
+typedef enum {
+    INFLATE_ERR_OK,
+    INFLATE_ERR_INVALID_BLOCK,
+    INFLATE_ERR_INVALID_CODE,
+    INFLATE_ERR_INVALID_DISTANCE,
+    INFLATE_ERR_END_OF_STREAM
+} inflate_err_e;
+
+typedef enum {
+    INFLATE_STATE_HEADER,
+    INFLATE_STATE_STORED,
+    INFLATE_STATE_HUFFMAN,
+    INFLATE_STATE_DONE
+} inflate_state_e;
+
+/**
+ * @param arg inflate_init中的arg
+ * @return 下一个输入字节
+ */
+typedef uint8_t (*inflate_read_fn)(void *arg);
+
+/* 范式Huffman树：各码长的码字数及按码字排列的符号 */
+typedef struct {
+    uint16_t count[16];
+    uint16_t symbol[288];
+} inflate_tree_t;
+
+typedef struct {
+    inflate_read_fn read;
+    void *arg;
+    uint32_t bit_buf;
+    uint8_t bit_num;
+    uint8_t state;
+    bool final;
+    /* 未完成的匹配（copy_dist为0时为未压缩块的剩余长度） */
+    uint16_t copy_len;
+    uint16_t copy_dist;
+    uint8_t *window;
+    uint16_t window_mask;
+    uint16_t window_pos;
+    inflate_tree_t lit_tree;
+    inflate_tree_t dist_tree;
+} inflate_t;
+
+void inflate_init(inflate_t *inf, inflate_read_fn read, void *arg, uint8_t *window, uint8_t window_bits);
+uint8_t inflate_read(inflate_t *inf, uint8_t *data_buf, uint16_t data_len);
+#endif
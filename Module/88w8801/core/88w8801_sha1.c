@@ -0,0 +1,248 @@
+#include <string.h>
+#include "88w8801_sha1.h"
+
+#define SHA1_ROL(x, n) ((x) << (n) | (x) >> (32 - (n)))
+/* 各轮的逻辑函数 */
+#define SHA1_F1(b, c, d) ((d) ^ ((b) & ((c) ^ (d))))
+#define SHA1_F2(b, c, d) ((b) ^ (c) ^ (d))
+#define SHA1_F3(b, c, d) (((b) & (c)) | ((d) & ((b) | (c))))
+#define SHA1_K1 0x5A827999
+#define SHA1_K2 0x6ED9EBA1
+#define SHA1_K3 0x8F1BBCDC
+#define SHA1_K4 0xCA62C1D6
+/* 消息扩展只保留最近16个字，i为常量时分支在编译时确定 */
+#define SHA1_W(i) ((i) < 16 ? *(w + (i)) : (*(w + ((i) & 15)) = SHA1_ROL(*(w + (((i) + 13) & 15)) ^ *(w + (((i) + 8) & 15)) ^ *(w + (((i) + 2) & 15)) ^ *(w + ((i) & 15)), 1)))
+#define SHA1_R(a, b, c, d, e, f, k, i) \
+    do { \
+        e += SHA1_ROL(a, 5) + f(b, c, d) + k + SHA1_W(i); \
+        b = SHA1_ROL(b, 30); \
+    } while (0)
+/* 五轮后变量恢复原位 */
+#define SHA1_R5(f, k, i) \
+    do { \
+        SHA1_R(a, b, c, d, e, f, k, i); \
+        SHA1_R(e, a, b, c, d, f, k, i + 1); \
+        SHA1_R(d, e, a, b, c, f, k, i + 2); \
+        SHA1_R(c, d, e, a, b, f, k, i + 3); \
+        SHA1_R(b, c, d, e, a, f, k, i + 4); \
+    } while (0)
+/* 消息长度（位）：一个密钥块及一个摘要 */
+#define HMAC_DIGEST_BITS ((SHA1_BLOCK_SIZE + SHA1_DIGEST_SIZE) << 3)
+
+static void sha1_compress(uint32_t *state, uint32_t *w);
+static void sha1_block(uint32_t *state, const uint8_t *block);
+static void hmac_sha1_init(sha1_t *inner, sha1_t *outer, const uint8_t *key, uint16_t key_len);
+static void hmac_sha1_digest(uint32_t *state, const uint32_t *pad_state, const uint32_t *digest);
+
+/**
+ * @param ctx 摘要状态
+ * @brief 初始化SHA-1
+ */
+void sha1_init(sha1_t *ctx) {
+    *ctx->state = 0x67452301;
+    *(ctx->state + 1) = 0xEFCDAB89;
+    *(ctx->state + 2) = 0x98BADCFE;
+    *(ctx->state + 3) = 0x10325476;
+    *(ctx->state + 4) = 0xC3D2E1F0;
+    ctx->count = 0;
+}
+
+/**
+ * @param ctx 摘要状态
+ * @param data 数据
+ * @param data_len 数据长度
+ * @brief 输入数据，整块直接压缩，不足一块的部分暂存
+ */
+void sha1_update(sha1_t *ctx, const uint8_t *data, uint32_t data_len) {
+    uint32_t used = ctx->count & (SHA1_BLOCK_SIZE - 1), len;
+    ctx->count += data_len;
+    if (used) {
+        memcpy(ctx->buf + used, data, len = data_len < SHA1_BLOCK_SIZE - used ? data_len : SHA1_BLOCK_SIZE - used);
+        if ((used += len) < SHA1_BLOCK_SIZE) return;
+        sha1_block(ctx->state, ctx->buf);
+        data += len, data_len -= len;
+    }
+    for (; data_len >= SHA1_BLOCK_SIZE; data += SHA1_BLOCK_SIZE, data_len -= SHA1_BLOCK_SIZE) sha1_block(ctx->state, data);
+    memcpy(ctx->buf, data, data_len);
+}
+
+/**
+ * @param ctx 摘要状态
+ * @param digest 摘要（SHA1_DIGEST_SIZE字节）
+ * @brief 填充并输出摘要
+ */
+void sha1_final(sha1_t *ctx, uint8_t *digest) {
+    uint32_t used = ctx->count & (SHA1_BLOCK_SIZE - 1), bits = ctx->count << 3;
+    *(ctx->buf + used++) = 0x80;
+    if (used > SHA1_BLOCK_SIZE - 8) {
+        memset(ctx->buf + used, 0, SHA1_BLOCK_SIZE - used);
+        sha1_block(ctx->state, ctx->buf);
+        used = 0;
+    }
+    memset(ctx->buf + used, 0, SHA1_BLOCK_SIZE - 4 - used);
+    for (used = 0; used < 4; ++used) *(ctx->buf + SHA1_BLOCK_SIZE - 1 - used) = bits >> (used << 3);
+    sha1_block(ctx->state, ctx->buf);
+    for (used = 0; used < SHA1_DIGEST_SIZE; ++used) *(digest + used) = *(ctx->state + (used >> 2)) >> ((3 - (used & 3)) << 3);
+}
+
+/**
+ * @param key 密钥
+ * @param key_len 密钥长度
+ * @param data 数据
+ * @param data_len 数据长度
+ * @param digest 摘要（SHA1_DIGEST_SIZE字节）
+ * @brief 计算HMAC-SHA1
+ */
+void hmac_sha1(const uint8_t *key, uint16_t key_len, const uint8_t *data, uint16_t data_len, uint8_t *digest) {
+    sha1_t inner, outer;
+    hmac_sha1_init(&inner, &outer, key, key_len);
+    sha1_update(&inner, data, data_len);
+    sha1_final(&inner, digest);
+    sha1_update(&outer, digest, SHA1_DIGEST_SIZE);
+    sha1_final(&outer, digest);
+}
+
+/**
+ * @param pwd 密码
+ * @param pwd_len 密码长度
+ * @param salt 盐
+ * @param salt_len 盐长度
+ * @param iterations 迭代次数
+ * @param key 派生密钥
+ * @param key_len 派生密钥长度
+ * @brief 一次计算完PBKDF2-SHA1
+ */
+void pbkdf2_sha1(const uint8_t *pwd, uint16_t pwd_len, const uint8_t *salt, uint16_t salt_len, uint32_t iterations, uint8_t *key, uint16_t key_len) {
+    pbkdf2_sha1_t ctx;
+    pbkdf2_sha1_init(&ctx, pwd, pwd_len, salt, salt_len, iterations, key, key_len);
+    while (!pbkdf2_sha1_step(&ctx, iterations));
+}
+
+/**
+ * @param ctx 计算状态
+ * @param pwd 密码，只在初始化时使用
+ * @param pwd_len 密码长度
+ * @param salt 盐
+ * @param salt_len 盐长度
+ * @param iterations 迭代次数
+ * @param key 派生密钥
+ * @param key_len 派生密钥长度
+ * @brief 初始化分段计算的PBKDF2-SHA1，预先计算HMAC内外层密钥块的中间状态
+ */
+void pbkdf2_sha1_init(pbkdf2_sha1_t *ctx, const uint8_t *pwd, uint16_t pwd_len, const uint8_t *salt, uint16_t salt_len, uint32_t iterations, uint8_t *key, uint16_t key_len) {
+    hmac_sha1_init(&ctx->inner, &ctx->outer, pwd, pwd_len);
+    ctx->salt = salt;
+    ctx->salt_len = salt_len;
+    ctx->key = key;
+    ctx->key_len = key_len;
+    ctx->iterations = iterations;
+    ctx->block = ctx->index = 0;
+}
+
+/**
+ * @param ctx 计算状态
+ * @param budget 本次至多计算的迭代次数
+ * @return 派生密钥是否已全部计算
+ * @brief 继续计算PBKDF2-SHA1，每块的首次迭代按HMAC计算，之后的迭代只压缩两次
+ */
+bool pbkdf2_sha1_step(pbkdf2_sha1_t *ctx, uint32_t budget) {
+    sha1_t sha1;
+    uint32_t *u = ctx->u, *t = ctx->t, index;
+    uint8_t digest[SHA1_DIGEST_SIZE], count[4], len;
+    for (; ctx->key_len && budget; ctx->key += len, ctx->key_len -= len, ctx->index = 0) {
+        if (!ctx->index) {
+            /* U1 = HMAC(pwd, salt || INT(block)) */
+            ++ctx->block;
+            for (index = 0; index < 4; ++index) *(count + index) = ctx->block >> ((3 - index) << 3);
+            sha1 = ctx->inner;
+            sha1_update(&sha1, ctx->salt, ctx->salt_len);
+            sha1_update(&sha1, count, sizeof(count));
+            sha1_final(&sha1, digest);
+            sha1 = ctx->outer;
+            sha1_update(&sha1, digest, SHA1_DIGEST_SIZE);
+            sha1_final(&sha1, digest);
+            for (index = 0; index < 5; ++index) *(t + index) = *(u + index) = *(sha1.state + index);
+            ++ctx->index, --budget;
+        }
+        /* Ui = HMAC(pwd, Ui-1)，T为各U的异或 */
+        for (; ctx->index < ctx->iterations && budget; ++ctx->index, --budget) {
+            hmac_sha1_digest(u, ctx->inner.state, u);
+            hmac_sha1_digest(u, ctx->outer.state, u);
+            *t ^= *u, *(t + 1) ^= *(u + 1), *(t + 2) ^= *(u + 2), *(t + 3) ^= *(u + 3), *(t + 4) ^= *(u + 4);
+        }
+        if (ctx->index < ctx->iterations) return false;
+        len = ctx->key_len < SHA1_DIGEST_SIZE ? ctx->key_len : SHA1_DIGEST_SIZE;
+        for (index = 0; index < len; ++index) *(ctx->key + index) = *(t + (index >> 2)) >> ((3 - (index & 3)) << 3);
+    }
+    return !ctx->key_len;
+}
+
+/**
+ * @param state 摘要状态
+ * @param w 消息块（16个字，用作消息扩展缓冲区）
+ * @brief 压缩一个消息块，80轮全部展开
+ */
+static void sha1_compress(uint32_t *state, uint32_t *w) {
+    uint32_t a = *state, b = *(state + 1), c = *(state + 2), d = *(state + 3), e = *(state + 4);
+    SHA1_R5(SHA1_F1, SHA1_K1, 0);
+    SHA1_R5(SHA1_F1, SHA1_K1, 5);
+    SHA1_R5(SHA1_F1, SHA1_K1, 10);
+    SHA1_R5(SHA1_F1, SHA1_K1, 15);
+    SHA1_R5(SHA1_F2, SHA1_K2, 20);
+    SHA1_R5(SHA1_F2, SHA1_K2, 25);
+    SHA1_R5(SHA1_F2, SHA1_K2, 30);
+    SHA1_R5(SHA1_F2, SHA1_K2, 35);
+    SHA1_R5(SHA1_F3, SHA1_K3, 40);
+    SHA1_R5(SHA1_F3, SHA1_K3, 45);
+    SHA1_R5(SHA1_F3, SHA1_K3, 50);
+    SHA1_R5(SHA1_F3, SHA1_K3, 55);
+    SHA1_R5(SHA1_F2, SHA1_K4, 60);
+    SHA1_R5(SHA1_F2, SHA1_K4, 65);
+    SHA1_R5(SHA1_F2, SHA1_K4, 70);
+    SHA1_R5(SHA1_F2, SHA1_K4, 75);
+    *state += a, *(state + 1) += b, *(state + 2) += c, *(state + 3) += d, *(state + 4) += e;
+}
+
+/**
+ * @param state 摘要状态
+ * @param block 消息块（SHA1_BLOCK_SIZE字节）
+ * @brief 按大端序读取消息块并压缩
+ */
+static void sha1_block(uint32_t *state, const uint8_t *block) {
+    uint32_t w[16];
+    for (uint8_t index = 0; index < 16; ++index, block += 4) *(w + index) = (uint32_t)*block << 24 | (uint32_t)*(block + 1) << 16 | (uint32_t)*(block + 2) << 8 | *(block + 3);
+    sha1_compress(state, w);
+}
+
+/**
+ * @param inner 内层状态，已输入密钥与ipad的异或
+ * @param outer 外层状态，已输入密钥与opad的异或
+ * @param key 密钥
+ * @param key_len 密钥长度，超过一块时使用其摘要
+ */
+static void hmac_sha1_init(sha1_t *inner, sha1_t *outer, const uint8_t *key, uint16_t key_len) {
+    uint8_t pad[SHA1_BLOCK_SIZE] = {0}, index;
+    if (key_len > SHA1_BLOCK_SIZE) {
+        sha1_init(inner);
+        sha1_update(inner, key, key_len);
+        sha1_final(inner, pad);
+    } else memcpy(pad, key, key_len);
+    for (index = 0; index < SHA1_BLOCK_SIZE; ++index) *(pad + index) ^= 0x36;
+    sha1_init(inner);
+    sha1_update(inner, pad, SHA1_BLOCK_SIZE);
+    for (index = 0; index < SHA1_BLOCK_SIZE; ++index) *(pad + index) ^= 0x36 ^ 0x5C;
+    sha1_init(outer);
+    sha1_update(outer, pad, SHA1_BLOCK_SIZE);
+}
+
+/**
+ * @param state 输出的摘要（以字表示），可与digest相同
+ * @param pad_state 已输入一个密钥块的状态
+ * @param digest 输入的摘要（以字表示）
+ * @brief 计算SHA-1(密钥块 || digest)，消息块为摘要及固定填充，只压缩一次
+ */
+static void hmac_sha1_digest(uint32_t *state, const uint32_t *pad_state, const uint32_t *digest) {
+    uint32_t w[16] = {*digest, *(digest + 1), *(digest + 2), *(digest + 3), *(digest + 4), 0x80000000, 0, 0, 0, 0, 0, 0, 0, 0, 0, HMAC_DIGEST_BITS};
+    *state = *pad_state, *(state + 1) = *(pad_state + 1), *(state + 2) = *(pad_state + 2), *(state + 3) = *(pad_state + 3), *(state + 4) = *(pad_state + 4);
+    sha1_compress(state, w);
+}
@@ -0,0 +1,43 @@
+/**
+ * SHA-1（FIPS 180-4）、HMAC-SHA1（RFC 2104）及PBKDF2-SHA1（RFC 8018），用于主机计算WPA/WPA2的PMK
+ * PBKDF2的每次迭代只需两次压缩：HMAC内外层密钥块的中间状态预先计算，20字节的U及填充直接以字填入消息块
+ */
+#ifndef _88W8801_SHA1_
+#define _88W8801_SHA1_
+#include <stdint.h>
+#include <stdbool.h>
+
+#define SHA1_DIGEST_SIZE 20
+#define SHA1_BLOCK_SIZE  64
+
+typedef struct {
+    uint32_t state[5];
+    /* 已输入的字节数 */
+    uint32_t count;
+    uint8_t buf[SHA1_BLOCK_SIZE];
+} sha1_t;
+
+/* 可分段计算的PBKDF2-SHA1，计算期间盐及派生密钥的缓冲区须保持有效 */
+typedef struct {
+    sha1_t inner;
+    sha1_t outer;
+    const uint8_t *salt;
+    uint16_t salt_len;
+    uint8_t *key;
+    uint16_t key_len;
+    uint32_t iterations;
+    /* 当前块序号及其已完成的迭代次数（0表示尚未计算U1），当前的U及各U的异或 */
+    uint32_t block;
+    uint32_t index;
+    uint32_t u[5];
+    uint32_t t[5];
+} pbkdf2_sha1_t;
+
+void sha1_init(sha1_t *ctx);
+void sha1_update(sha1_t *ctx, const uint8_t *data, uint32_t data_len);
+void sha1_final(sha1_t *ctx, uint8_t *digest);
+void hmac_sha1(const uint8_t *key, uint16_t key_len, const uint8_t *data, uint16_t data_len, uint8_t *digest);
+void pbkdf2_sha1(const uint8_t *pwd, uint16_t pwd_len, const uint8_t *salt, uint16_t salt_len, uint32_t iterations, uint8_t *key, uint16_t key_len);
+void pbkdf2_sha1_init(pbkdf2_sha1_t *ctx, const uint8_t *pwd, uint16_t pwd_len, const uint8_t *salt, uint16_t salt_len, uint32_t iterations, uint8_t *key, uint16_t key_len);
+bool pbkdf2_sha1_step(pbkdf2_sha1_t *ctx, uint32_t budget);
+#endif
@@ -1,33 +1,36 @@
-#include <stm32f4xx_ll_gpio.h>
-#include <stm32f4xx_ll_spi.h>
-#include <stm32f4xx_ll_utils.h>
-#include "88w8801_flash.h"
+#include <stddef.h>
+#include "88w8801_flash_hw.h"
 
 #define WRITE_ENABLE 0x6
 #define READ_SR1     0x5
 #define ERASE_SECTOR 0x20
 #define PAGE_PROGRAM 0x2
 #define JEDEC_ID     0x9F
-#define READ_MEMORY  0x3
+#define FAST_READ    0xB
 
 #define SR1_BUSY 0x1
 
-#define CS_RESET    LL_GPIO_ResetOutputPin(g_flashsInit.CS_GPIO_Port, g_flashsInit.CS_Pin)
-#define CS_SET      LL_GPIO_SetOutputPin(g_flashsInit.CS_GPIO_Port, g_flashsInit.CS_Pin)
+#define CS_RESET    flashHwSelect(true)
+#define CS_SET      flashHwSelect(false)
 #define PLACEHOLDER 0xFF
-#define SECTOR_SIZE 0x1000
-#define PAGE_SIZE   0x100
+#define SECTOR_SIZE FLASH_SECTOR_SIZE
+#define PAGE_SIZE   FLASH_PAGE_SIZE
 
-static flashSettings g_flashsInit;
+// Result of flashComparePage
+#define PAGE_MATCH        0
+#define PAGE_PROGRAM_ONLY 1
+#define PAGE_ERASE        2
 
-static uint8_t flashWriteData8(uint8_t u8Data) {
-    while (!LL_SPI_IsActiveFlag_TXE(g_flashsInit.SPIx));
-    LL_SPI_TransmitData8(g_flashsInit.SPIx, u8Data);
-    while (!LL_SPI_IsActiveFlag_RXNE(g_flashsInit.SPIx));
-    return LL_SPI_ReceiveData8(g_flashsInit.SPIx);
-}
+// Set while a read holds CS low, cleared by flashReadComplete
+static volatile bool g_bReading = false;
+static flashReadCallback g_frcCallback;
+static void *g_pvArg;
+
+static uint8_t flashWriteData8(uint8_t u8Data) { return flashHwTransfer8(u8Data); }
 
 static void flashWriteEnable(void) {
+    // Wait for the bus
+    flashWaitForRead();
     CS_RESET;
     // Automatically reset
     flashWriteData8(WRITE_ENABLE);
@@ -36,18 +39,17 @@ static void flashWriteEnable(void) {
 }
 
 static void flashWaitForCompletion(void) {
-    LL_mDelay(1);
     CS_RESET;
+    // SR1 is output continuously while CS stays low, poll BUSY until the chip is done
     flashWriteData8(READ_SR1);
     while (flashWriteData8(PLACEHOLDER) & SR1_BUSY);
     // Complete the instruction
     CS_SET;
-    LL_mDelay(1);
 }
 
 static void flashEraseSector(uint32_t u32Address) {
+    // Every instruction waits for completion before returning, no need to check BUSY first
     flashWriteEnable();
-    flashWaitForCompletion();
     CS_RESET;
     // Up to 4096 bytes (1 sector)
     // Reset each byte to 0xFF with aligned address
@@ -60,9 +62,8 @@ static void flashEraseSector(uint32_t u32Address) {
     flashWaitForCompletion();
 }
 
-static void flashPageProgram(uint32_t u32Address, uint8_t *pu8Data, uint8_t u8UpperBound) {
+static void flashPageProgram(uint32_t u32Address, const uint8_t *pu8Data, uint8_t u8UpperBound) {
     flashWriteEnable();
-    flashWaitForCompletion();
     CS_RESET;
     // Up to 256 bytes (1 page)
     // If an entire page is to be programmed, the last address byte should be set to 0
@@ -77,15 +78,11 @@ static void flashPageProgram(uint32_t u32Address, uint8_t *pu8Data, uint8_t u8Up
     flashWaitForCompletion();
 }
 
-void flashInit(flashSettings *flashsInit) {
-    g_flashsInit.SPIx = flashsInit->SPIx;
-    g_flashsInit.CS_GPIO_Port = flashsInit->CS_GPIO_Port;
-    g_flashsInit.CS_Pin = flashsInit->CS_Pin;
-    LL_SPI_Enable(g_flashsInit.SPIx);
-}
+void flashInit(flashSettings *flashsInit) { flashHwInit(flashsInit); }
 
 uint32_t flashGetJEDECID(void) {
     uint8_t pu8Data[4] = {0};
+    flashWaitForRead();
     CS_RESET;
     flashWriteData8(JEDEC_ID);
     *(pu8Data + 2) = flashWriteData8(PLACEHOLDER);
@@ -96,31 +93,200 @@ uint32_t flashGetJEDECID(void) {
 }
 
 void flashReadMemory(uint32_t u32Address, uint8_t *pu8Data, uint32_t u32Length) {
-    CS_RESET;
     // Up to the entire memory
-    flashWriteData8(READ_MEMORY);
+    flashWaitForRead();
+    if (flashReadMemoryAsync(u32Address, pu8Data, u32Length, NULL, NULL)) flashWaitForRead();
+}
+
+/**
+ * @param u32Address Start address
+ * @param pu8Data Destination, must stay valid until the callback
+ * @param u32Length Up to the entire memory
+ * @param frcCallback Completion callback (interrupt context), NULL to poll with flashIsReading
+ * @param pvArg Argument of frcCallback
+ * @return false if another read is in progress or DMA failed to start
+ * @brief Fast Read (0x0B); FLASH_DMA_THRESHOLD bytes or more are clocked by DMA and the call returns at once
+ */
+bool flashReadMemoryAsync(uint32_t u32Address, uint8_t *pu8Data, uint32_t u32Length, flashReadCallback frcCallback, void *pvArg) {
+    if (g_bReading) return false;
+    g_bReading = true;
+    g_frcCallback = frcCallback;
+    g_pvArg = pvArg;
+    CS_RESET;
+    flashWriteData8(FAST_READ);
     flashWriteData8((uint8_t)(u32Address >> 16));
     flashWriteData8((uint8_t)(u32Address >> 8));
     flashWriteData8((uint8_t)u32Address);
-    while (u32Length--) *pu8Data++ = flashWriteData8(PLACEHOLDER);
+    // 8 dummy clocks
+    flashWriteData8(PLACEHOLDER);
+    if (u32Length < FLASH_DMA_THRESHOLD) {
+        while (u32Length--) *pu8Data++ = flashWriteData8(PLACEHOLDER);
+        flashReadComplete(true);
+        return true;
+    }
+    if (flashHwReadStart(pu8Data, u32Length)) return true;
+    // Complete the instruction
+    CS_SET;
+    g_bReading = false;
+    return false;
+}
+
+/**
+ * @return Whether a read is in progress
+ */
+bool flashIsReading(void) { return g_bReading; }
+
+/**
+ * @brief Wait for the current read to complete
+ */
+void flashWaitForRead(void) {
+    while (g_bReading) flashHwIdle();
+}
+
+void flashReadComplete(bool bOK) {
+    flashReadCallback frcCallback = g_frcCallback;
     // Complete the instruction
     CS_SET;
+    // The callback may start the next read
+    g_bReading = false;
+    if (frcCallback) frcCallback(bOK, g_pvArg);
+}
+
+// Whether u32Length bytes from u32Address are all 0xFF
+static bool flashIsBlank(uint32_t u32Address, uint32_t u32Length) {
+    uint8_t pu8Page[PAGE_SIZE];
+    uint32_t u32Index, u32Chunk;
+    for (; u32Length; u32Address += u32Chunk, u32Length -= u32Chunk) {
+        flashReadMemory(u32Address, pu8Page, u32Chunk = u32Length < PAGE_SIZE ? u32Length : PAGE_SIZE);
+        for (u32Index = 0; u32Index < u32Chunk; ++u32Index)
+            if (*(pu8Page + u32Index) != 0xFF) return false;
+    }
+    return true;
+}
+
+// PAGE_MATCH if the page already holds pu8Data, PAGE_PROGRAM_ONLY if programming only clears bits, otherwise PAGE_ERASE
+static uint8_t flashComparePage(uint32_t u32Address, const uint8_t *pu8Data, uint32_t u32Length) {
+    uint8_t pu8Page[PAGE_SIZE], u8Result = PAGE_MATCH;
+    flashReadMemory(u32Address, pu8Page, u32Length);
+    while (u32Length--) {
+        if (*(pu8Page + u32Length) == *(pu8Data + u32Length)) continue;
+        if ((*(pu8Page + u32Length) & *(pu8Data + u32Length)) != *(pu8Data + u32Length)) return PAGE_ERASE;
+        u8Result = PAGE_PROGRAM_ONLY;
+    }
+    return u8Result;
 }
 
+/**
+ * @param u32Address Sector aligned
+ * @param u32Length Rounded up to whole sectors
+ * @return Number of sectors erased, blank sectors are skipped
+ */
 uint32_t flashEraseMemory(uint32_t u32Address, uint32_t u32Length) {
-    uint32_t u32Sector = u32Length / SECTOR_SIZE, u32SectorCount = u32Sector;
-    u32Address -= SECTOR_SIZE;
-    // Require aligned address
-    while (u32Sector--) flashEraseSector(u32Address += SECTOR_SIZE);
-    if (u32Length -= u32SectorCount * SECTOR_SIZE) flashEraseSector(u32Address += SECTOR_SIZE), ++u32SectorCount;
+    uint32_t u32SectorCount = 0;
+    for (u32Length += u32Address; u32Address < u32Length; u32Address += SECTOR_SIZE)
+        if (!flashIsBlank(u32Address, SECTOR_SIZE)) flashEraseSector(u32Address), ++u32SectorCount;
     return u32SectorCount;
 }
 
-uint32_t flashWriteMemory(uint32_t u32Address, uint8_t *pu8Data, uint32_t u32Length) {
-    uint32_t u32Page = u32Length / PAGE_SIZE, u32PageCount = u32Page;
-    u32Address -= PAGE_SIZE, pu8Data -= PAGE_SIZE;
-    // Require aligned address
-    while (u32Page--) flashPageProgram(u32Address += PAGE_SIZE, pu8Data += PAGE_SIZE, PAGE_SIZE - 1);
-    if (u32Length -= u32PageCount * PAGE_SIZE) flashPageProgram(u32Address += PAGE_SIZE, pu8Data += PAGE_SIZE, u32Length - 1), ++u32PageCount;
+/**
+ * @param u32Address Start address, the area must have been erased
+ * @param pu8Data Data
+ * @param u32Length Length
+ * @return Number of pages programmed, pages already holding the data are skipped
+ * @brief Programming is split at page boundaries, a page program would wrap around within the page
+ */
+uint32_t flashWriteMemory(uint32_t u32Address, const uint8_t *pu8Data, uint32_t u32Length) {
+    uint32_t u32PageCount = 0, u32Chunk;
+    for (; u32Length; u32Address += u32Chunk, pu8Data += u32Chunk, u32Length -= u32Chunk) {
+        if ((u32Chunk = PAGE_SIZE - (u32Address & (PAGE_SIZE - 1))) > u32Length) u32Chunk = u32Length;
+        if (flashComparePage(u32Address, pu8Data, u32Chunk) != PAGE_MATCH) flashPageProgram(u32Address, pu8Data, u32Chunk - 1), ++u32PageCount;
+    }
     return u32PageCount;
 }
+
+/**
+ * @param u32Address Sector aligned
+ * @param pu8Data Data
+ * @param u32Length Length, the rest of the last sector is erased only if the sector has to be erased
+ * @param fpiInfo Sectors erased and pages programmed/skipped, may be NULL
+ * @return Whether the CRC-32 read back matches pu8Data
+ * @brief Per sector: skip it if every page matches, program the differing pages if they only clear bits, otherwise erase it and
+ * program the pages that are not blank
+ */
+bool flashProgramMemory(uint32_t u32Address, const uint8_t *pu8Data, uint32_t u32Length, flashProgramInfo *fpiInfo) {
+    flashProgramInfo fpiLocal = {0};
+    uint32_t u32Sector, u32Page, u32Chunk, u32Offset;
+    // Pages of the current sector to be programmed
+    uint16_t u16Program;
+    uint8_t u8Result;
+    bool bErase;
+    for (u32Offset = 0; u32Offset < u32Length; u32Offset += u32Sector) {
+        u32Sector = u32Length - u32Offset < SECTOR_SIZE ? u32Length - u32Offset : SECTOR_SIZE;
+        for (u16Program = 0, bErase = false, u32Page = 0; u32Page < u32Sector; u32Page += PAGE_SIZE) {
+            u32Chunk = u32Sector - u32Page < PAGE_SIZE ? u32Sector - u32Page : PAGE_SIZE;
+            if ((u8Result = flashComparePage(u32Address + u32Offset + u32Page, pu8Data + u32Offset + u32Page, u32Chunk)) == PAGE_MATCH) continue;
+            u16Program |= 1 << u32Page / PAGE_SIZE;
+            if (u8Result == PAGE_ERASE) bErase = true;
+        }
+        if (bErase) {
+            flashEraseSector(u32Address + u32Offset), ++fpiLocal.u32SectorErased;
+            // Blank pages stay blank after erasing
+            for (u16Program = 0, u32Page = 0; u32Page < u32Sector; u32Page += PAGE_SIZE)
+                for (u32Chunk = 0; u32Chunk < PAGE_SIZE && u32Page + u32Chunk < u32Sector; ++u32Chunk)
+                    if (*(pu8Data + u32Offset + u32Page + u32Chunk) != 0xFF) {
+                        u16Program |= 1 << u32Page / PAGE_SIZE;
+                        break;
+                    }
+        }
+        for (u32Page = 0; u32Page < u32Sector; u32Page += PAGE_SIZE) {
+            if (!(u16Program & 1 << u32Page / PAGE_SIZE)) {
+                ++fpiLocal.u32PageSkipped;
+                continue;
+            }
+            u32Chunk = u32Sector - u32Page < PAGE_SIZE ? u32Sector - u32Page : PAGE_SIZE;
+            flashPageProgram(u32Address + u32Offset + u32Page, pu8Data + u32Offset + u32Page, u32Chunk - 1), ++fpiLocal.u32PageProgrammed;
+        }
+    }
+    if (fpiInfo) *fpiInfo = fpiLocal;
+    return flashReadCRC32(u32Address, u32Length) == flashCRC32(0, pu8Data, u32Length);
+}
+
+/**
+ * @param u32CRC CRC of the preceding data, 0 to start
+ * @param pu8Data Data
+ * @param u32Length Length
+ * @return CRC-32 (IEEE 802.3, same as zlib.crc32)
+ */
+uint32_t flashCRC32(uint32_t u32CRC, const uint8_t *pu8Data, uint32_t u32Length) {
+    // Nibble table of the reflected polynomial 0xEDB88320
+    static const uint32_t pu32Table[16] = {0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+                                           0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C, 0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C};
+    u32CRC = ~u32CRC;
+    while (u32Length--) {
+        u32CRC ^= *pu8Data++;
+        u32CRC = u32CRC >> 4 ^ *(pu32Table + (u32CRC & 0xF));
+        u32CRC = u32CRC >> 4 ^ *(pu32Table + (u32CRC & 0xF));
+    }
+    return ~u32CRC;
+}
+
+/**
+ * @param u32Address Start address
+ * @param u32Length Length
+ * @return CRC-32 of the flash contents, the next piece is read by DMA while the current one is computed
+ */
+uint32_t flashReadCRC32(uint32_t u32Address, uint32_t u32Length) {
+    uint8_t pu8Buffer[2][PAGE_SIZE];
+    uint32_t u32CRC = 0, u32Chunk = u32Length < PAGE_SIZE ? u32Length : PAGE_SIZE, u32Next;
+    uint8_t u8Index = 0;
+    flashReadMemory(u32Address, *pu8Buffer, u32Chunk);
+    while (u32Length) {
+        u32Address += u32Chunk, u32Length -= u32Chunk;
+        u32Next = u32Length < PAGE_SIZE ? u32Length : PAGE_SIZE;
+        if (u32Next) flashReadMemoryAsync(u32Address, *(pu8Buffer + (u8Index ^ 1)), u32Next, NULL, NULL);
+        u32CRC = flashCRC32(u32CRC, *(pu8Buffer + u8Index), u32Chunk);
+        flashWaitForRead();
+        u32Chunk = u32Next, u8Index ^= 1;
+    }
+    return u32CRC;
+}
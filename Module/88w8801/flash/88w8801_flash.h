@@ -1,6 +1,12 @@
 #ifndef _88W8801_FLASH_
 #define _88W8801_FLASH_
+#include <stdbool.h>
+#include "88w8801/88w8801.h"
+#ifdef WLAN_SIMULATION
+#include "88w8801_flash_sim.h"
+#else
 #include <stm32f4xx.h>
+#endif
 
 // JEDEC ID
 // Manufacturer ID
@@ -8,15 +14,38 @@
 // Device ID
 #define DEVICE_ID_W25Q16DV 0x4015
 
+// Erase and program granularity
+#define FLASH_SECTOR_SIZE 0x1000
+#define FLASH_PAGE_SIZE   0x100
+
 typedef struct {
     SPI_TypeDef *SPIx;
     GPIO_TypeDef *CS_GPIO_Port;
     uint32_t CS_Pin;
 } flashSettings;
 
+typedef struct {
+    uint32_t u32SectorErased;
+    uint32_t u32PageProgrammed;
+    uint32_t u32PageSkipped;
+} flashProgramInfo;
+
+/**
+ * @param bOK Whether the read succeeded
+ * @param pvArg pvArg of flashReadMemoryAsync
+ * @brief Called in interrupt context when an asynchronous read completes
+ */
+typedef void (*flashReadCallback)(bool bOK, void *pvArg);
+
 void flashInit(flashSettings *flashsInit);
 uint32_t flashGetJEDECID(void);
 void flashReadMemory(uint32_t u32Address, uint8_t *pu8Data, uint32_t u32Length);
+bool flashReadMemoryAsync(uint32_t u32Address, uint8_t *pu8Data, uint32_t u32Length, flashReadCallback frcCallback, void *pvArg);
+bool flashIsReading(void);
+void flashWaitForRead(void);
 uint32_t flashEraseMemory(uint32_t u32Address, uint32_t u32Length);
-uint32_t flashWriteMemory(uint32_t u32Address, uint8_t *pu8Data, uint32_t u32Length);
+uint32_t flashWriteMemory(uint32_t u32Address, const uint8_t *pu8Data, uint32_t u32Length);
+bool flashProgramMemory(uint32_t u32Address, const uint8_t *pu8Data, uint32_t u32Length, flashProgramInfo *fpiInfo);
+uint32_t flashCRC32(uint32_t u32CRC, const uint8_t *pu8Data, uint32_t u32Length);
+uint32_t flashReadCRC32(uint32_t u32Address, uint32_t u32Length);
 #endif
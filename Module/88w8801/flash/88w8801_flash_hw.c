@@ -0,0 +1,106 @@
+#include "88w8801/88w8801.h"
+#ifndef WLAN_SIMULATION
+#include <stm32f4xx_ll_bus.h>
+#include <stm32f4xx_ll_dma.h>
+#include <stm32f4xx_ll_gpio.h>
+#include <stm32f4xx_ll_spi.h>
+#include "88w8801_flash_hw.h"
+
+// NDTR is 16 bits wide, longer reads are split in the DMA interrupt
+#define DMA_MAX_LENGTH 0xFFFF
+// Flag bits of a stream in LISR/HISR (TCIF, HTIF, TEIF, DMEIF, FEIF)
+#define DMA_STREAM_FLAGS 0x3DUL
+#define DMA_STREAM_TEIF  0x8UL
+#define DMA_STREAM_TCIF  0x20UL
+
+// Bit offsets of streams 0-3 (4-7) in LISR/LIFCR (HISR/HIFCR)
+static const uint8_t pu8StreamShift[4] = {0, 6, 16, 22};
+// Transmitted from memory without increment while receiving
+static const uint8_t g_u8Placeholder = 0xFF;
+
+static flashSettings g_flashsInit;
+// Remaining part of a DMA read
+static uint8_t *g_pu8Data;
+static uint32_t g_u32Length;
+
+static uint32_t flashHwGetFlags(uint32_t u32Stream) { return ((u32Stream < 4 ? FLASH_DMA->LISR : FLASH_DMA->HISR) >> *(pu8StreamShift + (u32Stream & 3))) & DMA_STREAM_FLAGS; }
+
+static void flashHwClearFlags(uint32_t u32Stream) {
+    if (u32Stream < 4) FLASH_DMA->LIFCR = DMA_STREAM_FLAGS << *(pu8StreamShift + (u32Stream & 3));
+    else FLASH_DMA->HIFCR = DMA_STREAM_FLAGS << *(pu8StreamShift + (u32Stream & 3));
+}
+
+static void flashHwDmaNext(void) {
+    uint32_t u32Length = g_u32Length > DMA_MAX_LENGTH ? DMA_MAX_LENGTH : g_u32Length;
+    flashHwClearFlags(FLASH_DMA_RX_STREAM);
+    flashHwClearFlags(FLASH_DMA_TX_STREAM);
+    // RX: DR to memory
+    LL_DMA_ConfigTransfer(FLASH_DMA, FLASH_DMA_RX_STREAM, LL_DMA_DIRECTION_PERIPH_TO_MEMORY | LL_DMA_MODE_NORMAL | LL_DMA_PERIPH_NOINCREMENT | LL_DMA_MEMORY_INCREMENT | LL_DMA_PDATAALIGN_BYTE | LL_DMA_MDATAALIGN_BYTE | LL_DMA_PRIORITY_HIGH);
+    LL_DMA_SetChannelSelection(FLASH_DMA, FLASH_DMA_RX_STREAM, FLASH_DMA_CHANNEL);
+    LL_DMA_ConfigAddresses(FLASH_DMA, FLASH_DMA_RX_STREAM, LL_SPI_DMA_GetRegAddr(g_flashsInit.SPIx), (uint32_t)g_pu8Data, LL_DMA_DIRECTION_PERIPH_TO_MEMORY);
+    LL_DMA_SetDataLength(FLASH_DMA, FLASH_DMA_RX_STREAM, u32Length);
+    LL_DMA_EnableIT_TC(FLASH_DMA, FLASH_DMA_RX_STREAM);
+    LL_DMA_EnableIT_TE(FLASH_DMA, FLASH_DMA_RX_STREAM);
+    // TX: placeholder to DR, only provides the clock
+    LL_DMA_ConfigTransfer(FLASH_DMA, FLASH_DMA_TX_STREAM, LL_DMA_DIRECTION_MEMORY_TO_PERIPH | LL_DMA_MODE_NORMAL | LL_DMA_PERIPH_NOINCREMENT | LL_DMA_MEMORY_NOINCREMENT | LL_DMA_PDATAALIGN_BYTE | LL_DMA_MDATAALIGN_BYTE | LL_DMA_PRIORITY_LOW);
+    LL_DMA_SetChannelSelection(FLASH_DMA, FLASH_DMA_TX_STREAM, FLASH_DMA_CHANNEL);
+    LL_DMA_ConfigAddresses(FLASH_DMA, FLASH_DMA_TX_STREAM, (uint32_t)&g_u8Placeholder, LL_SPI_DMA_GetRegAddr(g_flashsInit.SPIx), LL_DMA_DIRECTION_MEMORY_TO_PERIPH);
+    LL_DMA_SetDataLength(FLASH_DMA, FLASH_DMA_TX_STREAM, u32Length);
+    g_pu8Data += u32Length, g_u32Length -= u32Length;
+    // RX first so that no byte is missed
+    LL_DMA_EnableStream(FLASH_DMA, FLASH_DMA_RX_STREAM);
+    LL_DMA_EnableStream(FLASH_DMA, FLASH_DMA_TX_STREAM);
+    LL_SPI_EnableDMAReq_RX(g_flashsInit.SPIx);
+    LL_SPI_EnableDMAReq_TX(g_flashsInit.SPIx);
+}
+
+void flashHwInit(flashSettings *flashsInit) {
+    g_flashsInit.SPIx = flashsInit->SPIx;
+    g_flashsInit.CS_GPIO_Port = flashsInit->CS_GPIO_Port;
+    g_flashsInit.CS_Pin = flashsInit->CS_Pin;
+    LL_SPI_Enable(g_flashsInit.SPIx);
+    LL_AHB1_GRP1_EnableClock(FLASH_DMA == DMA1 ? LL_AHB1_GRP1_PERIPH_DMA1 : LL_AHB1_GRP1_PERIPH_DMA2);
+    NVIC_SetPriority(FLASH_DMA_IRQn, NVIC_EncodePriority(NVIC_GetPriorityGrouping(), FLASH_IRQ_PRIORITY, 0));
+    NVIC_EnableIRQ(FLASH_DMA_IRQn);
+}
+
+void flashHwSelect(bool bSelect) {
+    if (bSelect) LL_GPIO_ResetOutputPin(g_flashsInit.CS_GPIO_Port, g_flashsInit.CS_Pin);
+    else LL_GPIO_SetOutputPin(g_flashsInit.CS_GPIO_Port, g_flashsInit.CS_Pin);
+}
+
+uint8_t flashHwTransfer8(uint8_t u8Data) {
+    while (!LL_SPI_IsActiveFlag_TXE(g_flashsInit.SPIx));
+    LL_SPI_TransmitData8(g_flashsInit.SPIx, u8Data);
+    while (!LL_SPI_IsActiveFlag_RXNE(g_flashsInit.SPIx));
+    return LL_SPI_ReceiveData8(g_flashsInit.SPIx);
+}
+
+bool flashHwReadStart(uint8_t *pu8Data, uint32_t u32Length) {
+    // The last polled byte has been read, RXNE is clear
+    g_pu8Data = pu8Data;
+    g_u32Length = u32Length;
+    flashHwDmaNext();
+    return true;
+}
+
+// The transfer completes in the DMA interrupt
+void flashHwIdle(void) {}
+
+void FLASH_DMA_IRQHandler(void) {
+    uint32_t u32Flags = flashHwGetFlags(FLASH_DMA_RX_STREAM);
+    if (!(u32Flags & (DMA_STREAM_TCIF | DMA_STREAM_TEIF))) return;
+    flashHwClearFlags(FLASH_DMA_RX_STREAM);
+    flashHwClearFlags(FLASH_DMA_TX_STREAM);
+    LL_SPI_DisableDMAReq_TX(g_flashsInit.SPIx);
+    LL_SPI_DisableDMAReq_RX(g_flashsInit.SPIx);
+    LL_DMA_DisableStream(FLASH_DMA, FLASH_DMA_TX_STREAM);
+    LL_DMA_DisableStream(FLASH_DMA, FLASH_DMA_RX_STREAM);
+    if (u32Flags & DMA_STREAM_TEIF) {
+        flashReadComplete(false);
+        return;
+    }
+    if (g_u32Length) flashHwDmaNext();
+    else flashReadComplete(true);
+}
+#endif
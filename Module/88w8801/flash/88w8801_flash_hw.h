@@ -0,0 +1,19 @@
+/**
+ * SPI Flash transport interface
+ * 88w8801_flash.c only implements the W25Q command set, the bytes on the bus are moved by:
+ * 88w8801_flash_hw.c - STM32 SPI, bulk reads by SPI TX/RX DMA completing in the DMA interrupt
+ * 88w8801_flash_sim.c - In-memory W25Q16 model for host simulation (WLAN_SIMULATION)
+ */
+#ifndef _88W8801_FLASH_HW_
+#define _88W8801_FLASH_HW_
+#include "88w8801_flash.h"
+
+void flashHwInit(flashSettings *flashsInit);
+void flashHwSelect(bool bSelect);
+uint8_t flashHwTransfer8(uint8_t u8Data);
+bool flashHwReadStart(uint8_t *pu8Data, uint32_t u32Length);
+void flashHwIdle(void);
+
+// Called by the transport (interrupt context) when a DMA read ends, implemented in 88w8801_flash.c
+void flashReadComplete(bool bOK);
+#endif
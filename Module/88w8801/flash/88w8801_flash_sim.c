@@ -0,0 +1,201 @@
+#include "88w8801/88w8801.h"
+#ifdef WLAN_SIMULATION
+#include <string.h>
+#include "88w8801_flash_hw.h"
+
+#define WRITE_ENABLE 0x6
+#define READ_SR1     0x5
+#define ERASE_SECTOR 0x20
+#define PAGE_PROGRAM 0x2
+#define JEDEC_ID     0x9F
+#define READ_MEMORY  0x3
+#define FAST_READ    0xB
+
+#define SR1_BUSY    0x1
+#define SR1_WEL     0x2
+// SR1 reads returning BUSY after an erase/program
+#define BUSY_POLLS 3
+// Typical sector erase and page program time (us)
+#define SECTOR_ERASE_TIME 45000
+#define PAGE_PROGRAM_TIME 700
+#define SECTOR_SIZE 0x1000
+#define PAGE_SIZE   0x100
+// W25Q16: 2MB
+#define MEMORY_SIZE 0x200000
+
+typedef struct {
+    uint8_t pu8Memory[MEMORY_SIZE];
+    bool bErased;
+    uint8_t u8SR1;
+    uint8_t u8BusyPolls;
+    // Current instruction
+    bool bSelected;
+    uint8_t u8Instruction;
+    uint32_t u32Index;
+    uint32_t u32Address;
+    // DMA read started and not yet completed
+    uint8_t *pu8Data;
+    uint32_t u32Length;
+    bool bDmaActive;
+    // Programmed bytes and erases, or only erases, left until the power is cut, 0 when no cut is pending
+    uint32_t u32PowerSteps;
+    bool bErasesOnly;
+    bool bPowerLost;
+    flashSimStats fssStats;
+} flashSim;
+
+static flashSim g_fsSim;
+
+// The chip leaves the factory erased
+static void flashSimErase(void) {
+    if (g_fsSim.bErased) return;
+    memset(g_fsSim.pu8Memory, 0xFF, MEMORY_SIZE);
+    g_fsSim.bErased = true;
+}
+
+// Index of the first data byte after instruction, address and dummy bytes
+static uint32_t flashSimDataIndex(void) { return g_fsSim.u8Instruction == FAST_READ ? 5 : 4; }
+
+// Whether a programmed byte or an erase still has power, the step that uses up u32PowerSteps is the one cut
+static bool flashSimPowerStep(bool bErase) {
+    if (g_fsSim.bPowerLost) return false;
+    if (!g_fsSim.u32PowerSteps || (g_fsSim.bErasesOnly && !bErase) || --g_fsSim.u32PowerSteps) return true;
+    g_fsSim.bPowerLost = true;
+    ++g_fsSim.fssStats.u32PowerCuts;
+    return false;
+}
+
+void flashHwInit(flashSettings *flashsInit) {
+    UNUSED(flashsInit);
+    flashSimErase();
+    g_fsSim.u8SR1 = g_fsSim.u8BusyPolls = 0;
+    g_fsSim.bSelected = g_fsSim.bDmaActive = false;
+}
+
+void flashHwSelect(bool bSelect) {
+    if (bSelect) {
+        g_fsSim.bSelected = true;
+        g_fsSim.u32Index = 0;
+        return;
+    }
+    if (!g_fsSim.bSelected) return;
+    g_fsSim.bSelected = false;
+    ++g_fsSim.fssStats.u32Instructions;
+    // Executed when CS goes high
+    switch (g_fsSim.u8Instruction) {
+    case WRITE_ENABLE:
+        if (g_fsSim.u32Index == 1) g_fsSim.u8SR1 |= SR1_WEL;
+        break;
+    case ERASE_SECTOR: {
+        if (g_fsSim.u32Index != 4 || !(g_fsSim.u8SR1 & SR1_WEL)) break;
+        const bool bPowered = !g_fsSim.bPowerLost;
+        if (flashSimPowerStep(true)) memset(g_fsSim.pu8Memory + (g_fsSim.u32Address & (MEMORY_SIZE - SECTOR_SIZE)), 0xFF, SECTOR_SIZE);
+        // Cut halfway, one half of the sector is left as it was, alternately the one with the header at the start
+        else if (bPowered) memset(g_fsSim.pu8Memory + (g_fsSim.u32Address & (MEMORY_SIZE - SECTOR_SIZE)) + (g_fsSim.fssStats.u32ErasesCut++ & 1) * SECTOR_SIZE / 2, 0xFF, SECTOR_SIZE / 2);
+        ++g_fsSim.fssStats.u32SectorErases;
+        g_fsSim.fssStats.u64BusyTime += SECTOR_ERASE_TIME;
+        g_fsSim.u8SR1 &= ~SR1_WEL;
+        g_fsSim.u8BusyPolls = BUSY_POLLS;
+        break;
+    }
+    case PAGE_PROGRAM:
+        if (g_fsSim.u32Index <= 4 || !(g_fsSim.u8SR1 & SR1_WEL)) break;
+        ++g_fsSim.fssStats.u32PagePrograms;
+        g_fsSim.fssStats.u64BusyTime += PAGE_PROGRAM_TIME;
+        g_fsSim.u8SR1 &= ~SR1_WEL;
+        g_fsSim.u8BusyPolls = BUSY_POLLS;
+        break;
+    default: break;
+    }
+}
+
+uint8_t flashHwTransfer8(uint8_t u8Data) {
+    uint8_t u8Result = 0xFF;
+    uint32_t u32Index = g_fsSim.u32Index++;
+    ++g_fsSim.fssStats.u64Bytes;
+    if (!g_fsSim.bSelected) return u8Result;
+    if (!u32Index) {
+        g_fsSim.u8Instruction = u8Data;
+        g_fsSim.u32Address = 0;
+        if (u8Data == READ_MEMORY || u8Data == FAST_READ) ++g_fsSim.fssStats.u32Reads;
+        return u8Result;
+    }
+    switch (g_fsSim.u8Instruction) {
+    case READ_SR1: u8Result = g_fsSim.u8BusyPolls ? (--g_fsSim.u8BusyPolls, g_fsSim.u8SR1 | SR1_BUSY) : g_fsSim.u8SR1; break;
+    case JEDEC_ID: u8Result = u32Index == 1 ? 0xEF : u32Index == 2 ? 0x40 : u32Index == 3 ? 0x15 : 0xFF; break;
+    case READ_MEMORY:
+    case FAST_READ:
+    case ERASE_SECTOR:
+    case PAGE_PROGRAM:
+        // 24-bit address, MSB first
+        if (u32Index < 4) {
+            g_fsSim.u32Address = (g_fsSim.u32Address << 8 | u8Data) & (MEMORY_SIZE - 1);
+            break;
+        }
+        if (g_fsSim.u8Instruction == PAGE_PROGRAM) {
+            // Only clears bits, wraps within the page
+            if (g_fsSim.u8SR1 & SR1_WEL && flashSimPowerStep(false)) *(g_fsSim.pu8Memory + ((g_fsSim.u32Address & ~(PAGE_SIZE - 1)) | ((g_fsSim.u32Address + u32Index - 4) & (PAGE_SIZE - 1)))) &= u8Data;
+        } else if (g_fsSim.u8Instruction != ERASE_SECTOR && u32Index >= flashSimDataIndex())
+            u8Result = *(g_fsSim.pu8Memory + ((g_fsSim.u32Address + u32Index - flashSimDataIndex()) & (MEMORY_SIZE - 1)));
+        break;
+    default: break;
+    }
+    return u8Result;
+}
+
+bool flashHwReadStart(uint8_t *pu8Data, uint32_t u32Length) {
+    if (!g_fsSim.bSelected || (g_fsSim.u8Instruction != READ_MEMORY && g_fsSim.u8Instruction != FAST_READ) || g_fsSim.u32Index < flashSimDataIndex() || g_fsSim.bDmaActive) return false;
+    g_fsSim.pu8Data = pu8Data;
+    g_fsSim.u32Length = u32Length;
+    g_fsSim.bDmaActive = true;
+    ++g_fsSim.fssStats.u32DmaReads;
+    return true;
+}
+
+void flashHwIdle(void) { flashSimIrq(); }
+
+/**
+ * @brief Simulated DMA interrupt, copies the data of the read in progress and completes it
+ */
+void flashSimIrq(void) {
+    if (!g_fsSim.bDmaActive) return;
+    g_fsSim.bDmaActive = false;
+    while (g_fsSim.u32Length--) *g_fsSim.pu8Data++ = flashHwTransfer8(0xFF);
+    flashReadComplete(true);
+}
+
+/**
+ * @param u32Steps Programmed bytes and erases from now on until the power is cut, the last one is interrupted; 0 restores the power
+ * @param bErasesOnly Count only erases, programmed bytes never lose the power
+ */
+void flashSimCutPower(uint32_t u32Steps, bool bErasesOnly) {
+    g_fsSim.u32PowerSteps = u32Steps;
+    g_fsSim.bErasesOnly = bErasesOnly;
+    if (u32Steps) return;
+    // Power-on state, anything not clocked in before the cut is lost
+    g_fsSim.bPowerLost = false;
+    g_fsSim.u8SR1 = g_fsSim.u8BusyPolls = 0;
+}
+
+/**
+ * @return Whether the power has been cut and not yet restored
+ */
+bool flashSimPowerLost(void) { return g_fsSim.bPowerLost; }
+
+/**
+ * @param u32Address Start address
+ * @param pu8Data Data
+ * @param u32Length Length
+ * @brief Preload memory as if programmed, e.g. with a firmware image
+ */
+void flashSimLoad(uint32_t u32Address, const uint8_t *pu8Data, uint32_t u32Length) {
+    flashSimErase();
+    if (u32Address >= MEMORY_SIZE) return;
+    if (u32Length > MEMORY_SIZE - u32Address) u32Length = MEMORY_SIZE - u32Address;
+    memcpy(g_fsSim.pu8Memory + u32Address, pu8Data, u32Length);
+}
+
+void flashSimGetStats(flashSimStats *fssStats) { *fssStats = g_fsSim.fssStats; }
+
+void flashSimResetStats(void) { memset(&g_fsSim.fssStats, 0, sizeof(flashSimStats)); }
+#endif
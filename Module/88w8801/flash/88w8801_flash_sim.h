@@ -0,0 +1,41 @@
+/**
+ * In-memory W25Q16 model for host simulation (WLAN_SIMULATION)
+ * Decodes the bytes clocked by 88w8801_flash.c (WRITE_ENABLE, READ_SR1, ERASE_SECTOR, PAGE_PROGRAM, JEDEC_ID, READ, FAST_READ),
+ * programming only clears bits and wraps within the page like the real chip, BUSY stays set for a few SR1 reads afterwards
+ * A DMA read does not complete when started but at flashHwIdle or flashSimIrq
+ * flashSimCutPower cuts the power at a given programmed byte or erase: the rest of that page program is lost, an erase only
+ * clears one half of the sector (alternately the first one), and nothing is written until the power is restored
+ */
+#ifndef _88W8801_FLASH_SIM_
+#define _88W8801_FLASH_SIM_
+#include <stdint.h>
+#include <stdbool.h>
+
+// Meaningless in simulation
+typedef void SPI_TypeDef;
+typedef void GPIO_TypeDef;
+
+typedef struct {
+    // Instructions (CS low to high)
+    uint32_t u32Instructions;
+    // Reads started, of which clocked by DMA
+    uint32_t u32Reads;
+    uint32_t u32DmaReads;
+    // Bytes clocked including instruction, address and dummy bytes
+    uint64_t u64Bytes;
+    uint32_t u32SectorErases;
+    uint32_t u32PagePrograms;
+    // Typical erase/program time (us) of W25Q16DV while BUSY is set
+    uint64_t u64BusyTime;
+    // Power cuts, of which during an erase
+    uint32_t u32PowerCuts;
+    uint32_t u32ErasesCut;
+} flashSimStats;
+
+void flashSimLoad(uint32_t u32Address, const uint8_t *pu8Data, uint32_t u32Length);
+void flashSimIrq(void);
+void flashSimCutPower(uint32_t u32Steps, bool bErasesOnly);
+bool flashSimPowerLost(void);
+void flashSimGetStats(flashSimStats *fssStats);
+void flashSimResetStats(void);
+#endif
@@ -0,0 +1,270 @@
+#include "88w8801/88w8801.h"
+#ifdef WLAN_KV_STORE
+#include <stddef.h>
+#include <string.h>
+#include "88w8801_kv.h"
+
+#ifdef WLAN_FLASH_DEBUG
+#include <stdio.h>
+#define FLASH_DEBUG printf
+#else
+#define FLASH_DEBUG(...) \
+    do { \
+    } while (0)
+#endif
+
+// 'K' 'V' 'S' 'T'
+#define KV_MAGIC 0x5453564B
+// Sector state, a sector started by garbage collection stays COPYING until the live records have been copied
+#define KV_SECTOR_COPYING 0xFFFFFFFF
+#define KV_SECTOR_ACTIVE  0xFFFF0000
+// Record state, cleared once the data has been written
+#define KV_RECORD_PENDING   0xFF
+#define KV_RECORD_COMMITTED 0x00
+// A record of length 0 deletes the key
+#define KV_RECORD_SIZE(len) (sizeof(kvRecord) + (((len) + 3) & ~3))
+// Index entry of a key without record, records never start at the beginning of a sector
+#define KV_NONE 0
+
+#if KV_SECTOR_NUM < 2 || KV_KEY_NUM <= KV_KEY_USER || KV_KEY_NUM > 0xFF
+#error "Invalid KV_SECTOR_NUM or KV_KEY_NUM"
+#endif
+#if KV_STORE_ADDRESS % FLASH_SECTOR_SIZE
+#error "KV_STORE_ADDRESS must be sector aligned"
+#endif
+// Both firmware slots are kept clear of the store
+#if (defined(WRITE_FIRMWARE_TO_FLASH) || defined(USE_FLASH_FIRMWARE)) && KV_STORE_ADDRESS < FLASH_FIRMWARE_ADDRESS + 2 * FLASH_FIRMWARE_SLOT_SIZE && KV_STORE_ADDRESS + KV_SECTOR_NUM * FLASH_SECTOR_SIZE > FLASH_FIRMWARE_ADDRESS
+#error "KV_STORE_ADDRESS overlaps the firmware slots"
+#endif
+// Garbage collection copies at most one record per key into the new sector, which must still take the record being written
+#if (KV_KEY_NUM + 1) * (8 + ((KV_VALUE_MAX + 3) & ~3)) > FLASH_SECTOR_SIZE - 16
+#error "KV_VALUE_MAX is too large"
+#endif
+
+typedef struct {
+    uint32_t u32Magic;
+    uint32_t u32Seq;
+    // ~u32Seq
+    uint32_t u32SeqCheck;
+    uint32_t u32State;
+} kvSector;
+
+typedef struct {
+    uint8_t u8Key;
+    uint8_t u8State;
+    uint16_t u16Length;
+    // CRC-32 of u8Key, u16Length and the data
+    uint32_t u32CRC;
+} kvRecord;
+
+// Address of the latest record and length of the value of each key
+static uint32_t g_pu32Index[KV_KEY_NUM];
+static uint16_t g_pu16Length[KV_KEY_NUM];
+// Newest and oldest sector, sequence number of the newest one and where the next record goes in it
+static uint8_t g_u8Head, g_u8Oldest;
+static uint32_t g_u32Seq, g_u32Offset;
+static bool g_bReady = false;
+
+static uint32_t kvSectorAddress(uint8_t u8Sector) { return KV_STORE_ADDRESS + u8Sector * FLASH_SECTOR_SIZE; }
+
+static uint32_t kvRecordCRC(const kvRecord *kvrRecord, const uint8_t *pu8Data) {
+    uint8_t pu8Key[3] = {kvrRecord->u8Key, (uint8_t)kvrRecord->u16Length, (uint8_t)(kvrRecord->u16Length >> 8)};
+    return flashCRC32(flashCRC32(0, pu8Key, sizeof(pu8Key)), pu8Data, kvrRecord->u16Length);
+}
+
+// Whether the rest of the sector from u32Address is erased
+static bool kvIsBlank(uint32_t u32Address) {
+    uint8_t pu8Data[64];
+    uint32_t u32End = (u32Address | (FLASH_SECTOR_SIZE - 1)) + 1, u32Index;
+    for (; u32Address < u32End; u32Address += sizeof(pu8Data)) {
+        flashReadMemory(u32Address, pu8Data, sizeof(pu8Data));
+        for (u32Index = 0; u32Index < sizeof(pu8Data); ++u32Index)
+            if (*(pu8Data + u32Index) != 0xFF) return false;
+    }
+    return true;
+}
+
+// Whether the header is intact and the sector is ACTIVE
+static bool kvReadSector(uint8_t u8Sector, kvSector *kvsSector) {
+    flashReadMemory(kvSectorAddress(u8Sector), (uint8_t *)kvsSector, sizeof(kvSector));
+    return kvsSector->u32Magic == KV_MAGIC && kvsSector->u32SeqCheck == ~kvsSector->u32Seq && kvsSector->u32State == KV_SECTOR_ACTIVE;
+}
+
+/**
+ * @param u8Sector Sector
+ * @return Offset after the last record, FLASH_SECTOR_SIZE if the sector cannot take any more records
+ * @brief Index the committed records in the order written, later records replace earlier ones
+ */
+static uint32_t kvScanSector(uint8_t u8Sector) {
+    uint8_t pu8Data[KV_VALUE_MAX];
+    kvRecord kvrRecord;
+    uint32_t u32Address = kvSectorAddress(u8Sector), u32Offset = sizeof(kvSector);
+    for (; u32Offset + sizeof(kvRecord) <= FLASH_SECTOR_SIZE; u32Offset += KV_RECORD_SIZE(kvrRecord.u16Length)) {
+        flashReadMemory(u32Address + u32Offset, (uint8_t *)&kvrRecord, sizeof(kvRecord));
+        // End of the log, anything written after it would be the remains of an interrupted record
+        if (kvrRecord.u8Key == 0xFF && kvrRecord.u8State == 0xFF && kvrRecord.u16Length == 0xFFFF) return kvIsBlank(u32Address + u32Offset) ? u32Offset : FLASH_SECTOR_SIZE;
+        // A torn header, the length cannot be trusted
+        if (kvrRecord.u8Key >= KV_KEY_NUM || kvrRecord.u16Length > KV_VALUE_MAX || u32Offset + KV_RECORD_SIZE(kvrRecord.u16Length) > FLASH_SECTOR_SIZE) return FLASH_SECTOR_SIZE;
+        if (kvrRecord.u8State != KV_RECORD_COMMITTED) continue;
+        flashReadMemory(u32Address + u32Offset + sizeof(kvRecord), pu8Data, kvrRecord.u16Length);
+        if (kvRecordCRC(&kvrRecord, pu8Data) != kvrRecord.u32CRC) {
+            FLASH_DEBUG("KV: CRC-32 mismatch at 0x%lX\n", u32Address + u32Offset);
+            continue;
+        }
+        *(g_pu32Index + kvrRecord.u8Key) = kvrRecord.u16Length ? u32Address + u32Offset : KV_NONE;
+        *(g_pu16Length + kvrRecord.u8Key) = kvrRecord.u16Length;
+    }
+    return FLASH_SECTOR_SIZE;
+}
+
+// Start a sector after the newest one
+static void kvStartSector(uint8_t u8Sector, uint32_t u32State) {
+    kvSector kvsSector = {KV_MAGIC, ++g_u32Seq, ~g_u32Seq, u32State};
+    flashWriteMemory(kvSectorAddress(u8Sector), (const uint8_t *)&kvsSector, sizeof(kvSector));
+    g_u8Head = u8Sector, g_u32Offset = sizeof(kvSector);
+}
+
+/**
+ * @param u8Key Key
+ * @param pu8Data Value
+ * @param u16Length Length, 0 to delete the key
+ * @return false if the sector is full or the record reads back wrong, the sector then takes no more records
+ * @brief Append a record to the newest sector: header and data first, then the state byte is cleared to commit it
+ */
+static bool kvWriteRecord(uint8_t u8Key, const uint8_t *pu8Data, uint16_t u16Length) {
+    uint8_t pu8Record[KV_RECORD_SIZE(KV_VALUE_MAX)], pu8Check[KV_RECORD_SIZE(KV_VALUE_MAX)];
+    kvRecord *kvrRecord = (kvRecord *)pu8Record;
+    const uint8_t u8State = KV_RECORD_COMMITTED;
+    const uint32_t u32Address = kvSectorAddress(g_u8Head) + g_u32Offset, u32Size = KV_RECORD_SIZE(u16Length);
+    if (g_u32Offset + u32Size > FLASH_SECTOR_SIZE) return false;
+    memset(pu8Record, 0xFF, u32Size);
+    kvrRecord->u8Key = u8Key;
+    kvrRecord->u8State = KV_RECORD_PENDING;
+    kvrRecord->u16Length = u16Length;
+    if (u16Length) memcpy(pu8Record + sizeof(kvRecord), pu8Data, u16Length);
+    kvrRecord->u32CRC = kvRecordCRC(kvrRecord, pu8Data);
+    flashWriteMemory(u32Address, pu8Record, u32Size);
+    flashReadMemory(u32Address, pu8Check, u32Size);
+    if (memcmp(pu8Record, pu8Check, u32Size)) {
+        FLASH_DEBUG("KV: Write failed at 0x%lX\n", u32Address);
+        g_u32Offset = FLASH_SECTOR_SIZE;
+        return false;
+    }
+    flashWriteMemory(u32Address + offsetof(kvRecord, u8State), &u8State, sizeof(u8State));
+    *(g_pu32Index + u8Key) = u16Length ? u32Address : KV_NONE;
+    *(g_pu16Length + u8Key) = u16Length;
+    g_u32Offset += u32Size;
+    return true;
+}
+
+/**
+ * @return Whether the records of the oldest sector could be copied
+ * @brief Move on to the next sector, which is always erased; if no erased sector is left after it,
+ * copy the live records of the oldest sector into it and erase the oldest one
+ */
+static bool kvAdvance(void) {
+    uint8_t pu8Data[KV_VALUE_MAX], u8Key;
+    const uint8_t u8Next = (g_u8Head + 1) % KV_SECTOR_NUM;
+    const uint32_t u32Oldest = kvSectorAddress(g_u8Oldest), u32State = KV_SECTOR_ACTIVE;
+    if ((u8Next + 1) % KV_SECTOR_NUM != g_u8Oldest) {
+        kvStartSector(u8Next, KV_SECTOR_ACTIVE);
+        return true;
+    }
+    // Until the sector is ACTIVE, kvInit discards it and keeps the oldest one
+    kvStartSector(u8Next, KV_SECTOR_COPYING);
+    for (u8Key = 0; u8Key < KV_KEY_NUM; ++u8Key) {
+        // Deleted keys are dropped, older records of them can only be in the oldest sector too
+        if (*(g_pu32Index + u8Key) < u32Oldest || *(g_pu32Index + u8Key) >= u32Oldest + FLASH_SECTOR_SIZE) continue;
+        flashReadMemory(*(g_pu32Index + u8Key) + sizeof(kvRecord), pu8Data, *(g_pu16Length + u8Key));
+        if (!kvWriteRecord(u8Key, pu8Data, *(g_pu16Length + u8Key))) return false;
+    }
+    flashWriteMemory(kvSectorAddress(u8Next) + offsetof(kvSector, u32State), (const uint8_t *)&u32State, sizeof(u32State));
+    flashEraseMemory(u32Oldest, FLASH_SECTOR_SIZE);
+    FLASH_DEBUG("KV: Sector %d erased\n", g_u8Oldest);
+    g_u8Oldest = (g_u8Oldest + 1) % KV_SECTOR_NUM;
+    return true;
+}
+
+// Write a record, moving on to the next sector once if the newest one cannot take it
+static bool kvAppend(uint8_t u8Key, const uint8_t *pu8Data, uint16_t u16Length) {
+    if (!g_bReady || u8Key >= KV_KEY_NUM) return false;
+    if (kvWriteRecord(u8Key, pu8Data, u16Length)) return true;
+    // The new sector is discarded at the next kvInit, nothing more can be written until then
+    if (!kvAdvance()) return g_bReady = false;
+    return kvWriteRecord(u8Key, pu8Data, u16Length);
+}
+
+/**
+ * @return Whether the store is usable, call after flashInit
+ * @brief Recover from an interrupted write, then build the index from the sectors oldest first
+ */
+bool kvInit(void) {
+    kvSector kvsSector;
+    uint32_t pu32Seq[KV_SECTOR_NUM], u32Last = 0;
+    bool pbValid[KV_SECTOR_NUM];
+    uint8_t u8Sector, u8Count = 0, u8Next;
+    memset(g_pu32Index, 0, sizeof(g_pu32Index));
+    for (u8Sector = 0; u8Sector < KV_SECTOR_NUM; ++u8Sector) {
+        if ((*(pbValid + u8Sector) = kvReadSector(u8Sector, &kvsSector))) *(pu32Seq + u8Sector) = kvsSector.u32Seq, ++u8Count;
+        // An unfinished garbage collection or an interrupted erase, blank sectors are skipped
+        else flashEraseMemory(kvSectorAddress(u8Sector), FLASH_SECTOR_SIZE);
+    }
+    g_u32Seq = 0;
+    for (u8Sector = 0; u8Sector < KV_SECTOR_NUM; ++u8Sector) {
+        if (!*(pbValid + u8Sector)) continue;
+        if (!g_u32Seq || *(pu32Seq + u8Sector) > g_u32Seq) g_u8Head = u8Sector, g_u32Seq = *(pu32Seq + u8Sector);
+        if (!u32Last || *(pu32Seq + u8Sector) < u32Last) g_u8Oldest = u8Sector, u32Last = *(pu32Seq + u8Sector);
+    }
+    if (!u8Count) {
+        // Empty store
+        kvStartSector(g_u8Oldest = 0, KV_SECTOR_ACTIVE);
+        FLASH_DEBUG("KV: Formatted\n");
+        return g_bReady = true;
+    }
+    if (u8Count == KV_SECTOR_NUM) {
+        // Garbage collection completed but the oldest sector was not erased, the newest one has all its live records
+        flashEraseMemory(kvSectorAddress(g_u8Oldest), FLASH_SECTOR_SIZE);
+        *(pbValid + g_u8Oldest) = false;
+        g_u8Oldest = (g_u8Oldest + 1) % KV_SECTOR_NUM;
+    }
+    // Sectors from the oldest to the newest follow each other
+    for (u8Next = g_u8Oldest;; u8Next = (u8Next + 1) % KV_SECTOR_NUM) {
+        g_u32Offset = kvScanSector(u8Next);
+        if (u8Next == g_u8Head) break;
+    }
+    FLASH_DEBUG("KV: Sector %d to %d, %ld bytes free\n", g_u8Oldest, g_u8Head, FLASH_SECTOR_SIZE - g_u32Offset);
+    return g_bReady = true;
+}
+
+/**
+ * @param u8Key Key
+ * @param pvData Destination, may be NULL to get the length only
+ * @param u16Size Size of pvData, a longer value is truncated
+ * @return Length of the value, KV_NOT_FOUND if the key does not exist
+ */
+uint16_t kvGet(uint8_t u8Key, void *pvData, uint16_t u16Size) {
+    if (!g_bReady || u8Key >= KV_KEY_NUM || *(g_pu32Index + u8Key) == KV_NONE) return KV_NOT_FOUND;
+    if (pvData && u16Size) flashReadMemory(*(g_pu32Index + u8Key) + sizeof(kvRecord), (uint8_t *)pvData, u16Size < *(g_pu16Length + u8Key) ? u16Size : *(g_pu16Length + u8Key));
+    return *(g_pu16Length + u8Key);
+}
+
+/**
+ * @param u8Key Key
+ * @param pvData Value
+ * @param u16Length Length, 1 to KV_VALUE_MAX
+ * @return Whether the value has been committed
+ * @brief Nothing is written if the key already holds the value
+ */
+bool kvSet(uint8_t u8Key, const void *pvData, uint16_t u16Length) {
+    uint8_t pu8Data[KV_VALUE_MAX];
+    if (!u16Length || u16Length > KV_VALUE_MAX) return false;
+    if (kvGet(u8Key, pu8Data, sizeof(pu8Data)) == u16Length && !memcmp(pu8Data, pvData, u16Length)) return true;
+    return kvAppend(u8Key, (const uint8_t *)pvData, u16Length);
+}
+
+/**
+ * @param u8Key Key
+ * @return Whether the key no longer exists
+ */
+bool kvDelete(uint8_t u8Key) { return kvGet(u8Key, NULL, 0) == KV_NOT_FOUND || kvAppend(u8Key, NULL, 0); }
+#endif
@@ -0,0 +1,33 @@
+/**
+ * Key/value store in the W25Q flash
+ * KV_SECTOR_NUM sectors from KV_STORE_ADDRESS are written as a ring log, every update appends a record to the newest sector
+ * and the RAM index keeps the address of the latest record of each key, so a lookup is one read
+ * A record is committed by clearing its state byte after the data has been written, records interrupted by a power loss are ignored
+ * One sector is always kept erased: when the newest sector is full, the next one is started, and if that leaves no erased sector
+ * the live records of the oldest one are copied into the new sector before erasing it, so every sector is erased in turn
+ */
+#ifndef _88W8801_KV_
+#define _88W8801_KV_
+#include "88w8801_flash.h"
+
+// Returned by kvGet when the key does not exist
+#define KV_NOT_FOUND 0xFFFF
+
+// Keys
+// SSID and passphrase of the AP to connect to
+#define KV_KEY_STA_SSID       0
+#define KV_KEY_STA_PASSPHRASE 1
+// BSS of the last connection (BSSID, channel)
+#define KV_KEY_STA_BSS 2
+// PMK derived from the passphrase
+#define KV_KEY_STA_PMK 3
+// Leases of the DHCP server
+#define KV_KEY_DHCPD_LEASES 4
+// Keys from here to KV_KEY_NUM - 1 are left to the application
+#define KV_KEY_USER 5
+
+bool kvInit(void);
+uint16_t kvGet(uint8_t u8Key, void *pvData, uint16_t u16Size);
+bool kvSet(uint8_t u8Key, const void *pvData, uint16_t u16Length);
+bool kvDelete(uint8_t u8Key);
+#endif
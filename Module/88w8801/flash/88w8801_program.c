@@ -1,6 +1,6 @@
 #include "88w8801/88w8801.h"
 #if defined(WRITE_FIRMWARE_TO_FLASH) || defined(USE_FLASH_FIRMWARE)
-#include "88w8801_flash.h"
+#include "88w8801_slot.h"
 
 #ifdef WLAN_FLASH_DEBUG
 #include <stdio.h>
@@ -11,9 +11,8 @@
     } while (0)
 #endif
 
-#ifdef WRITE_FIRMWARE_TO_FLASH
+#if defined(WRITE_FIRMWARE_TO_FLASH) && !defined(WLAN_FW_COMPRESSED)
 #define FIRMWARE_SIZE 0x3E630
-#define LAST_DWORD    0x188CDB1F
 #endif
 
 void flashInitFirmware(flashSettings *flashsInit) {
@@ -22,14 +21,42 @@ void flashInitFirmware(flashSettings *flashsInit) {
     if (u32Data != (MANUFACTURER_ID_WINBOND << 16 | DEVICE_ID_W25Q16DV)) return;
     FLASH_DEBUG("Manufacturer ID: 0x%X\nDevice ID: 0x%X\n", (uint16_t)(u32Data >> 16), (uint16_t)u32Data);
 #ifdef WRITE_FIRMWARE_TO_FLASH
-    u32Data = flashEraseMemory(FLASH_FIRMWARE_ADDRESS, FIRMWARE_SIZE);
-    FLASH_DEBUG("Erase %ld sectors from 0x%06X\n", u32Data, FLASH_FIRMWARE_ADDRESS);
+#ifdef WLAN_FW_COMPRESSED
+    // Defined in 88w8801_firmware_z.c
+    extern const uint8_t fw_mrvl88w8801_z[];
+    extern const uint32_t fw_mrvl88w8801_z_size;
+    const uint8_t *pu8Firmware = fw_mrvl88w8801_z;
+    const uint32_t u32Size = fw_mrvl88w8801_z_size;
+#else
     // Defined in 88w8801_firmware.c
     extern const uint8_t fw_mrvl88w8801[FIRMWARE_SIZE];
-    u32Data = flashWriteMemory(FLASH_FIRMWARE_ADDRESS, (uint8_t *)fw_mrvl88w8801, FIRMWARE_SIZE);
-    FLASH_DEBUG("Write %ld pages to flash\n", u32Data);
-    flashReadMemory(FLASH_FIRMWARE_ADDRESS + FIRMWARE_SIZE - 4, (uint8_t *)&u32Data, 4);
-    if (u32Data != LAST_DWORD) FLASH_DEBUG("Error: Expected 0x%08X instead of 0x%08lX\n", LAST_DWORD, u32Data);
+    const uint8_t *pu8Firmware = fw_mrvl88w8801;
+    const uint32_t u32Size = FIRMWARE_SIZE;
+#endif
+    flashSlotInfo fsiSlot;
+    uint32_t u32CRC = flashCRC32(0, pu8Firmware, u32Size), u32Version = 0;
+    if (flashSlotSelect(&fsiSlot)) {
+        // Nothing to do if the newest valid slot already holds this image
+        if (fsiSlot.u32Length == u32Size && fsiSlot.u32CRC == u32CRC) return;
+        u32Version = fsiSlot.u32Version;
+    }
+    fsiSlot.u32Length = u32Size;
+    fsiSlot.u32Version = u32Version + 1;
+    fsiSlot.u32CRC = u32CRC;
+#ifdef WLAN_FW_COMPRESSED
+    fsiSlot.bCompressed = true;
+#else
+    fsiSlot.bCompressed = false;
+#endif
+    // Resumes an interrupted write of the same image
+    if ((u32Data = flashSlotBegin(&fsiSlot)) == FLASH_SLOT_ERROR) {
+        FLASH_DEBUG("Error: Firmware does not fit in a slot\n");
+        return;
+    }
+    // One sector at a time so that the progress is recorded, a failed sector is retried at the next boot
+    for (uint32_t u32Chunk; u32Data < u32Size; u32Data += u32Chunk)
+        if (!flashSlotWrite(&fsiSlot, u32Data, pu8Firmware + u32Data, u32Chunk = u32Size - u32Data < FLASH_SECTOR_SIZE ? u32Size - u32Data : FLASH_SECTOR_SIZE)) return;
+    if (!flashSlotFinish(&fsiSlot)) FLASH_DEBUG("Error: CRC-32 mismatch, expected 0x%08lX\n", u32CRC);
 #endif
 }
 #endif
@@ -0,0 +1,177 @@
+#include "88w8801/88w8801.h"
+#if defined(WRITE_FIRMWARE_TO_FLASH) || defined(USE_FLASH_FIRMWARE)
+#include <stddef.h>
+#include <string.h>
+#include "88w8801_slot.h"
+
+#ifdef WLAN_FLASH_DEBUG
+#include <stdio.h>
+#define FLASH_DEBUG printf
+#else
+#define FLASH_DEBUG(...) \
+    do { \
+    } while (0)
+#endif
+
+// 'F' 'W' 'S' 'L'
+#define SLOT_MAGIC 0x4C535746
+// Bits are only cleared from one state to the next
+#define SLOT_STATE_EMPTY   0xFFFFFFFF
+#define SLOT_STATE_WRITING 0xFFFFFF00
+#define SLOT_STATE_VALID   0xFFFF0000
+#define SLOT_STATE_INVALID 0x00000000
+#define SLOT_FLAG_COMPRESSED 0x1
+// The header takes the first sector of the slot
+#define SLOT_HEADER_SIZE FLASH_SECTOR_SIZE
+#define SLOT_IMAGE_SIZE  (FLASH_FIRMWARE_SLOT_SIZE - SLOT_HEADER_SIZE)
+// One bit per image sector, cleared once the sector has been written
+#define SLOT_PROGRESS_SIZE ((SLOT_IMAGE_SIZE / FLASH_SECTOR_SIZE + 7) / 8)
+
+#if FLASH_FIRMWARE_SLOT_SIZE % FLASH_SECTOR_SIZE || FLASH_FIRMWARE_SLOT_SIZE <= SLOT_HEADER_SIZE
+#error "Invalid FLASH_FIRMWARE_SLOT_SIZE"
+#endif
+
+typedef struct {
+    uint32_t u32Magic;
+    uint32_t u32Version;
+    uint32_t u32Length;
+    uint32_t u32CRC;
+    uint32_t u32Flags;
+    // CRC-32 of the fields above
+    uint32_t u32HeaderCRC;
+    uint32_t u32State;
+    uint8_t pu8Progress[SLOT_PROGRESS_SIZE];
+} slotHeader;
+
+static uint32_t flashSlotAddress(uint8_t u8Slot) { return FLASH_FIRMWARE_ADDRESS + u8Slot * FLASH_FIRMWARE_SLOT_SIZE; }
+
+// Whether the header is intact, its state is not checked
+static bool flashSlotReadHeader(uint8_t u8Slot, slotHeader *shHeader) {
+    flashReadMemory(flashSlotAddress(u8Slot), (uint8_t *)shHeader, sizeof(slotHeader));
+    return shHeader->u32Magic == SLOT_MAGIC && shHeader->u32HeaderCRC == flashCRC32(0, (uint8_t *)shHeader, offsetof(slotHeader, u32HeaderCRC)) && shHeader->u32Length && shHeader->u32Length <= SLOT_IMAGE_SIZE;
+}
+
+static void flashSlotGetInfo(uint8_t u8Slot, slotHeader *shHeader, flashSlotInfo *fsiSlot) {
+    fsiSlot->u8Slot = u8Slot;
+    fsiSlot->u32Address = flashSlotAddress(u8Slot) + SLOT_HEADER_SIZE;
+    fsiSlot->u32Length = shHeader->u32Length;
+    fsiSlot->u32Version = shHeader->u32Version;
+    fsiSlot->u32CRC = shHeader->u32CRC;
+    fsiSlot->bCompressed = shHeader->u32Flags & SLOT_FLAG_COMPRESSED;
+}
+
+// Program a field of the header, only clearing bits
+static void flashSlotUpdate(uint8_t u8Slot, uint32_t u32Offset, const void *pvData, uint32_t u32Length) { flashWriteMemory(flashSlotAddress(u8Slot) + u32Offset, (const uint8_t *)pvData, u32Length); }
+
+/**
+ * @param fsiSlot Selected slot
+ * @return Whether a valid slot was found
+ * @brief Check the VALID slots from the highest version down, the first one whose image CRC matches is selected
+ */
+bool flashSlotSelect(flashSlotInfo *fsiSlot) {
+    slotHeader shHeader;
+    flashSlotInfo pfsiSlot[FLASH_SLOT_NUM];
+    bool pbValid[FLASH_SLOT_NUM];
+    uint8_t u8Slot, u8Best;
+    for (u8Slot = 0; u8Slot < FLASH_SLOT_NUM; ++u8Slot)
+        if ((*(pbValid + u8Slot) = flashSlotReadHeader(u8Slot, &shHeader) && shHeader.u32State == SLOT_STATE_VALID)) flashSlotGetInfo(u8Slot, &shHeader, pfsiSlot + u8Slot);
+    while (true) {
+        for (u8Best = FLASH_SLOT_NUM, u8Slot = 0; u8Slot < FLASH_SLOT_NUM; ++u8Slot)
+            if (*(pbValid + u8Slot) && (u8Best == FLASH_SLOT_NUM || (pfsiSlot + u8Slot)->u32Version > (pfsiSlot + u8Best)->u32Version)) u8Best = u8Slot;
+        if (u8Best == FLASH_SLOT_NUM) return false;
+        if (flashReadCRC32((pfsiSlot + u8Best)->u32Address, (pfsiSlot + u8Best)->u32Length) == (pfsiSlot + u8Best)->u32CRC) break;
+        FLASH_DEBUG("Error: Slot %c is corrupted\n", 'A' + u8Best);
+        *(pbValid + u8Best) = false;
+    }
+    *fsiSlot = *(pfsiSlot + u8Best);
+    FLASH_DEBUG("Slot %c: version %ld, %ld bytes%s\n", 'A' + u8Best, fsiSlot->u32Version, fsiSlot->u32Length, fsiSlot->bCompressed ? " (compressed)" : "");
+    return true;
+}
+
+/**
+ * @param fsiSlot u32Length, u32Version, u32CRC and bCompressed of the new image, u8Slot and u32Address are filled in
+ * @return Offset from which the image has to be written, FLASH_SLOT_ERROR if it does not fit
+ * @brief Choose the slot boot would not use; if it holds an unfinished write of the same image, resume it,
+ * otherwise erase it and start over
+ */
+uint32_t flashSlotBegin(flashSlotInfo *fsiSlot) {
+    slotHeader shHeader, shTarget;
+    flashSlotInfo fsiBoot;
+    uint32_t u32Offset;
+    uint8_t u8Slot, u8Target;
+    bool bResume = false;
+    if (!fsiSlot->u32Length || fsiSlot->u32Length > SLOT_IMAGE_SIZE) return FLASH_SLOT_ERROR;
+    // The slot boot would use now (image CRC checked) is kept as the fallback
+    u8Target = flashSlotSelect(&fsiBoot) ? fsiBoot.u8Slot : FLASH_SLOT_NUM;
+    // Prepare the header of the new image
+    memset(&shTarget, 0xFF, sizeof(slotHeader));
+    shTarget.u32Magic = SLOT_MAGIC;
+    shTarget.u32Version = fsiSlot->u32Version;
+    shTarget.u32Length = fsiSlot->u32Length;
+    shTarget.u32CRC = fsiSlot->u32CRC;
+    shTarget.u32Flags = fsiSlot->bCompressed ? SLOT_FLAG_COMPRESSED : 0;
+    shTarget.u32HeaderCRC = flashCRC32(0, (uint8_t *)&shTarget, offsetof(slotHeader, u32HeaderCRC));
+    shTarget.u32State = SLOT_STATE_WRITING;
+    for (u8Slot = 0; u8Slot < FLASH_SLOT_NUM; ++u8Slot) {
+        if (u8Slot == u8Target) continue;
+        // An unfinished write of the same image
+        if (flashSlotReadHeader(u8Slot, &shHeader) && shHeader.u32State == SLOT_STATE_WRITING && !memcmp(&shHeader, &shTarget, offsetof(slotHeader, u32State))) {
+            bResume = true;
+            break;
+        }
+    }
+    // Slot A unless boot uses it
+    if (!bResume) u8Slot = !u8Target;
+    fsiSlot->u8Slot = u8Slot;
+    fsiSlot->u32Address = flashSlotAddress(u8Slot) + SLOT_HEADER_SIZE;
+    if (bResume) {
+        // Continue from the first sector not yet written
+        for (u32Offset = 0; u32Offset < fsiSlot->u32Length; u32Offset += FLASH_SECTOR_SIZE)
+            if (*(shHeader.pu8Progress + u32Offset / FLASH_SECTOR_SIZE / 8) & 1 << (u32Offset / FLASH_SECTOR_SIZE % 8)) break;
+        if (u32Offset > fsiSlot->u32Length) u32Offset = fsiSlot->u32Length;
+        FLASH_DEBUG("Slot %c: resume from %ld of %ld bytes\n", 'A' + u8Slot, u32Offset, fsiSlot->u32Length);
+        return u32Offset;
+    }
+    // Only the header is erased, sectors of the image area that already hold the new image are kept by flashSlotWrite
+    flashEraseMemory(flashSlotAddress(u8Slot), SLOT_HEADER_SIZE);
+    flashSlotUpdate(u8Slot, 0, &shTarget, sizeof(slotHeader));
+    FLASH_DEBUG("Slot %c: write version %ld, %ld bytes\n", 'A' + u8Slot, fsiSlot->u32Version, fsiSlot->u32Length);
+    return 0;
+}
+
+/**
+ * @param fsiSlot Slot returned by flashSlotBegin
+ * @param u32Offset Offset in the image, sector aligned, in order from the offset returned by flashSlotBegin
+ * @param pu8Data Data
+ * @param u32Length Length, multiple of FLASH_SECTOR_SIZE except for the end of the image
+ * @return Whether the arguments are valid and the data reads back
+ * @brief Write part of the image with flashProgramMemory and record the sectors completed
+ */
+bool flashSlotWrite(flashSlotInfo *fsiSlot, uint32_t u32Offset, const uint8_t *pu8Data, uint32_t u32Length) {
+    uint8_t pu8Progress[SLOT_PROGRESS_SIZE];
+    uint32_t u32End = u32Offset + u32Length, u32Sector;
+    if (u32Offset % FLASH_SECTOR_SIZE || u32End > fsiSlot->u32Length || u32End < u32Offset) return false;
+    // Sectors already holding the data are skipped, the others are erased only if programming has to set bits
+    if (!flashProgramMemory(fsiSlot->u32Address + u32Offset, pu8Data, u32Length, NULL)) {
+        FLASH_DEBUG("Slot %c: write failed at %ld\n", 'A' + fsiSlot->u8Slot, u32Offset);
+        return false;
+    }
+    // Sectors ending in (u32Offset, u32End], the last sector ends with the image
+    flashReadMemory(flashSlotAddress(fsiSlot->u8Slot) + offsetof(slotHeader, pu8Progress), pu8Progress, SLOT_PROGRESS_SIZE);
+    for (u32Sector = u32Offset / FLASH_SECTOR_SIZE; u32Sector * FLASH_SECTOR_SIZE < u32End; ++u32Sector)
+        if ((u32Sector + 1) * FLASH_SECTOR_SIZE <= u32End || u32End == fsiSlot->u32Length) *(pu8Progress + u32Sector / 8) &= ~(1 << u32Sector % 8);
+    flashSlotUpdate(fsiSlot->u8Slot, offsetof(slotHeader, pu8Progress), pu8Progress, SLOT_PROGRESS_SIZE);
+    return true;
+}
+
+/**
+ * @param fsiSlot Slot returned by flashSlotBegin
+ * @return Whether the image CRC matches, the slot is then VALID, otherwise INVALID and rewritten from scratch next time
+ */
+bool flashSlotFinish(flashSlotInfo *fsiSlot) {
+    uint32_t u32State = flashReadCRC32(fsiSlot->u32Address, fsiSlot->u32Length) == fsiSlot->u32CRC ? SLOT_STATE_VALID : SLOT_STATE_INVALID;
+    flashSlotUpdate(fsiSlot->u8Slot, offsetof(slotHeader, u32State), &u32State, sizeof(u32State));
+    FLASH_DEBUG("Slot %c: %s\n", 'A' + fsiSlot->u8Slot, u32State == SLOT_STATE_VALID ? "valid" : "CRC-32 mismatch");
+    return u32State == SLOT_STATE_VALID;
+}
+#endif
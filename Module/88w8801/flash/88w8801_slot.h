@@ -0,0 +1,35 @@
+/**
+ * A/B firmware slots in the W25Q flash
+ * Slot A starts at FLASH_FIRMWARE_ADDRESS and slot B FLASH_FIRMWARE_SLOT_SIZE after it, each one is a header sector followed by the image
+ * The header carries length, version, CRC-32 and compression flag of the image; its state word and per-sector progress bits
+ * are only ever cleared, so they are updated without erasing:
+ * EMPTY (erased) -> WRITING (image being written, resumable) -> VALID (image verified) / INVALID (verification failed)
+ * Boot takes the VALID slot with the highest version whose image CRC matches, an update always writes the other slot,
+ * keeping the sectors of it that already hold the new image
+ */
+#ifndef _88W8801_SLOT_
+#define _88W8801_SLOT_
+#include "88w8801_flash.h"
+
+#define FLASH_SLOT_NUM 2
+// Returned by flashSlotBegin when the image does not fit
+#define FLASH_SLOT_ERROR 0xFFFFFFFF
+
+typedef struct {
+    // 0 for slot A, 1 for slot B
+    uint8_t u8Slot;
+    // Start of the image
+    uint32_t u32Address;
+    uint32_t u32Length;
+    uint32_t u32Version;
+    // CRC-32 of the image (flashCRC32)
+    uint32_t u32CRC;
+    // Deflate-compressed image produced by Utility/fw_pack.py
+    bool bCompressed;
+} flashSlotInfo;
+
+bool flashSlotSelect(flashSlotInfo *fsiSlot);
+uint32_t flashSlotBegin(flashSlotInfo *fsiSlot);
+bool flashSlotWrite(flashSlotInfo *fsiSlot, uint32_t u32Offset, const uint8_t *pu8Data, uint32_t u32Length);
+bool flashSlotFinish(flashSlotInfo *fsiSlot);
+#endif
@@ -12,6 +12,9 @@
 #include "lwip/nat.h"
 #include "88w8801/core/88w8801_core.h"
 #endif
+#ifdef WLAN_KV_STORE
+#include "88w8801/flash/88w8801_kv.h"
+#endif
 
 #ifndef LWIP_DEBUG
 #undef LWIP_DEBUGF
@@ -40,6 +43,18 @@ struct dhcpd_option_buf {
 } PACK_STRUCT_STRUCT;
 PACK_STRUCT_END
 
+#ifdef WLAN_KV_STORE
+// Lease saved in KV_KEY_DHCPD_LEASES, newest (highest IP) first
+PACK_STRUCT_BEGIN
+struct dhcpd_lease {
+  u8_t mac_addr[NETIF_MAX_HWADDR_LEN];
+  u32_t ip_addr;
+} PACK_STRUCT_STRUCT;
+PACK_STRUCT_END
+
+#define DHCPD_LEASE_NUM (KV_VALUE_MAX / sizeof(struct dhcpd_lease))
+#endif
+
 struct dhcpd {
   u8_t msg_type;
   u8_t option_count;
@@ -56,6 +71,10 @@ static err_t dhcpd_parse_request(struct pbuf *p);
 static struct pbuf *dhcpd_create_msg(struct pbuf *p);
 static err_t dhcpd_add_address(struct dhcp_msg *msg_in);
 static err_t dhcpd_options(struct dhcpd_option_buf *option_buf, struct dhcpd_address_list *addr);
+#ifdef WLAN_KV_STORE
+static void dhcpd_load_leases(void);
+static void dhcpd_save_leases(void);
+#endif
 
 static struct dhcpd *dhcpd = NULL;
 
@@ -76,6 +95,9 @@ err_t dhcpd_start(struct netif *netif, dhcpd_inform_fn access) {
   udp_bind_netif(dhcpd->pcb, netif);
   udp_bind(dhcpd->pcb, IP4_ADDR_ANY, LWIP_IANA_PORT_DHCP_SERVER);
   udp_recv(dhcpd->pcb, dhcpd_recv, NULL);
+#ifdef WLAN_KV_STORE
+  dhcpd_load_leases();
+#endif
   return ERR_OK;
 }
 
@@ -131,6 +153,9 @@ void dhcpd_erase(u8_t *mac, dhcpd_inform_fn info, struct dhcpd_address_list *add
   addr->offer = 2;
   memset(addr->hostname, 0, sizeof(addr->hostname));
   memset(addr->mac_addr, 0, sizeof(addr->mac_addr));
+#ifdef WLAN_KV_STORE
+  dhcpd_save_leases();
+#endif
 }
 
 static void dhcpd_recv(void *arg, struct udp_pcb *pcb, struct pbuf *p, const ip_addr_t *addr, u16_t port) {
@@ -298,6 +323,9 @@ static err_t dhcpd_options(struct dhcpd_option_buf *option_buf, struct dhcpd_add
       ip4_addr_copy(conf.dst_ip_addr, conf.netif_out->ip_addr);
       conf.src_netmask.addr = conf.dst_netmask.addr = PP_HTONL(LWIP_COMBINEU32(LWIP_AP_NETMASK));
       if (nat_add(&conf)) LWIP_DEBUGF(DHCPD_DEBUG | LWIP_DBG_TRACE | LWIP_DBG_LEVEL_SERIOUS, ("dhcpd_options(): failed to add NAT configuration\n"));
+#endif
+#ifdef WLAN_KV_STORE
+      dhcpd_save_leases();
 #endif
       if (dhcpd->access) dhcpd->access(*addr->hostname ? addr->hostname : DHCP_INFORM_NULL, addr->mac_addr, (u8_t *)ip4addr_ntoa((const ip4_addr_t *)&addr->ip_addr));
     } else *option_buf->data = DHCP_NAK;
@@ -360,4 +388,43 @@ static err_t dhcpd_options(struct dhcpd_option_buf *option_buf, struct dhcpd_add
   option_buf->code = DHCP_OPTION_END;
   return ERR_OK;
 }
+
+#ifdef WLAN_KV_STORE
+// Clients leased before a restart are acknowledged without a new DHCP_DISCOVER and keep their IP
+static void dhcpd_load_leases(void) {
+  struct dhcpd_lease lease[DHCPD_LEASE_NUM];
+  struct dhcpd_address_list *addr;
+  u16_t len = kvGet(KV_KEY_DHCPD_LEASES, lease, sizeof(lease));
+  if (len == KV_NOT_FOUND || len % sizeof(struct dhcpd_lease)) return;
+
+  // Oldest first, so that the newest ends up at the head of the list
+  for (len /= sizeof(struct dhcpd_lease); len--;) {
+    if (!(addr = (struct dhcpd_address_list *)mem_malloc(sizeof(struct dhcpd_address_list)))) {
+      LWIP_DEBUGF(DHCPD_DEBUG | LWIP_DBG_TRACE | LWIP_DBG_LEVEL_SERIOUS, ("dhcpd_load_leases(): could not allocate dhcpd_address_list\n"));
+      return;
+    }
+    memset(addr, 0, sizeof(struct dhcpd_address_list));
+    addr->offer = 1;
+    memcpy(addr->mac_addr, (lease + len)->mac_addr, NETIF_MAX_HWADDR_LEN);
+    addr->ip_addr.addr = (lease + len)->ip_addr;
+    addr->next = dhcpd->addr;
+    dhcpd->addr = addr;
+    LWIP_DEBUGF(DHCPD_DEBUG | LWIP_DBG_STATE, ("restored IP %s\n", ip4addr_ntoa((const ip4_addr_t *)&addr->ip_addr)));
+  }
+}
+
+// Nothing is written if the leases have not changed
+static void dhcpd_save_leases(void) {
+  struct dhcpd_lease lease[DHCPD_LEASE_NUM];
+  struct dhcpd_address_list *addr = dhcpd->addr;
+  u16_t count = 0;
+  for (; addr && count < DHCPD_LEASE_NUM; addr = addr->next) {
+    if (addr->offer & 2) continue;
+    memcpy((lease + count)->mac_addr, addr->mac_addr, NETIF_MAX_HWADDR_LEN);
+    (lease + count++)->ip_addr = addr->ip_addr.addr;
+  }
+  // kvSet refuses an empty value, the last released lease deletes the key
+  if (!(count ? kvSet(KV_KEY_DHCPD_LEASES, lease, count * sizeof(struct dhcpd_lease)) : kvDelete(KV_KEY_DHCPD_LEASES))) LWIP_DEBUGF(DHCPD_DEBUG | LWIP_DBG_TRACE | LWIP_DBG_LEVEL_WARNING, ("dhcpd_save_leases(): could not save leases\n"));
+}
+#endif
 #endif
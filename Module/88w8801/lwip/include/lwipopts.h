@@ -38,6 +38,14 @@
 // 禁用 Socket
 #define LWIP_SOCKET 0
 
+// 为 TxPD 预留链路层封装头部空间（发送零拷贝，TxPD 20 字节及 2 字节填充，使 TxPD 按 4 字节对齐）
+#if WLAN_TX_ZERO_COPY
+#define PBUF_LINK_ENCAPSULATION_HLEN 22
+#endif
+
+// 启用自定义 pbuf（接收零拷贝）
+#define LWIP_SUPPORT_CUSTOM_PBUF 1
+
 // 禁用统计收集
 #define LWIP_STATS 0
 
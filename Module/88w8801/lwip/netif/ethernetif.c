@@ -46,6 +46,7 @@
 #include "lwip/opt.h"
 #include "lwip/def.h"
 #include "lwip/mem.h"
+#include "lwip/memp.h"
 #include "lwip/pbuf.h"
 #include "lwip/stats.h"
 #include "lwip/snmp.h"
@@ -74,6 +75,32 @@
 //   /* Add whatever per-interface state that is needed here. */
 // };
 
+// Modified
+/* Hand received frames to lwIP in place, the rx buffer is released on pbuf_free */
+#define ETHERNETIF_RX_ZERO_COPY (!ETH_PAD_SIZE && RX_BUF_NUM > 2)
+
+#if ETHERNETIF_RX_ZERO_COPY
+struct rx_pbuf {
+  struct pbuf_custom p;
+  u8_t *rx_buf;
+};
+
+LWIP_MEMPOOL_DECLARE(RX_PBUF, (RX_BUF_NUM - 2) * MP_RX_AGGR_PKT_LIMIT, sizeof(struct rx_pbuf), "Zero-copy RX pbuf");
+
+static void
+rx_pbuf_free(struct pbuf *p) {
+  wlan_rx_buf_unref(((struct rx_pbuf *)p)->rx_buf);
+  LWIP_MEMPOOL_FREE(RX_PBUF, p);
+}
+#endif /* ETHERNETIF_RX_ZERO_COPY */
+
+#if PBUF_LINK_ENCAPSULATION_HLEN
+static void
+tx_pbuf_free(void *arg) {
+  pbuf_free((struct pbuf *)arg);
+}
+#endif /* PBUF_LINK_ENCAPSULATION_HLEN */
+
 /**
  * In this function, the hardware should be initialized.
  * Called from ethernetif_init().
@@ -92,6 +119,9 @@ low_level_init(struct netif *netif) {
   // Modified
   LWIP_DEBUGF(NETIF_DEBUG, ("netif MAC %02X:%02X:%02X:%02X:%02X:%02X\n", netif->hwaddr[0], netif->hwaddr[1], netif->hwaddr[2], netif->hwaddr[3], netif->hwaddr[4], netif->hwaddr[5]));
 
+  // Modified
+  LWIP_ASSERT("TxPD headroom", !PBUF_LINK_ENCAPSULATION_HLEN || PBUF_LINK_ENCAPSULATION_HLEN >= sizeof(TxPD));
+
   /* maximum transfer unit */
   netif->mtu = 1500;
 
@@ -142,10 +172,23 @@ low_level_output(struct netif *netif, struct pbuf *p) {
 #endif
 
   // Modified
-  /* Defined in 88w8801_core.c */
-  extern u8_t wlan_tx_buf[TX_BUF_SIZE];
-  pbuf_copy_partial(p, ((TxPD *)wlan_tx_buf)->payload, p->tot_len, 0);
-  wlan_send_data(NULL, p->tot_len, netif->num);
+#if PBUF_LINK_ENCAPSULATION_HLEN
+  TxPD *tx_packet;
+  /* Send a single pbuf in place while the tx queue is empty and the bus idle, the TxPD fills the reserved headroom and must be word aligned for DMA.
+     Otherwise copy it so that it is written together with the frames that follow */
+  if (p->next == NULL && wlan_send_ref_ready() && !(((mem_ptr_t)p->payload - PBUF_LINK_ENCAPSULATION_HLEN) & 3) && !pbuf_add_header(p, PBUF_LINK_ENCAPSULATION_HLEN)) {
+    tx_packet = (TxPD *)p->payload;
+    pbuf_remove_header(p, PBUF_LINK_ENCAPSULATION_HLEN);
+    /* Keep the pbuf until the transfer is done, a busy pbuf is not resent by TCP */
+    pbuf_ref(p);
+    if (wlan_send_data_ref(tx_packet, p->tot_len, PBUF_LINK_ENCAPSULATION_HLEN, netif->num, tx_pbuf_free, p)) pbuf_free(p);
+  } else
+#endif /* PBUF_LINK_ENCAPSULATION_HLEN */
+  {
+    /* Copy into the free tx buffer while the previous one may still be on the bus */
+    pbuf_copy_partial(p, ((TxPD *)wlan_get_tx_buf())->payload, p->tot_len, 0);
+    wlan_send_data(NULL, p->tot_len, netif->num);
+  }
 
   MIB2_STATS_NETIF_ADD(netif, ifoutoctets, p->tot_len);
   if (((u8_t *)p->payload)[0] & 1) {
@@ -181,6 +224,10 @@ low_level_input(struct netif *netif) {
   // struct pbuf *p, *q;
   struct pbuf *p;
   u16_t len;
+  u8_t *payload = (u8_t *)netif->state + ((RxPD *)netif->state)->rx_pkt_offset + SDIO_HDR_SIZE;
+#if ETHERNETIF_RX_ZERO_COPY
+  struct rx_pbuf *rx_pbuf;
+#endif
 
   /* Obtain the size of the packet and put it into the "len"
      variable. */
@@ -191,6 +238,19 @@ low_level_input(struct netif *netif) {
   len += ETH_PAD_SIZE; /* allow room for Ethernet padding */
 #endif
 
+  // Modified
+#if ETHERNETIF_RX_ZERO_COPY
+  /* Reference the frame in place if the rx buffer can be lent, otherwise copy it */
+  if ((rx_pbuf = (struct rx_pbuf *)LWIP_MEMPOOL_ALLOC(RX_PBUF)) != NULL && !wlan_rx_buf_ref(netif->state)) {
+    LWIP_MEMPOOL_FREE(RX_PBUF, rx_pbuf);
+    rx_pbuf = NULL;
+  }
+  if (rx_pbuf != NULL) {
+    rx_pbuf->rx_buf = netif->state;
+    rx_pbuf->p.custom_free_function = rx_pbuf_free;
+    p = pbuf_alloced_custom(PBUF_RAW, len, PBUF_REF, &rx_pbuf->p, payload, len);
+  } else
+#endif /* ETHERNETIF_RX_ZERO_COPY */
   /* We allocate a pbuf chain of pbufs from the pool. */
   p = pbuf_alloc(PBUF_RAW, len, PBUF_POOL);
 
@@ -201,7 +261,10 @@ low_level_input(struct netif *netif) {
 #endif
 
     // Modified
-    pbuf_take(p, (u8_t *)netif->state + ((RxPD *)netif->state)->rx_pkt_offset + SDIO_HDR_SIZE, len);
+#if ETHERNETIF_RX_ZERO_COPY
+    if (rx_pbuf == NULL)
+#endif
+    pbuf_take(p, payload, len);
 
     MIB2_STATS_NETIF_ADD(netif, ifinoctets, p->tot_len);
     if (((u8_t *)p->payload)[0] & 1) {
@@ -334,8 +397,19 @@ static struct netif lwip_sta, lwip_uap;
 
 void ethernetif_netif_init(u8_t *mac_addr) {
   if (!mac_addr) return;
+  /* Initialized before (wlan_init called again without reset), netif must not be added twice */
+  if (lwip_sta.input) {
+    ethernetif_link_down(BSS_TYPE_STA);
+    ethernetif_link_down(BSS_TYPE_UAP);
+    memcpy(lwip_sta.hwaddr, mac_addr, ETHARP_HWADDR_LEN);
+    memcpy(lwip_uap.hwaddr, mac_addr, ETHARP_HWADDR_LEN);
+    return;
+  }
   /* Initialize lwIP */
   lwip_init();
+#if ETHERNETIF_RX_ZERO_COPY
+  LWIP_MEMPOOL_INIT(RX_PBUF);
+#endif
 #if LWIP_NAT
   nat_init();
 #endif
@@ -1,10 +1,5 @@
 #include <string.h>
-#include <stm32f4xx_ll_gpio.h>
-#include <stm32f4xx_ll_utils.h>
-#include <stm32f4xx_ll_bus.h>
-#include <stm32f4xx_ll_dma.h>
-#include "88w8801_sdio.h"
-#include "88w8801/88w8801.h"
+#include "88w8801_sdio_hw.h"
 
 #ifdef WLAN_SDIO_DEBUG
 #include <stdio.h>
@@ -17,13 +12,15 @@
 
 static sdio_core_t sdio_core;
 
-static uint8_t sdio_check_err(void);
+static uint8_t sdio_init_card(GPIO_TypeDef *PDN_GPIO_Port, uint32_t PDN_Pin, bool reset);
 static uint8_t sdio_cmd3(uint32_t param, uint32_t *resp);
 static uint8_t sdio_cmd5(uint32_t param, uint32_t *resp, uint16_t retry_max);
 static uint8_t sdio_cmd7(uint32_t param, uint32_t *resp);
-static uint8_t sdio_cmd53_send(bool write, uint8_t func_num, uint32_t reg_addr, bool inc_addr, uint16_t block_count);
 static uint8_t sdio_get_cis(uint8_t func_num, uint32_t *cis_pointer);
 static uint8_t sdio_parse_cis(uint8_t func_num, uint32_t cis_pointer);
+static void sdio_cmd53_sync_cb(uint8_t err, void *arg);
+static uint32_t sdio_cmd53_arg(bool write, uint8_t func_num, uint32_t reg_addr, bool block_mode, bool inc_addr, uint16_t count);
+static uint16_t sdio_get_byte_len(uint16_t data_len);
 
 /**
  * @param PDN_GPIO_Port PDN所在GPIO端口
@@ -32,45 +29,41 @@ static uint8_t sdio_parse_cis(uint8_t func_num, uint32_t cis_pointer);
  * @brief 初始化SDIO
  */
 uint8_t sdio_init(GPIO_TypeDef *PDN_GPIO_Port, uint32_t PDN_Pin) {
-    /* 使用PDN引脚重置芯片 */
-    LL_GPIO_ResetOutputPin(PDN_GPIO_Port, PDN_Pin);
-    LL_mDelay(10);
-    LL_GPIO_SetOutputPin(PDN_GPIO_Port, PDN_Pin);
-    LL_mDelay(10);
+#ifdef WLAN_WARM_BOOT
+    /* 热启动先不重置芯片，初始化失败时使用PDN重置芯片后重试 */
+    if (!sdio_init_card(PDN_GPIO_Port, PDN_Pin, false)) return SDIO_ERR_OK;
+    SDIO_DEBUG("Warm init failed, reset chip\n");
+#endif
+    return sdio_init_card(PDN_GPIO_Port, PDN_Pin, true);
+}
+
+/**
+ * @return sdio_err_e中某一状态码
+ * @brief 结束未完成的传输，使用PDN重置芯片并重新初始化SDIO
+ */
+uint8_t sdio_power_cycle(void) {
+    sdio_cmd53_wait();
+    return sdio_init_card(sdio_core.pdn_port, sdio_core.pdn_pin, true);
+}
+
+/**
+ * @param PDN_GPIO_Port PDN所在GPIO端口
+ * @param PDN_Pin PDN引脚
+ * @param reset 是否使用PDN重置芯片
+ * @return sdio_err_e中某一状态码
+ * @brief 初始化卡并启用所有Func
+ */
+static uint8_t sdio_init_card(GPIO_TypeDef *PDN_GPIO_Port, uint32_t PDN_Pin, bool reset) {
     memset(&sdio_core, 0, sizeof(sdio_core_t));
+    sdio_core.pdn_port = PDN_GPIO_Port;
+    sdio_core.pdn_pin = PDN_Pin;
     (sdio_core.func + SDIO_FUNC_0)->func_status = true;
-    LL_APB2_GRP1_EnableClock(LL_APB2_GRP1_PERIPH_SDIO);
-    LL_AHB1_GRP1_EnableClock(LL_AHB1_GRP1_PERIPH_GPIOC);
-    LL_AHB1_GRP1_EnableClock(LL_AHB1_GRP1_PERIPH_GPIOD);
-    LL_GPIO_InitTypeDef gpioStruct;
-    gpioStruct.Pin = LL_GPIO_PIN_8 | LL_GPIO_PIN_9 | LL_GPIO_PIN_10 | LL_GPIO_PIN_11 | LL_GPIO_PIN_12;
-    gpioStruct.Mode = LL_GPIO_MODE_ALTERNATE;
-    gpioStruct.Speed = LL_GPIO_SPEED_FREQ_VERY_HIGH;
-    gpioStruct.OutputType = LL_GPIO_OUTPUT_PUSHPULL;
-    gpioStruct.Pull = LL_GPIO_PULL_UP;
-    gpioStruct.Alternate = LL_GPIO_AF_12;
-    LL_GPIO_Init(GPIOC, &gpioStruct);
-    gpioStruct.Pin = LL_GPIO_PIN_2;
-    gpioStruct.Mode = LL_GPIO_MODE_ALTERNATE;
-    gpioStruct.Speed = LL_GPIO_SPEED_FREQ_VERY_HIGH;
-    gpioStruct.OutputType = LL_GPIO_OUTPUT_PUSHPULL;
-    gpioStruct.Pull = LL_GPIO_PULL_UP;
-    gpioStruct.Alternate = LL_GPIO_AF_12;
-    LL_GPIO_Init(GPIOD, &gpioStruct);
-    /* 切换到1位总线，400kHz时钟 */
-    SDIO_InitTypeDef sdioStruct = {0};
-    sdioStruct.BusWide = SDIO_BUS_WIDE_1B;
-    sdioStruct.ClockDiv = SDIO_INIT_CLK_DIV;
-    SDIO_Init(SDIO, sdioStruct);
-    SDIO_PowerState_ON(SDIO);
-    __SDIO_ENABLE(SDIO);
-    /**
-     * 同时启用SDIO模式与DMA，因为写入同一寄存器至少需间隔3*SDIO_CK+2*PCLK2
-     * 另外如果在CMD53中不停启用DMA，DMA将锁住
-     */
-    SDIO->DCTRL |= SDIO_DCTRL_SDIOEN | SDIO_DCTRL_DMAEN;
-    /* 执行CMD5并设置OCR寄存器（3.2-3.4V） */
+    /* 重置芯片，切换到1位总线，400kHz时钟 */
     uint8_t err;
+    if ((err = sdio_hw_init(PDN_GPIO_Port, PDN_Pin, reset))) return err;
+    /* 芯片未重置时卡仍处于传输状态，先执行I/O复位回到初始化状态（芯片刚上电时无响应，忽略错误） */
+    if (!reset) sdio_cmd52(true, SDIO_FUNC_0, SDIO_CCCR_IO_ABORT, SDIO_IO_RESET, NULL);
+    /* 执行CMD5并设置OCR寄存器（3.2-3.4V） */
     uint32_t cmd_resp;
     if ((err = sdio_cmd5(0, &cmd_resp, SDIO_RETRY_MAX)) || (err = sdio_cmd5(0x300000, &cmd_resp, SDIO_RETRY_MAX))) return err;
     /* 解析R4，获取Func编号 */
@@ -81,9 +74,7 @@ uint8_t sdio_init(GPIO_TypeDef *PDN_GPIO_Port, uint32_t PDN_Pin) {
     if ((err = sdio_cmd7(SDIO_R6_RCA(cmd_resp) << 16, &cmd_resp))) return err;
     /* 切换到4位总线，24MHz时钟 */
     if ((err = sdio_set_bus_width(SDIO_BUS_WIDTH_4))) return err;
-    sdioStruct.BusWide = SDIO_BUS_WIDE_4B;
-    sdioStruct.ClockDiv = SDIO_TRANSFER_CLK_DIV;
-    SDIO_Init(SDIO, sdioStruct);
+    sdio_hw_set_bus_width(SDIO_BUS_WIDTH_4);
     /* 解析CIS */
     if ((err = sdio_get_cis(SDIO_FUNC_0, &cmd_resp)) || (err = sdio_parse_cis(SDIO_FUNC_0, cmd_resp))) return err;
     /* 设置分块大小 */
@@ -117,22 +108,16 @@ uint8_t sdio_cmd52(bool write, uint8_t func_num, uint32_t reg_addr, uint8_t para
      * |:------:|:------:|:------:|:------:|:------:|:------:|:---:|
      * |    1   |    3   |    1   |    1   |   17   |    1   |  8  |
      */
-    SDIO_CmdInitTypeDef sdioCmdStruct;
-    sdioCmdStruct.Argument = write << 31;
-    sdioCmdStruct.Argument |= func_num << 28;
-    sdioCmdStruct.Argument |= (write && resp) << 27;
-    sdioCmdStruct.Argument |= reg_addr << 9;
-    sdioCmdStruct.Argument |= param;
-    sdioCmdStruct.CmdIndex = SDIO_CMD52;
-    sdioCmdStruct.Response = SDIO_RESPONSE_SHORT;
-    sdioCmdStruct.WaitForInterrupt = SDIO_WAIT_NO;
-    sdioCmdStruct.CPSM = SDIO_CPSM_ENABLE;
-    SDIO_SendCommand(SDIO, &sdioCmdStruct);
-    /* 等待命令响应 */
-    while (!__SDIO_GET_FLAG(SDIO, SDIO_FLAG_CMDREND)) if (sdio_check_err()) return SDIO_ERR_CMD52_FAILED;
-    /* 清除命令响应标志 */
-    __SDIO_CLEAR_FLAG(SDIO, SDIO_FLAG_CMDREND);
-    if (resp) *resp = (uint8_t)SDIO_GetResponse(SDIO, SDIO_RESP1);
+    /* 数据线上有传输时不发送CMD52 */
+    sdio_cmd53_wait();
+    uint32_t argument = write << 31;
+    argument |= func_num << 28;
+    argument |= (write && resp) << 27;
+    argument |= reg_addr << 9;
+    argument |= param;
+    uint32_t cmd_resp;
+    if (!sdio_hw_send_cmd(SDIO_CMD52, argument, true, &cmd_resp)) return SDIO_ERR_CMD52_FAILED;
+    if (resp) *resp = (uint8_t)cmd_resp;
     return SDIO_ERR_OK;
 }
 
@@ -144,65 +129,109 @@ uint8_t sdio_cmd52(bool write, uint8_t func_num, uint32_t reg_addr, uint8_t para
  * @param data_buf 数据缓冲区
  * @param data_len 缓冲区长度
  * @return sdio_err_e中某一状态码
- * @brief 执行CMD53
+ * @brief 执行CMD53并等待传输结束
  */
 uint8_t sdio_cmd53(bool write, uint8_t func_num, uint32_t reg_addr, bool inc_addr, uint8_t *data_buf, uint32_t data_len) {
-    if (!(sdio_core.func + func_num)->cur_block_size) return SDIO_ERR_EMPTY_BLOCK_SIZE;
-    uint8_t err = SDIO_ERR_OK;
-    /* 计算分块数 */
-    data_len = (data_len + (sdio_core.func + func_num)->cur_block_size - 1) / (sdio_core.func + func_num)->cur_block_size;
-    if (write) err = sdio_cmd53_send(write, func_num, reg_addr, inc_addr, data_len);
-    /* 设置数据格式 */
-    SDIO_DataInitTypeDef sdioDataStruct = {0};
-    sdioDataStruct.DataTimeOut = SDIO_STOPTRANSFERTIMEOUT;
-    sdioDataStruct.DataLength = data_len * (sdio_core.func + func_num)->cur_block_size;
-    switch ((sdio_core.func + func_num)->cur_block_size) {
-    case 0x1: sdioDataStruct.DataBlockSize = SDIO_DATABLOCK_SIZE_1B; break;
-    case 0x2: sdioDataStruct.DataBlockSize = SDIO_DATABLOCK_SIZE_2B; break;
-    case 0x4: sdioDataStruct.DataBlockSize = SDIO_DATABLOCK_SIZE_4B; break;
-    case 0x8: sdioDataStruct.DataBlockSize = SDIO_DATABLOCK_SIZE_8B; break;
-    case 0x10: sdioDataStruct.DataBlockSize = SDIO_DATABLOCK_SIZE_16B; break;
-    case 0x20: sdioDataStruct.DataBlockSize = SDIO_DATABLOCK_SIZE_32B; break;
-    case 0x40: sdioDataStruct.DataBlockSize = SDIO_DATABLOCK_SIZE_64B; break;
-    case 0x80: sdioDataStruct.DataBlockSize = SDIO_DATABLOCK_SIZE_128B; break;
-    case 0x100: sdioDataStruct.DataBlockSize = SDIO_DATABLOCK_SIZE_256B; break;
-    case 0x200: sdioDataStruct.DataBlockSize = SDIO_DATABLOCK_SIZE_512B; break;
-    case 0x400: sdioDataStruct.DataBlockSize = SDIO_DATABLOCK_SIZE_1024B; break;
-    case 0x800: sdioDataStruct.DataBlockSize = SDIO_DATABLOCK_SIZE_2048B; break;
-    case 0x1000: sdioDataStruct.DataBlockSize = SDIO_DATABLOCK_SIZE_4096B; break;
-    case 0x2000: sdioDataStruct.DataBlockSize = SDIO_DATABLOCK_SIZE_8192B; break;
-    case 0x4000: sdioDataStruct.DataBlockSize = SDIO_DATABLOCK_SIZE_16384B; break;
+    /* 最高位表示传输未结束 */
+    volatile uint16_t result = 0x100;
+    uint8_t err;
+    if ((err = sdio_cmd53_async(write, func_num, reg_addr, inc_addr, data_buf, data_len, sdio_cmd53_sync_cb, (void *)&result))) return err;
+    while (result & 0x100) sdio_hw_idle();
+    return (uint8_t)result;
+}
+
+/**
+ * @param write 读/写操作
+ * @param func_num Func编号
+ * @param reg_addr 寄存器地址
+ * @param inc_addr 地址是否累加
+ * @param data_buf 数据缓冲区，传输结束前不可修改或释放
+ * @param data_len 缓冲区长度
+ * @param callback 传输结束回调，可为NULL
+ * @param arg 回调参数
+ * @return sdio_err_e中某一状态码
+ * @brief 将CMD53加入队列后立即返回，队列满时等待队首传输结束
+ */
+uint8_t sdio_cmd53_async(bool write, uint8_t func_num, uint32_t reg_addr, bool inc_addr, uint8_t *data_buf, uint32_t data_len, sdio_cmd53_cb callback, void *arg) {
+    sdio_func_t *func = sdio_core.func + func_num;
+    if (!data_len) return SDIO_ERR_INVALID_PARAMS;
+    if (!func->cur_block_size) return SDIO_ERR_EMPTY_BLOCK_SIZE;
+    /* 按分块拆分，不足一个分块的尾部按字节模式长度（2的幂）传输 */
+    uint32_t block_len = data_len / func->cur_block_size * func->cur_block_size;
+    uint16_t byte_len = data_len - block_len ? sdio_get_byte_len(data_len - block_len) : 0;
+    /* 字节模式无收益或不允许时，尾部补齐为一个分块 */
+    if (byte_len && (byte_len >= func->cur_block_size || func->byte_mode == SDIO_BYTE_MODE_OFF || (block_len && func->byte_mode != SDIO_BYTE_MODE_TAIL))) block_len += func->cur_block_size, byte_len = 0;
+    uint8_t transfer_num = !!block_len + !!byte_len;
+    while (sdio_core.queue_num > SDIO_QUEUE_SIZE - transfer_num) sdio_hw_idle();
+    sdio_hw_lock();
+    sdio_transfer_t *transfer = sdio_core.queue + (sdio_core.queue_head + sdio_core.queue_num) % SDIO_QUEUE_SIZE;
+    if (block_len) {
+        transfer->write = write;
+        transfer->chained = false;
+        transfer->argument = sdio_cmd53_arg(write, func_num, reg_addr, true, inc_addr, block_len / func->cur_block_size);
+        transfer->data_buf = data_buf;
+        transfer->block_size = func->cur_block_size;
+        transfer->data_len = block_len;
+        /* 拆分时仅在最后一段执行回调 */
+        transfer->callback = byte_len ? NULL : callback;
+        transfer->arg = arg;
+        transfer = sdio_core.queue + (sdio_core.queue_head + sdio_core.queue_num + 1) % SDIO_QUEUE_SIZE;
+    }
+    if (byte_len) {
+        transfer->write = write;
+        transfer->chained = block_len;
+        transfer->argument = sdio_cmd53_arg(write, func_num, reg_addr + (inc_addr ? block_len : 0), false, inc_addr, byte_len);
+        transfer->data_buf = data_buf + block_len;
+        transfer->block_size = transfer->data_len = byte_len;
+        transfer->callback = callback;
+        transfer->arg = arg;
+        ++sdio_core.stats.byte_mode_count;
+        sdio_core.stats.saved_bytes += func->cur_block_size - byte_len;
+    }
+    sdio_core.stats.cmd53_count += transfer_num;
+    bool idle = !sdio_core.queue_num;
+    sdio_core.queue_num += transfer_num;
+    sdio_hw_unlock();
+    /* 总线空闲时直接启动，否则由上一传输结束中断启动 */
+    if (idle) {
+        transfer = sdio_core.queue + sdio_core.queue_head;
+        if (!sdio_hw_transfer_start(transfer->write, transfer->argument, transfer->data_buf, transfer->block_size, transfer->data_len)) sdio_transfer_complete(false);
+    }
+    return SDIO_ERR_OK;
+}
+
+/**
+ * @return 是否有未结束的CMD53
+ */
+bool sdio_cmd53_busy(void) { return sdio_core.queue_num; }
+
+/**
+ * @brief 等待队列中所有CMD53传输结束
+ */
+void sdio_cmd53_wait(void) {
+    while (sdio_core.queue_num) sdio_hw_idle();
+}
+
+/**
+ * @param ok 传输是否成功
+ * @brief 队首传输结束，执行回调并启动下一传输
+ */
+void sdio_transfer_complete(bool ok) {
+    while (sdio_core.queue_num) {
+        sdio_transfer_t *transfer = sdio_core.queue + sdio_core.queue_head;
+        sdio_cmd53_cb callback = transfer->callback;
+        void *arg = transfer->arg;
+        uint8_t err = ok ? SDIO_ERR_OK : transfer->write + SDIO_ERR_CMD53_READ_FAILED;
+        sdio_core.queue_head = (sdio_core.queue_head + 1) % SDIO_QUEUE_SIZE;
+        --sdio_core.queue_num;
+        if (callback) callback(err, arg);
+        if (!sdio_core.queue_num) return;
+        /* 前一段失败时同一请求的后续段不再传输 */
+        transfer = sdio_core.queue + sdio_core.queue_head;
+        if (!ok && transfer->chained) continue;
+        /* 启动下一传输，启动失败则继续结束该传输 */
+        if ((ok = sdio_hw_transfer_start(transfer->write, transfer->argument, transfer->data_buf, transfer->block_size, transfer->data_len))) return;
     }
-    sdioDataStruct.TransferDir = !write << SDIO_DCTRL_DTDIR_Pos;
-    sdioDataStruct.TransferMode = SDIO_TRANSFER_MODE_BLOCK;
-    sdioDataStruct.DPSM = SDIO_DPSM_ENABLE;
-    SDIO_ConfigData(SDIO, &sdioDataStruct);
-    /* 开启DMA */
-    LL_DMA_InitTypeDef dmaStruct = {0};
-    dmaStruct.PeriphOrM2MSrcAddress = (uint32_t)&SDIO->FIFO;
-    dmaStruct.MemoryOrM2MDstAddress = (uint32_t)data_buf;
-    dmaStruct.Direction = write << DMA_SxCR_DIR_Pos;
-    dmaStruct.Mode = LL_DMA_MODE_PFCTRL;
-    dmaStruct.PeriphOrM2MSrcIncMode = LL_DMA_PERIPH_NOINCREMENT;
-    dmaStruct.MemoryOrM2MDstIncMode = LL_DMA_MEMORY_INCREMENT;
-    dmaStruct.PeriphOrM2MSrcDataSize = LL_DMA_PDATAALIGN_WORD;
-    dmaStruct.MemoryOrM2MDstDataSize = LL_DMA_MDATAALIGN_WORD;
-    dmaStruct.Channel = LL_DMA_CHANNEL_4;
-    dmaStruct.Priority = LL_DMA_PRIORITY_VERYHIGH;
-    dmaStruct.FIFOMode = LL_DMA_FIFOMODE_ENABLE;
-    dmaStruct.FIFOThreshold = LL_DMA_FIFOTHRESHOLD_FULL;
-    dmaStruct.MemBurst = LL_DMA_MBURST_INC4;
-    dmaStruct.PeriphBurst = LL_DMA_PBURST_INC4;
-    LL_DMA_Init(DMA2, LL_DMA_STREAM_3, &dmaStruct);
-    LL_DMA_EnableStream(DMA2, LL_DMA_STREAM_3);
-    if (!write) err = sdio_cmd53_send(write, func_num, reg_addr, inc_addr, data_len);
-    /* 等待数据传输 */
-    while (!(err || __SDIO_GET_FLAG(SDIO, SDIO_FLAG_DATAEND))) if (sdio_check_err()) err = write + SDIO_ERR_CMD53_READ_FAILED;
-    /* 清除数据传输标志 */
-    __SDIO_CLEAR_FLAG(SDIO, SDIO_FLAG_DATAEND | SDIO_FLAG_DBCKEND);
-    /* 关闭DMA */
-    LL_DMA_DeInit(DMA2, LL_DMA_STREAM_3);
-    return err;
 }
 
 /**
@@ -401,65 +430,35 @@ uint8_t sdio_get_block_size(uint8_t func_num, uint16_t *block_size) {
 }
 
 /**
- * @return 错误数
- * @brief 检查错误并清除对应标志
+ * @param func_num Func编号
+ * @param byte_mode CMD53字节模式策略
+ * @return sdio_err_e中某一状态码
+ * @brief 设置Func的CMD53字节模式策略，仅在卡支持时启用
  */
-static uint8_t sdio_check_err(void) {
-    uint8_t err = 0;
-    if (__SDIO_GET_FLAG(SDIO, SDIO_FLAG_CCRCFAIL)) {
-        __SDIO_CLEAR_FLAG(SDIO, SDIO_FLAG_CCRCFAIL);
-        ++err;
-        SDIO_DEBUG("Error: CMD%ld CRC failed\n", SDIO->CMD & SDIO_CMD_CMDINDEX);
-    }
-    if (__SDIO_GET_FLAG(SDIO, SDIO_FLAG_DCRCFAIL)) {
-        __SDIO_CLEAR_FLAG(SDIO, SDIO_FLAG_DCRCFAIL);
-        ++err;
-        SDIO_DEBUG("Error: Data CRC failed\n");
-    }
-    if (__SDIO_GET_FLAG(SDIO, SDIO_FLAG_CTIMEOUT)) {
-        __SDIO_CLEAR_FLAG(SDIO, SDIO_FLAG_CTIMEOUT);
-        ++err;
-        SDIO_DEBUG("Error: CMD%ld timeout\n", SDIO->CMD & SDIO_CMD_CMDINDEX);
-    }
-    if (__SDIO_GET_FLAG(SDIO, SDIO_FLAG_DTIMEOUT)) {
-        __SDIO_CLEAR_FLAG(SDIO, SDIO_FLAG_DTIMEOUT);
-        ++err;
-        SDIO_DEBUG("Error: Data timeout\n");
-    }
-    if (__SDIO_GET_FLAG(SDIO, SDIO_FLAG_TXUNDERR)) {
-        __SDIO_CLEAR_FLAG(SDIO, SDIO_FLAG_TXUNDERR);
-        ++err;
-        SDIO_DEBUG("Error: Transmit FIFO underrun\n");
-    }
-    if (__SDIO_GET_FLAG(SDIO, SDIO_FLAG_RXOVERR)) {
-        __SDIO_CLEAR_FLAG(SDIO, SDIO_FLAG_RXOVERR);
-        ++err;
-        SDIO_DEBUG("Error: Received FIFO overrun\n");
-    }
-    return err;
+uint8_t sdio_set_byte_mode(uint8_t func_num, sdio_byte_mode_e byte_mode) {
+    if (func_num >= SDIO_FUNC_NUM) return SDIO_ERR_INVALID_PARAMS;
+    (sdio_core.func + func_num)->byte_mode = byte_mode;
+    return SDIO_ERR_OK;
 }
 
+/**
+ * @param stats 统计信息
+ * @brief 获取CMD53统计信息
+ */
+void sdio_get_stats(sdio_stats_t *stats) { memcpy(stats, &sdio_core.stats, sizeof(sdio_stats_t)); }
+
+/**
+ * @brief 清除CMD53统计信息
+ */
+void sdio_reset_stats(void) { memset(&sdio_core.stats, 0, sizeof(sdio_stats_t)); }
+
 /**
  * @param param CMD3参数
  * @param resp CMD3返回值
  * @return sdio_err_e中某一状态码
  * @brief 执行CMD3
  */
-static uint8_t sdio_cmd3(uint32_t param, uint32_t *resp) {
-    SDIO_CmdInitTypeDef sdioCmdStruct;
-    sdioCmdStruct.Argument = param;
-    sdioCmdStruct.CmdIndex = SDIO_CMD3;
-    sdioCmdStruct.Response = SDIO_RESPONSE_SHORT;
-    sdioCmdStruct.WaitForInterrupt = SDIO_WAIT_NO;
-    sdioCmdStruct.CPSM = SDIO_CPSM_ENABLE;
-    SDIO_SendCommand(SDIO, &sdioCmdStruct);
-    /* 等待命令响应 */
-    while (!__SDIO_GET_FLAG(SDIO, SDIO_FLAG_CMDREND)) if (sdio_check_err()) return SDIO_ERR_CMD3_FAILED;
-    /* 清除命令响应标志 */
-    __SDIO_CLEAR_FLAG(SDIO, SDIO_FLAG_CMDREND);
-    if (resp) *resp = SDIO_GetResponse(SDIO, SDIO_RESP1);
-    return SDIO_ERR_OK;
-}
+static uint8_t sdio_cmd3(uint32_t param, uint32_t *resp) { return sdio_hw_send_cmd(SDIO_CMD3, param, true, resp) ? SDIO_ERR_OK : SDIO_ERR_CMD3_FAILED; }
 
 /**
  * @param param CMD5参数
@@ -469,21 +468,13 @@ static uint8_t sdio_cmd3(uint32_t param, uint32_t *resp) {
  * @brief 执行CMD5
  */
 static uint8_t sdio_cmd5(uint32_t param, uint32_t *resp, uint16_t retry_max) {
-    SDIO_CmdInitTypeDef sdioCmdStruct;
-    sdioCmdStruct.Argument = param;
-    sdioCmdStruct.CmdIndex = SDIO_CMD5;
-    sdioCmdStruct.Response = SDIO_RESPONSE_SHORT;
-    sdioCmdStruct.WaitForInterrupt = SDIO_WAIT_NO;
-    sdioCmdStruct.CPSM = SDIO_CPSM_ENABLE;
+    uint32_t cmd_resp;
     while (retry_max--) {
-        SDIO_SendCommand(SDIO, &sdioCmdStruct);
-        /* 等待命令响应 */
-        while (!__SDIO_GET_FLAG(SDIO, SDIO_FLAG_CMDREND)) if (sdio_check_err()) continue;
-        /* 清除命令响应标志 */
-        __SDIO_CLEAR_FLAG(SDIO, SDIO_FLAG_CMDREND);
+        /* 等待响应时忽略错误 */
+        sdio_hw_send_cmd(SDIO_CMD5, param, false, &cmd_resp);
         /* 判断是否成功 */
-        if (!SDIO_R4_C(param = SDIO_GetResponse(SDIO, SDIO_RESP1))) continue;
-        if (resp) *resp = param;
+        if (!SDIO_R4_C(cmd_resp)) continue;
+        if (resp) *resp = cmd_resp;
         return SDIO_ERR_OK;
     }
     return SDIO_ERR_CMD5_FAILED;
@@ -495,56 +486,7 @@ static uint8_t sdio_cmd5(uint32_t param, uint32_t *resp, uint16_t retry_max) {
  * @return sdio_err_e中某一状态码
  * @brief 执行CMD7
  */
-static uint8_t sdio_cmd7(uint32_t param, uint32_t *resp) {
-    SDIO_CmdInitTypeDef sdioCmdStruct;
-    sdioCmdStruct.Argument = param;
-    sdioCmdStruct.CmdIndex = SDIO_CMD7;
-    sdioCmdStruct.Response = SDIO_RESPONSE_SHORT;
-    sdioCmdStruct.WaitForInterrupt = SDIO_WAIT_NO;
-    sdioCmdStruct.CPSM = SDIO_CPSM_ENABLE;
-    SDIO_SendCommand(SDIO, &sdioCmdStruct);
-    /* 等待命令响应 */
-    while (!__SDIO_GET_FLAG(SDIO, SDIO_FLAG_CMDREND)) if (sdio_check_err()) return SDIO_ERR_CMD7_FAILED;
-    /* 清除命令响应标志 */
-    __SDIO_CLEAR_FLAG(SDIO, SDIO_FLAG_CMDREND);
-    if (resp) *resp = SDIO_GetResponse(SDIO, SDIO_RESP1);
-    return SDIO_ERR_OK;
-}
-
-/**
- * @param write 读/写操作
- * @param func_num Func编号
- * @param reg_addr 寄存器地址
- * @param inc_addr 地址是否累加
- * @param block_count 分块数
- * @return sdio_err_e中某一状态码
- * @brief 发送CMD53并等待响应
- */
-static uint8_t sdio_cmd53_send(bool write, uint8_t func_num, uint32_t reg_addr, bool inc_addr, uint16_t block_count) {
-    /**
-     * CMD53参数格式
-     * |R/W Flag|Func Num|Block Mode|OP Code|Reg Addr|Byte/Block Count|
-     * |:------:|:------:|:--------:|:-----:|:------:|:--------------:|
-     * |    1   |    3   |     1    |   1   |   17   |        9       |
-     */
-    SDIO_CmdInitTypeDef sdioCmdStruct;
-    sdioCmdStruct.Argument = write << 31;
-    sdioCmdStruct.Argument |= func_num << 28;
-    sdioCmdStruct.Argument |= 1 << 27;
-    sdioCmdStruct.Argument |= inc_addr << 26;
-    sdioCmdStruct.Argument |= reg_addr << 9;
-    sdioCmdStruct.Argument |= block_count;
-    sdioCmdStruct.CmdIndex = SDIO_CMD53;
-    sdioCmdStruct.Response = SDIO_RESPONSE_SHORT;
-    sdioCmdStruct.WaitForInterrupt = SDIO_WAIT_NO;
-    sdioCmdStruct.CPSM = SDIO_CPSM_ENABLE;
-    SDIO_SendCommand(SDIO, &sdioCmdStruct);
-    /* 等待命令响应 */
-    while (!__SDIO_GET_FLAG(SDIO, SDIO_FLAG_CMDREND)) if (sdio_check_err()) return write + SDIO_ERR_CMD53_READ_FAILED;
-    /* 清除命令响应标志 */
-    __SDIO_CLEAR_FLAG(SDIO, SDIO_FLAG_CMDREND);
-    return SDIO_ERR_OK;
-}
+static uint8_t sdio_cmd7(uint32_t param, uint32_t *resp) { return sdio_hw_send_cmd(SDIO_CMD7, param, true, resp) ? SDIO_ERR_OK : SDIO_ERR_CMD7_FAILED; }
 
 /**
  * @param func_num Func编号
@@ -622,3 +564,46 @@ static uint8_t sdio_parse_cis(uint8_t func_num, uint32_t cis_pointer) {
     }
     return SDIO_ERR_OK;
 }
+
+/**
+ * @param err sdio_err_e中某一状态码
+ * @param arg 同步等待的结果
+ * @brief 同步CMD53的结束回调
+ */
+static void sdio_cmd53_sync_cb(uint8_t err, void *arg) { *(volatile uint16_t *)arg = err; }
+
+/**
+ * @param write 读/写操作
+ * @param func_num Func编号
+ * @param reg_addr 寄存器地址
+ * @param block_mode 块/字节模式
+ * @param inc_addr 地址是否累加
+ * @param count 分块数或字节数（512记为0）
+ * @return CMD53参数
+ */
+static uint32_t sdio_cmd53_arg(bool write, uint8_t func_num, uint32_t reg_addr, bool block_mode, bool inc_addr, uint16_t count) {
+    /**
+     * CMD53参数格式
+     * |R/W Flag|Func Num|Block Mode|OP Code|Reg Addr|Byte/Block Count|
+     * |:------:|:------:|:--------:|:-----:|:------:|:--------------:|
+     * |    1   |    3   |     1    |   1   |   17   |        9       |
+     */
+    uint32_t argument = write << 31;
+    argument |= func_num << 28;
+    argument |= block_mode << 27;
+    argument |= inc_addr << 26;
+    argument |= reg_addr << 9;
+    argument |= count & 0x1FF;
+    return argument;
+}
+
+/**
+ * @param data_len 数据长度
+ * @return 字节模式传输长度
+ * @brief 主机以单个分块完成字节模式传输，分块大小需为2的幂且不小于DMA字宽
+ */
+static uint16_t sdio_get_byte_len(uint16_t data_len) {
+    uint16_t byte_len = 4;
+    while (byte_len < data_len) byte_len <<= 1;
+    return byte_len;
+}
@@ -14,7 +14,12 @@
 #ifndef _88W8801_SDIO_
 #define _88W8801_SDIO_
 #include <stdbool.h>
+#include "88w8801/88w8801.h"
+#ifdef WLAN_SIMULATION
+#include "88w8801_sdio_sim.h"
+#else
 #include <stm32f4xx.h>
+#endif
 
 typedef enum {
     SDIO_ERR_OK,
@@ -42,6 +47,10 @@ typedef enum {
     SDIO_ERR_PARSE_CIS_FAILED
 } sdio_err_e;
 
+#if SDIO_QUEUE_SIZE < 2
+#error "SDIO_QUEUE_SIZE must be at least 2"
+#endif
+
 /* 最大尝试次数 */
 #define SDIO_RETRY_MAX 100
 /* 分块大小/B */
@@ -101,6 +110,9 @@ typedef enum {
 // #define SDIO_CCCR_DRIVER_STRENGTH 0x15
 // #define SDIO_CCCR_INT_EXTENSION 0x16
 
+/* IO_ABORT寄存器RES位：I/O复位 */
+#define SDIO_IO_RESET 0x8
+
 typedef enum {
     CISTPL_NULL = 0x00,
     CISTPL_VERS_1 = 0x15,
@@ -116,24 +128,73 @@ typedef enum {
     SDIO_BUS_WIDTH_8 = 0x3
 } bus_width_e;
 
+typedef enum {
+    /* 始终使用块模式 */
+    SDIO_BYTE_MODE_OFF,
+    /* 不足一个分块的传输使用字节模式 */
+    SDIO_BYTE_MODE_SHORT,
+    /* 另外将较长传输拆分为块模式与字节模式尾部两次CMD53 */
+    SDIO_BYTE_MODE_TAIL
+} sdio_byte_mode_e;
+
 typedef struct {
     bool func_status;
     bool func_int_status;
     uint16_t cur_block_size;
     uint16_t max_block_size;
+    sdio_byte_mode_e byte_mode;
 } sdio_func_t;
 
+/**
+ * @param err sdio_err_e中某一状态码
+ * @param arg 用户参数
+ * @brief CMD53传输结束回调，在中断上下文中执行，不可再发起SDIO命令
+ */
+typedef void (*sdio_cmd53_cb)(uint8_t err, void *arg);
+
+typedef struct {
+    bool write;
+    /* 与前一项属于同一请求（块模式+字节模式尾部） */
+    bool chained;
+    uint32_t argument;
+    uint8_t *data_buf;
+    uint16_t block_size;
+    uint32_t data_len;
+    sdio_cmd53_cb callback;
+    void *arg;
+} sdio_transfer_t;
+
+typedef struct {
+    /* 总线上的CMD53次数 */
+    uint32_t cmd53_count;
+    /* 字节模式CMD53次数及相比按分块补齐节省的字节数 */
+    uint32_t byte_mode_count;
+    uint32_t saved_bytes;
+} sdio_stats_t;
+
 typedef struct {
+    /* PDN引脚，用于初始化失败后重置芯片 */
+    GPIO_TypeDef *pdn_port;
+    uint32_t pdn_pin;
     uint16_t manf_code;
     uint16_t manf_info;
     bool mgr_int_status;
     uint8_t func_total_num;
     sdio_func_t func[SDIO_FUNC_NUM];
+    /* CMD53队列，队首为正在传输的请求 */
+    sdio_transfer_t queue[SDIO_QUEUE_SIZE];
+    uint8_t queue_head;
+    volatile uint8_t queue_num;
+    sdio_stats_t stats;
 } sdio_core_t;
 
 uint8_t sdio_init(GPIO_TypeDef *PDN_GPIO_Port, uint32_t PDN_Pin);
+uint8_t sdio_power_cycle(void);
 uint8_t sdio_cmd52(bool write, uint8_t func_num, uint32_t reg_addr, uint8_t param, uint8_t *resp);
 uint8_t sdio_cmd53(bool write, uint8_t func_num, uint32_t reg_addr, bool inc_addr, uint8_t *data_buf, uint32_t data_len);
+uint8_t sdio_cmd53_async(bool write, uint8_t func_num, uint32_t reg_addr, bool inc_addr, uint8_t *data_buf, uint32_t data_len, sdio_cmd53_cb callback, void *arg);
+bool sdio_cmd53_busy(void);
+void sdio_cmd53_wait(void);
 uint8_t sdio_get_cccr_version(uint8_t *cccr_version);
 uint8_t sdio_get_sdio_version(uint8_t *sdio_version);
 uint8_t sdio_enable_func(uint8_t func_num);
@@ -149,4 +210,7 @@ uint8_t sdio_set_bus_width(bus_width_e bus_width);
 uint8_t sdio_get_bus_width(bus_width_e *bus_width);
 uint8_t sdio_set_block_size(uint8_t func_num, uint16_t block_size);
 uint8_t sdio_get_block_size(uint8_t func_num, uint16_t *block_size);
+uint8_t sdio_set_byte_mode(uint8_t func_num, sdio_byte_mode_e byte_mode);
+void sdio_get_stats(sdio_stats_t *stats);
+void sdio_reset_stats(void);
 #endif
@@ -0,0 +1,257 @@
+#include "88w8801/88w8801.h"
+#ifndef WLAN_SIMULATION
+#include <stm32f4xx_ll_gpio.h>
+#include <stm32f4xx_ll_utils.h>
+#include <stm32f4xx_ll_bus.h>
+#include <stm32f4xx_ll_dma.h>
+#include "88w8801_sdio_hw.h"
+
+#ifdef WLAN_SDIO_DEBUG
+#include <stdio.h>
+#define SDIO_DEBUG printf
+#else
+#define SDIO_DEBUG(...) \
+    do { \
+    } while (0)
+#endif
+
+/* 数据传输结束及错误中断 */
+#define SDIO_DATA_IT (SDIO_IT_DATAEND | SDIO_IT_DCRCFAIL | SDIO_IT_DTIMEOUT | SDIO_IT_TXUNDERR | SDIO_IT_RXOVERR)
+
+/* SDIO中断中置位的卡中断标志 */
+static volatile bool sdio_card_int;
+
+static uint8_t sdio_check_err(void);
+
+/**
+ * @param PDN_GPIO_Port PDN所在GPIO端口
+ * @param PDN_Pin PDN引脚
+ * @param reset 是否使用PDN引脚重置芯片
+ * @return sdio_err_e中某一状态码
+ * @brief 重置芯片并初始化SDIO外设（1位总线，400kHz时钟）
+ */
+uint8_t sdio_hw_init(GPIO_TypeDef *PDN_GPIO_Port, uint32_t PDN_Pin, bool reset) {
+    if (reset) {
+        /* 使用PDN引脚重置芯片 */
+        LL_GPIO_ResetOutputPin(PDN_GPIO_Port, PDN_Pin);
+        LL_mDelay(10);
+    }
+    LL_GPIO_SetOutputPin(PDN_GPIO_Port, PDN_Pin);
+    LL_mDelay(10);
+    LL_APB2_GRP1_EnableClock(LL_APB2_GRP1_PERIPH_SDIO);
+    LL_AHB1_GRP1_EnableClock(LL_AHB1_GRP1_PERIPH_GPIOC);
+    LL_AHB1_GRP1_EnableClock(LL_AHB1_GRP1_PERIPH_GPIOD);
+    LL_GPIO_InitTypeDef gpioStruct;
+    gpioStruct.Pin = LL_GPIO_PIN_8 | LL_GPIO_PIN_9 | LL_GPIO_PIN_10 | LL_GPIO_PIN_11 | LL_GPIO_PIN_12;
+    gpioStruct.Mode = LL_GPIO_MODE_ALTERNATE;
+    gpioStruct.Speed = LL_GPIO_SPEED_FREQ_VERY_HIGH;
+    gpioStruct.OutputType = LL_GPIO_OUTPUT_PUSHPULL;
+    gpioStruct.Pull = LL_GPIO_PULL_UP;
+    gpioStruct.Alternate = LL_GPIO_AF_12;
+    LL_GPIO_Init(GPIOC, &gpioStruct);
+    gpioStruct.Pin = LL_GPIO_PIN_2;
+    gpioStruct.Mode = LL_GPIO_MODE_ALTERNATE;
+    gpioStruct.Speed = LL_GPIO_SPEED_FREQ_VERY_HIGH;
+    gpioStruct.OutputType = LL_GPIO_OUTPUT_PUSHPULL;
+    gpioStruct.Pull = LL_GPIO_PULL_UP;
+    gpioStruct.Alternate = LL_GPIO_AF_12;
+    LL_GPIO_Init(GPIOD, &gpioStruct);
+    /* 切换到1位总线，400kHz时钟 */
+    SDIO_InitTypeDef sdioStruct = {0};
+    sdioStruct.BusWide = SDIO_BUS_WIDE_1B;
+    sdioStruct.ClockDiv = SDIO_INIT_CLK_DIV;
+    SDIO_Init(SDIO, sdioStruct);
+    SDIO_PowerState_ON(SDIO);
+    __SDIO_ENABLE(SDIO);
+    /**
+     * 同时启用SDIO模式与DMA，因为写入同一寄存器至少需间隔3*SDIO_CK+2*PCLK2
+     * 另外如果在CMD53中不停启用DMA，DMA将锁住
+     */
+    SDIO->DCTRL |= SDIO_DCTRL_SDIOEN | SDIO_DCTRL_DMAEN;
+    /* 卡中断及数据传输结束均在SDIO中断中处理 */
+    sdio_card_int = false;
+    __SDIO_ENABLE_IT(SDIO, SDIO_IT_SDIOIT);
+    NVIC_SetPriority(SDIO_IRQn, NVIC_EncodePriority(NVIC_GetPriorityGrouping(), SDIO_IRQ_PRIORITY, 0));
+    NVIC_EnableIRQ(SDIO_IRQn);
+    return SDIO_ERR_OK;
+}
+
+/**
+ * @param bus_width 数据宽度
+ * @brief 卡端切换数据宽度后，切换主机端数据宽度，时钟提高到24MHz
+ */
+void sdio_hw_set_bus_width(bus_width_e bus_width) {
+    SDIO_InitTypeDef sdioStruct = {0};
+    sdioStruct.BusWide = bus_width == SDIO_BUS_WIDTH_4 ? SDIO_BUS_WIDE_4B : bus_width == SDIO_BUS_WIDTH_8 ? SDIO_BUS_WIDE_8B : SDIO_BUS_WIDE_1B;
+    sdioStruct.ClockDiv = SDIO_TRANSFER_CLK_DIV;
+    SDIO_Init(SDIO, sdioStruct);
+}
+
+/**
+ * @param cmd_index CMD编号
+ * @param argument CMD参数
+ * @param check_err 等待响应时是否因错误退出
+ * @param resp 响应
+ * @return 是否成功
+ * @brief 发送短响应命令并等待响应
+ */
+bool sdio_hw_send_cmd(uint8_t cmd_index, uint32_t argument, bool check_err, uint32_t *resp) {
+    SDIO_CmdInitTypeDef sdioCmdStruct;
+    sdioCmdStruct.Argument = argument;
+    sdioCmdStruct.CmdIndex = cmd_index;
+    sdioCmdStruct.Response = SDIO_RESPONSE_SHORT;
+    sdioCmdStruct.WaitForInterrupt = SDIO_WAIT_NO;
+    sdioCmdStruct.CPSM = SDIO_CPSM_ENABLE;
+    SDIO_SendCommand(SDIO, &sdioCmdStruct);
+    /* 等待命令响应 */
+    while (!__SDIO_GET_FLAG(SDIO, SDIO_FLAG_CMDREND)) if (sdio_check_err() && check_err) return false;
+    /* 清除命令响应标志 */
+    __SDIO_CLEAR_FLAG(SDIO, SDIO_FLAG_CMDREND);
+    if (resp) *resp = SDIO_GetResponse(SDIO, SDIO_RESP1);
+    return true;
+}
+
+/**
+ * @param write 读/写操作
+ * @param argument CMD53参数
+ * @param data_buf 数据缓冲区
+ * @param block_size 分块大小
+ * @param data_len 传输长度
+ * @return 是否成功启动
+ * @brief 执行CMD53并启动DMA，不等待数据传输结束，结束后在SDIO中断中调用sdio_transfer_complete
+ */
+bool sdio_hw_transfer_start(bool write, uint32_t argument, uint8_t *data_buf, uint16_t block_size, uint32_t data_len) {
+    if (write && !sdio_hw_send_cmd(SDIO_CMD53, argument, true, NULL)) return false;
+    /* 设置数据格式 */
+    SDIO_DataInitTypeDef sdioDataStruct = {0};
+    sdioDataStruct.DataTimeOut = SDIO_STOPTRANSFERTIMEOUT;
+    sdioDataStruct.DataLength = data_len;
+    switch (block_size) {
+    case 0x1: sdioDataStruct.DataBlockSize = SDIO_DATABLOCK_SIZE_1B; break;
+    case 0x2: sdioDataStruct.DataBlockSize = SDIO_DATABLOCK_SIZE_2B; break;
+    case 0x4: sdioDataStruct.DataBlockSize = SDIO_DATABLOCK_SIZE_4B; break;
+    case 0x8: sdioDataStruct.DataBlockSize = SDIO_DATABLOCK_SIZE_8B; break;
+    case 0x10: sdioDataStruct.DataBlockSize = SDIO_DATABLOCK_SIZE_16B; break;
+    case 0x20: sdioDataStruct.DataBlockSize = SDIO_DATABLOCK_SIZE_32B; break;
+    case 0x40: sdioDataStruct.DataBlockSize = SDIO_DATABLOCK_SIZE_64B; break;
+    case 0x80: sdioDataStruct.DataBlockSize = SDIO_DATABLOCK_SIZE_128B; break;
+    case 0x100: sdioDataStruct.DataBlockSize = SDIO_DATABLOCK_SIZE_256B; break;
+    case 0x200: sdioDataStruct.DataBlockSize = SDIO_DATABLOCK_SIZE_512B; break;
+    case 0x400: sdioDataStruct.DataBlockSize = SDIO_DATABLOCK_SIZE_1024B; break;
+    case 0x800: sdioDataStruct.DataBlockSize = SDIO_DATABLOCK_SIZE_2048B; break;
+    case 0x1000: sdioDataStruct.DataBlockSize = SDIO_DATABLOCK_SIZE_4096B; break;
+    case 0x2000: sdioDataStruct.DataBlockSize = SDIO_DATABLOCK_SIZE_8192B; break;
+    case 0x4000: sdioDataStruct.DataBlockSize = SDIO_DATABLOCK_SIZE_16384B; break;
+    }
+    sdioDataStruct.TransferDir = !write << SDIO_DCTRL_DTDIR_Pos;
+    sdioDataStruct.TransferMode = SDIO_TRANSFER_MODE_BLOCK;
+    sdioDataStruct.DPSM = SDIO_DPSM_ENABLE;
+    SDIO_ConfigData(SDIO, &sdioDataStruct);
+    /* 开启DMA */
+    LL_DMA_InitTypeDef dmaStruct = {0};
+    dmaStruct.PeriphOrM2MSrcAddress = (uint32_t)&SDIO->FIFO;
+    dmaStruct.MemoryOrM2MDstAddress = (uint32_t)data_buf;
+    dmaStruct.Direction = write << DMA_SxCR_DIR_Pos;
+    dmaStruct.Mode = LL_DMA_MODE_PFCTRL;
+    dmaStruct.PeriphOrM2MSrcIncMode = LL_DMA_PERIPH_NOINCREMENT;
+    dmaStruct.MemoryOrM2MDstIncMode = LL_DMA_MEMORY_INCREMENT;
+    dmaStruct.PeriphOrM2MSrcDataSize = LL_DMA_PDATAALIGN_WORD;
+    dmaStruct.MemoryOrM2MDstDataSize = LL_DMA_MDATAALIGN_WORD;
+    dmaStruct.Channel = LL_DMA_CHANNEL_4;
+    dmaStruct.Priority = LL_DMA_PRIORITY_VERYHIGH;
+    dmaStruct.FIFOMode = LL_DMA_FIFOMODE_ENABLE;
+    dmaStruct.FIFOThreshold = LL_DMA_FIFOTHRESHOLD_FULL;
+    dmaStruct.MemBurst = LL_DMA_MBURST_INC4;
+    dmaStruct.PeriphBurst = LL_DMA_PBURST_INC4;
+    LL_DMA_Init(DMA2, LL_DMA_STREAM_3, &dmaStruct);
+    LL_DMA_EnableStream(DMA2, LL_DMA_STREAM_3);
+    if (!write && !sdio_hw_send_cmd(SDIO_CMD53, argument, true, NULL)) {
+        /* 命令失败，停止数据通道 */
+        SDIO->DCTRL &= ~SDIO_DCTRL_DTEN;
+        LL_DMA_DeInit(DMA2, LL_DMA_STREAM_3);
+        return false;
+    }
+    /* 开启数据传输中断 */
+    __SDIO_ENABLE_IT(SDIO, SDIO_DATA_IT);
+    return true;
+}
+
+/**
+ * @brief 屏蔽SDIO中断，用于保护CMD53队列
+ */
+void sdio_hw_lock(void) { NVIC_DisableIRQ(SDIO_IRQn); }
+
+/**
+ * @brief 恢复SDIO中断
+ */
+void sdio_hw_unlock(void) { NVIC_EnableIRQ(SDIO_IRQn); }
+
+/**
+ * @brief 等待传输结束时循环调用，传输在中断中完成，此处无需处理
+ */
+void sdio_hw_idle(void) {}
+
+/**
+ * @return 是否产生卡中断
+ * @brief 读取并清除SDIO中断中记录的卡中断标志
+ */
+bool sdio_hw_get_card_int(void) { return sdio_card_int ? (sdio_card_int = false, true) : false; }
+
+/**
+ * @brief SDIO中断，记录卡中断，数据传输结束或出错时关闭DMA并通知协议层
+ */
+void SDIO_IRQHandler(void) {
+    if (__SDIO_GET_FLAG(SDIO, SDIO_FLAG_SDIOIT)) {
+        __SDIO_CLEAR_FLAG(SDIO, SDIO_FLAG_SDIOIT);
+        sdio_card_int = true;
+    }
+    if (!(SDIO->MASK & SDIO_DATA_IT) || !(SDIO->STA & SDIO_DATA_IT)) return;
+    /* 关闭数据传输中断 */
+    __SDIO_DISABLE_IT(SDIO, SDIO_DATA_IT);
+    bool ok = !sdio_check_err() && __SDIO_GET_FLAG(SDIO, SDIO_FLAG_DATAEND);
+    /* 清除数据传输标志 */
+    __SDIO_CLEAR_FLAG(SDIO, SDIO_FLAG_DATAEND | SDIO_FLAG_DBCKEND);
+    /* 关闭DMA */
+    LL_DMA_DeInit(DMA2, LL_DMA_STREAM_3);
+    sdio_transfer_complete(ok);
+}
+
+/**
+ * @return 错误数
+ * @brief 检查错误并清除对应标志
+ */
+static uint8_t sdio_check_err(void) {
+    uint8_t err = 0;
+    if (__SDIO_GET_FLAG(SDIO, SDIO_FLAG_CCRCFAIL)) {
+        __SDIO_CLEAR_FLAG(SDIO, SDIO_FLAG_CCRCFAIL);
+        ++err;
+        SDIO_DEBUG("Error: CMD%ld CRC failed\n", SDIO->CMD & SDIO_CMD_CMDINDEX);
+    }
+    if (__SDIO_GET_FLAG(SDIO, SDIO_FLAG_DCRCFAIL)) {
+        __SDIO_CLEAR_FLAG(SDIO, SDIO_FLAG_DCRCFAIL);
+        ++err;
+        SDIO_DEBUG("Error: Data CRC failed\n");
+    }
+    if (__SDIO_GET_FLAG(SDIO, SDIO_FLAG_CTIMEOUT)) {
+        __SDIO_CLEAR_FLAG(SDIO, SDIO_FLAG_CTIMEOUT);
+        ++err;
+        SDIO_DEBUG("Error: CMD%ld timeout\n", SDIO->CMD & SDIO_CMD_CMDINDEX);
+    }
+    if (__SDIO_GET_FLAG(SDIO, SDIO_FLAG_DTIMEOUT)) {
+        __SDIO_CLEAR_FLAG(SDIO, SDIO_FLAG_DTIMEOUT);
+        ++err;
+        SDIO_DEBUG("Error: Data timeout\n");
+    }
+    if (__SDIO_GET_FLAG(SDIO, SDIO_FLAG_TXUNDERR)) {
+        __SDIO_CLEAR_FLAG(SDIO, SDIO_FLAG_TXUNDERR);
+        ++err;
+        SDIO_DEBUG("Error: Transmit FIFO underrun\n");
+    }
+    if (__SDIO_GET_FLAG(SDIO, SDIO_FLAG_RXOVERR)) {
+        __SDIO_CLEAR_FLAG(SDIO, SDIO_FLAG_RXOVERR);
+        ++err;
+        SDIO_DEBUG("Error: Received FIFO overrun\n");
+    }
+    return err;
+}
+#endif
@@ -0,0 +1,23 @@
+/**
+ * SDIO传输层接口
+ * 88w8801_sdio.c只负责SDIO协议（参数组合、CCCR/FBR/CIS访问、CMD53队列），
+ * 总线上的命令与数据收发由以下接口完成：
+ * 88w8801_sdio_hw.c - STM32 SDIO/DMA，数据传输在SDIO中断中完成
+ * 88w8801_sdio_sim.c - 主机仿真用虚拟SDIO卡（WLAN_SIMULATION），数据传输在模拟中断点完成
+ */
+#ifndef _88W8801_SDIO_HW_
+#define _88W8801_SDIO_HW_
+#include "88w8801_sdio.h"
+
+uint8_t sdio_hw_init(GPIO_TypeDef *PDN_GPIO_Port, uint32_t PDN_Pin, bool reset);
+void sdio_hw_set_bus_width(bus_width_e bus_width);
+bool sdio_hw_send_cmd(uint8_t cmd_index, uint32_t argument, bool check_err, uint32_t *resp);
+bool sdio_hw_transfer_start(bool write, uint32_t argument, uint8_t *data_buf, uint16_t block_size, uint32_t data_len);
+void sdio_hw_lock(void);
+void sdio_hw_unlock(void);
+void sdio_hw_idle(void);
+bool sdio_hw_get_card_int(void);
+
+/* 由传输层在数据传输结束（中断上下文）时调用，实现位于88w8801_sdio.c */
+void sdio_transfer_complete(bool ok);
+#endif
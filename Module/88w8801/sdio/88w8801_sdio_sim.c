@@ -0,0 +1,678 @@
+#include "88w8801/88w8801.h"
+#ifdef WLAN_SIMULATION
+#include <string.h>
+#include "88w8801_sdio_hw.h"
+#include "88w8801/core/88w8801_core.h"
+
+#ifdef WLAN_SDIO_DEBUG
+#include <stdio.h>
+#define SDIO_DEBUG printf
+#else
+#define SDIO_DEBUG(...) \
+    do { \
+    } while (0)
+#endif
+
+/* 虚拟卡的Func总数（含Func0） */
+#define SIM_FUNC_NUM 2
+/* 虚拟卡RCA */
+#define SIM_RCA 0x1
+/* Func0/Func1的CIS地址（公共CIS区域0x1000-0x17FFF） */
+#define SIM_CIS0_ADDR 0x1000
+#define SIM_CIS1_ADDR 0x1100
+/* Func1数据端口基地址，通过IO_PORT_*寄存器告知主机 */
+#define SIM_CTRL_PORT 0x10000
+/* 固件下载时每条记录头部长度 */
+#define SIM_FW_HDR_SIZE 16
+/* 固件下载结束命令 */
+#define SIM_FW_CMD_END 4
+/* 待上传封包队列深度 */
+#define SIM_QUEUE_SIZE 32
+/* 估算总线周期：命令48位+响应48位+间隔8位 */
+#define SIM_CMD_CLOCKS 104
+/* 估算总线周期：每个数据块的起始位、CRC16、结束位及间隔 */
+#define SIM_BLOCK_CLOCKS 20
+
+typedef struct {
+    uint8_t port;
+    uint16_t len;
+    uint8_t buf[RX_BUF_SIZE];
+} sim_packet_t;
+
+typedef struct {
+    uint8_t cccr[0x100];
+    uint8_t fbr[SIM_FUNC_NUM][0x100];
+    uint8_t regs[0x100];
+    uint16_t rd_bitmap;
+    uint16_t wr_bitmap;
+    uint8_t next_port;
+    sim_packet_t port[MAX_PORT];
+    sim_packet_t queue[SIM_QUEUE_SIZE];
+    uint8_t queue_head;
+    uint8_t queue_num;
+    bool fw_ready;
+    bool fw_data;
+    uint8_t tx_buf[MP_TX_AGGR_BUF_SIZE];
+    /* 当前端口写入已收到的长度及读取已完成的长度 */
+    uint32_t tx_len;
+    uint32_t rx_offset;
+    /* 已启动、尚未在模拟中断点完成的CMD53 */
+    bool transfer_active;
+    sdio_transfer_t transfer;
+    /* 模拟中断屏蔽 */
+    bool irq_locked;
+    sdio_sim_stats_t stats;
+} sim_card_t;
+
+static const uint8_t sim_cis0[] = {
+    /* CISTPL_MANFID: Marvell 88W8801 */
+    CISTPL_MANFID, 0x04, 0xDF, 0x02, 0x39, 0x91,
+    /* CISTPL_FUNCID: SDIO */
+    CISTPL_FUNCID, 0x02, 0x0C, 0x00,
+    /* CISTPL_FUNCE: Func0最大分块512字节，50MHz */
+    CISTPL_FUNCE, 0x04, 0x00, 0x00, 0x02, 0x32,
+    /* CISTPL_VERS_1 */
+    CISTPL_VERS_1, 0x19, 0x01, 0x00, 'M', 'a', 'r', 'v', 'e', 'l', 'l', 0x00, '8', '8', 'W', '8', '8', '0', '1', ' ', 'S', 'I', 'M', 0x00, 0x00, 0x00, 0xFF,
+    CISTPL_END, 0x00
+};
+
+static const uint8_t sim_cis1[] = {
+    /* CISTPL_FUNCID: SDIO */
+    CISTPL_FUNCID, 0x02, 0x0C, 0x00,
+    /* CISTPL_FUNCE: Func1最大分块512字节（TPLFE_MAX_BLOCK_SIZE位于偏移0xC） */
+    CISTPL_FUNCE, 0x2A, 0x01, 0x01, 0x11, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x02, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    CISTPL_END, 0x00
+};
+
+static const uint8_t sim_mac_addr[MAC_ADDR_LENGTH] = {0x02, 0x50, 0x43, 0x88, 0x01, 0x01};
+
+static sim_card_t sim_card;
+static sdio_sim_cmd_fn sim_cmd_fn = NULL;
+static sdio_sim_data_fn sim_data_fn = NULL;
+
+static uint8_t sim_func0_read(uint32_t reg_addr);
+static void sim_func0_write(uint32_t reg_addr, uint8_t param);
+static uint8_t sim_func1_read(uint32_t reg_addr);
+static void sim_func1_write(uint32_t reg_addr, uint8_t param);
+static uint16_t sim_get_block_size(uint8_t func_num);
+static void sim_update_regs(void);
+static sim_packet_t *sim_alloc_packet(uint8_t pack_type, uint16_t data_len);
+static void sim_flush_queue(void);
+static void sim_download_fw(uint8_t *data_buf);
+static void sim_process_host_packet(uint8_t *data_buf, uint32_t data_len);
+static void sim_process_cmd(uint8_t *cmd_buf, uint16_t cmd_len);
+static bool sim_transfer(bool write, uint32_t argument, uint8_t *data_buf, uint16_t block_size, uint32_t data_len);
+
+/**
+ * @param PDN_GPIO_Port 无意义
+ * @param PDN_Pin 无意义
+ * @param reset 是否重置虚拟卡
+ * @return sdio_err_e中某一状态码
+ * @brief 重置虚拟卡，回调函数保持不变（不重置时固件已运行的虚拟卡只结束未完成的传输）
+ */
+uint8_t sdio_hw_init(GPIO_TypeDef *PDN_GPIO_Port, uint32_t PDN_Pin, bool reset) {
+    UNUSED(PDN_GPIO_Port);
+    UNUSED(PDN_Pin);
+    if (!reset && sim_card.fw_ready) {
+        sim_card.transfer_active = sim_card.irq_locked = false;
+        sim_card.tx_len = sim_card.rx_offset = 0;
+        return SDIO_ERR_OK;
+    }
+    memset(&sim_card, 0, sizeof(sim_card_t));
+    /* SDIO 2.00，CCCR 2.00 */
+    *(sim_card.cccr + SDIO_CCCR_SDIO_VERSION) = 0x32;
+    *(sim_card.cccr + SDIO_CCCR_CIS_POINTER) = (uint8_t)SIM_CIS0_ADDR;
+    *(sim_card.cccr + SDIO_CCCR_CIS_POINTER + 1) = (uint8_t)(SIM_CIS0_ADDR >> 8);
+    *(*(sim_card.fbr + SDIO_FUNC_1) + SDIO_CCCR_CIS_POINTER) = (uint8_t)SIM_CIS1_ADDR;
+    *(*(sim_card.fbr + SDIO_FUNC_1) + SDIO_CCCR_CIS_POINTER + 1) = (uint8_t)(SIM_CIS1_ADDR >> 8);
+    /* 固件下载前Func1寄存器 */
+    *(sim_card.regs + CARD_TO_HOST_EVENT_REG) = CARD_IO_READY | DN_LD_CARD_RDY;
+    *(sim_card.regs + READ_BASE_0_REG) = SIM_FW_HDR_SIZE;
+    *(sim_card.regs + IO_PORT_0_REG) = (uint8_t)SIM_CTRL_PORT;
+    *(sim_card.regs + IO_PORT_1_REG) = (uint8_t)(SIM_CTRL_PORT >> 8);
+    *(sim_card.regs + IO_PORT_2_REG) = (uint8_t)(SIM_CTRL_PORT >> 16);
+    /* 所有写入端口空闲，Port 0用于命令 */
+    sim_card.wr_bitmap = 0xFFFF;
+    sim_card.next_port = 1;
+    sim_update_regs();
+    return SDIO_ERR_OK;
+}
+
+/**
+ * @param bus_width 数据宽度
+ * @brief 总线宽度以卡端CCCR为准，用于估算总线周期
+ */
+void sdio_hw_set_bus_width(bus_width_e bus_width) { UNUSED(bus_width); }
+
+/**
+ * @param cmd_index CMD编号
+ * @param argument CMD参数
+ * @param check_err 无意义，虚拟卡不产生CRC错误
+ * @param resp 响应
+ * @return 是否成功，非法命令视为超时
+ * @brief 解析并执行短响应命令
+ */
+bool sdio_hw_send_cmd(uint8_t cmd_index, uint32_t argument, bool check_err, uint32_t *resp) {
+    UNUSED(check_err);
+    uint32_t cmd_resp = 0;
+    sim_card.stats.bus_clocks += SIM_CMD_CLOCKS;
+    switch (cmd_index) {
+    /* R4：C=1，Func数，OCR 3.2-3.4V */
+    case SDIO_CMD5: cmd_resp = 1U << 31 | (SIM_FUNC_NUM & 0x7) << 28 | 0x300000; break;
+    /* R6：RCA */
+    case SDIO_CMD3: cmd_resp = SIM_RCA << 16; break;
+    case SDIO_CMD7:
+        if (argument >> 16 != SIM_RCA) return false;
+        break;
+    case SDIO_CMD52: {
+        ++sim_card.stats.cmd52_count;
+        bool write = argument >> 31;
+        uint8_t func_num = argument >> 28 & 0x7;
+        uint32_t reg_addr = argument >> 9 & 0x1FFFF;
+        if (func_num >= SIM_FUNC_NUM || (func_num && !(*(sim_card.cccr + SDIO_CCCR_IO_READY) & 1 << func_num))) return false;
+        if (write) func_num ? sim_func1_write(reg_addr, (uint8_t)argument) : sim_func0_write(reg_addr, (uint8_t)argument);
+        /* R5：[15:8]状态，[7:0]数据，未设置RAW时写操作返回写入值 */
+        cmd_resp = 0x1000 | (write && !(argument >> 27 & 0x1) ? (uint8_t)argument : func_num ? sim_func1_read(reg_addr) : sim_func0_read(reg_addr));
+        break;
+    }
+    default: return false;
+    }
+    if (resp) *resp = cmd_resp;
+    return true;
+}
+
+/**
+ * @param write 读/写操作
+ * @param argument CMD53参数
+ * @param data_buf 数据缓冲区
+ * @param block_size 分块大小
+ * @param data_len 传输长度
+ * @return 是否成功启动
+ * @brief 记录CMD53，数据在下一模拟中断点才复制，以检查主机在传输结束前是否改动缓冲区
+ */
+bool sdio_hw_transfer_start(bool write, uint32_t argument, uint8_t *data_buf, uint16_t block_size, uint32_t data_len) {
+    if (sim_card.transfer_active) return false;
+    sim_card.transfer.write = write;
+    sim_card.transfer.argument = argument;
+    sim_card.transfer.data_buf = data_buf;
+    sim_card.transfer.block_size = block_size;
+    sim_card.transfer.data_len = data_len;
+    sim_card.transfer_active = true;
+    return true;
+}
+
+/**
+ * @brief 屏蔽模拟中断
+ */
+void sdio_hw_lock(void) { sim_card.irq_locked = true; }
+
+/**
+ * @brief 恢复模拟中断
+ */
+void sdio_hw_unlock(void) { sim_card.irq_locked = false; }
+
+/**
+ * @brief 等待传输结束时循环调用，作为模拟中断点
+ */
+void sdio_hw_idle(void) { sdio_sim_irq(); }
+
+/**
+ * @return 是否产生卡中断
+ * @brief 中断为电平触发，Func1中断状态与屏蔽寄存器相与且CCCR中断开启时有效
+ */
+bool sdio_hw_get_card_int(void) {
+    sdio_sim_irq();
+    bool card_int = *(sim_card.regs + HOST_INT_STATUS_REG) & *(sim_card.regs + HOST_INT_MASK_REG) && (*(sim_card.cccr + SDIO_CCCR_INT_ENABLE) & (1 | 1 << SDIO_FUNC_1)) == (1 | 1 << SDIO_FUNC_1);
+    if (card_int) ++sim_card.stats.int_count;
+    return card_int;
+}
+
+/**
+ * @brief 模拟中断点：完成已启动的CMD53并通知协议层，可由主循环调用
+ */
+void sdio_sim_irq(void) {
+    if (!sim_card.transfer_active || sim_card.irq_locked) return;
+    sim_card.transfer_active = false;
+    ++sim_card.stats.transfer_int_count;
+    sdio_transfer_complete(sim_transfer(sim_card.transfer.write, sim_card.transfer.argument, sim_card.transfer.data_buf, sim_card.transfer.block_size, sim_card.transfer.data_len));
+}
+
+/**
+ * @param cmd_fn 命令处理函数
+ * @param data_fn 数据处理函数
+ * @brief 设置脚本回调，用于模拟AP/STA等对端
+ */
+void sdio_sim_set_handler(sdio_sim_cmd_fn cmd_fn, sdio_sim_data_fn data_fn) {
+    sim_cmd_fn = cmd_fn;
+    sim_data_fn = data_fn;
+}
+
+/**
+ * @param pack_type 封包类型
+ * @param data_buf 封包内容（不含SDIO头）
+ * @param data_len 内容长度
+ * @return 是否成功
+ * @brief 将封包放入上传队列，命令响应使用Port 0，其余依次使用Port 1-15
+ */
+bool sdio_sim_upload(uint8_t pack_type, uint8_t *data_buf, uint16_t data_len) {
+    sim_packet_t *packet = sim_alloc_packet(pack_type, data_len);
+    if (!packet) return false;
+    memcpy(packet->buf + SDIO_HDR_SIZE, data_buf, data_len);
+    sim_flush_queue();
+    return true;
+}
+
+/**
+ * @param cmd_buf 主机命令封包
+ * @param rsp_buf 响应参数
+ * @param rsp_len 参数长度
+ * @return 是否成功
+ * @brief 以主机命令的头部组合响应并上传
+ */
+bool sdio_sim_upload_cmdrsp(uint8_t *cmd_buf, uint8_t *rsp_buf, uint16_t rsp_len) {
+    sim_packet_t *packet = sim_alloc_packet(TYPE_CMD_CMDRSP, CMD_HDR_SIZE - SDIO_HDR_SIZE + rsp_len);
+    if (!packet) return false;
+    HOST_DS_COMMAND *rsp = (HOST_DS_COMMAND *)packet->buf;
+    rsp->command = ((HOST_DS_COMMAND *)cmd_buf)->command | HOST_RET_BIT;
+    rsp->size = CMD_HDR_SIZE - SDIO_HDR_SIZE + rsp_len;
+    rsp->seq_num = ((HOST_DS_COMMAND *)cmd_buf)->seq_num;
+    rsp->bss = ((HOST_DS_COMMAND *)cmd_buf)->bss;
+    rsp->result = HOST_RESULT_OK;
+    if (rsp_len) memcpy(packet->buf + CMD_HDR_SIZE, rsp_buf, rsp_len);
+    ++sim_card.stats.card_cmdrsp_count;
+    sim_flush_queue();
+    return true;
+}
+
+/**
+ * @param event_id 事件ID
+ * @param bss_type BSS网络类型
+ * @param data_buf 事件内容
+ * @param data_len 内容长度
+ * @return 是否成功
+ * @brief 组合事件并上传
+ */
+bool sdio_sim_upload_event(uint16_t event_id, uint8_t bss_type, uint8_t *data_buf, uint16_t data_len) {
+    sim_packet_t *packet = sim_alloc_packet(TYPE_EVENT, EVENT_HDR_SIZE - SDIO_HDR_SIZE + data_len);
+    if (!packet) return false;
+    /* 事件ID、BSS序号及BSS类型 */
+    *(uint32_t *)(packet->buf + SDIO_HDR_SIZE) = event_id | (uint32_t)bss_type << 24;
+    if (data_len) memcpy(packet->buf + EVENT_HDR_SIZE, data_buf, data_len);
+    ++sim_card.stats.card_event_count;
+    sim_flush_queue();
+    return true;
+}
+
+/**
+ * @param data_buf 以太网帧
+ * @param data_len 帧长度
+ * @param bss_type BSS网络类型
+ * @return 是否成功
+ * @brief 组合RxPD并上传
+ */
+bool sdio_sim_upload_data(uint8_t *data_buf, uint16_t data_len, uint8_t bss_type) { return sdio_sim_upload_data_ex(data_buf, data_len, bss_type, 0, 0, 0); }
+
+/**
+ * @param data_buf 以太网帧
+ * @param data_len 帧长度
+ * @param bss_type BSS网络类型
+ * @param pkt_type 封包类型（0为以太网帧，PKT_TYPE_AMSDU、PKT_TYPE_BAR等）
+ * @param priority 优先级（TID）
+ * @param seq_num 序列号
+ * @return 是否成功
+ * @brief 组合RxPD并上传，可指定A-MPDU重排序使用的字段
+ */
+bool sdio_sim_upload_data_ex(uint8_t *data_buf, uint16_t data_len, uint8_t bss_type, uint16_t pkt_type, uint8_t priority, uint16_t seq_num) {
+    sim_packet_t *packet = sim_alloc_packet(TYPE_DATA, sizeof(RxPD) - SDIO_HDR_SIZE + data_len);
+    if (!packet) return false;
+    RxPD *rx_packet = (RxPD *)packet->buf;
+    rx_packet->bss_type = bss_type;
+    rx_packet->rx_pkt_length = data_len;
+    rx_packet->rx_pkt_offset = sizeof(RxPD) - SDIO_HDR_SIZE;
+    rx_packet->rx_pkt_type = pkt_type;
+    rx_packet->seq_num = seq_num;
+    rx_packet->priority = priority;
+    memcpy(rx_packet->payload, data_buf, data_len);
+    ++sim_card.stats.card_data_count;
+    sim_flush_queue();
+    return true;
+}
+
+/**
+ * @param stats 统计数据
+ * @brief 获取总线统计数据
+ */
+void sdio_sim_get_stats(sdio_sim_stats_t *stats) {
+    if (stats) *stats = sim_card.stats;
+}
+
+/**
+ * @brief 清零总线统计数据
+ */
+void sdio_sim_reset_stats(void) { memset(&sim_card.stats, 0, sizeof(sdio_sim_stats_t)); }
+
+/**
+ * @param write 读/写操作
+ * @param argument CMD53参数
+ * @param data_buf 数据缓冲区
+ * @param block_size 分块大小
+ * @param data_len 传输长度
+ * @return 是否成功
+ * @brief 解析CMD53并在主机缓冲区与虚拟卡之间复制数据，在模拟中断点执行
+ */
+static bool sim_transfer(bool write, uint32_t argument, uint8_t *data_buf, uint16_t block_size, uint32_t data_len) {
+    uint8_t func_num = argument >> 28 & 0x7;
+    bool inc_addr = argument >> 26 & 0x1;
+    uint32_t reg_addr = argument >> 9 & 0x1FFFF;
+    sim_card.stats.bus_clocks += SIM_CMD_CLOCKS;
+    bool block_mode = argument >> 27 & 0x1;
+    uint16_t count = argument & 0x1FF;
+    if (func_num >= SIM_FUNC_NUM || !block_size || (func_num && !(*(sim_card.cccr + SDIO_CCCR_IO_READY) & 1 << func_num))) return false;
+    /* 块模式下分块大小需与FBR一致，字节模式下主机以单个分块传输count字节（0表示512） */
+    if (block_mode ? block_size != sim_get_block_size(func_num) || data_len != (uint32_t)count * block_size : block_size != data_len || data_len != (count ? count : 512)) return false;
+    /* 按CCCR中的总线宽度估算周期 */
+    uint8_t clock_shift = (*(sim_card.cccr + SDIO_CCCR_BUS_CONTROL) & 0x3) == SDIO_BUS_WIDTH_4 ? 1 : (*(sim_card.cccr + SDIO_CCCR_BUS_CONTROL) & 0x3) == SDIO_BUS_WIDTH_8 ? 0 : 3;
+    ++sim_card.stats.cmd53_count;
+    sim_card.stats.block_count += data_len / block_size;
+    sim_card.stats.byte_count += data_len;
+    sim_card.stats.bus_clocks += (uint64_t)data_len / block_size * ((block_size << clock_shift) + SIM_BLOCK_CLOCKS);
+    if (!func_num) {
+        for (uint32_t index = 0; index < data_len; ++index) {
+            if (write) sim_func0_write(reg_addr, *(data_buf + index));
+            else *(data_buf + index) = sim_func0_read(reg_addr);
+            if (inc_addr) ++reg_addr;
+        }
+        return true;
+    }
+    /* 寄存器区域，即使使用固定地址（REG_PORT）也按地址递增返回整个寄存器表 */
+    if (reg_addr < SIM_CTRL_PORT) {
+        for (uint32_t index = 0; index < data_len; ++index, ++reg_addr) {
+            if (write) sim_func1_write(reg_addr, *(data_buf + index));
+            else *(data_buf + index) = sim_func1_read(reg_addr);
+        }
+        return true;
+    }
+    uint8_t port = (reg_addr - SIM_CTRL_PORT) & (MAX_PORT - 1);
+    /**
+     * 多端口读写：地址bit[11:4]为相对起始端口的位图，bit[3:0]为起始端口
+     * 各端口数据按分块对齐依次存放，字节模式尾部可能由下一次CMD53传输
+     */
+    uint8_t port_bitmap = (reg_addr - SIM_CTRL_PORT) & MPA_ADDR_BASE ? (reg_addr - SIM_CTRL_PORT) >> 4 & 0xFF : 1;
+    uint16_t func_block_size = sim_get_block_size(func_num);
+    uint32_t offset = 0, end = 0;
+    uint8_t index;
+    if (write) {
+        if (sim_card.tx_len + data_len > sizeof(sim_card.tx_buf)) return sim_card.tx_len = 0, false;
+        memcpy(sim_card.tx_buf + sim_card.tx_len, data_buf, data_len);
+        sim_card.tx_len += data_len;
+        if (!sim_card.fw_ready) {
+            sim_card.stats.fw_byte_count += data_len;
+            sim_download_fw(sim_card.tx_buf);
+            sim_card.tx_len = 0;
+        } else {
+            /* 等待全部封包写入 */
+            for (index = 0; index < 8; ++index) {
+                if (!(port_bitmap & 1 << index)) continue;
+                if (offset + SDIO_HDR_SIZE > sim_card.tx_len || (end = offset + *(uint16_t *)(sim_card.tx_buf + offset)) > sim_card.tx_len) return true;
+                offset += (end - offset + func_block_size - 1) / func_block_size * func_block_size;
+            }
+            for (index = 0, offset = 0; index < 8; ++index, port = (port + 1) & (MAX_PORT - 1)) {
+                if (!(port_bitmap & 1 << index)) continue;
+                uint16_t pack_len = *(uint16_t *)(sim_card.tx_buf + offset);
+                if (!(sim_card.wr_bitmap & 1 << port)) return sim_card.tx_len = 0, false;
+                /* 卡端立即处理，端口重新空闲 */
+                sim_card.wr_bitmap &= ~(1 << port);
+                sim_process_host_packet(sim_card.tx_buf + offset, sim_card.tx_len - offset);
+                sim_card.wr_bitmap |= 1 << port;
+                offset += (pack_len + func_block_size - 1) / func_block_size * func_block_size;
+            }
+            sim_card.tx_len = 0;
+            /* 置位下载中断状态 */
+            *(sim_card.regs + HOST_INT_STATUS_REG) |= DN_LD_HOST_INT_STATUS;
+        }
+    } else {
+        /* 复制本次CMD53覆盖的部分 */
+        for (index = 0; index < 8; ++index) {
+            if (!(port_bitmap & 1 << index)) continue;
+            sim_packet_t *packet = sim_card.port + ((port + index) & (MAX_PORT - 1));
+            if (!(sim_card.rd_bitmap & 1 << ((port + index) & (MAX_PORT - 1)))) return sim_card.rx_offset = 0, false;
+            uint32_t from = offset > sim_card.rx_offset ? offset : sim_card.rx_offset;
+            uint32_t to = offset + packet->len < sim_card.rx_offset + data_len ? offset + packet->len : sim_card.rx_offset + data_len;
+            if (from < to) memcpy(data_buf + from - sim_card.rx_offset, packet->buf + from - offset, to - from);
+            end = offset + packet->len;
+            offset += (packet->len + func_block_size - 1) / func_block_size * func_block_size;
+        }
+        /* 读取到最后一个封包末尾后释放端口 */
+        if ((sim_card.rx_offset += data_len) < end) return true;
+        for (index = 0; index < 8; ++index) {
+            if (!(port_bitmap & 1 << index)) continue;
+            sim_card.rd_bitmap &= ~(1 << ((port + index) & (MAX_PORT - 1)));
+            (sim_card.port + ((port + index) & (MAX_PORT - 1)))->len = 0;
+        }
+        sim_card.rx_offset = 0;
+        sim_flush_queue();
+    }
+    sim_update_regs();
+    return true;
+}
+
+/**
+ * @param reg_addr 寄存器地址
+ * @return 寄存器值
+ * @brief 读取Func0地址空间（CCCR、FBR、CIS）
+ */
+static uint8_t sim_func0_read(uint32_t reg_addr) {
+    if (reg_addr < SDIO_FBR_BASE(SDIO_FUNC_1)) return *(sim_card.cccr + reg_addr);
+    if (reg_addr < SDIO_FBR_BASE(SIM_FUNC_NUM)) return *(*(sim_card.fbr + reg_addr / SDIO_FBR_BASE(1)) + (reg_addr & 0xFF));
+    if (reg_addr >= SIM_CIS0_ADDR && reg_addr < SIM_CIS0_ADDR + sizeof(sim_cis0)) return *(sim_cis0 + reg_addr - SIM_CIS0_ADDR);
+    if (reg_addr >= SIM_CIS1_ADDR && reg_addr < SIM_CIS1_ADDR + sizeof(sim_cis1)) return *(sim_cis1 + reg_addr - SIM_CIS1_ADDR);
+    return 0;
+}
+
+/**
+ * @param reg_addr 寄存器地址
+ * @param param 写入值
+ * @brief 写入Func0地址空间，只有可写寄存器生效
+ */
+static void sim_func0_write(uint32_t reg_addr, uint8_t param) {
+    switch (reg_addr) {
+    case SDIO_CCCR_IO_ENABLE:
+        /* Func立即准备好 */
+        *(sim_card.cccr + SDIO_CCCR_IO_ENABLE) = *(sim_card.cccr + SDIO_CCCR_IO_READY) = param & ((1 << SIM_FUNC_NUM) - 2);
+        break;
+    case SDIO_CCCR_INT_ENABLE: *(sim_card.cccr + SDIO_CCCR_INT_ENABLE) = param & ((1 << SIM_FUNC_NUM) - 1); break;
+    case SDIO_CCCR_IO_ABORT:
+        /* I/O复位：Func关闭，中断、总线宽度及分块大小恢复默认值，固件不受影响 */
+        if (param & SDIO_IO_RESET) {
+            *(sim_card.cccr + SDIO_CCCR_IO_ENABLE) = *(sim_card.cccr + SDIO_CCCR_IO_READY) = *(sim_card.cccr + SDIO_CCCR_INT_ENABLE) = *(sim_card.cccr + SDIO_CCCR_BUS_CONTROL) = 0;
+            *(sim_card.cccr + SDIO_CCCR_BLOCK_SIZE) = *(sim_card.cccr + SDIO_CCCR_BLOCK_SIZE + 1) = 0;
+            *(*(sim_card.fbr + SDIO_FUNC_1) + SDIO_CCCR_BLOCK_SIZE) = *(*(sim_card.fbr + SDIO_FUNC_1) + SDIO_CCCR_BLOCK_SIZE + 1) = 0;
+        }
+        break;
+    case SDIO_CCCR_BUS_CONTROL: *(sim_card.cccr + SDIO_CCCR_BUS_CONTROL) = param; break;
+    case SDIO_CCCR_BLOCK_SIZE:
+    case SDIO_CCCR_BLOCK_SIZE + 1: *(sim_card.cccr + reg_addr) = param; break;
+    case SDIO_FBR_BASE(SDIO_FUNC_1) + SDIO_CCCR_BLOCK_SIZE:
+    case SDIO_FBR_BASE(SDIO_FUNC_1) + SDIO_CCCR_BLOCK_SIZE + 1: *(*(sim_card.fbr + SDIO_FUNC_1) + (reg_addr & 0xFF)) = param; break;
+    default: SDIO_DEBUG("SIM: Write to read-only Func0 register 0x%lX\n", (unsigned long)reg_addr); break;
+    }
+}
+
+/**
+ * @param reg_addr 寄存器地址
+ * @return 寄存器值
+ * @brief 读取Func1寄存器
+ */
+static uint8_t sim_func1_read(uint32_t reg_addr) { return reg_addr < sizeof(sim_card.regs) ? *(sim_card.regs + reg_addr) : 0; }
+
+/**
+ * @param reg_addr 寄存器地址
+ * @param param 写入值
+ * @brief 写入Func1寄存器，HOST_INT_STATUS_REG写0清除对应位
+ */
+static void sim_func1_write(uint32_t reg_addr, uint8_t param) {
+    switch (reg_addr) {
+    case HOST_INT_MASK_REG: *(sim_card.regs + HOST_INT_MASK_REG) = param; break;
+    case HOST_INT_STATUS_REG: *(sim_card.regs + HOST_INT_STATUS_REG) &= param; break;
+    default: SDIO_DEBUG("SIM: Write to read-only Func1 register 0x%lX\n", (unsigned long)reg_addr); break;
+    }
+}
+
+/**
+ * @param func_num Func编号
+ * @return 卡端记录的分块大小
+ */
+static uint16_t sim_get_block_size(uint8_t func_num) {
+    uint8_t *block_size = func_num ? *(sim_card.fbr + func_num) + SDIO_CCCR_BLOCK_SIZE : sim_card.cccr + SDIO_CCCR_BLOCK_SIZE;
+    return *(block_size + 1) << 8 | *block_size;
+}
+
+/**
+ * @brief 将位图与端口长度写入寄存器表
+ */
+static void sim_update_regs(void) {
+    *(sim_card.regs + RD_BITMAP_L) = (uint8_t)sim_card.rd_bitmap;
+    *(sim_card.regs + RD_BITMAP_U) = (uint8_t)(sim_card.rd_bitmap >> 8);
+    *(sim_card.regs + WR_BITMAP_L) = (uint8_t)sim_card.wr_bitmap;
+    *(sim_card.regs + WR_BITMAP_U) = (uint8_t)(sim_card.wr_bitmap >> 8);
+    for (uint8_t index = 0; index < MAX_PORT; ++index) {
+        *(sim_card.regs + RD_LEN_P0_L + (index << 1)) = (uint8_t)(sim_card.port + index)->len;
+        *(sim_card.regs + RD_LEN_P0_U + (index << 1)) = (uint8_t)((sim_card.port + index)->len >> 8);
+    }
+}
+
+/**
+ * @param pack_type 封包类型
+ * @param data_len 内容长度（不含SDIO头）
+ * @return 队列节点，队列已满或封包过长时返回NULL
+ * @brief 在上传队列尾部分配节点并填写SDIO头
+ */
+static sim_packet_t *sim_alloc_packet(uint8_t pack_type, uint16_t data_len) {
+    if (sim_card.queue_num == SIM_QUEUE_SIZE || SDIO_HDR_SIZE + data_len > RX_BUF_SIZE) {
+        SDIO_DEBUG("SIM: Upload dropped, type %d, size %d\n", pack_type, data_len);
+        return NULL;
+    }
+    sim_packet_t *packet = sim_card.queue + (sim_card.queue_head + sim_card.queue_num++) % SIM_QUEUE_SIZE;
+    memset(packet->buf, 0, SDIO_HDR_SIZE + data_len);
+    *(uint16_t *)packet->buf = packet->len = SDIO_HDR_SIZE + data_len;
+    *(uint16_t *)(packet->buf + 2) = pack_type;
+    packet->port = pack_type == TYPE_CMD_CMDRSP ? CTRL_PORT : MAX_PORT;
+    return packet;
+}
+
+/**
+ * @brief 按顺序将队列中的封包放入空闲读取端口并置位上传中断状态
+ */
+static void sim_flush_queue(void) {
+    sim_packet_t *packet;
+    while (sim_card.queue_num) {
+        packet = sim_card.queue + sim_card.queue_head;
+        /* 数据与事件依次使用Port 1-15，与主机的读取顺序一致 */
+        uint8_t port = packet->port == CTRL_PORT ? CTRL_PORT : sim_card.next_port;
+        if (sim_card.rd_bitmap & 1 << port) break;
+        memcpy((sim_card.port + port)->buf, packet->buf, packet->len);
+        (sim_card.port + port)->len = packet->len;
+        sim_card.rd_bitmap |= 1 << port;
+        if (port != CTRL_PORT && ++sim_card.next_port == MAX_PORT) sim_card.next_port = 1;
+        sim_card.queue_head = (sim_card.queue_head + 1) % SIM_QUEUE_SIZE;
+        --sim_card.queue_num;
+        *(sim_card.regs + HOST_INT_STATUS_REG) |= UP_LD_HOST_INT_STATUS;
+    }
+    sim_update_regs();
+}
+
+/**
+ * @param data_buf 主机写入的固件块
+ * @brief 固件由16字节头部{命令, 地址, 长度, CRC}与数据交替组成，卡端通过READ_BASE_*寄存器请求下一块长度
+ */
+static void sim_download_fw(uint8_t *data_buf) {
+    uint16_t next_len = SIM_FW_HDR_SIZE;
+    if (sim_card.fw_data) sim_card.fw_data = false;
+    else if (*(uint32_t *)data_buf == SIM_FW_CMD_END) {
+        /* 固件下载完成 */
+        next_len = 0;
+        sim_card.fw_ready = true;
+        *(sim_card.regs + CARD_FW_STATUS0_REG) = (uint8_t)FIRMWARE_READY;
+        *(sim_card.regs + CARD_FW_STATUS1_REG) = (uint8_t)(FIRMWARE_READY >> 8);
+        SDIO_DEBUG("SIM: Firmware ready, %lu bytes\n", (unsigned long)sim_card.stats.byte_count);
+    } else {
+        next_len = *(uint32_t *)(data_buf + 8);
+        /* 长度非法时请求奇数长度，主机按CRC错误处理 */
+        if (!next_len || next_len > TX_BUF_SIZE) next_len = 1;
+        else sim_card.fw_data = true;
+    }
+    *(sim_card.regs + READ_BASE_0_REG) = (uint8_t)next_len;
+    *(sim_card.regs + READ_BASE_1_REG) = (uint8_t)(next_len >> 8);
+}
+
+/**
+ * @param data_buf 主机封包
+ * @param data_len 传输长度（按块对齐）
+ * @brief 固件运行后处理主机发来的命令与数据
+ */
+static void sim_process_host_packet(uint8_t *data_buf, uint32_t data_len) {
+    uint16_t pack_len = *(uint16_t *)data_buf;
+    if (pack_len < SDIO_HDR_SIZE || pack_len > data_len) {
+        SDIO_DEBUG("SIM: Invalid host packet size %d\n", pack_len);
+        return;
+    }
+    switch (*(uint16_t *)(data_buf + 2)) {
+    case TYPE_CMD_CMDRSP:
+        ++sim_card.stats.host_cmd_count;
+        if (!sim_cmd_fn || !sim_cmd_fn(data_buf, pack_len)) sim_process_cmd(data_buf, pack_len);
+        break;
+    case TYPE_DATA: {
+        ++sim_card.stats.host_data_count;
+        TxPD *tx_packet = (TxPD *)data_buf;
+        if (sim_data_fn) sim_data_fn(data_buf + SDIO_HDR_SIZE + tx_packet->tx_pkt_offset, tx_packet->tx_pkt_length, tx_packet->bss_type);
+        break;
+    }
+    default: SDIO_DEBUG("SIM: Invalid host packet type %d\n", *(uint16_t *)(data_buf + 2)); break;
+    }
+}
+
+/**
+ * @param cmd_buf 命令封包
+ * @param cmd_len 封包长度
+ * @brief 内置固件模型，未知命令原样返回参数
+ */
+static void sim_process_cmd(uint8_t *cmd_buf, uint16_t cmd_len) {
+    HOST_DS_COMMAND *cmd = (HOST_DS_COMMAND *)cmd_buf;
+    uint8_t *params = cmd_buf + CMD_HDR_SIZE;
+    uint16_t params_len = cmd_len > CMD_HDR_SIZE ? cmd_len - CMD_HDR_SIZE : 0;
+    switch (cmd->command) {
+    case HOST_ID_GET_HW_SPEC: {
+        HOST_DS_GET_HW_SPEC hw_spec = {0};
+        memcpy(hw_spec.permanent_addr, sim_mac_addr, MAC_ADDR_LENGTH);
+        hw_spec.fw_release_number = 0x0E1C0000;
+        hw_spec.mp_end_port = MAX_PORT;
+        sdio_sim_upload_cmdrsp(cmd_buf, (uint8_t *)&hw_spec, sizeof(HOST_DS_GET_HW_SPEC));
+        break;
+    }
+    case HOST_ID_802_11_MAC_ADDR: {
+        HOST_DS_802_11_MAC_ADDR mac_addr = {0};
+        mac_addr.action = cmd->params.mac_addr.action;
+        memcpy(mac_addr.mac_addr, sim_mac_addr, MAC_ADDR_LENGTH);
+        sdio_sim_upload_cmdrsp(cmd_buf, (uint8_t *)&mac_addr, sizeof(HOST_DS_802_11_MAC_ADDR));
+        break;
+    }
+    case HOST_ID_802_11_SCAN: {
+        /* 无脚本时搜索不到AP */
+        uint8_t scan_rsp[3] = {0};
+        sdio_sim_upload_cmdrsp(cmd_buf, scan_rsp, sizeof(scan_rsp));
+        break;
+    }
+    case HOST_ID_802_11_ASSOCIATE: {
+        uint8_t assoc_rsp[sizeof(IEEEtypes_AssocRsp_t) - 1] = {0x01, 0x04};
+        sdio_sim_upload_cmdrsp(cmd_buf, assoc_rsp, sizeof(assoc_rsp));
+        sdio_sim_upload_event(EVENT_PORT_RELEASE, BSS_TYPE_STA, NULL, 0);
+        break;
+    }
+    case HOST_ID_APCMD_BSS_START:
+        sdio_sim_upload_cmdrsp(cmd_buf, NULL, 0);
+        sdio_sim_upload_event(EVENT_MICRO_AP_BSS_START, BSS_TYPE_UAP, NULL, 0);
+        break;
+    default: sdio_sim_upload_cmdrsp(cmd_buf, params, params_len); break;
+    }
+}
+#endif
@@ -0,0 +1,60 @@
+/**
+ * 主机仿真用虚拟SDIO卡（WLAN_SIMULATION）
+ * 模拟88W8801的CCCR/FBR/CIS、Func1寄存器（HOST_INT_STATUS_REG、RD_BITMAP_*、WR_BITMAP_*、RD_LEN_P0_*、IO_PORT_*）
+ * 以及固件下载握手，命令与数据由内置固件模型或外部脚本处理
+ * CMD53在启动后不立即完成，而在模拟中断点（sdio_hw_idle、sdio_hw_get_card_int、sdio_sim_irq）完成
+ */
+#ifndef _88W8801_SDIO_SIM_
+#define _88W8801_SDIO_SIM_
+#include <stdint.h>
+#include <stdbool.h>
+
+/* 仿真环境下PDN引脚无意义 */
+typedef void GPIO_TypeDef;
+
+typedef struct {
+    /* 命令数 */
+    uint32_t cmd52_count;
+    uint32_t cmd53_count;
+    /* CMD53传输的分块数与字节数 */
+    uint32_t block_count;
+    uint64_t byte_count;
+    /* 按总线宽度估算的SDIO_CK周期数 */
+    uint64_t bus_clocks;
+    /* 卡中断次数 */
+    uint32_t int_count;
+    /* 数据传输结束中断次数 */
+    uint32_t transfer_int_count;
+    /* 主机下发的命令/数据，卡上传的响应/事件/数据 */
+    uint32_t host_cmd_count;
+    uint32_t host_data_count;
+    uint32_t card_cmdrsp_count;
+    uint32_t card_event_count;
+    uint32_t card_data_count;
+    /* 固件下载写入的字节数 */
+    uint64_t fw_byte_count;
+} sdio_sim_stats_t;
+
+/**
+ * @param cmd_buf 命令封包（含SDIO头）
+ * @param cmd_len 封包长度
+ * @return 已由脚本处理则返回true，否则交由内置固件模型处理
+ */
+typedef bool (*sdio_sim_cmd_fn)(uint8_t *cmd_buf, uint16_t cmd_len);
+/**
+ * @param data_buf 主机发送的以太网帧
+ * @param data_len 帧长度
+ * @param bss_type BSS网络类型
+ */
+typedef void (*sdio_sim_data_fn)(uint8_t *data_buf, uint16_t data_len, uint8_t bss_type);
+
+void sdio_sim_irq(void);
+void sdio_sim_set_handler(sdio_sim_cmd_fn cmd_fn, sdio_sim_data_fn data_fn);
+bool sdio_sim_upload(uint8_t pack_type, uint8_t *data_buf, uint16_t data_len);
+bool sdio_sim_upload_cmdrsp(uint8_t *cmd_buf, uint8_t *rsp_buf, uint16_t rsp_len);
+bool sdio_sim_upload_event(uint16_t event_id, uint8_t bss_type, uint8_t *data_buf, uint16_t data_len);
+bool sdio_sim_upload_data(uint8_t *data_buf, uint16_t data_len, uint8_t bss_type);
+bool sdio_sim_upload_data_ex(uint8_t *data_buf, uint16_t data_len, uint8_t bss_type, uint16_t pkt_type, uint8_t priority, uint16_t seq_num);
+void sdio_sim_get_stats(sdio_sim_stats_t *stats);
+void sdio_sim_reset_stats(void);
+#endif
@@ -1,5 +1,5 @@
 #include "88w8801_wrapper.h"
-#include "88w8801/sdio/88w8801_sdio.h"
+#include "88w8801/sdio/88w8801_sdio_hw.h"
 #include "lwip/timeouts.h"
 #include "systime/systime.h"
 
@@ -15,7 +15,14 @@ uint16_t wrapper_init(core_err_e *status, wlan_cb_t *callback, GPIO_TypeDef *PDN
 
 uint8_t wrapper_proc(void) {
     if (!((sys_now() & CHECK_TIMEOUTS_INTERVAL) != CHECK_TIMEOUTS_INTERVAL || *sys_status)) sys_check_timeouts();
-    return __SDIO_GET_FLAG(SDIO, SDIO_FLAG_SDIOIT) ? (__SDIO_CLEAR_FLAG(SDIO, SDIO_FLAG_SDIOIT), wlan_process_packet()) : CORE_ERR_OK;
+    uint8_t err = sdio_hw_get_card_int() ? wlan_process_packet() : wlan_rx_pending() ? wlan_process_rx() : CORE_ERR_OK;
+#ifdef WLAN_HOST_PMK
+    wlan_poll_pmk();
+#endif
+#ifdef WLAN_11N
+    wlan_poll_tx_ba();
+#endif
+    return err || (err = wlan_poll_cmd()) || (err = wlan_poll_rx_reorder()) ? err : wlan_flush_data(false);
 }
 
 #if LWIP_TCP
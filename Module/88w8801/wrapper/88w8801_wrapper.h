@@ -1,6 +1,6 @@
 #ifndef _88W8801_WRAPPER_
 #define _88W8801_WRAPPER_
-#include <stm32f4xx.h>
+#include "88w8801/sdio/88w8801_sdio.h"
 #include "88w8801/core/88w8801_core.h"
 #include "lwip/opt.h"
 #if LWIP_TCP
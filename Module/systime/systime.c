@@ -1,7 +1,29 @@
 #include "systime.h"
+#ifdef WLAN_SIMULATION
+#include <time.h>
+#else
+#include <stm32f4xx.h>
+#endif
 
 static volatile uint32_t sys_time = 0;
 
 void SysTick_Handler(void) { ++sys_time; }
 
 uint32_t sys_now(void) { return sys_time; }
+
+/**
+ * @return 微秒计时，用于统计耗时（约71分钟溢出）
+ * @brief 由SysTick计数值插值，仿真时使用主机单调时钟
+ */
+uint32_t sys_now_us(void) {
+#ifdef WLAN_SIMULATION
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint32_t)(ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000);
+#else
+    uint32_t ms, val;
+    /* 读取期间发生SysTick中断时重新读取 */
+    do ms = sys_time, val = SysTick->VAL; while (ms != sys_time);
+    return ms * 1000 + (SysTick->LOAD - val) * 1000 / (SysTick->LOAD + 1);
+#endif
+}
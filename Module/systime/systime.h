@@ -2,4 +2,5 @@
 #define _SYSTIME_
 #include <stdint.h>
 uint32_t sys_now(void);
+uint32_t sys_now_us(void);
 #endif
@@ -0,0 +1,77 @@
+#!/usr/bin/env python3
+# Created by Glif.
+"""
+88W8801 固件压缩工具
+
+将原始固件（二进制文件或 88w8801_firmware.c）压缩为驱动使用的格式：
+  头部 8 字节：'F' 'W' 'Z'、窗口位数、原始长度（uint32，小端）
+  其后为 DEFLATE 数据流（RFC 1951，无 zlib/gzip 头部），窗口不超过 1 << 窗口位数 字节
+
+用法：
+  python3 fw_pack.py ../Module/88w8801/core/88w8801_firmware.c ../Module/88w8801/core/88w8801_firmware_z.c
+  python3 fw_pack.py firmware.bin firmware_z.bin
+输出文件扩展名为 .c 时生成 C 数组（WLAN_FW_COMPRESSED），否则生成二进制文件（写入 SPI Flash 或用于 OTA）
+"""
+import os
+import re
+import struct
+import sys
+import zlib
+
+# 与 88w8801_core.h 中的 FW_Z_MAGIC、FW_Z_WINDOW_BITS 一致
+FW_Z_MAGIC = b'FWZ'
+FW_Z_WINDOW_BITS = 12
+
+
+def load_firmware(path):
+    with open(path, 'rb') as f:
+        data = f.read()
+    if not path.endswith('.c'):
+        return data
+    # 只解析 fw_mrvl88w8801 数组
+    text = data.decode('ascii')
+    body = text[text.index('fw_mrvl88w8801'):]
+    body = body[body.index('{') + 1:body.index('}')]
+    return bytes(int(x, 16) for x in re.findall(r'0x([0-9A-Fa-f]{2})\b', body))
+
+
+def pack(data, window_bits=FW_Z_WINDOW_BITS):
+    compressor = zlib.compressobj(9, zlib.DEFLATED, -window_bits, 9)
+    stream = compressor.compress(data) + compressor.flush()
+    image = FW_Z_MAGIC + struct.pack('<BI', window_bits, len(data)) + stream
+    # 校验：解压缩结果与原始固件一致
+    if zlib.decompress(image[8:], -window_bits) != data:
+        raise RuntimeError('verification failed')
+    return image
+
+
+def write_c(path, image, raw_len, source):
+    lines = ['#include <stdint.h>', '#include "88w8801/88w8801.h"', '',
+             '#if defined(WLAN_FW_COMPRESSED) && !defined(USE_FLASH_FIRMWARE)',
+             '// Generated by Utility/fw_pack.py from %s (%d -> %d bytes)' % (os.path.basename(source), raw_len, len(image)),
+             'const uint8_t fw_mrvl88w8801_z[] = {']
+    for index in range(0, len(image), 16):
+        lines.append('    ' + ', '.join('0x%02X' % x for x in image[index:index + 16]) + ',')
+    lines[-1] = lines[-1][:-1] + '};'
+    lines += ['const uint32_t fw_mrvl88w8801_z_size = sizeof(fw_mrvl88w8801_z);', '#endif', '']
+    with open(path, 'w', newline='\n') as f:
+        f.write('\n'.join(lines))
+
+
+def main(argv):
+    if len(argv) != 3:
+        print(__doc__)
+        return 1
+    data = load_firmware(argv[1])
+    image = pack(data)
+    if argv[2].endswith('.c'):
+        write_c(argv[2], image, len(data), argv[1])
+    else:
+        with open(argv[2], 'wb') as f:
+            f.write(image)
+    print('%s: %d -> %d bytes (%.1f%%), last dword 0x%08X' % (argv[2], len(data), len(image), len(image) * 100.0 / len(data), struct.unpack('<I', image[-4:])[0]))
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main(sys.argv))